@@ -25,6 +25,8 @@ set(COMMONLIST
     ${COMMON_DIR}/IPC/CommonSyscalls.h
     ${COMMON_DIR}/IPC/Primitives.cpp
     ${COMMON_DIR}/IPC/Primitives.h
+    ${COMMON_DIR}/IPC/SharedMemoryTransport.cpp
+    ${COMMON_DIR}/IPC/SharedMemoryTransport.h
     ${COMMON_DIR}/KeyIdentification.cpp
     ${COMMON_DIR}/KeyIdentification.h
     ${COMMON_DIR}/CPPStandard.h
@@ -41,9 +43,12 @@ set(COMMONLIST
     ${COMMON_DIR}/String.h
     ${COMMON_DIR}/System.cpp
     ${COMMON_DIR}/System.h
+    ${COMMON_DIR}/ThreadPool.cpp
+    ${COMMON_DIR}/ThreadPool.h
     ${COMMON_DIR}/Type.h
     ${COMMON_DIR}/Util.cpp
     ${COMMON_DIR}/Util.h
+    ${COMMON_DIR}/cm/cm_cache.cpp
     ${COMMON_DIR}/cm/cm_load.cpp
     ${COMMON_DIR}/cm/cm_local.h
     ${COMMON_DIR}/cm/cm_patch.cpp
@@ -223,7 +228,10 @@ endif()
 
 # Tests runnable for any engine variant
 set(ENGINETESTLIST ${COMMONTESTLIST}
+    ${COMMON_DIR}/IPC/SharedMemoryTransportTest.cpp
     ${ENGINE_DIR}/framework/CommandSystemTest.cpp
+    ${ENGINE_DIR}/qcommon/huffman_test.cpp
+    ${ENGINE_DIR}/qcommon/msg_test.cpp
 )
 
 set(QCOMMONLIST
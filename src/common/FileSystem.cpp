@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #if defined(BUILD_ENGINE)
 #include "minizip/unzip.h"
+#include "ThreadPool.h"
 #endif
 
 #if defined(__GLIBC__)
@@ -61,6 +62,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <fcntl.h>
 #include <dirent.h>
 #include <unistd.h>
+#ifndef BUILD_VM
+#include <sys/mman.h>
+#endif
 #endif
 #ifdef __APPLE__
 #include <mach-o/dyld.h>
@@ -134,6 +138,9 @@ namespace FS {
 static Cvar::Cvar<bool> fs_legacypaks("fs_legacypaks", "also load pk3s, ignoring version", Cvar::NONE, false);
 static Cvar::Cvar<int> fs_maxSymlinkDepth("fs_maxSymlinkDepth", "max depth of symlinks in zip paks (0 means disabled)", Cvar::NONE, 1);
 static Cvar::Cvar<std::string> fs_pakprefixes("fs_pakprefixes", "prefixes to look for paks to load", 0, "");
+static Cvar::Cvar<bool> fs_pakIndexCache("fs_pakIndexCache", "cache the file lists of zip paks in the homepath", Cvar::NONE, true);
+static Cvar::Range<Cvar::Cvar<int>> fs_readThreads("fs_readThreads", "threads used to read files in the background (0 means one per core, up to 4)", Cvar::NONE, 0, 0, 16);
+static Cvar::Range<Cvar::Cvar<int>> fs_pakIndexThreads("fs_pakIndexThreads", "threads used to read the file lists of paks (0 means one per core)", Cvar::NONE, 0, 0, 64);
 
 bool UseLegacyPaks()
 {
@@ -693,6 +700,72 @@ void File::SetLineBuffered(bool enable, std::error_code& err) const
 		ClearErrorCode(err);
 }
 
+FileView::~FileView()
+{
+#ifndef BUILD_VM
+	if (!mapBase)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(mapBase);
+#else
+	munmap(mapBase, mapLength);
+#endif
+#endif
+}
+
+#ifndef BUILD_VM
+FileView FileView::Map(int fd, offset_t offset, size_t length, std::error_code& err)
+{
+	if (length == 0) {
+		ClearErrorCode(err);
+		return FileView();
+	}
+
+	// Mappings must start at a multiple of the page size (allocation granularity on Windows)
+#ifdef _WIN32
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	offset_t alignment = systemInfo.dwAllocationGranularity;
+#else
+	offset_t alignment = sysconf(_SC_PAGESIZE);
+#endif
+	offset_t alignedOffset = offset - offset % alignment;
+	size_t mapLength = length + (offset - alignedOffset);
+
+#ifdef _WIN32
+	HANDLE mapping = CreateFileMappingW(reinterpret_cast<HANDLE>(_get_osfhandle(fd)), nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		_doserrno = GetLastError();
+		SetErrorCodeSystem(err);
+		return FileView();
+	}
+	void* base = MapViewOfFile(mapping, FILE_MAP_READ, alignedOffset >> 32, alignedOffset & 0xffffffff, mapLength);
+	if (!base)
+		_doserrno = GetLastError();
+	// The view keeps the mapping alive
+	CloseHandle(mapping);
+	if (!base) {
+		SetErrorCodeSystem(err);
+		return FileView();
+	}
+#else
+	void* base = mmap(nullptr, mapLength, PROT_READ, MAP_PRIVATE, fd, alignedOffset);
+	if (base == MAP_FAILED) {
+		SetErrorCodeSystem(err);
+		return FileView();
+	}
+#endif
+
+	ClearErrorCode(err);
+	FileView out;
+	out.mapBase = base;
+	out.mapLength = mapLength;
+	out.mapOffset = offset - alignedOffset;
+	out.mapSize = length;
+	return out;
+}
+#endif
+
 #if defined(BUILD_ENGINE)
 // Workaround for GCC 4.7.2 bug: http://gcc.gnu.org/bugzilla/show_bug.cgi?id=55015
 namespace {
@@ -724,6 +797,11 @@ public:
 			unzClose(zipFile);
 	}
 
+	bool IsOpen() const
+	{
+		return zipFile != nullptr;
+	}
+
 	// Open an archive from an existing file descriptor
 	static ZipArchive Open(int fd, std::error_code& err)
 	{
@@ -731,7 +809,7 @@ public:
 		zlib_filefunc64_def funcs;
 		struct zipData_t {
 			int fd;
-			char buffer[1024];
+			char buffer[16384];
 			offset_t pos;
 			offset_t bufferPos;
 			offset_t bufferLen;
@@ -837,7 +915,7 @@ public:
 	}
 
 	// Iterate through all the files in the archive and invoke the callback.
-	// Callback signature: void(Str::StringRef filename, offset_t offset, uint32_t crc)
+	// Callback signature: void(Str::StringRef filename, offset_t offset, uint32_t crc, const unz_file_info64& fileInfo)
 	template<typename Func> void ForEachFile(Func&& func, std::error_code& err)
 	{
 		unz_global_info64 globalInfo;
@@ -867,7 +945,7 @@ public:
 			if (IsSymlink(fileInfo)) {
 				crc ^= 0x80000000;
 			}
-			func(filename, offset, crc);
+			func(filename, offset, crc, fileInfo);
 
 			if (i + 1 != globalInfo.number_entry) {
 				result = unzGoToNextFile(zipFile);
@@ -968,6 +1046,20 @@ public:
 		}
 	}
 
+	// Get the position of the data of the currently open file in the archive
+	offset_t FileDataOffset() const
+	{
+		return unzGetCurrentFileZStreamPos64(zipFile);
+	}
+
+	// Whether an entry can be read directly from the archive without minizip
+	static bool IsPlainEntry(const unz_file_info64& fileInfo)
+	{
+		// no encryption, and stored or deflated
+		return !(fileInfo.flag & 1) && !IsSymlink(fileInfo)
+			&& (fileInfo.compression_method == 0 || fileInfo.compression_method == Z_DEFLATED);
+	}
+
 	// Get the length of the currently open file
 	offset_t FileLength(std::error_code& err) const
 	{
@@ -1044,7 +1136,7 @@ private:
 
 	Util::optional<offset_t> FindOffsetForName(Str::StringRef name, std::error_code& err) {
 		Util::optional<offset_t> offset;
-		ForEachFile([&](Str::StringRef arcName, offset_t arcOffset, uint32_t) {
+		ForEachFile([&](Str::StringRef arcName, offset_t arcOffset, uint32_t, const unz_file_info64&) {
 			if (!offset && arcName == name) {
 				offset = arcOffset;
 			}
@@ -1055,6 +1147,270 @@ private:
 	unzFile zipFile;
 };
 
+// A file in a zip pak, indexed when the pak is loaded
+struct ZipEntry {
+	offset_t compressedSize;
+	offset_t uncompressedSize;
+	uint32_t crc;
+	int method;
+
+	// Stored or deflated file which can be read with pread() and zlib instead
+	// of minizip. Symlinks and anything unusual go through the archive.
+	bool plain;
+
+	// Position of the file data, found from the local header on first read
+	offset_t dataOffset;
+};
+
+// Read exactly length bytes at the given position of a file
+static void PreadFull(int fd, void* buffer, size_t length, offset_t pos, std::error_code& err)
+{
+	while (length) {
+		intptr_t result = my_pread(fd, buffer, length, pos);
+		if (result == -1) {
+			SetErrorCodeSystem(err);
+			return;
+		}
+		if (result == 0) {
+			SetErrorCodeZlib(err, UNZ_BADZIPFILE);
+			return;
+		}
+		buffer = static_cast<char*>(buffer) + result;
+		length -= result;
+		pos += result;
+	}
+	ClearErrorCode(err);
+}
+
+// Decompress a deflated entry directly from the pak file
+static void InflateEntry(int fd, const ZipEntry& entry, char* out, std::error_code& err)
+{
+	z_stream stream{};
+	if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+		SetErrorCodeZlib(err, UNZ_INTERNALERROR);
+		return;
+	}
+
+	std::vector<char> buffer(std::min<offset_t>(entry.compressedSize, 65536));
+	offset_t pos = entry.dataOffset;
+	offset_t remaining = entry.compressedSize;
+	stream.next_out = reinterpret_cast<Bytef*>(out);
+	offset_t outRemaining = entry.uncompressedSize;
+
+	int result = Z_OK;
+	while (result != Z_STREAM_END) {
+		if (stream.avail_in == 0) {
+			if (remaining == 0)
+				break;
+			size_t chunk = std::min<offset_t>(remaining, buffer.size());
+			PreadFull(fd, buffer.data(), chunk, pos, err);
+			if (err) {
+				inflateEnd(&stream);
+				return;
+			}
+			pos += chunk;
+			remaining -= chunk;
+			stream.next_in = reinterpret_cast<Bytef*>(buffer.data());
+			stream.avail_in = chunk;
+		}
+
+		// zlib counts in uInt, so hand out the output in pieces for huge files
+		if (stream.avail_out == 0) {
+			stream.avail_out = std::min<offset_t>(outRemaining, UINT_MAX);
+			outRemaining -= stream.avail_out;
+		}
+
+		result = inflate(&stream, Z_NO_FLUSH);
+		if (result != Z_OK && result != Z_STREAM_END)
+			break;
+	}
+
+	bool complete = result == Z_STREAM_END && offset_t(stream.total_out) == entry.uncompressedSize;
+	inflateEnd(&stream);
+	if (!complete) {
+		SetErrorCodeZlib(err, UNZ_BADZIPFILE);
+		return;
+	}
+	ClearErrorCode(err);
+}
+
+// A loaded zip pak. The archive stays open for as long as the pak is loaded
+// and its files are indexed, so reading a file doesn't parse the archive again.
+// A pak indexed from the cache only opens the archive when minizip is needed.
+class ZipPak {
+public:
+	// The entries are keyed by central directory offset, as in the file map.
+	// The archive may be left closed.
+	ZipPak(int fd, ZipArchive&& archive, std::unordered_map<offset_t, ZipEntry>&& entries)
+		: fd(fd), archive(std::move(archive)), entries(std::move(entries)) {}
+
+	static ZipEntry MakeEntry(const unz_file_info64& fileInfo)
+	{
+		ZipEntry entry;
+		entry.compressedSize = fileInfo.compressed_size;
+		entry.uncompressedSize = fileInfo.uncompressed_size;
+		entry.crc = fileInfo.crc;
+		entry.method = fileInfo.compression_method;
+		entry.plain = ZipArchive::IsPlainEntry(fileInfo);
+		entry.dataOffset = 0;
+		return entry;
+	}
+
+	// Read a whole file, given the offset recorded in the file map
+	std::string ReadFile(Str::StringRef name, offset_t offset, std::error_code& err)
+	{
+		ZipEntry entry;
+		if (!FindPlainEntry(offset, entry, err)) {
+			if (err)
+				return "";
+			std::lock_guard<std::mutex> lock(mutex);
+			return ReadFileFromArchive(name, offset, err);
+		}
+
+		// The data is read without the lock, pread() doesn't use the file position
+		std::string out;
+		out.resize(entry.uncompressedSize);
+		if (entry.method == 0) {
+			if (entry.compressedSize != entry.uncompressedSize) {
+				SetErrorCodeZlib(err, UNZ_BADZIPFILE);
+				return "";
+			}
+			PreadFull(fd, &out[0], entry.uncompressedSize, entry.dataOffset, err);
+		} else {
+			InflateEntry(fd, entry, &out[0], err);
+		}
+		if (err)
+			return "";
+
+		if (crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(out.data()), out.size()) != entry.crc) {
+			SetErrorCodeZlib(err, UNZ_CRCERROR);
+			return "";
+		}
+
+		return out;
+	}
+
+	// Check whether ReadFileView maps the file rather than copying it
+	bool IsMapped(offset_t offset)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = entries.find(offset);
+		return it != entries.end() && IsMappedEntry(it->second);
+	}
+
+	// Map a file stored without compression, or read it if it isn't
+	FileView ReadFileView(Str::StringRef name, offset_t offset, std::error_code& err)
+	{
+		ZipEntry entry;
+		if (!FindPlainEntry(offset, entry, err) || !IsMappedEntry(entry)) {
+			if (err)
+				return {};
+			std::string contents = ReadFile(name, offset, err);
+			if (err)
+				return {};
+			return FileView(std::move(contents));
+		}
+
+		FileView out = FileView::Map(fd, entry.dataOffset, entry.uncompressedSize, err);
+		if (err)
+			return {};
+
+		if (crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(out.data()), out.size()) != entry.crc) {
+			SetErrorCodeZlib(err, UNZ_CRCERROR);
+			return {};
+		}
+
+		return out;
+	}
+
+	// Run a function with exclusive access to the archive
+	template<typename Func> void WithArchive(Func&& func, std::error_code& err)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!OpenArchive(err))
+			return;
+		func(archive);
+	}
+
+private:
+	// Smaller files are cheaper to copy than to map
+	static constexpr offset_t MIN_MAPPED_SIZE = 64 * 1024;
+
+	static bool IsMappedEntry(const ZipEntry& entry)
+	{
+		return entry.plain && entry.method == 0 && entry.uncompressedSize >= MIN_MAPPED_SIZE
+			&& entry.compressedSize == entry.uncompressedSize;
+	}
+
+	// Get a copy of the entry of a file which can be read without minizip
+	bool FindPlainEntry(offset_t offset, ZipEntry& entry, std::error_code& err)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ClearErrorCode(err);
+		auto it = entries.find(offset);
+		if (it == entries.end() || !it->second.plain)
+			return false;
+
+		if (!it->second.dataOffset) {
+			if (!OpenArchive(err))
+				return false;
+			archive.OpenFile(offset, err);
+			if (err)
+				return false;
+			it->second.dataOffset = archive.FileDataOffset();
+			archive.CloseFile(err);
+			if (err)
+				return false;
+		}
+		entry = it->second;
+		return true;
+	}
+
+	// Must be called with the lock held
+	bool OpenArchive(std::error_code& err)
+	{
+		if (!archive.IsOpen())
+			archive = ZipArchive::Open(fd, err);
+		else
+			ClearErrorCode(err);
+		return archive.IsOpen();
+	}
+
+	// Must be called with the lock held
+	std::string ReadFileFromArchive(Str::StringRef name, offset_t offset, std::error_code& err)
+	{
+		if (!OpenArchive(err))
+			return "";
+
+		// Open file in zip
+		offset_t length = archive.OpenFileWithSymlinkResolution(name, offset, err);
+		if (err)
+			return "";
+
+		// Read file
+		std::string out;
+		out.resize(length);
+		archive.ReadFile(&out[0], length, err);
+		if (err) {
+			std::error_code ignored;
+			archive.CloseFile(ignored);
+			return "";
+		}
+
+		// Close file and check for CRC errors
+		archive.CloseFile(err);
+		if (err)
+			return "";
+
+		return out;
+	}
+
+	int fd;
+	ZipArchive archive;
+	std::mutex mutex; // protects the archive, its opening and the data offsets of the entries
+	std::unordered_map<offset_t, ZipEntry> entries;
+};
+
 } // GCC bug workaround
 #endif // defined(BUILD_ENGINE)
 
@@ -1074,6 +1430,31 @@ struct LoadedPakGuard {
 };
 static LoadedPakGuard loadedPaksGuard;
 
+#ifdef BUILD_ENGINE
+// Open zip paks, in the same order as loadedPaks (nullptr for directories).
+// Destroyed before the guard above closes the fds.
+static std::vector<std::unique_ptr<ZipPak>> zipPaks;
+
+// Threads reading and inflating files for ReadFileAsync, which use the paks
+// in zipPaks
+static Sys::ThreadPool readPool("file reading", fs_readThreads);
+
+// Files being read by PrefetchFile, taken by the next read of each file. When
+// there are too many, the oldest prefetch is dropped as it is likely unused.
+static const size_t MAX_PREFETCHED_FILES = 64;
+struct PrefetchedFile {
+	uint64_t sequence;
+	std::future<std::string> contents;
+};
+static std::mutex prefetchMutex;
+static uint64_t prefetchSequence = 0;
+static std::unordered_map<std::string, PrefetchedFile, Str::IHash, Str::IEqual> prefetchedFiles;
+
+// Locked exclusively while the loaded paks and the file map change, see
+// LockLoadedPaks
+static std::shared_timed_mutex loadedPaksMutex;
+#endif
+
 // std::unordered_set uses std::hash which does not
 // hash pair of std::string.
 struct stdStringPairHasher
@@ -1159,83 +1540,6 @@ static void ParseDeleted(const PakInfo& parent, Str::StringRef deletedData)
 	}
 }
 
-static void InternalLoadPak(
-	const PakInfo& pak, Util::optional<uint32_t> expectedChecksum, Str::StringRef pathPrefix,
-	bool loadDeps, std::error_code& err);
-
-// Parse the dependencies file of a package
-// Each line of the dependencies file is a name followed by an optional version
-static void ParseDeps(const PakInfo& parent, Str::StringRef depsData, Str::StringRef prefix, std::error_code& err)
-{
-	auto lineStart = depsData.begin();
-	int line = 0;
-	while (lineStart != depsData.end()) {
-		// Get the end of the line or the end of the file
-		line++;
-		auto lineEnd = std::find(lineStart, depsData.end(), '\n');
-
-		// Skip spaces
-		while (lineStart != lineEnd && Str::cisspace(*lineStart))
-			lineStart++;
-		if (lineStart == lineEnd) {
-			lineStart = lineEnd == depsData.end() ? lineEnd : lineEnd + 1;
-			continue;
-		}
-
-		// Read the package name
-		std::string name;
-		while (lineStart != lineEnd && !Str::cisspace(*lineStart))
-			name.push_back(*lineStart++);
-
-		// Skip spaces
-		while (lineStart != lineEnd && Str::cisspace(*lineStart))
-			lineStart++;
-
-		// If this is the end of the line, load a package by name
-		if (lineStart == lineEnd) {
-			const PakInfo* pak = FindPak(name);
-			if (!pak) {
-				fsLogs.Warn("Could not find pak '%s' required by '%s'", name, parent.path);
-				SetErrorCodeFilesystem(err, filesystem_error::missing_dependency);
-				return;
-			}
-			InternalLoadPak(*pak, Util::nullopt, prefix, true, err);
-			if (err)
-				return;
-			lineStart = lineEnd == depsData.end() ? lineEnd : lineEnd + 1;
-			continue;
-		}
-
-		// Read the package version
-		std::string version;
-		while (lineStart != lineEnd && !Str::cisspace(*lineStart))
-			version.push_back(*lineStart++);
-
-		// Skip spaces
-		while (lineStart != lineEnd && Str::cisspace(*lineStart))
-			lineStart++;
-
-		// If this is the end of the line, load a package with an explicit version
-		if (lineStart == lineEnd) {
-			const PakInfo* pak = FindPak(name, version);
-			if (!pak) {
-				fsLogs.Warn("Could not find pak '%s' with version '%s' required by '%s'", name, version, parent.path);
-				SetErrorCodeFilesystem(err, filesystem_error::missing_dependency);
-				return;
-			}
-			InternalLoadPak(*pak, Util::nullopt, prefix, true, err);
-			if (err)
-				return;
-			lineStart = lineEnd == depsData.end() ? lineEnd : lineEnd + 1;
-			continue;
-		}
-
-		// If there is still stuff at the end of the line, print a warning and ignore it
-		fsLogs.Warn("Invalid dependency specification on line %d in %s", line, Path::Build(parent.path, PAK_DEPS_FILE));
-		lineStart = lineEnd == depsData.end() ? lineEnd : lineEnd + 1;
-	}
-}
-
 /* The code is expected to be only reliable for ignoring deleted files
 in dependencies. For example if the unvanquished_0.52.2.dpk pak lists the
 scripts/colors.shader file in the DELETED file and has unvanquished_0.52.1.dpk
@@ -1259,218 +1563,709 @@ static bool FileIsDeleted(const PakInfo& pak, Str::StringRef filename)
 	return deletedFileSet.find(std::pair<std::string, std::string>(pak.name, filename)) != deletedFileSet.end();
 }
 
-static void InternalLoadPak(
-	const PakInfo& pak, Util::optional<uint32_t> expectedChecksum, Str::StringRef pathPrefix,
-	bool loadDeps, std::error_code& err)
-{
-	Util::optional<uint32_t> realChecksum;
-	bool hasDeleted = false;
-	offset_t deletedOffset = 0;
-	bool hasDeps = false;
-	offset_t depsOffset = 0;
-	ZipArchive zipFile;
-	bool isLegacy = pak.version.empty();
+/* The file lists of zip paks are cached in the homepath, so that a pak which
+didn't change since the last start is loaded without parsing its central
+directory. A cache file is keyed by the path of the pak, and holds its size
+and timestamp; a pak whose size or timestamp differs is indexed again and its
+cache file replaced. The DEPS and DELETED files are cached as well, so a cached
+pak doesn't need to open the archive at all. */
 
-	// Check if this pak has already been loaded to avoid recursive dependencies
-	for (auto& x: loadedPaks) {
+// A file of a zip pak as listed in its central directory
+struct ZipFileRecord {
+	std::string name;
+	offset_t offset;
+
+	// CRC used for the pak checksum, which differs from the file CRC for symlinks
+	uint32_t listedCrc;
+	ZipEntry entry;
+};
+
+// What is cached about a zip pak
+struct ZipPakContents {
+	std::vector<ZipFileRecord> records;
+	std::string depsData;
+	std::string deletedData;
+};
+
+static const uint32_t PAK_INDEX_MAGIC = 0x58494b50; // "PKIX"
+static const uint32_t PAK_INDEX_VERSION = 1;
+static const size_t PAK_INDEX_HEADER_SIZE = 3 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+static std::string PakIndexCachePath(Str::StringRef pakPath)
+{
+	uint32_t hash = crc32(0, reinterpret_cast<const Bytef*>(pakPath.data()), pakPath.size());
+	return Str::Format("cache/paks/%s-%08x.idx", Path::BaseName(pakPath), hash);
+}
+
+// Helpers to build and parse the cache files, which are in native byte order
+template<typename T> static void PutPakIndexValue(std::string& out, T value)
+{
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+static void PutPakIndexString(std::string& out, Str::StringRef str)
+{
+	PutPakIndexValue<uint32_t>(out, str.size());
+	out.append(str.data(), str.size());
+}
+template<typename T> static bool GetPakIndexValue(const std::string& in, size_t& pos, T& value)
+{
+	if (in.size() - pos < sizeof(value))
+		return false;
+	memcpy(&value, in.data() + pos, sizeof(value));
+	pos += sizeof(value);
+	return true;
+}
+static bool GetPakIndexString(const std::string& in, size_t& pos, std::string& str)
+{
+	uint32_t length;
+	if (!GetPakIndexValue(in, pos, length) || in.size() - pos < length)
+		return false;
+	str.assign(in, pos, length);
+	pos += length;
+	return true;
+}
+
+// Header: magic, version, size and timestamp of the pak, checksum of the rest
+static bool ReadPakIndexCache(Str::StringRef pakPath, uint64_t size, int64_t timestamp, ZipPakContents& contents)
+{
+	if (!fs_pakIndexCache.Get() || homePath.empty())
+		return false;
+
+	std::error_code err;
+	File file = HomePath::OpenRead(PakIndexCachePath(pakPath), err);
+	if (err)
+		return false;
+	std::string data = file.ReadAll(err);
+	if (err)
+		return false;
+
+	size_t pos = 0;
+	uint32_t magic, version, dataChecksum;
+	uint64_t cachedSize;
+	int64_t cachedTimestamp;
+	if (!GetPakIndexValue(data, pos, magic) || magic != PAK_INDEX_MAGIC
+		|| !GetPakIndexValue(data, pos, version) || version != PAK_INDEX_VERSION
+		|| !GetPakIndexValue(data, pos, cachedSize) || cachedSize != size
+		|| !GetPakIndexValue(data, pos, cachedTimestamp) || cachedTimestamp != timestamp
+		|| !GetPakIndexValue(data, pos, dataChecksum)
+		|| dataChecksum != crc32(0, reinterpret_cast<const Bytef*>(data.data() + pos), data.size() - pos))
+		return false;
+
+	std::string cachedPath;
+	uint32_t numRecords;
+	if (!GetPakIndexString(data, pos, cachedPath) || cachedPath != pakPath
+		|| !GetPakIndexString(data, pos, contents.depsData)
+		|| !GetPakIndexString(data, pos, contents.deletedData)
+		|| !GetPakIndexValue(data, pos, numRecords))
+		return false;
+
+	contents.records.resize(numRecords);
+	for (ZipFileRecord& record: contents.records) {
+		uint64_t offset, compressedSize, uncompressedSize;
+		int32_t method;
+		uint8_t plain;
+		if (!GetPakIndexString(data, pos, record.name)
+			|| !GetPakIndexValue(data, pos, offset)
+			|| !GetPakIndexValue(data, pos, record.listedCrc)
+			|| !GetPakIndexValue(data, pos, compressedSize)
+			|| !GetPakIndexValue(data, pos, uncompressedSize)
+			|| !GetPakIndexValue(data, pos, record.entry.crc)
+			|| !GetPakIndexValue(data, pos, method)
+			|| !GetPakIndexValue(data, pos, plain))
+			return false;
+		record.offset = offset;
+		record.entry.compressedSize = compressedSize;
+		record.entry.uncompressedSize = uncompressedSize;
+		record.entry.method = method;
+		record.entry.plain = plain;
+		record.entry.dataOffset = 0;
+	}
+	return pos == data.size();
+}
+
+// Errors are ignored, the pak is just indexed again next time
+static void WritePakIndexCache(Str::StringRef pakPath, uint64_t size, int64_t timestamp, const ZipPakContents& contents)
+{
+	if (!fs_pakIndexCache.Get() || homePath.empty())
+		return;
+
+	std::string data;
+	PutPakIndexString(data, pakPath);
+	PutPakIndexString(data, contents.depsData);
+	PutPakIndexString(data, contents.deletedData);
+	PutPakIndexValue<uint32_t>(data, contents.records.size());
+	for (const ZipFileRecord& record: contents.records) {
+		PutPakIndexString(data, record.name);
+		PutPakIndexValue<uint64_t>(data, record.offset);
+		PutPakIndexValue<uint32_t>(data, record.listedCrc);
+		PutPakIndexValue<uint64_t>(data, record.entry.compressedSize);
+		PutPakIndexValue<uint64_t>(data, record.entry.uncompressedSize);
+		PutPakIndexValue<uint32_t>(data, record.entry.crc);
+		PutPakIndexValue<int32_t>(data, record.entry.method);
+		PutPakIndexValue<uint8_t>(data, record.entry.plain);
+	}
+
+	std::string header;
+	PutPakIndexValue<uint32_t>(header, PAK_INDEX_MAGIC);
+	PutPakIndexValue<uint32_t>(header, PAK_INDEX_VERSION);
+	PutPakIndexValue<uint64_t>(header, size);
+	PutPakIndexValue<int64_t>(header, timestamp);
+	PutPakIndexValue<uint32_t>(header, crc32(0, reinterpret_cast<const Bytef*>(data.data()), data.size()));
+
+	// Write to a temporary file first, another process may be reading the cache
+	std::string path = PakIndexCachePath(pakPath);
+	std::string tmpPath = path + ".tmp";
+	std::error_code err;
+	File file = HomePath::OpenWrite(tmpPath, err);
+	if (err)
+		return;
+	file.Write(header.data(), header.size(), err);
+	if (!err)
+		file.Write(data.data(), data.size(), err);
+	if (!err)
+		file.Close(err);
+	if (!err)
+		HomePath::MoveFile(path, tmpPath, err);
+	if (err)
+		HomePath::DeleteFile(tmpPath, err);
+}
+
+// Cache files written in another format are removed too. Only the header and
+// the pak path are read.
+void PruneIndexCache()
+{
+	if (homePath.empty())
+		return;
+
+	std::error_code err;
+	std::vector<std::string> names;
+	for (const std::string& name: HomePath::ListFiles("cache/paks", err)) {
+		if (Str::IsSuffix(".idx", name))
+			names.push_back(name);
+	}
+	if (err)
+		return;
+
+	for (const std::string& name: names) {
+		std::string path = "cache/paks/" + name;
+		File file = HomePath::OpenRead(path, err);
+		if (err)
+			continue;
+
+		std::string header(PAK_INDEX_HEADER_SIZE + sizeof(uint32_t), '\0');
+		size_t pos = 0;
+		uint32_t magic, version, pathLength = 0;
+		bool valid = file.Read(&header[0], header.size(), err) == header.size() && !err
+			&& GetPakIndexValue(header, pos, magic) && magic == PAK_INDEX_MAGIC
+			&& GetPakIndexValue(header, pos, version) && version == PAK_INDEX_VERSION;
+
+		std::string pakPath;
+		if (valid) {
+			pos = PAK_INDEX_HEADER_SIZE;
+			offset_t length = file.Length(err);
+			valid = !err && GetPakIndexValue(header, pos, pathLength) && pathLength <= length - header.size();
+		}
+		if (valid) {
+			pakPath.resize(pathLength);
+			valid = file.Read(&pakPath[0], pathLength, err) == pathLength && !err;
+		}
+		file.Close(err);
+
+		if (valid && RawPath::FileExists(pakPath))
+			continue;
+		fsLogs.Debug("Removing pak index cache file %s", path);
+		HomePath::DeleteFile(path, err);
+	}
+}
+
+// Everything about a pak that can be read without touching the loaded pak
+// state, so that several paks can be indexed at the same time. The fd is
+// closed unless the pak gets loaded.
+struct PakIndex {
+	PakIndex() = default;
+	PakIndex(const PakIndex&) = delete;
+	PakIndex& operator=(const PakIndex&) = delete;
+	~PakIndex()
+	{
+		zipPak.reset();
+		if (fd != -1)
+			close(fd);
+	}
+
+	bool indexed = false;
+	std::error_code err;
+	int fd = -1;
+	std::unique_ptr<ZipPak> zipPak;
+
+	// Files matching the path prefix, with their offset in the zip archive
+	std::vector<std::pair<std::string, offset_t>> files;
+	std::vector<std::string> invalidFiles;
+
+	Util::optional<uint32_t> realChecksum;
+	std::chrono::system_clock::time_point timestamp;
+	bool fromCache = false;
+	bool hasDeleted = false;
+	std::string deletedData;
+	bool hasDeps = false;
+	std::string depsData;
+};
+
+// Timings of the pak loading currently in progress, logged once the outermost
+// load completes.
+static struct {
+	int depth = 0;
+	int numPaks = 0;
+	int numThreads = 0;
+	int numCached = 0;
+	size_t numFiles = 0;
+	Sys::SteadyClock::duration indexTime{};
+	Sys::SteadyClock::duration indexWork{};
+} pakLoadStats;
+
+struct PakLoadTimer {
+	PakLoadTimer()
+	{
+		if (pakLoadStats.depth++ == 0) {
+			pakLoadStats.numPaks = 0;
+			pakLoadStats.numThreads = 0;
+			pakLoadStats.numCached = 0;
+			pakLoadStats.numFiles = 0;
+			pakLoadStats.indexTime = {};
+			pakLoadStats.indexWork = {};
+			start = Sys::SteadyClock::now();
+		}
+	}
+	~PakLoadTimer()
+	{
+		if (--pakLoadStats.depth != 0 || pakLoadStats.numPaks == 0)
+			return;
+		auto ms = [](Sys::SteadyClock::duration d) {
+			return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(d).count());
+		};
+		Sys::SteadyClock::duration total = Sys::SteadyClock::now() - start;
+		fsLogs.Verbose("Loaded %d paks (%d from the index cache) with %d files in %d ms: indexing took %d ms (%d ms of work on %d threads), merging %d ms",
+			pakLoadStats.numPaks, pakLoadStats.numCached, pakLoadStats.numFiles, ms(total), ms(pakLoadStats.indexTime),
+			ms(pakLoadStats.indexWork), pakLoadStats.numThreads, ms(total - pakLoadStats.indexTime));
+	}
+
+	Sys::SteadyClock::time_point start;
+};
+
+// Check if this pak has already been loaded, to avoid recursive dependencies
+static bool IsPakLoaded(const PakInfo& pak, Str::StringRef pathPrefix)
+{
+	for (auto& x: loadedPaks) {
 		// If the prefix is a superset of our current prefix, then it already
 		// includes all the files we care about.
 		if (x.path == pak.path && Str::IsPrefix(x.pathPrefix, pathPrefix))
-			return;
+			return true;
 	}
+	return false;
+}
 
-	if (pak.type == pakType_t::PAK_ZIP) {
-		if (!isLegacy) {
-			fsLogs.WithoutSuppression().Notice("Loading pak '%s'...", pak.path.c_str());
-		} else {
-			fsLogs.WithoutSuppression().Notice("Loading legacy pak '%s'...", pak.path.c_str());
+// Add the files of a zip pak matching the prefix to its index, and calculate
+// the checksum of the package (checksum of all file checksums)
+static void IndexZipFiles(
+	const PakInfo& pak, Str::StringRef pathPrefix, const std::vector<ZipFileRecord>& records,
+	PakIndex& index, std::unordered_map<offset_t, ZipEntry>& entries)
+{
+	bool isLegacy = pak.version.empty();
+	index.realChecksum = crc32(0, Z_NULL, 0);
+	for (const ZipFileRecord& record: records) {
+		if (!Str::IsPrefix(pathPrefix, record.name)
+			&& record.name != PAK_DELETED_FILE
+			&& record.name != PAK_DEPS_FILE)
+			continue;
+		if (!Path::IsValid(record.name, false)) {
+			index.invalidFiles.push_back(record.name);
+			continue;
 		}
-	} else if (pak.type == pakType_t::PAK_DIR) {
+
+		entries.emplace(record.offset, record.entry);
+
+		// Legacy paks don't have version neither checksum
 		if (!isLegacy) {
-			fsLogs.WithoutSuppression().Notice("Loading pakdir '%s'...", pak.path.c_str());
-		} else {
-			fsLogs.WithoutSuppression().Notice("Loading legacy pakdir '%s'...", pak.path.c_str());
+			index.realChecksum = crc32(*index.realChecksum, reinterpret_cast<const Bytef*>(&record.listedCrc), sizeof(record.listedCrc));
 		}
-	} else {
-		ASSERT_UNREACHABLE();
+
+		if (!isLegacy && record.name == PAK_DELETED_FILE) {
+			index.hasDeleted = true;
+			continue;
+		}
+		else if (!isLegacy && record.name == PAK_DEPS_FILE) {
+			index.hasDeps = true;
+			continue;
+		}
+
+		index.files.emplace_back(record.name, record.offset);
 	}
+}
 
-	loadedPaks.emplace_back();
-	auto &loadedPak = loadedPaks.back();
-	loadedPak.name = pak.name;
-	loadedPak.version = pak.version;
-	loadedPak.checksum = pak.checksum;
-	loadedPak.type = pak.type;
-	loadedPak.path = pak.path;
+// Open a pak, list its files and calculate its checksum. This only uses the
+// pak itself and its cache file, so it can run on any thread; warnings are
+// left for MergePak.
+static void IndexPak(const PakInfo& pak, Str::StringRef pathPrefix, PakIndex& index)
+{
+	std::error_code& err = index.err;
+	bool isLegacy = pak.version.empty();
+	index.indexed = true;
 
-	// Update the list of files, but don't overwrite existing files, so the sort order is preserved
 	if (pak.type == pakType_t::PAK_DIR) {
-		loadedPak.fd = -1;
 		auto dirRange = RawPath::ListFilesRecursive(pak.path, err);
 		if (err)
 			return;
 		for (auto it = dirRange.begin(); it != dirRange.end();) {
 			if (!isLegacy && *it == PAK_DELETED_FILE) {
-				hasDeleted = true;
+				index.hasDeleted = true;
 			}
 			else if (!isLegacy && *it == PAK_DEPS_FILE) {
-				hasDeps = true;
+				index.hasDeps = true;
 			}
 			else if (!Str::IsSuffix("/", *it) && Str::IsPrefix(pathPrefix, *it)) {
-				if (FileIsDeleted(pak, *it)) {
-					Log::Debug("Ignoring deleted file %s from %s", *it, pak.path);
-				}
-				else {
-					fileMap.emplace(*it, std::pair<uint32_t, offset_t>(loadedPaks.size() - 1, 0));
-				}
+				index.files.emplace_back(*it, 0);
 			}
 			it.increment(err);
 			if (err)
 				return;
 		}
+
+		if (index.hasDeleted) {
+			File deletedFile = RawPath::OpenRead(Path::Build(pak.path, PAK_DELETED_FILE), err);
+			if (err)
+				return;
+			index.deletedData = deletedFile.ReadAll(err);
+			if (err)
+				return;
+		}
+
+		if (index.hasDeps) {
+			File depsFile = RawPath::OpenRead(Path::Build(pak.path, PAK_DEPS_FILE), err);
+			if (err)
+				return;
+			index.depsData = depsFile.ReadAll(err);
+			if (err)
+				return;
+		}
 	} else if (pak.type == pakType_t::PAK_ZIP) {
 		// Open file
-		loadedPak.fd = my_open(pak.path, openMode_t::MODE_READ);
-		if (loadedPak.fd == -1) {
+		index.fd = my_open(pak.path, openMode_t::MODE_READ);
+		if (index.fd == -1) {
 			SetErrorCodeSystem(err);
 			return;
 		}
 
-		// Open zip
-		zipFile = ZipArchive::Open(loadedPak.fd, err);
+		// Get the timestamp of the pak, but only for dpk files.
+		// Directories (aka a dpkdir) don't need timestamp.
+		// Fixes Windows bug where calling _wstat64i with trailing slash causes "file not found" error.
+		// For future stat calls on directories, trim the trailing slash (if exists)
+		index.timestamp = FS::RawPath::FileTimestamp(pak.path, err);
 		if (err)
 			return;
-
-		// Get the file list and calculate the checksum of the package (checksum of all file checksums)
-		realChecksum = crc32(0, Z_NULL, 0);
-		zipFile.ForEachFile([&pak, &realChecksum, &pathPrefix, &hasDeps, &hasDeleted, &depsOffset, &deletedOffset, &isLegacy](Str::StringRef filename, offset_t offset, uint32_t crc) {
-			// Note that 'return' is effectively 'continue' since we are in a lambda
-			if (!Str::IsPrefix(pathPrefix, filename)
-				&& filename != PAK_DELETED_FILE
-				&& filename != PAK_DEPS_FILE)
-				return;
-			if (Str::IsSuffix("/", filename))
-				return;
-			if (!Path::IsValid(filename, false)) {
-				fsLogs.Warn("Invalid filename '%s' in pak '%s'", filename, pak.path);
+		my_stat_t st;
+		if (my_fstat(index.fd, &st) == -1) {
+			SetErrorCodeSystem(err);
+			return;
+		}
+		int64_t timestamp = std::chrono::system_clock::to_time_t(index.timestamp);
+
+		ZipPakContents contents;
+		ZipArchive zipFile;
+		index.fromCache = ReadPakIndexCache(pak.path, st.st_size, timestamp, contents);
+		if (!index.fromCache) {
+			// Open zip
+			zipFile = ZipArchive::Open(index.fd, err);
+			if (err)
 				return;
-			}
-
-			// Legacy paks don't have version neither checksum
-			if (!isLegacy) {
-				realChecksum = crc32(*realChecksum, reinterpret_cast<const Bytef*>(&crc), sizeof(crc));
-			}
 
-			if (!isLegacy && filename == PAK_DELETED_FILE) {
-				hasDeleted = true;
-				deletedOffset = offset;
-				return;
-			}
-			else if (!isLegacy && filename == PAK_DEPS_FILE) {
-				hasDeps = true;
-				depsOffset = offset;
+			// Get the file list
+			zipFile.ForEachFile([&contents](Str::StringRef filename, offset_t offset, uint32_t crc, const unz_file_info64& fileInfo) {
+				if (!Str::IsSuffix("/", filename))
+					contents.records.push_back({filename, offset, crc, ZipPak::MakeEntry(fileInfo)});
+			}, err);
+			if (err)
 				return;
-			}
+		}
 
-			if (FileIsDeleted(pak, filename)) {
-				Log::Debug("Ignoring deleted file %s from %s", filename, pak.path);
-			}
-			else {
-				fileMap.emplace(filename, std::pair<uint32_t, offset_t>(loadedPaks.size() - 1, offset));
+		std::unordered_map<offset_t, ZipEntry> entries;
+		IndexZipFiles(pak, pathPrefix, contents.records, index, entries);
+
+		// Keep the archive open with its index for reading the files
+		index.zipPak.reset(new ZipPak(index.fd, std::move(zipFile), std::move(entries)));
+
+		if (!index.fromCache) {
+			// Read the DEPS and DELETED files whatever the prefix, for the cache
+			for (const ZipFileRecord& record: contents.records) {
+				if (isLegacy)
+					break;
+				if (record.name == PAK_DEPS_FILE)
+					contents.depsData = index.zipPak->ReadFile(record.name, record.offset, err);
+				else if (record.name == PAK_DELETED_FILE)
+					contents.deletedData = index.zipPak->ReadFile(record.name, record.offset, err);
+				if (err)
+					return;
 			}
-		}, err);
-		if (err)
-			return;
+			WritePakIndexCache(pak.path, st.st_size, timestamp, contents);
+		}
+
+		index.depsData = std::move(contents.depsData);
+		index.deletedData = std::move(contents.deletedData);
 	} else {
 		ASSERT_UNREACHABLE();
 	}
+}
 
-	// Save the real checksum in the list of loaded paks (empty for directories, not used for legacy paks)
-	loadedPak.realChecksum = realChecksum;
+// Index several paks on a pool of threads. Paks which are already loaded are
+// left unindexed, and so are repeats of a pak in the list: MergePak finds them
+// loaded by their first occurrence, and two workers would otherwise write the
+// same index cache file.
+static void IndexPaks(const std::vector<const PakInfo*>& paks, Str::StringRef pathPrefix, std::vector<PakIndex>& indexes)
+{
+	std::vector<size_t> pending;
+	std::unordered_set<std::string> pendingPaths;
+	for (size_t i = 0; i < paks.size(); i++) {
+		if (!IsPakLoaded(*paks[i], pathPrefix) && pendingPaths.insert(paks[i]->path).second)
+			pending.push_back(i);
+	}
+	if (pending.empty())
+		return;
+
+	size_t numThreads = fs_pakIndexThreads.Get();
+	if (numThreads == 0)
+		numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	numThreads = std::min(numThreads, pending.size());
+
+	Sys::SteadyClock::time_point start = Sys::SteadyClock::now();
+	std::atomic<size_t> next(0);
+	std::vector<Sys::SteadyClock::duration> work(numThreads);
+	auto worker = [&](size_t thread) {
+		for (size_t i; (i = next++) < pending.size();) {
+			Sys::SteadyClock::time_point pakStart = Sys::SteadyClock::now();
+			IndexPak(*paks[pending[i]], pathPrefix, indexes[pending[i]]);
+			work[thread] += Sys::SteadyClock::now() - pakStart;
+		}
+	};
+
+	// The calling thread takes part, and whatever isn't picked up by a thread
+	// that failed to start is done there too.
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < numThreads; i++) {
+		try {
+			threads.emplace_back(worker, i);
+		} catch (std::system_error&) {
+			break;
+		}
+	}
+	worker(0);
+	for (std::thread& thread: threads)
+		thread.join();
+
+	pakLoadStats.indexTime += Sys::SteadyClock::now() - start;
+	for (Sys::SteadyClock::duration d: work)
+		pakLoadStats.indexWork += d;
+	pakLoadStats.numThreads = std::max(pakLoadStats.numThreads, static_cast<int>(threads.size() + 1));
+}
+
+static void ParseDeps(const PakInfo& parent, Str::StringRef depsData, Str::StringRef prefix, std::error_code& err);
+
+// Add an indexed pak to the list of loaded paks and its files to the file map,
+// then load its dependencies. The pak is indexed here if it wasn't already.
+static void MergePak(
+	const PakInfo& pak, PakIndex& index, Util::optional<uint32_t> expectedChecksum, Str::StringRef pathPrefix,
+	bool loadDeps, std::error_code& err)
+{
+	bool isLegacy = pak.version.empty();
+
+	// The pak may have been loaded as a dependency of a pak merged before it
+	if (IsPakLoaded(pak, pathPrefix))
+		return;
 
-	// Get the timestamp of the pak, but only for dpk files. 
-	// Directories (aka a dpkdir) don't need timestamp.
-	// Fixes Windows bug where calling _wstat64i with trailing slash causes "file not found" error.
-	// For future stat calls on directories, trim the trailing slash (if exists)
 	if (pak.type == pakType_t::PAK_ZIP) {
-		loadedPak.timestamp = FS::RawPath::FileTimestamp(pak.path, err);
-		if (err)
-			return;
+		if (!isLegacy) {
+			fsLogs.WithoutSuppression().Notice("Loading pak '%s'...", pak.path.c_str());
+		} else {
+			fsLogs.WithoutSuppression().Notice("Loading legacy pak '%s'...", pak.path.c_str());
+		}
+	} else if (pak.type == pakType_t::PAK_DIR) {
+		if (!isLegacy) {
+			fsLogs.WithoutSuppression().Notice("Loading pakdir '%s'...", pak.path.c_str());
+		} else {
+			fsLogs.WithoutSuppression().Notice("Loading legacy pakdir '%s'...", pak.path.c_str());
+		}
+	} else {
+		ASSERT_UNREACHABLE();
+	}
+
+	if (!index.indexed) {
+		Sys::SteadyClock::time_point start = Sys::SteadyClock::now();
+		IndexPak(pak, pathPrefix, index);
+		Sys::SteadyClock::duration time = Sys::SteadyClock::now() - start;
+		pakLoadStats.indexTime += time;
+		pakLoadStats.indexWork += time;
+		pakLoadStats.numThreads = std::max(pakLoadStats.numThreads, 1);
+	}
+
+	{
+		std::lock_guard<std::shared_timed_mutex> lock(loadedPaksMutex);
+		loadedPaks.emplace_back();
+		zipPaks.emplace_back();
+	}
+	auto &loadedPak = loadedPaks.back();
+	loadedPak.name = pak.name;
+	loadedPak.version = pak.version;
+	loadedPak.checksum = pak.checksum;
+	loadedPak.type = pak.type;
+	loadedPak.path = pak.path;
+	loadedPak.fd = index.fd;
+	index.fd = -1;
+	zipPaks.back() = std::move(index.zipPak);
+
+	if (index.err) {
+		SetErrorCode(err, index.err.value(), index.err.category());
+		return;
+	}
+
+	pakLoadStats.numPaks++;
+	pakLoadStats.numCached += index.fromCache;
+	pakLoadStats.numFiles += index.files.size();
+
+	for (const std::string& filename: index.invalidFiles)
+		fsLogs.Warn("Invalid filename '%s' in pak '%s'", filename, pak.path);
+
+	// Update the list of files, but don't overwrite existing files, so the sort order is preserved
+	{
+		std::lock_guard<std::shared_timed_mutex> lock(loadedPaksMutex);
+		for (auto& file: index.files) {
+			if (FileIsDeleted(pak, file.first)) {
+				Log::Debug("Ignoring deleted file %s from %s", file.first, pak.path);
+			}
+			else {
+				fileMap.emplace(std::move(file.first), std::pair<uint32_t, offset_t>(loadedPaks.size() - 1, file.second));
+			}
+		}
 	}
 
+	// Save the real checksum in the list of loaded paks (empty for directories, not used for legacy paks)
+	loadedPak.realChecksum = index.realChecksum;
+	loadedPak.timestamp = index.timestamp;
 	loadedPak.pathPrefix = pathPrefix;
+	loadedPak.indexedFromCache = index.fromCache;
 
 	// Legacy paks don't have version neither checksum
 	if (!isLegacy) {
 		// If an explicit checksum was requested, verify that the pak we loaded is the one we are expecting
-		if (expectedChecksum && realChecksum != *expectedChecksum) {
+		if (expectedChecksum && index.realChecksum != *expectedChecksum) {
 			SetErrorCodeFilesystem(err, filesystem_error::wrong_pak_checksum, pak.path);
 			return;
 		}
 
 		// Print a warning if the checksum doesn't match the one in the filename
-		if (pak.checksum && *pak.checksum != realChecksum)
+		if (pak.checksum && *pak.checksum != index.realChecksum)
 			fsLogs.Warn("Pak checksum doesn't match filename: %s", pak.path);
 	}
 
-	// Load deleted file list
+	// Load deleted file list and dependencies, which were read with the index
 	// Do not look for deleted file list if it's a legacy pak (pk3)
 	if (!isLegacy) {
-		if (hasDeleted) {
-			std::string deletedData;
-			if (pak.type == pakType_t::PAK_DIR) {
-				File depsFile = RawPath::OpenRead(Path::Build(pak.path, PAK_DELETED_FILE), err);
-				if (err)
-					return;
-				deletedData = depsFile.ReadAll(err);
-				if (err)
-					return;
-			} else if (pak.type == pakType_t::PAK_ZIP) {
-				zipFile.OpenFile(deletedOffset, err);
-				if (err)
-					return;
-				offset_t length = zipFile.FileLength(err);
-				if (err)
-					return;
-				deletedData.resize(length);
-				auto read = zipFile.ReadFile(&deletedData[0], length, err);
-				deletedData.resize(read);
-				if (err)
-					return;
-			} else {
-				ASSERT_UNREACHABLE();
+		if (index.hasDeleted)
+			ParseDeleted(pak, index.deletedData);
+
+		// Load dependencies (non-legacy paks (pk3) only)
+		if (loadDeps && index.hasDeps)
+			ParseDeps(pak, index.depsData, pathPrefix, err);
+	}
+}
+
+// Parse the dependencies file of a package
+// Each line of the dependencies file is a name followed by an optional version
+// The dependencies are indexed together, then loaded in the order they are listed.
+static void ParseDeps(const PakInfo& parent, Str::StringRef depsData, Str::StringRef prefix, std::error_code& err)
+{
+	std::vector<const PakInfo*> deps;
+	bool missing = false;
+	auto lineStart = depsData.begin();
+	int line = 0;
+	while (lineStart != depsData.end()) {
+		// Get the end of the line or the end of the file
+		line++;
+		auto lineEnd = std::find(lineStart, depsData.end(), '\n');
+
+		// Skip spaces
+		while (lineStart != lineEnd && Str::cisspace(*lineStart))
+			lineStart++;
+		if (lineStart == lineEnd) {
+			lineStart = lineEnd == depsData.end() ? lineEnd : lineEnd + 1;
+			continue;
+		}
+
+		// Read the package name
+		std::string name;
+		while (lineStart != lineEnd && !Str::cisspace(*lineStart))
+			name.push_back(*lineStart++);
+
+		// Skip spaces
+		while (lineStart != lineEnd && Str::cisspace(*lineStart))
+			lineStart++;
+
+		// If this is the end of the line, load a package by name
+		if (lineStart == lineEnd) {
+			const PakInfo* pak = FindPak(name);
+			if (!pak) {
+				fsLogs.Warn("Could not find pak '%s' required by '%s'", name, parent.path);
+				missing = true;
+				break;
 			}
-			ParseDeleted(pak, deletedData);
+			deps.push_back(pak);
+			lineStart = lineEnd == depsData.end() ? lineEnd : lineEnd + 1;
+			continue;
 		}
 
-		// Load dependencies (non-legacy paks (pk3) only)
-		if (loadDeps && hasDeps) {
-			std::string depsData;
-			if (pak.type == pakType_t::PAK_DIR) {
-				File depsFile = RawPath::OpenRead(Path::Build(pak.path, PAK_DEPS_FILE), err);
-				if (err)
-					return;
-				depsData = depsFile.ReadAll(err);
-				if (err)
-					return;
-			} else if (pak.type == pakType_t::PAK_ZIP) {
-				zipFile.OpenFile(depsOffset, err);
-				if (err)
-					return;
-				offset_t length = zipFile.FileLength(err);
-				if (err)
-					return;
-				depsData.resize(length);
-				auto read = zipFile.ReadFile(&depsData[0], length, err);
-				depsData.resize(read);
-				if (err)
-					return;
-			} else {
-				ASSERT_UNREACHABLE();
+		// Read the package version
+		std::string version;
+		while (lineStart != lineEnd && !Str::cisspace(*lineStart))
+			version.push_back(*lineStart++);
+
+		// Skip spaces
+		while (lineStart != lineEnd && Str::cisspace(*lineStart))
+			lineStart++;
+
+		// If this is the end of the line, load a package with an explicit version
+		if (lineStart == lineEnd) {
+			const PakInfo* pak = FindPak(name, version);
+			if (!pak) {
+				fsLogs.Warn("Could not find pak '%s' with version '%s' required by '%s'", name, version, parent.path);
+				missing = true;
+				break;
 			}
-			ParseDeps(pak, depsData, pathPrefix, err);
+			deps.push_back(pak);
+			lineStart = lineEnd == depsData.end() ? lineEnd : lineEnd + 1;
+			continue;
 		}
+
+		// If there is still stuff at the end of the line, print a warning and ignore it
+		fsLogs.Warn("Invalid dependency specification on line %d in %s", line, Path::Build(parent.path, PAK_DEPS_FILE));
+		lineStart = lineEnd == depsData.end() ? lineEnd : lineEnd + 1;
+	}
+
+	// The dependencies listed before a missing one are still loaded
+	std::vector<PakIndex> indexes(deps.size());
+	IndexPaks(deps, prefix, indexes);
+	for (size_t i = 0; i < deps.size(); i++) {
+		MergePak(*deps[i], indexes[i], Util::nullopt, prefix, true, err);
+		if (err)
+			return;
 	}
+
+	if (missing)
+		SetErrorCodeFilesystem(err, filesystem_error::missing_dependency);
+}
+
+static void InternalLoadPak(
+	const PakInfo& pak, Util::optional<uint32_t> expectedChecksum, Str::StringRef pathPrefix,
+	bool loadDeps, std::error_code& err)
+{
+	PakLoadTimer timer;
+	PakIndex index;
+	MergePak(pak, index, expectedChecksum, pathPrefix, loadDeps, err);
 }
 
 void LoadPak(const PakInfo& pak, std::error_code& err)
@@ -1493,11 +2288,32 @@ void LoadPakExplicitWithoutChecksum(const PakInfo& pak, std::error_code& err)
 	InternalLoadPak(pak, {}, "", false, err);
 }
 
+void LoadPaksExplicit(std::vector<PakLoadRequest>& requests)
+{
+	PakLoadTimer timer;
+	std::vector<const PakInfo*> paks;
+	for (const PakLoadRequest& request: requests)
+		paks.push_back(request.pak);
+	std::vector<PakIndex> indexes(paks.size());
+	IndexPaks(paks, "", indexes);
+	for (size_t i = 0; i < requests.size(); i++) {
+		requests[i].err.clear();
+		MergePak(*requests[i].pak, indexes[i], requests[i].expectedChecksum, "", false, requests[i].err);
+	}
+}
+
 void ClearPaks()
 {
 	fsLogs.Verbose("^5Unloading all paks");
+	{
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		prefetchedFiles.clear();
+	}
+	readPool.Wait();
+	std::lock_guard<std::shared_timed_mutex> lock(loadedPaksMutex);
 	deletedFileSet.clear();
 	fileMap.clear();
+	zipPaks.clear();
 	for (LoadedPakInfo& x: loadedPaks) {
 		if (x.fd != -1)
 			close(x.fd);
@@ -1549,11 +2365,64 @@ std::string ReadFile(Str::StringRef path, std::error_code& err) {
 	ClearErrorCode(err);
 	return content;
 }
+
+// The VM can't map the paks, the contents are always copied
+FileView ReadFileView(Str::StringRef path, std::error_code& err)
+{
+	std::string contents = ReadFile(path, err);
+	return FileView(std::move(contents));
+}
 #endif
 
 #ifdef BUILD_ENGINE
+// Read a file of a pakdir
+static std::string ReadDirFile(Str::StringRef path, std::error_code& err)
+{
+	// Open file
+	File file = RawPath::OpenRead(path, err);
+	if (err)
+		return "";
+
+	// Get file length
+	offset_t length = file.Length(err);
+	if (err)
+		return "";
+
+	// Read file contents
+	std::string out;
+	out.resize(length);
+	file.Read(&out[0], length, err);
+	return out;
+}
+
+// Get the result of a prefetch of the file, if there is one
+static bool TakePrefetchedFile(Str::StringRef path, std::string& out, std::error_code& err)
+{
+	std::future<std::string> future;
+	{
+		std::lock_guard<std::mutex> lock(prefetchMutex);
+		auto it = prefetchedFiles.find(path);
+		if (it == prefetchedFiles.end())
+			return false;
+		future = std::move(it->second.contents);
+		prefetchedFiles.erase(it);
+	}
+
+	try {
+		out = future.get();
+		ClearErrorCode(err);
+	} catch (std::system_error& e) {
+		SetErrorCode(err, e.code().value(), e.code().category());
+	}
+	return true;
+}
+
 std::string ReadFile(Str::StringRef path, std::error_code& err)
 {
+	std::string out;
+	if (TakePrefetchedFile(path, out, err))
+		return out;
+
 	auto it = fileMap.find(path);
 	if (it == fileMap.end()) {
 		SetErrorCodeFilesystem(err, filesystem_error::no_such_file, path);
@@ -1562,48 +2431,87 @@ std::string ReadFile(Str::StringRef path, std::error_code& err)
 
 	const LoadedPakInfo& pak = loadedPaks[it->second.first];
 	if (pak.type == pakType_t::PAK_DIR) {
-		// Open file
-		File file = RawPath::OpenRead(Path::Build(pak.path, it->first), err);
-		if (err)
-			return "";
+		return ReadDirFile(Path::Build(pak.path, it->first), err);
+	} else if (pak.type == pakType_t::PAK_ZIP) {
+		return zipPaks[it->second.first]->ReadFile(it->first, it->second.second, err);
+	}
 
-		// Get file length
-		offset_t length = file.Length(err);
-		if (err)
-			return "";
+	ASSERT_UNREACHABLE();
+}
 
-		// Read file contents
-		std::string out;
-		out.resize(length);
-		file.Read(&out[0], length, err);
-		return out;
+std::future<std::string> ReadFileAsync(Str::StringRef path)
+{
+	auto it = fileMap.find(path);
+	if (it == fileMap.end()) {
+		std::promise<std::string> promise;
+		promise.set_exception(std::make_exception_ptr(filesystem_exception(filesystem_error::no_such_file, path)));
+		return promise.get_future();
+	}
+
+	// Only the pak is used by the task, the file map may change before it runs
+	std::shared_ptr<std::packaged_task<std::string()>> task;
+	const LoadedPakInfo& pak = loadedPaks[it->second.first];
+	if (pak.type == pakType_t::PAK_DIR) {
+		std::string fullPath = Path::Build(pak.path, it->first);
+		task = std::make_shared<std::packaged_task<std::string()>>([fullPath] {
+			return ReadDirFile(fullPath, throws());
+		});
 	} else if (pak.type == pakType_t::PAK_ZIP) {
-		// Open zip
-		ZipArchive zipFile = ZipArchive::Open(pak.fd, err);
-		if (err)
-			return "";
+		ZipPak* zipPak = zipPaks[it->second.first].get();
+		std::string name = it->first;
+		offset_t offset = it->second.second;
+		task = std::make_shared<std::packaged_task<std::string()>>([zipPak, name, offset] {
+			return zipPak->ReadFile(name, offset, throws());
+		});
+	} else {
+		ASSERT_UNREACHABLE();
+	}
 
-		// Open file in zip
-		offset_t length = zipFile.OpenFileWithSymlinkResolution(it->first, it->second.second, err);
-		if (err)
-			return "";
+	std::future<std::string> future = task->get_future();
+	readPool.Enqueue([task] { (*task)(); });
+	return future;
+}
 
-		// Read file
-		std::string out;
-		out.resize(length);
-		zipFile.ReadFile(&out[0], length, err);
-		if (err)
-			return "";
+void PrefetchFile(Str::StringRef path)
+{
+	auto it = fileMap.find(path);
+	if (it == fileMap.end())
+		return;
 
-		// Close file and check for CRC errors
-		zipFile.CloseFile(err);
-		if (err)
-			return "";
+	// Mapping a file is already cheaper than copying it in the background
+	if (loadedPaks[it->second.first].type == pakType_t::PAK_ZIP && zipPaks[it->second.first]->IsMapped(it->second.second))
+		return;
 
-		return out;
+	std::lock_guard<std::mutex> lock(prefetchMutex);
+	if (prefetchedFiles.count(path))
+		return;
+
+	if (prefetchedFiles.size() >= MAX_PREFETCHED_FILES) {
+		auto oldest = std::min_element(prefetchedFiles.begin(), prefetchedFiles.end(), [](const auto& a, const auto& b) {
+			return a.second.sequence < b.second.sequence;
+		});
+		prefetchedFiles.erase(oldest);
 	}
+	prefetchedFiles.emplace(path, PrefetchedFile{prefetchSequence++, ReadFileAsync(path)});
+}
 
-	ASSERT_UNREACHABLE();
+std::shared_lock<std::shared_timed_mutex> LockLoadedPaks()
+{
+	return std::shared_lock<std::shared_timed_mutex>(loadedPaksMutex);
+}
+
+FileView ReadFileView(Str::StringRef path, std::error_code& err)
+{
+	std::string prefetched;
+	if (TakePrefetchedFile(path, prefetched, err))
+		return FileView(std::move(prefetched));
+
+	auto it = fileMap.find(path);
+	if (it != fileMap.end() && loadedPaks[it->second.first].type == pakType_t::PAK_ZIP)
+		return zipPaks[it->second.first]->ReadFileView(it->first, it->second.second, err);
+
+	std::string contents = ReadFile(path, err);
+	return FileView(std::move(contents));
 }
 
 // Note: Does not handle symlinks.
@@ -1622,39 +2530,36 @@ void CopyFile(Str::StringRef path, const File& dest, std::error_code& err)
 			return;
 		file.CopyTo(dest, err);
 	} else if (pak.type == pakType_t::PAK_ZIP) {
-		// Open zip
-		ZipArchive zipFile = ZipArchive::Open(pak.fd, err);
-		if (err)
-			return;
-
-		// Open file in zip
-		zipFile.OpenFile(it->second.second, err);
-		if (err)
-			return;
-
-		// Copy contents into destination
-		char buffer[65536];
-		while (true) {
-			offset_t read = zipFile.ReadFile(buffer, sizeof(buffer), err);
-			if (err) {
-				std::error_code ignored;
-				// TODO: Support closing on exceptions.
-				zipFile.CloseFile(ignored);
-				return;
-			}
-			if (read == 0)
-				break;
-			dest.Write(buffer, read, err);
-			if (err) {
-				std::error_code ignored;
-				// TODO: Support closing on exceptions.
-				zipFile.CloseFile(ignored);
+		zipPaks[it->second.first]->WithArchive([&](ZipArchive& zipFile) {
+			// Open file in zip
+			zipFile.OpenFile(it->second.second, err);
+			if (err)
 				return;
+
+			// Copy contents into destination
+			char buffer[65536];
+			while (true) {
+				offset_t read = zipFile.ReadFile(buffer, sizeof(buffer), err);
+				if (err) {
+					std::error_code ignored;
+					// TODO: Support closing on exceptions.
+					zipFile.CloseFile(ignored);
+					return;
+				}
+				if (read == 0)
+					break;
+				dest.Write(buffer, read, err);
+				if (err) {
+					std::error_code ignored;
+					// TODO: Support closing on exceptions.
+					zipFile.CloseFile(ignored);
+					return;
+				}
 			}
-		}
 
-		// Close file and check for CRC errors
-		zipFile.CloseFile(err);
+			// Close file and check for CRC errors
+			zipFile.CloseFile(err);
+		}, err);
 	} else {
 		ASSERT_UNREACHABLE();
 	}
@@ -2487,6 +3392,7 @@ void Initialize(Str::StringRef homePath, Str::StringRef libPath, const std::vect
 		fsLogs.Warn("No pak search paths found");
 
 	RefreshPaks();
+	PakPath::PruneIndexCache();
 }
 #endif
 
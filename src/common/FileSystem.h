@@ -31,6 +31,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef COMMON_FILESYSTEM_H_
 #define COMMON_FILESYSTEM_H_
 
+#include <future>
+#include <shared_mutex>
+
 #include "Command.h"
 
 #ifdef BUILD_ENGINE
@@ -159,6 +162,64 @@ private:
 	FILE* fd;
 };
 
+// Read-only contents of a file. Depending on how the file is stored, this is
+// either a copy of the contents or the file mapped into memory.
+class FileView {
+public:
+	FileView()
+		: mapBase(nullptr), mapLength(0), mapOffset(0), mapSize(0) {}
+	explicit FileView(std::string contents)
+		: contents(std::move(contents)), mapBase(nullptr), mapLength(0), mapOffset(0), mapSize(0) {}
+
+	// Noncopyable
+	FileView(const FileView&) = delete;
+	FileView& operator=(const FileView&) = delete;
+	FileView(FileView&& other)
+		: FileView()
+	{
+		*this = std::move(other);
+	}
+	FileView& operator=(FileView&& other)
+	{
+		std::swap(contents, other.contents);
+		std::swap(mapBase, other.mapBase);
+		std::swap(mapLength, other.mapLength);
+		std::swap(mapOffset, other.mapOffset);
+		std::swap(mapSize, other.mapSize);
+		return *this;
+	}
+
+	// Unmap the file
+	~FileView();
+
+#ifndef BUILD_VM
+	// Map a range of an open file, which doesn't need to be aligned
+	static FileView Map(int fd, offset_t offset, size_t length, std::error_code& err = throws());
+#endif
+
+	const char* data() const
+	{
+		return mapBase ? static_cast<const char*>(mapBase) + mapOffset : contents.data();
+	}
+	size_t size() const
+	{
+		return mapBase ? mapSize : contents.size();
+	}
+
+	// Check whether the contents are mapped rather than copied
+	bool IsMapped() const
+	{
+		return mapBase != nullptr;
+	}
+
+private:
+	std::string contents;
+	void* mapBase;
+	size_t mapLength;
+	size_t mapOffset;
+	size_t mapSize;
+};
+
 // Path manipulation functions
 namespace Path {
 
@@ -311,6 +372,10 @@ struct LoadedPakInfo: public PakInfo {
 	// Prefix used to load this pak. This restricts the files loaded from this
 	// pak to only those that start with the prefix.
 	std::string pathPrefix;
+
+	// Whether the file list of this zip pak was read from the index cache in
+	// the homepath. This is only valid in the engine.
+	bool indexedFromCache = false;
 };
 
 // Operations which work on files that are in packages. Packages should be used
@@ -330,8 +395,25 @@ namespace PakPath {
 	void LoadPakExplicitWithoutChecksum(const PakInfo& pak, std::error_code& err = throws());
 
 #ifndef BUILD_VM
+	// A pak to load with LoadPaksExplicit, and the error it failed to load with
+	struct PakLoadRequest {
+		const PakInfo* pak;
+		Util::optional<uint32_t> expectedChecksum;
+		std::error_code err;
+	};
+
+	// Load several paks like LoadPakExplicit, or LoadPakExplicitWithoutChecksum
+	// for those without an expected checksum. The paks are indexed in parallel
+	// but added in the order given, so the result is the same as loading them
+	// one by one.
+	void LoadPaksExplicit(std::vector<PakLoadRequest>& requests);
+
 	// Remove all loaded paks
 	void ClearPaks();
+
+	// Remove the cached file lists of paks that no longer exist. This is done
+	// when the filesystem is initialized.
+	void PruneIndexCache();
 #endif
 
 	// Get a list of all the loaded paks
@@ -340,6 +422,27 @@ namespace PakPath {
 	// Read an entire file into a string
 	std::string ReadFile(Str::StringRef path, std::error_code& err = throws());
 
+	// Read an entire file without copying it when possible: files stored
+	// uncompressed in zip paks are mapped from the pak
+	FileView ReadFileView(Str::StringRef path, std::error_code& err = throws());
+
+#ifndef BUILD_VM
+	// Read an entire file on one of the file reading threads. Getting the
+	// result throws the error the read failed with.
+	std::future<std::string> ReadFileAsync(Str::StringRef path);
+
+	// Start reading a file in the background, so that the next ReadFile or
+	// ReadFileView of it only waits for that read to complete. Does nothing
+	// if the file doesn't exist or if ReadFileView would map it; the oldest
+	// prefetches are dropped if there are too many.
+	void PrefetchFile(Str::StringRef path);
+
+	// The reads above are only safe on the main thread, which loads and
+	// unloads the paks. Other threads hold this lock while they read files,
+	// so that the paks don't change meanwhile.
+	std::shared_lock<std::shared_timed_mutex> LockLoadedPaks();
+#endif
+
 	// Copy an entire file to another file
 	void CopyFile(Str::StringRef path, const File& dest, std::error_code& err = throws());
 
@@ -62,5 +62,230 @@ namespace {
         ASSERT_EQ(contents, "test2");
     }
 
+    TEST_F(FileSystemTest, ReadDeflatedZipFile)
+    {
+        std::string expected;
+        for (int i = 0; i < 1000; i++) {
+            expected += Str::Format("line %d\n", i);
+        }
+
+        // twice, the second read uses the data offset found by the first
+        for (int i = 0; i < 2; i++) {
+            std::string contents = PakPath::ReadFile("deflated.txt");
+            ASSERT_EQ(contents, expected);
+        }
+    }
+
+    TEST_F(FileSystemTest, ReadFileViewMapsStoredZipFile)
+    {
+        std::string expected;
+        for (int i = 0; i < 100000; i++) {
+            expected.push_back((i * 7 + i / 251) & 255);
+        }
+
+        FileView view = PakPath::ReadFileView("stored.bin");
+        EXPECT_TRUE(view.IsMapped());
+        ASSERT_EQ(std::string(view.data(), view.size()), expected);
+
+        FileView moved = std::move(view);
+        ASSERT_EQ(std::string(moved.data(), moved.size()), expected);
+    }
+
+    TEST_F(FileSystemTest, ReadFileViewCopiesOtherFiles)
+    {
+        FileView deflated = PakPath::ReadFileView("deflated.txt");
+        EXPECT_FALSE(deflated.IsMapped());
+        EXPECT_EQ(std::string(deflated.data(), deflated.size()), PakPath::ReadFile("deflated.txt"));
+
+        FileView dir = PakPath::ReadFileView("TEST2.TXT");
+        EXPECT_FALSE(dir.IsMapped());
+        EXPECT_EQ(std::string(dir.data(), dir.size()), "test2");
+    }
+
+    TEST_F(FileSystemTest, ReadFileAsync)
+    {
+        std::vector<std::future<std::string>> futures;
+        for (const char* name : {"deflated.txt", "stored.bin", "TEST2.TXT"}) {
+            futures.push_back(PakPath::ReadFileAsync(name));
+        }
+        std::future<std::string> missing = PakPath::ReadFileAsync("missing.txt");
+
+        EXPECT_EQ(futures[0].get(), PakPath::ReadFile("deflated.txt"));
+        EXPECT_EQ(futures[1].get(), PakPath::ReadFile("stored.bin"));
+        EXPECT_EQ(futures[2].get(), "test2");
+        EXPECT_THROW(missing.get(), std::system_error);
+    }
+
+    TEST_F(FileSystemTest, ReadPrefetchedFile)
+    {
+        std::string expected = PakPath::ReadFile("deflated.txt");
+
+        PakPath::PrefetchFile("deflated.txt");
+        PakPath::PrefetchFile("missing.txt");
+        EXPECT_EQ(PakPath::ReadFile("DEFLATED.TXT"), expected);
+
+        PakPath::PrefetchFile("deflated.txt");
+        FileView view = PakPath::ReadFileView("deflated.txt");
+        EXPECT_EQ(std::string(view.data(), view.size()), expected);
+
+        std::error_code err;
+        PakPath::ReadFile("missing.txt", err);
+        EXPECT_TRUE(err);
+    }
+
+    TEST_F(FileSystemTest, PrefetchDoesNotCopyMappedFile)
+    {
+        std::string expected = PakPath::ReadFile("stored.bin");
+
+        PakPath::PrefetchFile("stored.bin");
+        FileView view = PakPath::ReadFileView("stored.bin");
+        EXPECT_TRUE(view.IsMapped());
+        EXPECT_EQ(std::string(view.data(), view.size()), expected);
+    }
+
+    TEST_F(FileSystemTest, LoadPaksExplicitKeepsOrder)
+    {
+        // ClearPaks refreshes the list of available paks
+        PakPath::ClearPaks();
+        const PakInfo* testdpk = FindPak("testdpk", "src");
+        const PakInfo* testdata = FindPak("testdata", "src");
+        ASSERT_TRUE(testdpk && testdata);
+        std::string testdpkPath = testdpk->path;
+        std::string testdataPath = testdata->path;
+
+        std::vector<PakPath::PakLoadRequest> requests = {
+            {testdpk, 0x12345678, {}},
+            {testdata, Util::nullopt, {}},
+            {testdpk, Util::nullopt, {}},
+        };
+        PakPath::LoadPaksExplicit(requests);
+        std::vector<LoadedPakInfo> loaded = PakPath::GetLoadedPaks();
+
+        // restore the paks loaded by the fixture
+        PakPath::ClearPaks();
+        for (const char* name : {"testdata", "testdpk"}) {
+            PakPath::LoadPak(*FindPak(name, "src"));
+        }
+
+        EXPECT_TRUE(requests[0].err);
+        EXPECT_FALSE(requests[1].err);
+        EXPECT_FALSE(requests[2].err);
+        ASSERT_EQ(loaded.size(), 2u);
+        EXPECT_EQ(loaded[0].path, testdpkPath);
+        EXPECT_EQ(loaded[1].path, testdataPath);
+    }
+
+    TEST_F(FileSystemTest, PakIndexCacheMatchesArchive)
+    {
+        struct Loaded {
+            Util::optional<uint32_t> realChecksum;
+            std::vector<std::string> files;
+            std::string deflated;
+        };
+        auto load = [] {
+            PakPath::ClearPaks();
+            for (const char* name : {"testdata", "testdpk"}) {
+                PakPath::LoadPak(*FindPak(name, "src"));
+            }
+            Loaded loaded;
+            loaded.realChecksum = PakPath::GetLoadedPaks().back().realChecksum;
+            for (const std::string& file : PakPath::ListFilesRecursive("")) {
+                loaded.files.push_back(file);
+            }
+            std::sort(loaded.files.begin(), loaded.files.end());
+            loaded.deflated = PakPath::ReadFile("deflated.txt");
+            return loaded;
+        };
+
+        Cvar::SetValue("fs_pakIndexCache", "0");
+        Loaded expected = load();
+        Cvar::SetValue("fs_pakIndexCache", "1");
+
+        // start without the cache files of previous runs
+        for (const std::string& file : HomePath::ListFiles("cache/paks")) {
+            HomePath::DeleteFile("cache/paks/" + file);
+        }
+
+        // written by the first load, read by the second
+        for (int i = 0; i < 2; i++) {
+            Loaded loaded = load();
+            EXPECT_EQ(PakPath::GetLoadedPaks().back().indexedFromCache, i == 1);
+            EXPECT_EQ(loaded.realChecksum, expected.realChecksum);
+            EXPECT_EQ(loaded.files, expected.files);
+            EXPECT_EQ(loaded.deflated, expected.deflated);
+        }
+
+        // a damaged cache file is ignored
+        for (const std::string& file : HomePath::ListFiles("cache/paks")) {
+            File f = HomePath::OpenEdit("cache/paks/" + file);
+            f.SeekEnd(-1);
+            f.Write("?", 1);
+        }
+        Loaded loaded = load();
+        EXPECT_FALSE(PakPath::GetLoadedPaks().back().indexedFromCache);
+        EXPECT_EQ(loaded.realChecksum, expected.realChecksum);
+        EXPECT_EQ(loaded.files, expected.files);
+    }
+
+    TEST_F(FileSystemTest, PakIndexCacheFollowsPakChanges)
+    {
+        // a copy of testdpk in the homepath, which the test can change
+        std::string contents = RawPath::OpenRead(FindPak("testdpk", "src")->path).ReadAll();
+        auto writeCopy = [](Str::StringRef data) {
+            File file = HomePath::OpenWrite("pkg/pakindexcache_0.dpk");
+            file.Write(data.data(), data.size());
+            file.Close();
+        };
+        auto loadCopy = [] {
+            PakPath::ClearPaks();
+            const PakInfo* pak = FindPak("pakindexcache", "0");
+            EXPECT_TRUE(pak);
+            if (pak) {
+                PakPath::LoadPak(*pak);
+            }
+            return PakPath::ReadFile("deflated.txt");
+        };
+        auto restorePaks = [] {
+            PakPath::ClearPaks();
+            for (const char* name : {"testdata", "testdpk"}) {
+                PakPath::LoadPak(*FindPak(name, "src"));
+            }
+        };
+        auto numCacheFiles = [] {
+            size_t count = 0;
+            for (const std::string& file : HomePath::ListFiles("cache/paks")) {
+                count += Str::IsSuffix(".idx", file);
+            }
+            return count;
+        };
+
+        Cvar::SetValue("fs_pakIndexCache", "1");
+        std::string expected = PakPath::ReadFile("deflated.txt");
+        writeCopy(contents);
+        restorePaks();
+        size_t numOtherCacheFiles = numCacheFiles();
+
+        EXPECT_EQ(loadCopy(), expected);
+        EXPECT_FALSE(PakPath::GetLoadedPaks().back().indexedFromCache);
+        EXPECT_EQ(loadCopy(), expected);
+        EXPECT_TRUE(PakPath::GetLoadedPaks().back().indexedFromCache);
+
+        // a different size, with a zip comment which keeps the archive valid
+        std::string changed = contents + "changed";
+        changed[contents.size() - 2] = 7;
+        writeCopy(changed);
+        EXPECT_EQ(loadCopy(), expected);
+        EXPECT_FALSE(PakPath::GetLoadedPaks().back().indexedFromCache);
+        EXPECT_EQ(loadCopy(), expected);
+        EXPECT_TRUE(PakPath::GetLoadedPaks().back().indexedFromCache);
+
+        // the cache file of a deleted pak is removed
+        restorePaks();
+        EXPECT_EQ(numCacheFiles(), numOtherCacheFiles + 1);
+        HomePath::DeleteFile("pkg/pakindexcache_0.dpk");
+        PakPath::PruneIndexCache();
+        EXPECT_EQ(numCacheFiles(), numOtherCacheFiles);
+    }
+
 } // namespace
 } // namespace FS
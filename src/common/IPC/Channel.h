@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define COMMON_IPC_CHANNEL_H_
 
 #include "Primitives.h"
+#include "SharedMemoryTransport.h"
 
 namespace IPC {
 
@@ -73,6 +74,9 @@ namespace IPC {
      * the same time pass references to where the output should be written.
      * After the lambda has been called, it will serialize the outputs and
      * send it in the socket.
+     *
+     * Once both ends agree on it, the messages can be carried by a
+     * SharedMemoryTransport instead of going through the socket each time.
      */
 
     #ifdef BUILD_ENGINE
@@ -88,10 +92,12 @@ namespace IPC {
         Channel(Socket socket)
             : socket(std::move(socket)), canSendSyncMsg(TOPLEVEL_MSG_ALLOWED), canSendAsyncMsg(TOPLEVEL_MSG_ALLOWED) {}
         Channel(Channel&& other)
-            : socket(std::move(other.socket)), canSendSyncMsg(TOPLEVEL_MSG_ALLOWED), canSendAsyncMsg(TOPLEVEL_MSG_ALLOWED) {}
+            : socket(std::move(other.socket)), transport(std::move(other.transport)), canSendSyncMsg(TOPLEVEL_MSG_ALLOWED), canSendAsyncMsg(TOPLEVEL_MSG_ALLOWED) {}
         Channel& operator=(Channel&& other)
         {
             std::swap(socket, other.socket);
+            std::swap(transport, other.transport);
+            std::swap(transferredBytes, other.transferredBytes);
             canSendSyncMsg = other.canSendSyncMsg;
             canSendAsyncMsg = other.canSendAsyncMsg;
             return *this;
@@ -104,17 +110,40 @@ namespace IPC {
         // Wrappers around socket functions
         void SendMsg(const Util::Writer& writer) const
         {
-            socket.SendMsg(writer);
+            transferredBytes += writer.GetData().size();
+            if (transport)
+                transport->SendMsg(socket, writer);
+            else
+                socket.SendMsg(writer);
         }
         Util::Reader RecvMsg() const
         {
-            return socket.RecvMsg();
+            Util::Reader reader = transport ? transport->RecvMsg(socket) : socket.RecvMsg();
+            transferredBytes += reader.GetData().size();
+            return reader;
         }
         void SetRecvTimeout(std::chrono::nanoseconds timeout)
         {
             socket.SetRecvTimeout(timeout);
         }
 
+        // Switch to the shared memory transport, the engine creates it and
+        // the VM accepts it when receiving ID_SHARED_MEMORY_TRANSPORT.
+        void CreateSharedMemoryTransport(size_t size)
+        {
+            transport = SharedMemoryTransport::Create(socket, size);
+        }
+        void AcceptSharedMemoryTransport(SharedMemory shm)
+        {
+            transport = SharedMemoryTransport::Accept(std::move(shm));
+        }
+
+        // Total size of the messages sent and received, used for profiling
+        uint64_t GetTransferredBytes() const
+        {
+            return transferredBytes;
+        }
+
         // Wait for a synchronous message reply, returns the message ID and contents
         std::pair<uint32_t, Util::Reader> RecvReplyMsg()
         {
@@ -126,6 +155,8 @@ namespace IPC {
 
     private:
         Socket socket;
+        std::unique_ptr<SharedMemoryTransport> transport;
+        mutable uint64_t transferredBytes = 0;
         std::unordered_map<uint32_t, Util::Reader> replies;
 
     public:
@@ -94,6 +94,9 @@ namespace IPC {
 	const uint32_t ID_RETURN = 0xffffffff;
 	const uint32_t ID_EXIT = 0xfffffffe;
 
+	// Sent by the engine on the socket to switch a channel to the shared memory transport
+	const uint32_t ID_SHARED_MEMORY_TRANSPORT = 0xfffffffd;
+
     // Combine a major and minor ID into a single number.
     // TODO we use a template, because we need the ID to be part of template
     // arguments and some compilers do not support constexpr yet.
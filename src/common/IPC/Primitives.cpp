@@ -367,6 +367,7 @@ bool InternalRecvMsg(Sys::OSHandle handle, Util::Reader& reader)
 			reader.GetHandles().back().handle = h[i];
 		}
 	}
+	Util::ReserveMessageBuffer(reader.GetData(), reader.GetData().size() + result - 1);
 	reader.GetData().insert(reader.GetData().end(), &recvBuffer[1], &recvBuffer[result]);
 	return recvBuffer[0];
 #else
@@ -463,6 +464,7 @@ bool InternalRecvMsg(Sys::OSHandle handle, Util::Reader& reader)
 		h[i] = NACL_INVALID_HANDLE;
 	}
 
+	Util::ReserveMessageBuffer(reader.GetData(), reader.GetData().size() + result - 1);
 	reader.GetData().insert(reader.GetData().end(), &desc_end[1], &desc_end[result]);
 	return desc_end[0];
 #endif
@@ -0,0 +1,212 @@
+/*
+===========================================================================
+Daemon BSD Source Code
+Copyright (c) 2024, Daemon Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Daemon developers nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL DAEMON DEVELOPERS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+===========================================================================
+*/
+
+#include "SharedMemoryTransport.h"
+#include "CommandBuffer.h"
+
+namespace IPC {
+
+    // Layout of the shared memory region: the sleeping flags of both ends, each
+    // in its own cache line, then the ring written by the creator and the one
+    // written by the other end.
+    static const size_t CREATOR_SLEEPING_OFFSET = 0;
+    static const size_t ACCEPTOR_SLEEPING_OFFSET = 64;
+    static const size_t RINGS_OFFSET = 128;
+
+    // Header of a message in the ring, either the size of the message that
+    // follows or a marker saying the message is on the socket.
+    static const uint32_t SOCKET_MARKER = 0xffffffff;
+    static const size_t HEADER_SIZE = sizeof(uint32_t);
+
+    // How many times the ring is checked before going to sleep on the socket,
+    // long enough to cover a short syscall handled by the other end.
+    static const int SPIN_COUNT = 2000;
+
+    // Spinning on a single core only delays the other end
+    static int SpinCount()
+    {
+        static const int count = std::thread::hardware_concurrency() > 1 ? SPIN_COUNT : 0;
+        return count;
+    }
+
+    static size_t Align(size_t size)
+    {
+        return (size + 3) & ~3;
+    }
+
+    SharedMemoryTransport::SharedMemoryTransport(SharedMemory shm_, bool creator)
+        : shm(std::move(shm_)), sendRing(new CommandBuffer), recvRing(new CommandBuffer), creator(creator)
+    {
+        if (shm.GetSize() < RINGS_OFFSET + 2 * (CommandBuffer::DATA_OFFSET + 4096)) {
+            Sys::Drop("IPC: Shared memory transport of size %zu is too small", shm.GetSize());
+        }
+
+        size_t ringSize = ((shm.GetSize() - RINGS_OFFSET) / 2) & ~size_t(63);
+        char* rings = static_cast<char*>(shm.GetBase()) + RINGS_OFFSET;
+        CommandBuffer& creatorRing = creator ? *sendRing : *recvRing;
+        CommandBuffer& acceptorRing = creator ? *recvRing : *sendRing;
+        creatorRing.Init(rings, ringSize);
+        acceptorRing.Init(rings + ringSize, ringSize);
+    }
+
+    SharedMemoryTransport::~SharedMemoryTransport() = default;
+
+    std::unique_ptr<SharedMemoryTransport> SharedMemoryTransport::Create(const Socket& socket, size_t size)
+    {
+        std::unique_ptr<SharedMemoryTransport> transport(new SharedMemoryTransport(SharedMemory::Create(size), true));
+        transport->sendRing->Reset();
+        transport->recvRing->Reset();
+        transport->SleepingFlag(true).store(0);
+        transport->SleepingFlag(false).store(0);
+
+        Util::Writer writer;
+        writer.Write<uint32_t>(ID_SHARED_MEMORY_TRANSPORT);
+        writer.Write<SharedMemory>(transport->shm);
+        socket.SendMsg(writer);
+
+        return transport;
+    }
+
+    std::unique_ptr<SharedMemoryTransport> SharedMemoryTransport::Accept(SharedMemory shm)
+    {
+        return std::unique_ptr<SharedMemoryTransport>(new SharedMemoryTransport(std::move(shm), false));
+    }
+
+    std::atomic<uint32_t>& SharedMemoryTransport::SleepingFlag(bool creatorSide) const
+    {
+        char* base = static_cast<char*>(shm.GetBase());
+        return *reinterpret_cast<std::atomic<uint32_t>*>(base + (creatorSide ? CREATOR_SLEEPING_OFFSET : ACCEPTOR_SLEEPING_OFFSET));
+    }
+
+    void SharedMemoryTransport::SendMsg(const Socket& socket, const Util::Writer& writer)
+    {
+        const std::vector<char>& data = writer.GetData();
+        size_t size = Align(HEADER_SIZE + data.size());
+
+        // Always leave room for a marker after a message, so that when the
+        // ring is full the next message can go on the socket without waiting.
+        sendRing->LoadReaderData();
+        bool onSocket = !writer.GetHandles().empty() || size > sendRing->GetSize() / 4 ||
+                        !sendRing->CanWrite(size + HEADER_SIZE);
+
+        if (onSocket) {
+            // Only wait if the other end is a whole ring of messages behind
+            size = HEADER_SIZE;
+            for (int i = 0, count = SpinCount(); !sendRing->CanWrite(size); i++) {
+                if (i < count) {
+                    std::this_thread::yield();
+                } else {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                sendRing->LoadReaderData();
+            }
+            sendRing->Write(reinterpret_cast<const char*>(&SOCKET_MARKER), HEADER_SIZE);
+        } else {
+            uint32_t header = data.size();
+            sendRing->Write(reinterpret_cast<const char*>(&header), HEADER_SIZE);
+            sendRing->Write(data.data(), data.size(), HEADER_SIZE);
+        }
+        sendRing->AdvanceWritePointer(size);
+
+        // Pairs with the fence in WaitForMessage: either the receiver sees the
+        // new write pointer or we see that it is sleeping.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (SleepingFlag(!creator).exchange(0)) {
+            Util::Writer wakeup;
+            wakeup.Write<uint32_t>(0);
+            socket.SendMsg(wakeup);
+        }
+
+        if (onSocket) {
+            socket.SendMsg(writer);
+        }
+    }
+
+    bool SharedMemoryTransport::Poll()
+    {
+        recvRing->LoadWriterData();
+        return recvRing->CanRead(HEADER_SIZE);
+    }
+
+    void SharedMemoryTransport::WaitForMessage(const Socket& socket)
+    {
+        for (int i = 0, count = SpinCount(); i < count; i++) {
+            if (Poll()) {
+                return;
+            }
+        }
+
+        std::atomic<uint32_t>& sleeping = SleepingFlag(creator);
+        while (true) {
+            sleeping.store(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (Poll()) {
+                // If the flag was already cleared, the sender has sent or is
+                // about to send a wakeup that must be taken off the socket.
+                if (!sleeping.exchange(0)) {
+                    socket.RecvMsg();
+                }
+                return;
+            }
+
+            socket.RecvMsg();
+            if (Poll()) {
+                return;
+            }
+        }
+    }
+
+    Util::Reader SharedMemoryTransport::RecvMsg(const Socket& socket)
+    {
+        WaitForMessage(socket);
+
+        uint32_t header;
+        recvRing->Read(reinterpret_cast<char*>(&header), HEADER_SIZE);
+        if (header == SOCKET_MARKER) {
+            recvRing->AdvanceReadPointer(HEADER_SIZE);
+            return socket.RecvMsg();
+        }
+
+        size_t size = Align(HEADER_SIZE + header);
+        if (header > recvRing->GetSize() || !recvRing->CanRead(size)) {
+            Sys::Drop("IPC: Invalid message size %u in the shared memory transport", header);
+        }
+
+        Util::Reader reader;
+        std::vector<char>& data = reader.GetData();
+        Util::ReserveMessageBuffer(data, header);
+        data.resize(header);
+        recvRing->Read(data.data(), header, HEADER_SIZE);
+        recvRing->AdvanceReadPointer(size);
+        return reader;
+    }
+
+} // namespace IPC
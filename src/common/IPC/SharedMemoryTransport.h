@@ -0,0 +1,88 @@
+/*
+===========================================================================
+Daemon BSD Source Code
+Copyright (c) 2024, Daemon Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Daemon developers nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL DAEMON DEVELOPERS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+===========================================================================
+*/
+
+#ifndef COMMON_IPC_SHARED_MEMORY_TRANSPORT_H_
+#define COMMON_IPC_SHARED_MEMORY_TRANSPORT_H_
+
+#include "Primitives.h"
+
+namespace IPC {
+
+    struct CommandBuffer;
+
+    /*
+     * The shared memory transport carries the messages of a Channel in two
+     * circular buffers, one for each direction, that live in a single shared
+     * memory region. A synchronous call is then a pair of memory copies instead
+     * of a pair of socket round trips through the kernel.
+     *
+     * The socket stays the source of truth for everything the rings can't do:
+     *  - Messages with handles, and messages too big for the ring, are sent on
+     *    the socket and a marker is put in the ring at their place so that the
+     *    receiver reads them in order.
+     *  - A receiver first spins on the ring for a short while then marks itself
+     *    as sleeping and blocks on the socket. The sender wakes it with a small
+     *    message on the socket. This keeps the socket receive timeout and the
+     *    detection of a dead process working as before.
+     *
+     * Each end owns one of the rings for writing and the other for reading so
+     * the CommandBuffer logic can be used unchanged. (CommandBuffer.h can't be
+     * included here as it depends on the syscall definitions)
+     */
+
+    class SharedMemoryTransport {
+    public:
+        // Creates the shared memory region and sends it on the socket, to be
+        // given to Accept by the other end. Only done by the engine.
+        static std::unique_ptr<SharedMemoryTransport> Create(const Socket& socket, size_t size);
+        static std::unique_ptr<SharedMemoryTransport> Accept(SharedMemory shm);
+        ~SharedMemoryTransport();
+
+        void SendMsg(const Socket& socket, const Util::Writer& writer);
+        Util::Reader RecvMsg(const Socket& socket);
+
+    private:
+        SharedMemoryTransport(SharedMemory shm, bool creator);
+
+        // Returns true if there is a message in the receive ring
+        bool Poll();
+        void WaitForMessage(const Socket& socket);
+
+        std::atomic<uint32_t>& SleepingFlag(bool creatorSide) const;
+
+        SharedMemory shm;
+        std::unique_ptr<CommandBuffer> sendRing;
+        std::unique_ptr<CommandBuffer> recvRing;
+        bool creator;
+    };
+
+} // namespace IPC
+
+#endif // COMMON_IPC_SHARED_MEMORY_TRANSPORT_H_
@@ -0,0 +1,200 @@
+/*
+===========================================================================
+Daemon BSD Source Code
+Copyright (c) 2026, Daemon Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Daemon developers nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL DAEMON DEVELOPERS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+===========================================================================
+*/
+
+#include <gtest/gtest.h>
+
+#include "common/Common.h"
+#include "Common.h"
+#include "SharedMemoryTransport.h"
+
+namespace IPC {
+namespace {
+
+    // Small enough for the tests to wrap around the rings and to send
+    // messages that don't fit in them
+    static const size_t TRANSPORT_SIZE = 64 * 1024;
+
+    class SharedMemoryTransportTest : public ::testing::Test {
+    protected:
+        void SetUp() override
+        {
+            std::tie(engineSocket, vmSocket) = Socket::CreatePair();
+            engine = SharedMemoryTransport::Create(engineSocket, TRANSPORT_SIZE);
+
+            // The VM side of the handshake, done by the Channel in VMMain
+            Util::Reader reader = vmSocket.RecvMsg();
+            ASSERT_EQ(reader.Read<uint32_t>(), ID_SHARED_MEMORY_TRANSPORT);
+            vm = SharedMemoryTransport::Accept(reader.Read<SharedMemory>());
+        }
+
+        static Util::Writer MakeMsg(uint32_t id, size_t size)
+        {
+            Util::Writer writer;
+            writer.Write<uint32_t>(id);
+            for (size_t i = 0; i < size; i++) {
+                writer.Write<uint8_t>((id + i) & 255);
+            }
+            return writer;
+        }
+
+        // Returns the id of the message after checking its contents
+        static uint32_t CheckMsg(Util::Reader reader, size_t size)
+        {
+            uint32_t id = reader.Read<uint32_t>();
+            for (size_t i = 0; i < size; i++) {
+                EXPECT_EQ(reader.Read<uint8_t>(), (id + i) & 255);
+            }
+            reader.CheckEndRead();
+            return id;
+        }
+
+        Socket engineSocket;
+        Socket vmSocket;
+        std::unique_ptr<SharedMemoryTransport> engine;
+        std::unique_ptr<SharedMemoryTransport> vm;
+    };
+
+    TEST_F(SharedMemoryTransportTest, RequestResponseAcrossThreads)
+    {
+        const uint32_t count = 2000;
+
+        std::thread vmThread([&] {
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t id = CheckMsg(vm->RecvMsg(vmSocket), i % 100);
+                vm->SendMsg(vmSocket, MakeMsg(id + 1, i % 50));
+            }
+        });
+
+        for (uint32_t i = 0; i < count; i++) {
+            engine->SendMsg(engineSocket, MakeMsg(2 * i, i % 100));
+            EXPECT_EQ(CheckMsg(engine->RecvMsg(engineSocket), i % 50), 2 * i + 1);
+        }
+
+        vmThread.join();
+    }
+
+    // Many more bytes than a ring holds, sent and received in turn from one
+    // thread so the messages end at every position of the rings
+    TEST_F(SharedMemoryTransportTest, RingWrapsAround)
+    {
+        for (uint32_t i = 0; i < 1000; i++) {
+            size_t size = (i * 37) % 1500;
+            engine->SendMsg(engineSocket, MakeMsg(i, size));
+            EXPECT_EQ(CheckMsg(vm->RecvMsg(vmSocket), size), i);
+
+            vm->SendMsg(vmSocket, MakeMsg(i, size));
+            EXPECT_EQ(CheckMsg(engine->RecvMsg(engineSocket), size), i);
+        }
+    }
+
+    // Messages queued faster than the other end reads them fill the ring, then
+    // go on the socket until the sender has to wait for the reader
+    TEST_F(SharedMemoryTransportTest, FullRingKeepsOrder)
+    {
+        const uint32_t count = 200;
+
+        std::thread engineThread([&] {
+            for (uint32_t i = 0; i < count; i++) {
+                engine->SendMsg(engineSocket, MakeMsg(i, 1000));
+            }
+        });
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        for (uint32_t i = 0; i < count; i++) {
+            EXPECT_EQ(CheckMsg(vm->RecvMsg(vmSocket), 1000), i);
+        }
+
+        engineThread.join();
+    }
+
+    // Messages bigger than the ring and messages with handles go through the
+    // socket, in order with the ones in the ring
+    TEST_F(SharedMemoryTransportTest, MessagesOnSocketKeepOrder)
+    {
+        const size_t bigSize = TRANSPORT_SIZE / 2;
+
+        engine->SendMsg(engineSocket, MakeMsg(1, 10));
+        engine->SendMsg(engineSocket, MakeMsg(2, bigSize));
+        engine->SendMsg(engineSocket, MakeMsg(3, 10));
+
+        Util::Writer withHandle = MakeMsg(4, 0);
+        SharedMemory shm = SharedMemory::Create(4096);
+        static_cast<char*>(shm.GetBase())[0] = 42;
+        withHandle.Write<SharedMemory>(shm);
+        engine->SendMsg(engineSocket, withHandle);
+
+        engine->SendMsg(engineSocket, MakeMsg(5, 10));
+
+        EXPECT_EQ(CheckMsg(vm->RecvMsg(vmSocket), 10), 1u);
+        EXPECT_EQ(CheckMsg(vm->RecvMsg(vmSocket), bigSize), 2u);
+        EXPECT_EQ(CheckMsg(vm->RecvMsg(vmSocket), 10), 3u);
+
+        Util::Reader reader = vm->RecvMsg(vmSocket);
+        EXPECT_EQ(reader.Read<uint32_t>(), 4u);
+        SharedMemory received = reader.Read<SharedMemory>();
+        EXPECT_EQ(static_cast<char*>(received.GetBase())[0], 42);
+
+        EXPECT_EQ(CheckMsg(vm->RecvMsg(vmSocket), 10), 5u);
+    }
+
+    // A receiver which has been waiting for longer than it spins sleeps on the
+    // socket and must be woken up by the sender
+    TEST_F(SharedMemoryTransportTest, SleepingReceiverIsWokenUp)
+    {
+        for (uint32_t i = 0; i < 5; i++) {
+            std::thread vmThread([&] {
+                EXPECT_EQ(CheckMsg(vm->RecvMsg(vmSocket), 10), i);
+            });
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            engine->SendMsg(engineSocket, MakeMsg(i, 10));
+            vmThread.join();
+        }
+
+        // the wakeups were all consumed, the next message comes from the ring
+        engine->SendMsg(engineSocket, MakeMsg(5, 10));
+        EXPECT_EQ(CheckMsg(vm->RecvMsg(vmSocket), 10), 5u);
+    }
+
+    // The receiver must be the main thread, Sys::Drop is fatal on the others
+    TEST_F(SharedMemoryTransportTest, PeerDeathIsDetected)
+    {
+        std::thread engineThread([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            engine.reset();
+            engineSocket.Close();
+        });
+
+        EXPECT_THROW(vm->RecvMsg(vmSocket), Sys::DropErr);
+        engineThread.join();
+    }
+
+} // namespace
+} // namespace IPC
@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef COMMON_SERIALIZATION_H_
 #define COMMON_SERIALIZATION_H_
 
+#include <atomic>
 #include <limits>
 #include <map>
 #include <set>
@@ -71,11 +72,47 @@ namespace Util {
 	// Trait declaration for the serialization trait.
 	template<typename T, typename = void> struct SerializeTraits {};
 
+	/*
+	 * The data of Writers and Readers comes from a per-thread pool of buffers
+	 * which keep their capacity, so that once the buffers have grown to the
+	 * usual message sizes, building and receiving messages doesn't allocate.
+	 */
+	struct MessageBufferStats {
+		std::atomic<uint64_t> acquired; // buffers handed to Writers and Readers
+		std::atomic<uint64_t> grown; // buffers created or grown by ReserveMessageBuffer
+		std::atomic<uint64_t> allocated; // heap allocations for the buffers and their pools
+	};
+	MessageBufferStats& GetMessageBufferStats();
+	std::vector<char> AcquireMessageBuffer();
+	void ReleaseMessageBuffer(std::vector<char> buffer);
+
+	// Make room for size bytes, counting the growth if there wasn't enough
+	inline void ReserveMessageBuffer(std::vector<char>& buffer, size_t size)
+	{
+		if (size > buffer.capacity()) {
+			GetMessageBufferStats().grown++;
+			GetMessageBufferStats().allocated++;
+			buffer.reserve(std::max(size, 2 * buffer.capacity()));
+		}
+	}
+
 	// Class to generate messages
 	class Writer {
 	public:
+		Writer()
+			: data(AcquireMessageBuffer()) {}
+		Writer(const Writer&) = default;
+		Writer(Writer&&) = default;
+		Writer& operator=(const Writer&) = default;
+		Writer& operator=(Writer&&) = default;
+		~Writer()
+		{
+			ReleaseMessageBuffer(std::move(data));
+		}
+
 		void WriteData(const void* p, size_t len)
 		{
+			ReserveMessageBuffer(data, data.size() + len);
 			data.insert(data.end(), static_cast<const char*>(p), static_cast<const char*>(p) + len);
 		}
 		void WriteSize(size_t size)
@@ -131,7 +168,7 @@ namespace Util {
 	class Reader {
 	public:
 		Reader()
-			: pos(0), handles_pos(0) {}
+			: data(AcquireMessageBuffer()), pos(0), handles_pos(0) {}
 		Reader(Reader&& other) NOEXCEPT
 			: data(std::move(other.data)), handles(std::move(other.handles)), pos(other.pos), handles_pos(other.handles_pos) {}
 		Reader& operator=(Reader&& other) NOEXCEPT
@@ -147,6 +184,8 @@ namespace Util {
 			// Close any handles that weren't read
 			for (size_t i = handles_pos; i < handles.size(); i++)
 				handles[i].Close();
+
+			ReleaseMessageBuffer(std::move(data));
 		}
 
 		void ReadData(void* p, size_t len)
@@ -201,6 +240,11 @@ namespace Util {
 				Sys::Drop("Reader: Unexpected end of message");
 		}
 
+		bool HasUnreadData() const
+		{
+			return pos != data.size();
+		}
+
 		void CheckEndRead()
 		{
 			if (pos != data.size())
@@ -0,0 +1,104 @@
+/*
+===========================================================================
+Daemon BSD Source Code
+Copyright (c) 2026, Daemon Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Daemon developers nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL DAEMON DEVELOPERS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+===========================================================================
+*/
+
+#include "Common.h"
+#include "ThreadPool.h"
+
+namespace Sys {
+
+    ThreadPool::ThreadPool(std::string name, const Cvar::Cvar<int>& numThreads)
+    : name(std::move(name)), numThreads(numThreads) {
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread: threads) {
+            thread.join();
+        }
+    }
+
+    void ThreadPool::Enqueue(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (threads.empty()) {
+                Start();
+            }
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    void ThreadPool::Wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return tasks.empty() && busy == 0; });
+    }
+
+    void ThreadPool::Start() {
+        unsigned count = std::max(numThreads.Get(), 0);
+        if (count == 0) {
+            count = Math::Clamp(std::thread::hardware_concurrency(), 1u, 4u);
+        }
+        for (unsigned i = 0; i < count; i++) {
+            try {
+                threads.emplace_back(&ThreadPool::Run, this);
+            } catch (std::system_error&) {
+                break;
+            }
+        }
+        if (threads.empty()) {
+            Sys::Error("Could not start any %s thread", name);
+        }
+    }
+
+    void ThreadPool::Run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            std::function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+            busy++;
+            lock.unlock();
+            task();
+            lock.lock();
+            busy--;
+            if (tasks.empty() && busy == 0) {
+                idle.notify_all();
+            }
+        }
+    }
+
+}
@@ -0,0 +1,82 @@
+/*
+===========================================================================
+Daemon BSD Source Code
+Copyright (c) 2026, Daemon Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Daemon developers nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL DAEMON DEVELOPERS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+===========================================================================
+*/
+
+#ifndef COMMON_THREAD_POOL_H_
+#define COMMON_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Cvar {
+    template<typename T> class Cvar;
+}
+
+namespace Sys {
+
+    // Threads running queued tasks in the background. They are started on
+    // first use, as many as the cvar says then, 0 meaning one per core up
+    // to 4. The tasks left in the queue are run before the pool is destroyed.
+    class ThreadPool {
+        public:
+            // The name is what the threads do, used in errors
+            ThreadPool(std::string name, const Cvar::Cvar<int>& numThreads);
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+            ~ThreadPool();
+
+            void Enqueue(std::function<void()> task);
+
+            // Wait until the queued tasks are done
+            void Wait();
+
+        private:
+            // Must be called with the lock held
+            void Start();
+            void Run();
+
+            std::string name;
+            const Cvar::Cvar<int>& numThreads;
+            std::mutex mutex;
+            std::condition_variable wake;
+            std::condition_variable idle;
+            std::deque<std::function<void()>> tasks;
+            std::vector<std::thread> threads;
+            size_t busy = 0;
+            bool stopping = false;
+    };
+
+}
+
+#endif // COMMON_THREAD_POOL_H_
@@ -54,4 +54,81 @@ void UpdateFPSCounter(float halfLife, int frameMs, float& fps)
 	}
 }
 
+static MessageBufferStats messageBufferStats;
+
+// Buffers kept per thread, larger ones are freed instead of being kept
+static const size_t MAX_POOLED_MESSAGE_BUFFERS = 8;
+static const size_t MAX_POOLED_MESSAGE_CAPACITY = 1 << 20;
+
+#ifdef BUILD_ENGINE
+thread_local
+#endif
+static bool messageBufferPoolDestroyed;
+
+namespace {
+struct MessageBufferPoolGuard {
+	~MessageBufferPoolGuard()
+	{
+		messageBufferPoolDestroyed = true;
+	}
+};
+} // namespace
+
+// Returns nullptr once the pool is destroyed, Writers and Readers can be
+// destroyed later than it at exit
+static std::vector<std::vector<char>>* MessageBufferPool()
+{
+#ifdef BUILD_ENGINE
+	thread_local
+#endif
+	static std::vector<std::vector<char>> pool;
+
+	// destroyed before the pool since it is constructed after it
+#ifdef BUILD_ENGINE
+	thread_local
+#endif
+	static MessageBufferPoolGuard guard;
+
+	return messageBufferPoolDestroyed ? nullptr : &pool;
+}
+
+MessageBufferStats& GetMessageBufferStats()
+{
+	return messageBufferStats;
+}
+
+std::vector<char> AcquireMessageBuffer()
+{
+	messageBufferStats.acquired++;
+
+	auto* pool = MessageBufferPool();
+	if (!pool || pool->empty()) {
+		return {};
+	}
+
+	std::vector<char> buffer = std::move(pool->back());
+	pool->pop_back();
+	return buffer;
+}
+
+void ReleaseMessageBuffer(std::vector<char> buffer)
+{
+	auto* pool = MessageBufferPool();
+	if (!pool || buffer.capacity() == 0 || buffer.capacity() > MAX_POOLED_MESSAGE_CAPACITY) {
+		return;
+	}
+
+	if (pool->size() >= MAX_POOLED_MESSAGE_BUFFERS) {
+		return;
+	}
+
+	if (pool->capacity() == 0) {
+		messageBufferStats.allocated++;
+		pool->reserve(MAX_POOLED_MESSAGE_BUFFERS);
+	}
+
+	buffer.clear();
+	pool->push_back(std::move(buffer));
+}
+
 } // namespace Util
@@ -30,7 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <gtest/gtest.h>
 
-#include "Util.h"
+#include "Common.h"
 
 namespace Util {
 	namespace {
@@ -75,5 +75,40 @@ namespace Util {
 			// 0.5 * 60 + 0.5 * 2
 			EXPECT_FLOAT_EQ(31, counter);
 		}
+
+		TEST(MessageBufferTest, SteadyStateDoesNotAllocate)
+		{
+			char payload[300];
+			memset(payload, 'x', sizeof(payload));
+			auto roundTrip = [&] {
+				Writer writer;
+				writer.Write<uint32_t>(42);
+				writer.WriteData(payload, sizeof(payload));
+
+				// copied through the pool functions, so that the copy is counted
+				Reader reader;
+				ReserveMessageBuffer(reader.GetData(), writer.GetData().size());
+				reader.GetData().assign(writer.GetData().begin(), writer.GetData().end());
+				char received[sizeof(payload)];
+				EXPECT_EQ(42u, reader.Read<uint32_t>());
+				reader.ReadData(received, sizeof(received));
+				EXPECT_EQ(0, memcmp(payload, received, sizeof(payload)));
+				reader.CheckEndRead();
+			};
+
+			// let the pooled buffers grow
+			roundTrip();
+			roundTrip();
+
+			uint64_t allocated = GetMessageBufferStats().allocated;
+			uint64_t grown = GetMessageBufferStats().grown;
+			uint64_t acquired = GetMessageBufferStats().acquired;
+			for (int i = 0; i < 100; i++) {
+				roundTrip();
+			}
+			EXPECT_EQ(allocated, GetMessageBufferStats().allocated);
+			EXPECT_EQ(grown, GetMessageBufferStats().grown);
+			EXPECT_EQ(acquired + 200, GetMessageBufferStats().acquired);
+		}
 	} // namespace
 } // namespace Util
@@ -0,0 +1,510 @@
+/*
+===========================================================================
+Daemon BSD Source Code
+Copyright (c) 2026, Daemon Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Daemon developers nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL DAEMON DEVELOPERS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+===========================================================================
+*/
+
+#include "cm_local.h"
+#include "common/FileSystem.h"
+
+/*
+================================================================================
+
+COLLISION CACHE
+
+Generating the facets of the patches and triangle soups is the slowest part of
+loading a map, and the result only depends on the map. It is saved in the
+homepath after the first load and read back with a single read afterwards.
+
+The cache is keyed by a checksum of the map and its external entities. A cache
+written by another version or architecture, whose contents do not match their
+checksum, or which has an index out of range, is ignored and replaced.
+
+The area flood data is not cached: all the area portals are closed when a map
+is loaded, so CM_FloodAreaConnections only numbers the areas.
+
+================================================================================
+*/
+
+static Cvar::Cvar<bool> cm_cache(VM_STRING_PREFIX "cm_cache",
+	"cache the collision data of map surfaces in the homepath", Cvar::NONE, true);
+
+static const char CM_CACHE_MAGIC[ 4 ] = { 'C', 'M', 'C', 'H' };
+static const uint32_t CM_CACHE_VERSION = 1;
+
+struct cacheHeader_t
+{
+	char     magic[ 4 ];
+	uint32_t version;
+
+	// the records are raw structures, which differ between architectures
+	uint32_t surfaceCollideSize;
+	uint32_t planeSize;
+	uint32_t facetSize;
+	uint32_t facetNodeSize;
+
+	uint64_t mapChecksum;
+	uint32_t triangleSoups;
+	uint32_t numSurfaces;
+	uint32_t numRecords;
+	uint32_t pad;
+	uint64_t dataLength;
+	uint64_t dataChecksum;
+};
+
+// One per surface collide, followed by its planes, facets, facet nodes and
+// facet order. The pointers of the collide are fixed up on load.
+struct cacheRecord_t
+{
+	int32_t           surfaceNum;
+	cSurfaceCollide_t sc;
+};
+
+static size_t CM_CacheAlign( size_t size )
+{
+	return ( size + 7 ) & ~size_t( 7 );
+}
+
+static std::string CM_CachePath( Str::StringRef name )
+{
+	return "cache/maps/" + name + ".cmc";
+}
+
+static size_t CM_CacheRecordSize( int numPlanes, int numFacets, int numFacetNodes )
+{
+	return CM_CacheAlign( sizeof( cacheRecord_t ) )
+	     + CM_CacheAlign( numPlanes * sizeof( cPlane_t ) )
+	     + CM_CacheAlign( numFacets * sizeof( cFacet_t ) )
+	     + CM_CacheAlign( numFacetNodes * sizeof( cFacetNode_t ) )
+	     + CM_CacheAlign( numFacets * sizeof( int ) );
+}
+
+static void CM_SetCacheHeaderLayout( cacheHeader_t *header )
+{
+	memcpy( header->magic, CM_CACHE_MAGIC, sizeof( header->magic ) );
+	header->version = CM_CACHE_VERSION;
+	header->surfaceCollideSize = sizeof( cSurfaceCollide_t );
+	header->planeSize = sizeof( cPlane_t );
+	header->facetSize = sizeof( cFacet_t );
+	header->facetNodeSize = sizeof( cFacetNode_t );
+}
+
+/*
+==================
+CM_CacheChecksum
+
+64-bit FNV-1a, over whole words where possible
+==================
+*/
+uint64_t CM_CacheChecksum( const void *data, size_t length, uint64_t hash )
+{
+	static const uint64_t FNV_PRIME = 1099511628211ULL;
+	const byte *p = static_cast<const byte *>( data );
+
+	for ( ; length >= sizeof( uint64_t ); length -= sizeof( uint64_t ), p += sizeof( uint64_t ) )
+	{
+		uint64_t word;
+		memcpy( &word, p, sizeof( word ) );
+		hash = ( hash ^ word ) * FNV_PRIME;
+	}
+
+	for ( ; length; length--, p++ )
+	{
+		hash = ( hash ^ *p ) * FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/*
+==================
+CM_ValidateFacetTree
+
+The traces walk the tree with a fixed size stack, and without checking the
+node and facet numbers
+==================
+*/
+static const int MAX_CACHED_FACET_TREE_DEPTH = 32;
+
+static bool CM_ValidateFacetTree( const cSurfaceCollide_t *sc )
+{
+	struct nodeDepth_t
+	{
+		int nodeNum;
+		int depth;
+	};
+
+	nodeDepth_t stack[ MAX_CACHED_FACET_TREE_DEPTH + 1 ];
+	int         stackSize = 0;
+	int         visited = 0;
+
+	stack[ stackSize++ ] = { 0, 0 };
+
+	while ( stackSize )
+	{
+		nodeDepth_t n = stack[ --stackSize ];
+		const cFacetNode_t *node = &sc->facetNodes[ n.nodeNum ];
+
+		// a node reached twice makes the walk longer than the tree
+		if ( ++visited > sc->numFacetNodes )
+		{
+			return false;
+		}
+
+		if ( node->numFacets )
+		{
+			if ( node->numFacets < 0 || node->firstFacet < 0 || node->firstFacet > sc->numFacets - node->numFacets )
+			{
+				return false;
+			}
+
+			continue;
+		}
+
+		// the children come after their parent, so there are no cycles
+		if ( n.depth >= MAX_CACHED_FACET_TREE_DEPTH
+		     || n.nodeNum + 1 >= sc->numFacetNodes
+		     || node->secondChild <= n.nodeNum + 1 || node->secondChild >= sc->numFacetNodes )
+		{
+			return false;
+		}
+
+		stack[ stackSize++ ] = { node->secondChild, n.depth + 1 };
+		stack[ stackSize++ ] = { n.nodeNum + 1, n.depth + 1 };
+	}
+
+	return true;
+}
+
+/*
+==================
+CM_ValidateCachedCollide
+
+A cache which matches its checksum may still come from another build or have
+been edited, check every index the traces use
+==================
+*/
+static bool CM_ValidateCachedCollide( cSurfaceCollide_t *sc )
+{
+	for ( int i = 0; i < sc->numPlanes; i++ )
+	{
+		if ( sc->planes[ i ].signbits < 0 || sc->planes[ i ].signbits > 7 )
+		{
+			return false;
+		}
+
+		sc->planes[ i ].hashChain = nullptr;
+	}
+
+	for ( int i = 0; i < sc->numFacets; i++ )
+	{
+		const cFacet_t *facet = &sc->facets[ i ];
+
+		if ( facet->surfacePlane < 0 || facet->surfacePlane >= sc->numPlanes
+		     || facet->numBorders < 0 || facet->numBorders > MAX_FACET_BEVELS )
+		{
+			return false;
+		}
+
+		for ( int j = 0; j < facet->numBorders; j++ )
+		{
+			if ( facet->borderPlanes[ j ] < 0 || facet->borderPlanes[ j ] >= sc->numPlanes )
+			{
+				return false;
+			}
+		}
+	}
+
+	if ( !sc->numFacetNodes )
+	{
+		return true;
+	}
+
+	for ( int i = 0; i < sc->numFacets; i++ )
+	{
+		if ( sc->facetOrder[ i ] < 0 || sc->facetOrder[ i ] >= sc->numFacets )
+		{
+			return false;
+		}
+	}
+
+	return CM_ValidateFacetTree( sc );
+}
+
+/*
+==================
+CM_ParseCollisionCache
+
+Points the collides into the buffer, or returns false if it isn't a usable
+cache for the map
+==================
+*/
+static bool CM_ParseCollisionCache( Str::StringRef path, byte *buffer, size_t length, uint64_t mapChecksum,
+                                    bool triangleSoups, std::vector<cSurfaceCollide_t *> &collides )
+{
+	cacheHeader_t expected{};
+	CM_SetCacheHeaderLayout( &expected );
+
+	const cacheHeader_t *header = reinterpret_cast<const cacheHeader_t *>( buffer );
+	byte *data = buffer + sizeof( cacheHeader_t );
+	int numSurfaces = collides.size();
+
+	if ( memcmp( header->magic, expected.magic, sizeof( expected.magic ) )
+	     || header->version != expected.version
+	     || header->surfaceCollideSize != expected.surfaceCollideSize
+	     || header->planeSize != expected.planeSize
+	     || header->facetSize != expected.facetSize
+	     || header->facetNodeSize != expected.facetNodeSize )
+	{
+		cmLog.Verbose( "Collision cache %s has a different format", path );
+		return false;
+	}
+
+	if ( header->mapChecksum != mapChecksum
+	     || header->triangleSoups != uint32_t( triangleSoups )
+	     || header->numSurfaces != uint32_t( numSurfaces ) )
+	{
+		cmLog.Verbose( "Collision cache %s is out of date", path );
+		return false;
+	}
+
+	if ( header->dataLength != length - sizeof( cacheHeader_t )
+	     || header->dataChecksum != CM_CacheChecksum( data, header->dataLength ) )
+	{
+		cmLog.Warn( "Collision cache %s is corrupted", path );
+		return false;
+	}
+
+	size_t offset = 0;
+
+	for ( uint32_t i = 0; i < header->numRecords; i++ )
+	{
+		if ( length - sizeof( cacheHeader_t ) - offset < sizeof( cacheRecord_t ) )
+		{
+			cmLog.Warn( "Collision cache %s is truncated", path );
+			return false;
+		}
+
+		cacheRecord_t *record = reinterpret_cast<cacheRecord_t *>( data + offset );
+		cSurfaceCollide_t *sc = &record->sc;
+
+		if ( record->surfaceNum < 0 || record->surfaceNum >= numSurfaces || collides[ record->surfaceNum ]
+		     || sc->numPlanes < 0 || sc->numFacets < 0 || sc->numFacetNodes < 0
+		     || CM_CacheRecordSize( sc->numPlanes, sc->numFacets, sc->numFacetNodes ) > length - sizeof( cacheHeader_t ) - offset )
+		{
+			cmLog.Warn( "Collision cache %s has a bad record", path );
+			return false;
+		}
+
+		byte *p = data + offset + CM_CacheAlign( sizeof( cacheRecord_t ) );
+		sc->planes = reinterpret_cast<cPlane_t *>( p );
+		p += CM_CacheAlign( sc->numPlanes * sizeof( cPlane_t ) );
+		sc->facets = reinterpret_cast<cFacet_t *>( p );
+		p += CM_CacheAlign( sc->numFacets * sizeof( cFacet_t ) );
+		sc->facetNodes = sc->numFacetNodes ? reinterpret_cast<cFacetNode_t *>( p ) : nullptr;
+		p += CM_CacheAlign( sc->numFacetNodes * sizeof( cFacetNode_t ) );
+		sc->facetOrder = sc->numFacetNodes ? reinterpret_cast<int *>( p ) : nullptr;
+
+		if ( !CM_ValidateCachedCollide( sc ) )
+		{
+			cmLog.Warn( "Collision cache %s has a bad surface collide", path );
+			return false;
+		}
+
+		collides[ record->surfaceNum ] = sc;
+		offset += CM_CacheRecordSize( sc->numPlanes, sc->numFacets, sc->numFacetNodes );
+	}
+
+	cmLog.Debug( "Loaded %d surface collides from %s", header->numRecords, path );
+	return true;
+}
+
+/*
+==================
+CM_LoadCollisionCache
+
+Fills the cached surface collides indexed by surface number, or returns false
+if there is no usable cache for the map. Surfaces without a collide are null.
+==================
+*/
+bool CM_LoadCollisionCache( Str::StringRef name, uint64_t mapChecksum, bool triangleSoups, int numSurfaces,
+                            std::vector<cSurfaceCollide_t *> &collides )
+{
+	collides.clear();
+
+	if ( !cm_cache.Get() )
+	{
+		return false;
+	}
+
+	std::string path = CM_CachePath( name );
+	std::error_code err;
+	FS::File file = FS::HomePath::OpenRead( path, err );
+
+	if ( err )
+	{
+		return false;
+	}
+
+	size_t length = file.Length( err );
+
+	if ( err || length < sizeof( cacheHeader_t ) )
+	{
+		return false;
+	}
+
+	// the collides point into the buffer, so it lives as long as the map
+	byte *buffer = ( byte * ) CM_Alloc( length );
+	file.Read( buffer, length, err );
+	collides.resize( numSurfaces );
+
+	if ( err || !CM_ParseCollisionCache( path, buffer, length, mapChecksum, triangleSoups, collides ) )
+	{
+		CM_Free( buffer );
+		collides.clear();
+		return false;
+	}
+
+	return true;
+}
+
+/*
+==================
+CM_SaveCollisionCache
+
+Writes the surface collides of the loaded map
+==================
+*/
+void CM_SaveCollisionCache( Str::StringRef name, uint64_t mapChecksum, bool triangleSoups )
+{
+	if ( !cm_cache.Get() )
+	{
+		return;
+	}
+
+	size_t dataLength = 0;
+	uint32_t numRecords = 0;
+
+	for ( int i = 0; i < cm.numSurfaces; i++ )
+	{
+		const cSurface_t *surface = cm.surfaces[ i ];
+
+		if ( surface && surface->sc )
+		{
+			dataLength += CM_CacheRecordSize( surface->sc->numPlanes, surface->sc->numFacets, surface->sc->numFacetNodes );
+			numRecords++;
+		}
+	}
+
+	// zero filled so that the padding is deterministic
+	std::vector<byte> buffer( sizeof( cacheHeader_t ) + dataLength );
+	byte *data = buffer.data() + sizeof( cacheHeader_t );
+	byte *p = data;
+
+	for ( int i = 0; i < cm.numSurfaces; i++ )
+	{
+		const cSurface_t *surface = cm.surfaces[ i ];
+
+		if ( !surface || !surface->sc )
+		{
+			continue;
+		}
+
+		const cSurfaceCollide_t *sc = surface->sc;
+
+		cacheRecord_t *record = reinterpret_cast<cacheRecord_t *>( p );
+		record->surfaceNum = i;
+		VectorCopy( sc->bounds[ 0 ], record->sc.bounds[ 0 ] );
+		VectorCopy( sc->bounds[ 1 ], record->sc.bounds[ 1 ] );
+		record->sc.numPlanes = sc->numPlanes;
+		record->sc.numFacets = sc->numFacets;
+		record->sc.numFacetNodes = sc->numFacetNodes;
+		p += CM_CacheAlign( sizeof( cacheRecord_t ) );
+
+		cPlane_t *planes = reinterpret_cast<cPlane_t *>( p );
+
+		for ( int j = 0; j < sc->numPlanes; j++ )
+		{
+			planes[ j ].plane = sc->planes[ j ].plane;
+			planes[ j ].signbits = sc->planes[ j ].signbits;
+		}
+
+		p += CM_CacheAlign( sc->numPlanes * sizeof( cPlane_t ) );
+
+		std::copy_n( sc->facets, sc->numFacets, reinterpret_cast<cFacet_t *>( p ) );
+		p += CM_CacheAlign( sc->numFacets * sizeof( cFacet_t ) );
+
+		std::copy_n( sc->facetNodes, sc->numFacetNodes, reinterpret_cast<cFacetNode_t *>( p ) );
+		p += CM_CacheAlign( sc->numFacetNodes * sizeof( cFacetNode_t ) );
+
+		if ( sc->numFacetNodes )
+		{
+			std::copy_n( sc->facetOrder, sc->numFacets, reinterpret_cast<int *>( p ) );
+		}
+
+		p += CM_CacheAlign( sc->numFacets * sizeof( int ) );
+	}
+
+	cacheHeader_t *header = reinterpret_cast<cacheHeader_t *>( buffer.data() );
+	CM_SetCacheHeaderLayout( header );
+	header->mapChecksum = mapChecksum;
+	header->triangleSoups = triangleSoups;
+	header->numSurfaces = cm.numSurfaces;
+	header->numRecords = numRecords;
+	header->dataLength = dataLength;
+	header->dataChecksum = CM_CacheChecksum( data, dataLength );
+
+	// write to a temporary file first so that an interrupted write doesn't leave a broken cache
+	std::string path = CM_CachePath( name );
+	std::string tempPath = path + ".tmp";
+	std::error_code err;
+
+	FS::File file = FS::HomePath::OpenWrite( tempPath, err );
+
+	if ( !err )
+	{
+		file.Write( buffer.data(), buffer.size(), err );
+	}
+
+	if ( !err )
+	{
+		file.Close( err );
+	}
+
+	if ( !err )
+	{
+		FS::HomePath::MoveFile( path, tempPath, err );
+	}
+
+	if ( err )
+	{
+		cmLog.Warn( "Could not write collision cache %s: %s", path, err.message() );
+		return;
+	}
+
+	cmLog.Debug( "Saved %d surface collides to %s", numRecords, path );
+}
@@ -38,23 +38,37 @@ Maryland 20850 USA.
 
 // to allow boxes to be treated as brush models, we allocate
 // some extra indexes along with those needed by the map
-static const int BOX_LEAF_BRUSHES = 1; // ydnar
-static const int BOX_BRUSHES      = 1;
-static const int BOX_SIDES        = 6;
 static const int BOX_LEAFS        = 2;
+
+// the brushes and planes of the box model are kept per thread instead
+static const int BOX_SIDES        = 6;
 static const int BOX_PLANES       = 12;
 
 #define LL( x ) x = LittleLong( x )
 
 clipMap_t cm;
-int       c_pointcontents;
-int       c_traces, c_brush_traces, c_patch_traces, c_trisoup_traces;
+std::atomic<int> c_pointcontents;
+std::atomic<int> c_traces, c_brush_traces, c_patch_traces, c_trisoup_traces;
 
-static cmodel_t  box_model;
-static cplane_t  *box_planes;
-static cbrush_t  *box_brush;
+// The model returned by CM_TempBoxModel, one per thread so that traces
+// can run concurrently. Its leaf references its brush as cm.numBrushes.
+struct boxHull_t
+{
+	cmodel_t     model;
+	cplane_t     planes[ BOX_PLANES ];
+	cbrushside_t sides[ BOX_SIDES ];
+	cbrush_t     brush;
+	int          leafBrush;
+	bool         initialized;
+};
+
+#ifdef BUILD_ENGINE
+thread_local
+#endif
+static boxHull_t boxHull;
+
+static boxHull_t *CM_BoxHull();
 
-void      CM_InitBoxHull();
 void      CM_FloodAreaConnections();
 
 Cvar::Cvar<bool> cm_forceTriangles(VM_STRING_PREFIX "cm_forceTriangles", "Convert all patches into triangles?", Cvar::CHEAT | Cvar::ROM, false);
@@ -70,6 +84,15 @@ void* CM_Alloc( size_t size )
     return alloc;
 }
 
+// Free an allocation before the map is cleared
+void CM_Free( void *alloc )
+{
+    auto it = std::find(allocations.rbegin(), allocations.rend(), alloc);
+    if (it == allocations.rend()) Sys::Error("CM_Free: Unknown allocation");
+    allocations.erase(std::next(it).base());
+    free(alloc);
+}
+
 void CM_FreeAll()
 {
     for (auto alloc : allocations)
@@ -257,6 +280,56 @@ void CM_BoundBrush( cbrush_t *b )
 	b->bounds[ 1 ][ 2 ] = b->sides[ 5 ].plane->dist;
 }
 
+/*
+=================
+CM_LoadBrushPlanes
+
+Copies the brush planes for the SIMD brush tests. The planes completing
+the last block of a brush have a null normal and a huge distance, so that
+all traces are behind them.
+=================
+*/
+static void CM_LoadBrushPlanes()
+{
+	int numBlocks = 0;
+
+	for ( int i = 0; i < cm.numBrushes; i++ )
+	{
+		numBlocks += ( cm.brushes[ i ].numsides + 3 ) / 4;
+	}
+
+	cbrushPlanes_t *block = ( cbrushPlanes_t * ) CM_Alloc( numBlocks * sizeof( *block ) );
+
+	for ( int i = 0; i < cm.numBrushes; i++ )
+	{
+		cbrush_t *brush = &cm.brushes[ i ];
+		brush->planes = block;
+
+		for ( int j = 0; j < ( brush->numsides + 3 ) / 4 * 4; j++ )
+		{
+			int lane = j & 3;
+
+			if ( j < brush->numsides )
+			{
+				const cplane_t *plane = brush->sides[ j ].plane;
+				block->normal[ 0 ][ lane ] = plane->normal[ 0 ];
+				block->normal[ 1 ][ lane ] = plane->normal[ 1 ];
+				block->normal[ 2 ][ lane ] = plane->normal[ 2 ];
+				block->dist[ lane ] = plane->dist;
+			}
+			else
+			{
+				block->dist[ lane ] = 1.0e30f;
+			}
+
+			if ( lane == 3 )
+			{
+				block++;
+			}
+		}
+	}
+}
+
 /*
 =================
 CMod_LoadBrushes
@@ -279,7 +352,7 @@ static void CMod_LoadBrushes(const byte *const cmod_base, const lump_t *l)
 
 	count = l->filelen / sizeof( *in );
 
-	cm.brushes = ( cbrush_t * ) CM_Alloc( ( BOX_BRUSHES + count ) * sizeof( *cm.brushes ) );
+	cm.brushes = ( cbrush_t * ) CM_Alloc( count * sizeof( *cm.brushes ) );
 	cm.numBrushes = count;
 
 	out = cm.brushes;
@@ -300,6 +373,8 @@ static void CMod_LoadBrushes(const byte *const cmod_base, const lump_t *l)
 
 		CM_BoundBrush( out );
 	}
+
+	CM_LoadBrushPlanes();
 }
 
 /*
@@ -383,7 +458,7 @@ static void CMod_LoadPlanes(const byte *const cmod_base, const lump_t *l)
 		Sys::Drop( "Map with no planes" );
 	}
 
-	cm.planes = ( cplane_t * ) CM_Alloc( ( BOX_PLANES + count ) * sizeof( *cm.planes ) );
+	cm.planes = ( cplane_t * ) CM_Alloc( count * sizeof( *cm.planes ) );
 	cm.numPlanes = count;
 
 	out = cm.planes;
@@ -423,7 +498,7 @@ static void CMod_LoadLeafBrushes(const byte *const cmod_base, const lump_t *l)
 	count = l->filelen / sizeof( *in );
 
 	// ydnar: more than <count> brushes are stored in leafbrushes...
-	cm.leafbrushes = ( int * ) CM_Alloc( ( BOX_LEAF_BRUSHES + count ) * sizeof( *cm.leafbrushes ) );
+	cm.leafbrushes = ( int * ) CM_Alloc( count * sizeof( *cm.leafbrushes ) );
 	cm.numLeafBrushes = count;
 
 	out = cm.leafbrushes;
@@ -489,7 +564,7 @@ static void CMod_LoadBrushSides(const byte *const cmod_base, const lump_t *l)
 
 	count = l->filelen / sizeof( *in );
 
-	cm.brushsides = ( cbrushside_t * ) CM_Alloc( ( BOX_SIDES + count ) * sizeof( *cm.brushsides ) );
+	cm.brushsides = ( cbrushside_t * ) CM_Alloc( count * sizeof( *cm.brushsides ) );
 	cm.numBrushSides = count;
 
 	out = cm.brushsides;
@@ -623,7 +698,8 @@ CMod_LoadSurfaces
 */
 static const int MAX_PATCH_SIZE  = 64;
 static const int MAX_PATCH_VERTS = ( MAX_PATCH_SIZE * MAX_PATCH_SIZE );
-static void CMod_LoadSurfaces(const byte *const cmod_base, const lump_t *surfs, const lump_t *verts, const lump_t *indexesLump)
+static void CMod_LoadSurfaces(const byte *const cmod_base, const lump_t *surfs, const lump_t *verts, const lump_t *indexesLump,
+                              const std::vector<cSurfaceCollide_t *> &cachedCollides)
 {
 	drawVert_t    *dv, *dv_p;
 	dsurface_t    *in;
@@ -666,6 +742,8 @@ static void CMod_LoadSurfaces(const byte *const cmod_base, const lump_t *surfs,
 	// scan through all the surfaces
 	for ( i = 0; i < count; i++, in++ )
 	{
+		cSurfaceCollide_t *cached = cachedCollides.empty() ? nullptr : cachedCollides[ i ];
+
 		if ( LittleLong( in->surfaceType ) == mapSurfaceType_t::MST_PATCH )
 		{
 			// FIXME: check for non-colliding patches
@@ -696,7 +774,7 @@ static void CMod_LoadSurfaces(const byte *const cmod_base, const lump_t *surfs,
 			surface->surfaceFlags = cm.shaders[ shaderNum ].surfaceFlags;
 
 			// create the internal facet structure
-			surface->sc = CM_GeneratePatchCollide( width, height, vertexes );
+			surface->sc = cached ? cached : CM_GeneratePatchCollide( width, height, vertexes );
 		}
 		else if ( LittleLong( in->surfaceType ) == mapSurfaceType_t::MST_TRIANGLE_SOUP && ( cm.perPolyCollision || cm_forceTriangles.Get() ) )
 		{
@@ -746,7 +824,7 @@ static void CMod_LoadSurfaces(const byte *const cmod_base, const lump_t *surfs,
 			surface->surfaceFlags = cm.shaders[ shaderNum ].surfaceFlags;
 
 			// create the internal facet structure
-			surface->sc = CM_GenerateTriangleSoupCollide( numVertexes, vertexes, numIndexes, indexes );
+			surface->sc = cached ? cached : CM_GenerateTriangleSoupCollide( numVertexes, vertexes, numIndexes, indexes );
 		}
 	}
 }
@@ -824,10 +902,23 @@ void CM_LoadMap(Str::StringRef name)
 	CMod_LoadNodes(cmod_base, &header.lumps[LUMP_NODES]);
 	CMod_LoadEntityString(cmod_base, &header.lumps[LUMP_ENTITIES], externalEntities);
 	CMod_LoadVisibility(cmod_base, &header.lumps[LUMP_VISIBILITY]);
+
+	// the external entities decide whether triangle soups collide
+	uint64_t mapChecksum = CM_CacheChecksum( externalEntities.data(), externalEntities.size(),
+	                                         CM_CacheChecksum( mapData.data(), mapData.size() ) );
+	bool triangleSoups = cm.perPolyCollision || cm_forceTriangles.Get();
+	std::vector<cSurfaceCollide_t *> cachedCollides;
+	cm.loadedFromCache = CM_LoadCollisionCache(
+		name, mapChecksum, triangleSoups, header.lumps[LUMP_SURFACES].filelen / sizeof( dsurface_t ), cachedCollides );
+
 	CMod_LoadSurfaces(cmod_base,
-					  &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], &header.lumps[LUMP_DRAWINDEXES]);
+					  &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS], &header.lumps[LUMP_DRAWINDEXES],
+					  cachedCollides);
 
-	CM_InitBoxHull();
+	if ( !cm.loadedFromCache )
+	{
+		CM_SaveCollisionCache( name, mapChecksum, triangleSoups );
+	}
 
 	CM_FloodAreaConnections();
 }
@@ -862,7 +953,7 @@ cmodel_t       *CM_ClipHandleToModel( clipHandle_t handle )
 
 	if ( handle == BOX_MODEL_HANDLE || handle == CAPSULE_MODEL_HANDLE )
 	{
-		return &box_model;
+		return &CM_BoxHull()->model;
 	}
 
 	Sys::Drop( "CM_ClipHandleToModel: bad handle %i (max %d)", handle, cm.numSubModels );
@@ -893,6 +984,11 @@ char           *CM_EntityString()
 	return cm.entityString;
 }
 
+int CM_NumClusters()
+{
+	return cm.numClusters;
+}
+
 int CM_LeafCluster( int leafnum )
 {
 	if ( leafnum < 0 || leafnum >= cm.numLeafs )
@@ -917,47 +1013,48 @@ int CM_LeafArea( int leafnum )
 
 /*
 ===================
-CM_InitBoxHull
+CM_BoxHull
 
 Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
 ===================
 */
-void CM_InitBoxHull()
+static boxHull_t *CM_BoxHull()
 {
-	int          i;
-	int          side;
-	cplane_t     *p;
-	cbrushside_t *s;
+	boxHull_t *hull = &boxHull;
 
-	box_planes = &cm.planes[ cm.numPlanes ];
+	// the brush number of the box follows the ones of the current map
+	hull->leafBrush = cm.numBrushes;
 
-	box_brush = &cm.brushes[ cm.numBrushes ];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
+	if ( hull->initialized )
+	{
+		return hull;
+	}
 
-	box_model.leaf.numLeafBrushes = 1;
-	box_model.leaf.firstLeafBrush = cm.leafbrushes + cm.numLeafBrushes;
-	cm.leafbrushes[ cm.numLeafBrushes ] = cm.numBrushes;
+	hull->brush.numsides = 6;
+	hull->brush.sides = hull->sides;
+	hull->brush.contents = CONTENTS_BODY;
 
-	for ( i = 0; i < 6; i++ )
+	hull->model.leaf.numLeafBrushes = 1;
+	hull->model.leaf.firstLeafBrush = &hull->leafBrush;
+
+	for ( int i = 0; i < 6; i++ )
 	{
-		side = i & 1;
+		int side = i & 1;
 
 		// brush sides
-		s = &cm.brushsides[ cm.numBrushSides + i ];
-		s->plane = cm.planes + ( cm.numPlanes + i * 2 + side );
+		cbrushside_t *s = &hull->sides[ i ];
+		s->plane = &hull->planes[ i * 2 + side ];
 		s->surfaceFlags = 0;
 
 		// planes
-		p = &box_planes[ i * 2 ];
+		cplane_t *p = &hull->planes[ i * 2 ];
 		p->type = i >> 1;
 		p->signbits = 0;
 		VectorClear( p->normal );
 		p->normal[ i >> 1 ] = 1;
 
-		p = &box_planes[ i * 2 + 1 ];
+		p = &hull->planes[ i * 2 + 1 ];
 		p->type = 3 + ( i >> 1 );
 		p->signbits = 0;
 		VectorClear( p->normal );
@@ -965,6 +1062,14 @@ void CM_InitBoxHull()
 
 		SetPlaneSignbits( p );
 	}
+
+	hull->initialized = true;
+	return hull;
+}
+
+const cbrush_t *CM_BoxBrush()
+{
+	return &boxHull.brush;
 }
 
 /*
@@ -978,29 +1083,31 @@ Capsules are handled differently though.
 */
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, bool capsule )
 {
-	VectorCopy( mins, box_model.mins );
-	VectorCopy( maxs, box_model.maxs );
+	boxHull_t *hull = CM_BoxHull();
+
+	VectorCopy( mins, hull->model.mins );
+	VectorCopy( maxs, hull->model.maxs );
 
 	if ( capsule )
 	{
 		return CAPSULE_MODEL_HANDLE;
 	}
 
-	box_planes[ 0 ].dist = maxs[ 0 ];
-	box_planes[ 1 ].dist = -maxs[ 0 ];
-	box_planes[ 2 ].dist = mins[ 0 ];
-	box_planes[ 3 ].dist = -mins[ 0 ];
-	box_planes[ 4 ].dist = maxs[ 1 ];
-	box_planes[ 5 ].dist = -maxs[ 1 ];
-	box_planes[ 6 ].dist = mins[ 1 ];
-	box_planes[ 7 ].dist = -mins[ 1 ];
-	box_planes[ 8 ].dist = maxs[ 2 ];
-	box_planes[ 9 ].dist = -maxs[ 2 ];
-	box_planes[ 10 ].dist = mins[ 2 ];
-	box_planes[ 11 ].dist = -mins[ 2 ];
-
-	VectorCopy( mins, box_brush->bounds[ 0 ] );
-	VectorCopy( maxs, box_brush->bounds[ 1 ] );
+	hull->planes[ 0 ].dist = maxs[ 0 ];
+	hull->planes[ 1 ].dist = -maxs[ 0 ];
+	hull->planes[ 2 ].dist = mins[ 0 ];
+	hull->planes[ 3 ].dist = -mins[ 0 ];
+	hull->planes[ 4 ].dist = maxs[ 1 ];
+	hull->planes[ 5 ].dist = -maxs[ 1 ];
+	hull->planes[ 6 ].dist = mins[ 1 ];
+	hull->planes[ 7 ].dist = -mins[ 1 ];
+	hull->planes[ 8 ].dist = maxs[ 2 ];
+	hull->planes[ 9 ].dist = -maxs[ 2 ];
+	hull->planes[ 10 ].dist = mins[ 2 ];
+	hull->planes[ 11 ].dist = -mins[ 2 ];
+
+	VectorCopy( mins, hull->brush.bounds[ 0 ] );
+	VectorCopy( maxs, hull->brush.bounds[ 1 ] );
 
 	return BOX_MODEL_HANDLE;
 }
@@ -77,13 +77,21 @@ struct cbrushside_t
 	int       surfaceFlags;
 };
 
+// The planes of a brush four at a time in structure of arrays layout, for
+// the SIMD brush tests
+struct cbrushPlanes_t
+{
+	float normal[ 3 ][ 4 ];
+	float dist[ 4 ];
+};
+
 struct cbrush_t
 {
-	int          contents;
-	vec3_t       bounds[ 2 ];
-	int          numsides;
-	cbrushside_t *sides;
-	int          checkcount; // to avoid repeated testings
+	int            contents;
+	vec3_t         bounds[ 2 ];
+	int            numsides;
+	cbrushside_t   *sides;
+	cbrushPlanes_t *planes; // ( numsides + 3 ) / 4 blocks, nullptr for the box brush
 };
 
 struct cPlane_t
@@ -130,6 +138,16 @@ struct cFacet_t
 	bool     borderInward[ MAX_FACET_BEVELS ];
 };
 
+// A node of the bounding volume hierarchy of the facets of a surface. The
+// first child of an inner node is the next node.
+struct cFacetNode_t
+{
+	vec3_t bounds[ 2 ];
+	int    secondChild;
+	int    firstFacet; // in facetOrder
+	int    numFacets; // 0 for inner nodes
+};
+
 struct cSurfaceCollide_t
 {
 	vec3_t   bounds[ 2 ];
@@ -138,11 +156,14 @@ struct cSurfaceCollide_t
 
 	int      numFacets;
 	cFacet_t *facets;
+
+	int          numFacetNodes;
+	cFacetNode_t *facetNodes;
+	int          *facetOrder; // facet numbers in the order of the leaf nodes
 };
 
 struct cSurface_t
 {
-	int               checkcount; // to avoid repeated testings
 	int               surfaceFlags;
 	int               contents;
 	cSurfaceCollide_t *sc;
@@ -200,8 +221,8 @@ struct clipMap_t
 	cSurface_t   **surfaces; // non-patches will be nullptr
 
 	int          floodvalid;
-	int          checkcount; // incremented on each trace
 	bool     perPolyCollision;
+	bool     loadedFromCache; // the surface collides were read from the collision cache
 };
 
 // keep 1/8 unit away to keep the position valid before network snapping
@@ -217,8 +238,8 @@ struct clipMap_t
 #define SURFACE_CLIP_EPSILON ( 0.125f )
 
 extern clipMap_t cm;
-extern int       c_pointcontents;
-extern int       c_traces, c_brush_traces, c_patch_traces, c_trisoup_traces;
+extern std::atomic<int> c_pointcontents;
+extern std::atomic<int> c_traces, c_brush_traces, c_patch_traces, c_trisoup_traces;
 extern Cvar::Cvar<bool> cm_forceTriangles;
 extern Log::Logger cmLog;
 
@@ -232,6 +253,23 @@ struct sphere_t
 	vec3_t offset;
 };
 
+// Brushes and surfaces already tested by the traces running on a thread, to
+// avoid testing them again when they are in several leafs. Each trace, or
+// batch of traces, takes a new stamp instead of clearing the arrays, and the
+// traces of a batch are told apart with their bit in the rays mask.
+struct traceVisit_t
+{
+	unsigned stamp;
+	unsigned rays;
+};
+
+struct traceVisits_t
+{
+	std::vector<traceVisit_t> brushes; // the last one is the box model brush
+	std::vector<traceVisit_t> surfaces;
+	unsigned                  stamp;
+};
+
 struct traceWork_t
 {
 	traceType_t type;
@@ -248,6 +286,8 @@ struct traceWork_t
 	bool    isPoint; // optimized case
 	trace_t     trace; // returned from trace call
 	sphere_t    sphere; // sphere for oriendted capsule collision
+	traceVisits_t *visits;
+	unsigned    rayMask; // bit of the trace in its batch
 };
 
 struct leafList_t
@@ -281,6 +321,7 @@ cSurfaceCollide_t              *CM_GenerateTriangleSoupCollide( int numVertexes,
 
 
 void* CM_Alloc( size_t size );
+void CM_Free( void *alloc );
 
 // cm_plane.c
 
@@ -302,6 +343,13 @@ bool CM_ValidateFacet( cFacet_t *facet );
 void     CM_AddFacetBevels( cFacet_t *facet );
 bool CM_GenerateFacetFor3Points( cFacet_t *facet, const vec3_t p1, const vec3_t p2, const vec3_t p3 );
 bool CM_GenerateFacetFor4Points( cFacet_t *facet, const vec3_t p1, const vec3_t p2, const vec3_t p3, const vec3_t p4 );
+void CM_BuildFacetTree( cSurfaceCollide_t *sc );
+
+// cm_cache.cpp
+uint64_t CM_CacheChecksum( const void *data, size_t length, uint64_t hash = 14695981039346656037ULL );
+bool CM_LoadCollisionCache( Str::StringRef name, uint64_t mapChecksum, bool triangleSoups, int numSurfaces,
+                            std::vector<cSurfaceCollide_t *> &collides );
+void CM_SaveCollisionCache( Str::StringRef name, uint64_t mapChecksum, bool triangleSoups );
 
 
 // cm_test.c
@@ -311,6 +359,13 @@ void                           CM_BoxLeafnums_r( leafList_t *ll, int nodenum );
 
 cmodel_t                       *CM_ClipHandleToModel( clipHandle_t handle );
 
+// The brush numbered cm.numBrushes is the one of the box model of the thread
+const cbrush_t                 *CM_BoxBrush();
+inline const cbrush_t          *CM_LeafBrush( int brushNum )
+{
+	return brushNum == cm.numBrushes ? CM_BoxBrush() : &cm.brushes[ brushNum ];
+}
+
 // XreaL BEGIN
 bool                       CM_BoundsIntersect( const vec3_t mins, const vec3_t maxs, const vec3_t mins2, const vec3_t maxs2 );
 bool                       CM_BoundsIntersectPoint( const vec3_t mins, const vec3_t maxs, const vec3_t point );
@@ -846,5 +846,7 @@ cSurfaceCollide_t *CM_GeneratePatchCollide( int width, int height, const vec3_t
 	sc->bounds[ 1 ][ 1 ] += 1;
 	sc->bounds[ 1 ][ 2 ] += 1;
 
+	CM_BuildFacetTree( sc );
+
 	return sc;
 }
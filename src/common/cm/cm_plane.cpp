@@ -688,3 +688,146 @@ bool CM_GenerateFacetFor3Points( cFacet_t *facet, const vec3_t p1, const vec3_t
 
 	return true;
 }
+
+/*
+==================
+CM_FacetBounds
+
+The facet is behind all its planes, so each of them that is axial bounds
+it on one side. A trace can only hit the facet if it goes within
+SURFACE_CLIP_EPSILON of these bounds, the other sides are unbounded.
+==================
+*/
+static void CM_FacetBounds( const cSurfaceCollide_t *sc, const cFacet_t *facet, vec3_t bounds[ 2 ] )
+{
+	VectorSet( bounds[ 0 ], -1.0e30f, -1.0e30f, -1.0e30f );
+	VectorSet( bounds[ 1 ], 1.0e30f, 1.0e30f, 1.0e30f );
+
+	for ( int i = -1; i < facet->numBorders; i++ )
+	{
+		plane_t plane = sc->planes[ i < 0 ? facet->surfacePlane : facet->borderPlanes[ i ] ].plane;
+
+		if ( i >= 0 && facet->borderInward[ i ] )
+		{
+			VectorNegate( plane.normal, plane.normal );
+			plane.dist = -plane.dist;
+		}
+
+		for ( int axis = 0; axis < 3; axis++ )
+		{
+			if ( plane.normal[ ( axis + 1 ) % 3 ] != 0 || plane.normal[ ( axis + 2 ) % 3 ] != 0 )
+			{
+				continue;
+			}
+
+			// expand by one unit for epsilon purposes, like the surface bounds
+			if ( plane.normal[ axis ] == 1 )
+			{
+				bounds[ 1 ][ axis ] = std::min( bounds[ 1 ][ axis ], plane.dist + 1 );
+			}
+			else if ( plane.normal[ axis ] == -1 )
+			{
+				bounds[ 0 ][ axis ] = std::max( bounds[ 0 ][ axis ], -plane.dist - 1 );
+			}
+		}
+	}
+}
+
+/*
+==================
+CM_BuildFacetTree
+
+Builds a bounding volume hierarchy of the facets of a surface, so that
+traces only test the facets near them.
+==================
+*/
+static const int FACET_TREE_LEAF_SIZE = 4;
+
+struct facetBounds_t
+{
+	vec3_t bounds[ 2 ];
+	vec3_t center;
+};
+
+static void CM_BuildFacetTree_r( std::vector<cFacetNode_t> &nodes, const std::vector<facetBounds_t> &facetBounds,
+                                 int *order, int first, int count )
+{
+	int nodeNum = nodes.size();
+	nodes.emplace_back();
+
+	vec3_t centerBounds[ 2 ];
+	ClearBounds( nodes[ nodeNum ].bounds[ 0 ], nodes[ nodeNum ].bounds[ 1 ] );
+	ClearBounds( centerBounds[ 0 ], centerBounds[ 1 ] );
+
+	for ( int i = first; i < first + count; i++ )
+	{
+		const facetBounds_t &fb = facetBounds[ order[ i ] ];
+		AddPointToBounds( fb.bounds[ 0 ], nodes[ nodeNum ].bounds[ 0 ], nodes[ nodeNum ].bounds[ 1 ] );
+		AddPointToBounds( fb.bounds[ 1 ], nodes[ nodeNum ].bounds[ 0 ], nodes[ nodeNum ].bounds[ 1 ] );
+		AddPointToBounds( fb.center, centerBounds[ 0 ], centerBounds[ 1 ] );
+	}
+
+	if ( count <= FACET_TREE_LEAF_SIZE )
+	{
+		nodes[ nodeNum ].firstFacet = first;
+		nodes[ nodeNum ].numFacets = count;
+		return;
+	}
+
+	// split at the median of the facet centers on the longest axis
+	int axis = 0;
+
+	for ( int i = 1; i < 3; i++ )
+	{
+		if ( centerBounds[ 1 ][ i ] - centerBounds[ 0 ][ i ] > centerBounds[ 1 ][ axis ] - centerBounds[ 0 ][ axis ] )
+		{
+			axis = i;
+		}
+	}
+
+	int half = count / 2;
+	std::nth_element( order + first, order + first + half, order + first + count, [ & ]( int a, int b ) {
+		return facetBounds[ a ].center[ axis ] < facetBounds[ b ].center[ axis ];
+	} );
+
+	CM_BuildFacetTree_r( nodes, facetBounds, order, first, half );
+	nodes[ nodeNum ].secondChild = nodes.size();
+	CM_BuildFacetTree_r( nodes, facetBounds, order, first + half, count - half );
+}
+
+void CM_BuildFacetTree( cSurfaceCollide_t *sc )
+{
+	if ( !sc->numFacets )
+	{
+		return;
+	}
+
+	std::vector<facetBounds_t> facetBounds( sc->numFacets );
+
+	for ( int i = 0; i < sc->numFacets; i++ )
+	{
+		facetBounds_t &fb = facetBounds[ i ];
+		CM_FacetBounds( sc, &sc->facets[ i ], fb.bounds );
+
+		// keep the unbounded sides within the surface to find the centers
+		for ( int j = 0; j < 3; j++ )
+		{
+			fb.center[ j ] = 0.5f * ( std::max( fb.bounds[ 0 ][ j ], sc->bounds[ 0 ][ j ] )
+			                        + std::min( fb.bounds[ 1 ][ j ], sc->bounds[ 1 ][ j ] ) );
+		}
+	}
+
+	sc->facetOrder = ( int * ) CM_Alloc( sc->numFacets * sizeof( *sc->facetOrder ) );
+
+	for ( int i = 0; i < sc->numFacets; i++ )
+	{
+		sc->facetOrder[ i ] = i;
+	}
+
+	std::vector<cFacetNode_t> nodes;
+	CM_BuildFacetTree_r( nodes, facetBounds, sc->facetOrder, 0, sc->numFacets );
+
+	sc->numFacetNodes = nodes.size();
+	sc->facetNodes = ( cFacetNode_t * ) CM_Alloc( nodes.size() * sizeof( *sc->facetNodes ) );
+	std::copy( nodes.begin(), nodes.end(), sc->facetNodes );
+}
@@ -59,10 +59,24 @@ void         CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const
                                      const vec3_t mins, const vec3_t maxs, clipHandle_t model,
                                      int brushmask, int skipmask, const vec3_t origin,
                                      const vec3_t angles, traceType_t type );
+
+struct boxTraceQuery_t
+{
+	vec3_t start;
+	vec3_t end;
+	vec3_t mins;
+	vec3_t maxs;
+};
+
+// Same as calling CM_BoxTrace for each query, but the sweeps through the
+// world share the descent of the BSP tree
+void         CM_BoxTraceBatch( trace_t *results, const boxTraceQuery_t *queries, int count,
+                               clipHandle_t model, int brushmask, int skipmask, traceType_t type );
 std::string CM_CheckTraceConsistency( const vec3_t start, const vec3_t end, int contentmask, int skipmask, const trace_t &tr );
 
 float CM_DistanceToModel( const vec3_t loc, clipHandle_t model );
 
+int   CM_NumClusters();
 byte *CM_ClusterPVS( int cluster );
 
 int  CM_PointLeafnum( const vec3_t p );
@@ -168,8 +168,6 @@ int CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsiz
 {
 	leafList_t ll;
 
-	cm.checkcount++;
-
 	VectorCopy( mins, ll.bounds[ 0 ] );
 	VectorCopy( maxs, ll.bounds[ 1 ] );
 	ll.count = 0;
@@ -233,7 +231,7 @@ int CM_PointContents( const vec3_t p, clipHandle_t model )
 	const int *endBrushNum = firstBrushNum + leaf->numLeafBrushes;
 	for ( const int *brushNum = firstBrushNum; brushNum < endBrushNum; brushNum++ )
 	{
-		const cbrush_t *b = &cm.brushes[ *brushNum ];
+		const cbrush_t *b = CM_LeafBrush( *brushNum );
 
 		// XreaL BEGIN
 		if ( !CM_BoundsIntersectPoint( b->bounds[ 0 ], b->bounds[ 1 ], p ) )
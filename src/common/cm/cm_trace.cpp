@@ -43,6 +43,10 @@ Maryland 20850 USA.
 
 static Cvar::Cvar<bool> cm_noCurves(VM_STRING_PREFIX "cm_noCurves",
 	"treat BSP patches as empty space for collision detection", Cvar::CHEAT, false);
+static Cvar::Cvar<bool> cm_facetTrees(VM_STRING_PREFIX "cm_facetTrees",
+	"only test the patch and triangle soup facets near the trace, 0 to test them all", Cvar::CHEAT, true);
+static Cvar::Cvar<bool> cm_simdBrushes(VM_STRING_PREFIX "cm_simdBrushes",
+	"test four brush planes at a time when SIMD is available, 0 for the reference code", Cvar::CHEAT, true);
 
 /*
 ===============================================================================
@@ -150,6 +154,208 @@ float CM_DistanceFromLineSquared( const vec3_t p, const vec3_t lp1, const vec3_t
 	return VectorLengthSquared( t );
 }
 
+#if defined( DAEMON_USE_ARCH_INTRINSICS_I686_SSE )
+/*
+===============================================================================
+
+SIMD BRUSH PLANES
+
+The distances of the trace to four brush planes at a time, computed with
+the same operations in the same order as the reference code so that both
+give the same results.
+
+===============================================================================
+*/
+
+static inline __m128 CM_Select( __m128 mask, __m128 a, __m128 b )
+{
+	return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+}
+
+static inline __m128 CM_Dot4( __m128 x, __m128 y, __m128 z, __m128 nx, __m128 ny, __m128 nz )
+{
+	return _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, nx ), _mm_mul_ps( y, ny ) ), _mm_mul_ps( z, nz ) );
+}
+
+// The trace as seen by the brush planes
+struct brushTraceSIMD_t
+{
+	bool   capsule;
+	__m128 start[ 3 ], end[ 3 ];
+	__m128 size[ 2 ][ 3 ]; // box
+	__m128 radius, offset[ 3 ]; // capsule
+	__m128 startMinus[ 3 ], startPlus[ 3 ], endMinus[ 3 ], endPlus[ 3 ];
+};
+
+static void CM_SetupBrushTraceSIMD( const traceWork_t *tw, brushTraceSIMD_t *bt )
+{
+	bt->capsule = tw->type == traceType_t::TT_CAPSULE;
+
+	for ( int i = 0; i < 3; i++ )
+	{
+		bt->start[ i ] = _mm_set1_ps( tw->start[ i ] );
+		bt->end[ i ] = _mm_set1_ps( tw->end[ i ] );
+		bt->size[ 0 ][ i ] = _mm_set1_ps( tw->size[ 0 ][ i ] );
+		bt->size[ 1 ][ i ] = _mm_set1_ps( tw->size[ 1 ][ i ] );
+		bt->offset[ i ] = _mm_set1_ps( tw->sphere.offset[ i ] );
+		bt->startMinus[ i ] = _mm_set1_ps( tw->start[ i ] - tw->sphere.offset[ i ] );
+		bt->startPlus[ i ] = _mm_set1_ps( tw->start[ i ] + tw->sphere.offset[ i ] );
+		bt->endMinus[ i ] = _mm_set1_ps( tw->end[ i ] - tw->sphere.offset[ i ] );
+		bt->endPlus[ i ] = _mm_set1_ps( tw->end[ i ] + tw->sphere.offset[ i ] );
+	}
+
+	bt->radius = _mm_set1_ps( tw->sphere.radius );
+}
+
+// Distances of the start and end of the trace to the planes of a block,
+// the end one is only computed when d2 is not null
+static inline void CM_BrushPlaneDistancesSIMD( const brushTraceSIMD_t *bt, const cbrushPlanes_t *block,
+                                               __m128 *d1, __m128 *d2 )
+{
+	__m128 nx = _mm_loadu_ps( block->normal[ 0 ] );
+	__m128 ny = _mm_loadu_ps( block->normal[ 1 ] );
+	__m128 nz = _mm_loadu_ps( block->normal[ 2 ] );
+	__m128 pd = _mm_loadu_ps( block->dist );
+
+	if ( bt->capsule )
+	{
+		// adjust the plane distance appropriately for radius
+		__m128 dist = _mm_add_ps( pd, bt->radius );
+
+		// find the closest point on the capsule to the plane
+		__m128 t = CM_Dot4( nx, ny, nz, bt->offset[ 0 ], bt->offset[ 1 ], bt->offset[ 2 ] );
+		__m128 minus = _mm_cmpgt_ps( t, _mm_setzero_ps() );
+
+		*d1 = _mm_sub_ps( CM_Dot4( CM_Select( minus, bt->startMinus[ 0 ], bt->startPlus[ 0 ] ),
+		                           CM_Select( minus, bt->startMinus[ 1 ], bt->startPlus[ 1 ] ),
+		                           CM_Select( minus, bt->startMinus[ 2 ], bt->startPlus[ 2 ] ), nx, ny, nz ), dist );
+
+		if ( d2 )
+		{
+			*d2 = _mm_sub_ps( CM_Dot4( CM_Select( minus, bt->endMinus[ 0 ], bt->endPlus[ 0 ] ),
+			                           CM_Select( minus, bt->endMinus[ 1 ], bt->endPlus[ 1 ] ),
+			                           CM_Select( minus, bt->endMinus[ 2 ], bt->endPlus[ 2 ] ), nx, ny, nz ), dist );
+		}
+	}
+	else
+	{
+		// adjust the plane distance appropriately for mins/maxs, the
+		// corner is the one of tw->offsets[ plane->signbits ]
+		__m128 zero = _mm_setzero_ps();
+		__m128 ox = CM_Select( _mm_cmplt_ps( nx, zero ), bt->size[ 1 ][ 0 ], bt->size[ 0 ][ 0 ] );
+		__m128 oy = CM_Select( _mm_cmplt_ps( ny, zero ), bt->size[ 1 ][ 1 ], bt->size[ 0 ][ 1 ] );
+		__m128 oz = CM_Select( _mm_cmplt_ps( nz, zero ), bt->size[ 1 ][ 2 ], bt->size[ 0 ][ 2 ] );
+		__m128 dist = _mm_sub_ps( pd, CM_Dot4( ox, oy, oz, nx, ny, nz ) );
+
+		*d1 = _mm_sub_ps( CM_Dot4( bt->start[ 0 ], bt->start[ 1 ], bt->start[ 2 ], nx, ny, nz ), dist );
+
+		if ( d2 )
+		{
+			*d2 = _mm_sub_ps( CM_Dot4( bt->end[ 0 ], bt->end[ 1 ], bt->end[ 2 ], nx, ny, nz ), dist );
+		}
+	}
+}
+
+/*
+================
+CM_ClipToBrushPlanesSIMD
+
+The plane loop of CM_TraceThroughBrush. Returns false if the trace is
+completely in front of a plane, else the fractions where it enters and
+leaves the brush and the side it enters through, the first one in case
+of a tie like in the reference loop.
+================
+*/
+static bool CM_ClipToBrushPlanesSIMD( const traceWork_t *tw, const cbrush_t *brush, bool *startout, bool *getout,
+                                      float *enterFrac, float *leaveFrac, const cbrushside_t **leadside )
+{
+	brushTraceSIMD_t bt;
+	CM_SetupBrushTraceSIMD( tw, &bt );
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 epsilon = _mm_set1_ps( SURFACE_CLIP_EPSILON );
+	const __m128 four = _mm_set1_ps( 4.0f );
+
+	__m128 startoutMask = zero, getoutMask = zero;
+	__m128 enterFracs = _mm_set1_ps( -1.0f ), leaveFracs = one;
+	__m128 enterSides = _mm_set1_ps( -1.0f );
+	__m128 sides = _mm_set_ps( 3, 2, 1, 0 );
+
+	const cbrushPlanes_t *endBlock = brush->planes + ( brush->numsides + 3 ) / 4;
+
+	for ( const cbrushPlanes_t *block = brush->planes; block < endBlock; block++, sides = _mm_add_ps( sides, four ) )
+	{
+		__m128 d1, d2;
+		CM_BrushPlaneDistancesSIMD( &bt, block, &d1, &d2 );
+
+		__m128 out1 = _mm_cmpgt_ps( d1, zero );
+		__m128 out2 = _mm_cmpgt_ps( d2, zero );
+
+		// if completely in front of face, no intersection with the entire brush
+		__m128 front = _mm_or_ps( _mm_cmpge_ps( d2, epsilon ), _mm_cmpge_ps( d2, d1 ) );
+
+		if ( _mm_movemask_ps( _mm_and_ps( out1, front ) ) )
+		{
+			return false;
+		}
+
+		getoutMask = _mm_or_ps( getoutMask, out2 ); // endpoint is not in solid
+		startoutMask = _mm_or_ps( startoutMask, out1 );
+
+		// if it doesn't cross the plane, the plane isn't relevant
+		__m128 crosses = _mm_or_ps( _mm_cmpnle_ps( d1, zero ), _mm_cmpnle_ps( d2, zero ) );
+		__m128 enters = _mm_cmpgt_ps( d1, d2 );
+
+		// the reference loop only divides for crossing planes, where d1 != d2;
+		// the other lanes, padding included, must not divide by zero as that
+		// raises SIGFPE when floating point exceptions are enabled
+		__m128 denominator = CM_Select( _mm_and_ps( crosses, _mm_cmpneq_ps( d1, d2 ) ), _mm_sub_ps( d1, d2 ), one );
+
+		// enter
+		__m128 f = _mm_div_ps( _mm_sub_ps( d1, epsilon ), denominator );
+		f = _mm_andnot_ps( _mm_cmplt_ps( f, zero ), f );
+
+		__m128 update = _mm_and_ps( _mm_and_ps( crosses, enters ), _mm_cmpgt_ps( f, enterFracs ) );
+		enterFracs = CM_Select( update, f, enterFracs );
+		enterSides = CM_Select( update, sides, enterSides );
+
+		// leave
+		f = _mm_div_ps( _mm_add_ps( d1, epsilon ), denominator );
+		f = CM_Select( _mm_cmpgt_ps( f, one ), one, f );
+
+		update = _mm_and_ps( _mm_andnot_ps( enters, crosses ), _mm_cmplt_ps( f, leaveFracs ) );
+		leaveFracs = CM_Select( update, f, leaveFracs );
+	}
+
+	*startout = _mm_movemask_ps( startoutMask ) != 0;
+	*getout = _mm_movemask_ps( getoutMask ) != 0;
+
+	alignas( 16 ) float enter[ 4 ], leave[ 4 ], side[ 4 ];
+	_mm_store_ps( enter, enterFracs );
+	_mm_store_ps( leave, leaveFracs );
+	_mm_store_ps( side, enterSides );
+
+	int enterSide = -1;
+	*enterFrac = -1.0f;
+	*leaveFrac = 1.0f;
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		if ( enter[ i ] > *enterFrac || ( enter[ i ] == *enterFrac && side[ i ] < enterSide ) )
+		{
+			*enterFrac = enter[ i ];
+			enterSide = side[ i ];
+		}
+
+		*leaveFrac = std::min( *leaveFrac, leave[ i ] );
+	}
+
+	*leadside = enterSide >= 0 ? brush->sides + enterSide : nullptr;
+	return true;
+}
+#endif
+
 /*
 ===============================================================================
 
@@ -186,9 +392,42 @@ static void CM_TestBoxInBrush( traceWork_t *tw, const cbrush_t *brush )
 		return;
 	}
 
+#if defined( DAEMON_USE_ARCH_INTRINSICS_I686_SSE )
+	if ( brush->planes && cm_simdBrushes.Get() )
+	{
+		brushTraceSIMD_t bt;
+		CM_SetupBrushTraceSIMD( tw, &bt );
+
+		// the first six planes are the axial planes, so we only
+		// need to test the remainder, from the third lane of the second block
+		__m128 lanes = _mm_cmpge_ps( _mm_set_ps( 3, 2, 1, 0 ), _mm_set1_ps( 2 ) );
+		const cbrushPlanes_t *endBlock = brush->planes + ( brush->numsides + 3 ) / 4;
+
+		for ( const cbrushPlanes_t *block = brush->planes + 1; block < endBlock; block++ )
+		{
+			__m128 distances;
+			CM_BrushPlaneDistancesSIMD( &bt, block, &distances, nullptr );
+
+			// if completely in front of face, no intersection
+			if ( _mm_movemask_ps( _mm_and_ps( lanes, _mm_cmpgt_ps( distances, _mm_setzero_ps() ) ) ) )
+			{
+				return;
+			}
+
+			lanes = _mm_cmpeq_ps( _mm_setzero_ps(), _mm_setzero_ps() );
+		}
+
+		// inside this brush
+		tw->trace.startsolid = tw->trace.allsolid = true;
+		tw->trace.fraction = 0;
+		tw->trace.contents = brush->contents;
+		return;
+	}
+#endif
+
 	const cbrushside_t *firstSide = brush->sides;
 	const cbrushside_t *endSide = firstSide + brush->numsides;
-	
+
 	// the first six planes are the axial planes, so we only
 	// need to test the remainder
 	firstSide += 6;
@@ -247,6 +486,63 @@ static void CM_TestBoxInBrush( traceWork_t *tw, const cbrush_t *brush )
 	tw->trace.contents = brush->contents;
 }
 
+/*
+====================
+CM_FindSurfaceFacets
+
+Facets of the surface whose bounds the trace touches, in increasing
+order so that ties between facets are broken as when testing them all
+====================
+*/
+static const std::vector<int> &CM_FindSurfaceFacets( const traceWork_t *tw, const cSurfaceCollide_t *sc )
+{
+	// per thread to allow concurrent traces
+#ifdef BUILD_ENGINE
+	thread_local
+#endif
+	static std::vector<int> found;
+
+	found.clear();
+
+	if ( !sc->facetNodes || !cm_facetTrees.Get() )
+	{
+		for ( int i = 0; i < sc->numFacets; i++ )
+		{
+			found.push_back( i );
+		}
+
+		return found;
+	}
+
+	int stack[ 64 ];
+	int depth = 0;
+
+	stack[ depth++ ] = 0;
+
+	while ( depth )
+	{
+		int nodeNum = stack[ --depth ];
+		const cFacetNode_t *node = &sc->facetNodes[ nodeNum ];
+
+		if ( !CM_BoundsIntersect( tw->bounds[ 0 ], tw->bounds[ 1 ], node->bounds[ 0 ], node->bounds[ 1 ] ) )
+		{
+			continue;
+		}
+
+		if ( node->numFacets )
+		{
+			found.insert( found.end(), sc->facetOrder + node->firstFacet, sc->facetOrder + node->firstFacet + node->numFacets );
+			continue;
+		}
+
+		stack[ depth++ ] = node->secondChild;
+		stack[ depth++ ] = nodeNum + 1;
+	}
+
+	std::sort( found.begin(), found.end() );
+	return found;
+}
+
 /*
 ====================
 CM_PositionTestInSurfaceCollide
@@ -254,7 +550,7 @@ CM_PositionTestInSurfaceCollide
 */
 static bool CM_PositionTestInSurfaceCollide( traceWork_t *tw, const cSurfaceCollide_t *sc )
 {
-	int      i, j;
+	int      j;
 	float    offset, t;
 	cPlane_t *planes;
 	cFacet_t *facet;
@@ -265,11 +561,9 @@ static bool CM_PositionTestInSurfaceCollide( traceWork_t *tw, const cSurfaceColl
 		return false;
 	}
 
-	//
-	facet = sc->facets;
-
-	for ( i = 0; i < sc->numFacets; i++, facet++ )
+	for ( int facetNum : CM_FindSurfaceFacets( tw, sc ) )
 	{
+		facet = &sc->facets[ facetNum ];
 		planes = &sc->planes[ facet->surfacePlane ];
 
 		plane_t plane = planes->plane;
@@ -360,6 +654,74 @@ static bool CM_PositionTestInSurfaceCollide( traceWork_t *tw, const cSurfaceColl
 	return false;
 }
 
+/*
+================
+CM_BeginTraceVisits
+
+Takes a new stamp so that no brush or surface counts as tested yet
+================
+*/
+#ifdef BUILD_ENGINE
+thread_local
+#endif
+static traceVisits_t traceVisits;
+
+static void CM_BeginTraceVisits( traceWork_t *tw )
+{
+	traceVisits_t *visits = &traceVisits;
+	size_t numBrushes = cm.numBrushes + 1;
+	size_t numSurfaces = cm.numSurfaces;
+
+	if ( visits->brushes.size() < numBrushes )
+	{
+		visits->brushes.resize( numBrushes, {} );
+	}
+
+	if ( visits->surfaces.size() < numSurfaces )
+	{
+		visits->surfaces.resize( numSurfaces, {} );
+	}
+
+	if ( ++visits->stamp == 0 )
+	{
+		std::fill( visits->brushes.begin(), visits->brushes.end(), traceVisit_t{} );
+		std::fill( visits->surfaces.begin(), visits->surfaces.end(), traceVisit_t{} );
+		visits->stamp = 1;
+	}
+
+	tw->visits = visits;
+	tw->rayMask = 1;
+}
+
+// Return false if the brush or surface was already tested by this trace
+static inline bool CM_Visit( const traceWork_t *tw, traceVisit_t *visit )
+{
+	if ( visit->stamp != tw->visits->stamp )
+	{
+		visit->stamp = tw->visits->stamp;
+		visit->rays = tw->rayMask;
+		return true;
+	}
+
+	if ( visit->rays & tw->rayMask )
+	{
+		return false;
+	}
+
+	visit->rays |= tw->rayMask;
+	return true;
+}
+
+static inline bool CM_VisitBrush( traceWork_t *tw, int brushNum )
+{
+	return CM_Visit( tw, &tw->visits->brushes[ brushNum ] );
+}
+
+static inline bool CM_VisitSurface( traceWork_t *tw, int surfaceNum )
+{
+	return CM_Visit( tw, &tw->visits->surfaces[ surfaceNum ] );
+}
+
 /*
 ================
 CM_TestInLeaf
@@ -372,14 +734,12 @@ void CM_TestInLeaf( traceWork_t *tw, const cLeaf_t *leaf )
 	const int *endBrushNum = firstBrushNum + leaf->numLeafBrushes;
 	for ( const int *brushNum = firstBrushNum; brushNum < endBrushNum; brushNum++ )
 	{
-		cbrush_t *b = &cm.brushes[ *brushNum ];
-
-		if ( b->checkcount == cm.checkcount )
+		if ( !CM_VisitBrush( tw, *brushNum ) )
 		{
 			continue; // already checked this brush in another leaf
 		}
 
-		b->checkcount = cm.checkcount;
+		const cbrush_t *b = CM_LeafBrush( *brushNum );
 
 		if ( !( b->contents & tw->contents ) )
 		{
@@ -411,13 +771,11 @@ void CM_TestInLeaf( traceWork_t *tw, const cLeaf_t *leaf )
 			continue;
 		}
 
-		if ( surface->checkcount == cm.checkcount )
+		if ( !CM_VisitSurface( tw, *surfaceNum ) )
 		{
 			continue; // already checked this surface in another leaf
 		}
 
-		surface->checkcount = cm.checkcount;
-
 		if ( !( surface->contents & tw->contents ) )
 		{
 			continue;
@@ -633,11 +991,9 @@ void CM_PositionTest( traceWork_t *tw )
 	ll.lastLeaf = 0;
 	ll.overflowed = false;
 
-	cm.checkcount++;
-
 	CM_BoxLeafnums_r( &ll, 0 );
 
-	cm.checkcount++;
+	CM_BeginTraceVisits( tw );
 
 	// test the contents of the leafs
 	for ( i = 0; i < ll.count; i++ )
@@ -659,6 +1015,30 @@ TRACING
 ===============================================================================
 */
 
+// The relationship of a point trace to a plane of a surface
+static void CM_PointTraceToPlane( const traceWork_t *tw, const cPlane_t *plane, bool *frontFacing, float *intersection )
+{
+	vec_t offset = DotProduct( tw->offsets[ plane->signbits ], plane->plane.normal );
+	vec_t d1 = DotProduct( tw->start, plane->plane.normal ) - plane->plane.dist + offset;
+	vec_t d2 = DotProduct( tw->end, plane->plane.normal ) - plane->plane.dist + offset;
+
+	*frontFacing = !( d1 <= 0 );
+
+	if ( d1 == d2 )
+	{
+		*intersection = 99999;
+	}
+	else
+	{
+		*intersection = d1 / ( d1 - d2 );
+
+		if ( *intersection <= 0 )
+		{
+			*intersection = 99999;
+		}
+	}
+}
+
 /*
 ====================
 CM_TracePointThroughSurfaceCollide
@@ -668,61 +1048,28 @@ CM_TracePointThroughSurfaceCollide
 */
 void CM_TracePointThroughSurfaceCollide( traceWork_t *tw, const cSurfaceCollide_t *sc )
 {
-	static bool frontFacing[ SHADER_MAX_TRIANGLES ];
-	static float    intersection[ SHADER_MAX_TRIANGLES ];
-	float           intersect;
+	bool            frontFacing, borderFrontFacing;
+	float           intersect, borderIntersect;
 	const cPlane_t  *planes;
 	const cFacet_t  *facet;
-	int             i, j, k;
+	int             j;
 
 	if ( !tw->isPoint )
 	{
 		return;
 	}
 
-	// determine the trace's relationship to all planes
-	planes = sc->planes;
-
-	for ( i = 0; i < sc->numPlanes; i++, planes++ )
-	{
-		vec_t offset = DotProduct( tw->offsets[ planes->signbits ], planes->plane.normal );
-		vec_t d1 = DotProduct( tw->start, planes->plane.normal ) - planes->plane.dist + offset;
-		vec_t d2 = DotProduct( tw->end, planes->plane.normal ) - planes->plane.dist + offset;
-
-		if ( d1 <= 0 )
-		{
-			frontFacing[ i ] = false;
-		}
-		else
-		{
-			frontFacing[ i ] = true;
-		}
-
-		if ( d1 == d2 )
-		{
-			intersection[ i ] = 99999;
-		}
-		else
-		{
-			intersection[ i ] = d1 / ( d1 - d2 );
-
-			if ( intersection[ i ] <= 0 )
-			{
-				intersection[ i ] = 99999;
-			}
-		}
-	}
-
 	// see if any of the surface planes are intersected
-	for ( i = 0, facet = sc->facets; i < sc->numFacets; i++, facet++ )
+	for ( int facetNum : CM_FindSurfaceFacets( tw, sc ) )
 	{
-		if ( !frontFacing[ facet->surfacePlane ] )
+		facet = &sc->facets[ facetNum ];
+		CM_PointTraceToPlane( tw, &sc->planes[ facet->surfacePlane ], &frontFacing, &intersect );
+
+		if ( !frontFacing )
 		{
 			continue;
 		}
 
-		intersect = intersection[ facet->surfacePlane ];
-
 		if ( intersect < 0 )
 		{
 			continue; // surface is behind the starting point
@@ -735,18 +1082,18 @@ void CM_TracePointThroughSurfaceCollide( traceWork_t *tw, const cSurfaceCollide_
 
 		for ( j = 0; j < facet->numBorders; j++ )
 		{
-			k = facet->borderPlanes[ j ];
+			CM_PointTraceToPlane( tw, &sc->planes[ facet->borderPlanes[ j ] ], &borderFrontFacing, &borderIntersect );
 
-			if ( frontFacing[ k ] != facet->borderInward[ j ] )
+			if ( borderFrontFacing != facet->borderInward[ j ] )
 			{
-				if ( intersection[ k ] > intersect )
+				if ( borderIntersect > intersect )
 				{
 					break;
 				}
 			}
 			else
 			{
-				if ( intersection[ k ] < intersect )
+				if ( borderIntersect < intersect )
 				{
 					break;
 				}
@@ -844,7 +1191,7 @@ CM_TraceThroughSurfaceCollide
 */
 void CM_TraceThroughSurfaceCollide( traceWork_t *tw, const cSurfaceCollide_t *sc )
 {
-	int           i, j, hitnum;
+	int           j, hitnum;
 	float         offset, enterFrac, leaveFrac, t;
 	cPlane_t      *planes;
 	cFacet_t      *facet;
@@ -862,8 +1209,9 @@ void CM_TraceThroughSurfaceCollide( traceWork_t *tw, const cSurfaceCollide_t *sc
 	}
 
 	plane_t bestplane = {};
-	for ( i = 0, facet = sc->facets; i < sc->numFacets; i++, facet++ )
+	for ( int facetNum : CM_FindSurfaceFacets( tw, sc ) )
 	{
+		facet = &sc->facets[ facetNum ];
 		enterFrac = -1.0f;
 		leaveFrac = 1.0f;
 		hitnum = -1;
@@ -1059,6 +1407,21 @@ void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush )
 	const cbrushside_t *firstSide = brush->sides;
 	const cbrushside_t *endSide = firstSide + brush->numsides;
 
+#if defined( DAEMON_USE_ARCH_INTRINSICS_I686_SSE )
+	if ( brush->planes && cm_simdBrushes.Get() )
+	{
+		if ( !CM_ClipToBrushPlanesSIMD( tw, brush, &startout, &getout, &enterFrac, &leaveFrac, &leadside ) )
+		{
+			return;
+		}
+
+		if ( leadside )
+		{
+			clipplane = leadside->plane;
+		}
+	}
+	else
+#endif
 	if ( tw->type == traceType_t::TT_CAPSULE )
 	{
 		//
@@ -1271,14 +1634,12 @@ void CM_TraceThroughLeaf( traceWork_t *tw, const cLeaf_t *leaf )
 	const int *endBrushNum = firstBrushNum + leaf->numLeafBrushes;
 	for ( const int *brushNum = firstBrushNum; brushNum < endBrushNum; brushNum++ )
 	{
-		cbrush_t *b = &cm.brushes[ *brushNum ];
-
-		if ( b->checkcount == cm.checkcount )
+		if ( !CM_VisitBrush( tw, *brushNum ) )
 		{
 			continue; // already checked this brush in another leaf
 		}
 
-		b->checkcount = cm.checkcount;
+		const cbrush_t *b = CM_LeafBrush( *brushNum );
 
 		if ( !( b->contents & tw->contents ) )
 		{
@@ -1321,13 +1682,11 @@ void CM_TraceThroughLeaf( traceWork_t *tw, const cLeaf_t *leaf )
 			continue;
 		}
 
-		if ( surface->checkcount == cm.checkcount )
+		if ( !CM_VisitSurface( tw, *surfaceNum ) )
 		{
 			continue; // already checked this surface in another leaf
 		}
 
-		surface->checkcount = cm.checkcount;
-
 		if ( !( surface->contents & tw->contents ) )
 		{
 			continue;
@@ -1708,43 +2067,19 @@ void CM_TraceBoundingBoxThroughCapsule( traceWork_t *tw, clipHandle_t model )
 
 /*
 ==================
-CM_TraceThroughTree
+CM_SplitTraceSegment
 
-Traverse all the contacted leafs from the start to the end position.
-If the trace is a point, they will be exactly in order, but for larger
-trace volumes it is possible to hit something in a later leaf with
-a smaller intercept fraction.
+Finds on which sides of a node plane the segment p1 to p2 of the trace
+goes. Returns 0 or 1 if it only touches the front or back child, or 2 if it
+crosses the plane. In that case side is the child it goes through first,
+the segment goes through it up to frac and through the other one from frac2.
 ==================
 */
-static void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2 )
+static inline int CM_SplitTraceSegment( const traceWork_t *tw, const cplane_t *plane, const vec3_t p1, const vec3_t p2,
+                                        int *side, float *frac, float *frac2 )
 {
-	cNode_t  *node;
-	cplane_t *plane;
-	float    t1, t2, offset;
-	float    frac, frac2;
-	float    idist;
-	vec3_t   mid;
-	int      side;
-	float    midf;
-
-	if ( tw->trace.fraction < p1f )
-	{
-		return; // already hit something nearer
-	}
-
-	// if < 0, we are in a leaf node
-	if ( num < 0 )
-	{
-		CM_TraceThroughLeaf( tw, &cm.leafs[ -1 - num ] );
-		return;
-	}
-
-	//
-	// find the point distances to the separating plane
-	// and the offset for the size of the box
-	//
-	node = cm.nodes + num;
-	plane = node->plane;
+	float t1, t2, offset;
+	float idist;
 
 	// adjust the plane distance appropriately for mins/maxs
 	if ( plane->type < 3 )
@@ -1763,109 +2098,233 @@ static void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f,
 	// see which sides we need to consider
 	if ( t1 >= offset + 1 && t2 >= offset + 1 )
 	{
-		CM_TraceThroughTree( tw, node->children[ 0 ], p1f, p2f, p1, p2 );
-		return;
+		return 0;
 	}
 
 	if ( t1 < -offset - 1 && t2 < -offset - 1 )
 	{
-		CM_TraceThroughTree( tw, node->children[ 1 ], p1f, p2f, p1, p2 );
-		return;
+		return 1;
 	}
 
 	// put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
 	if ( t1 < t2 )
 	{
 		idist = 1.0f / ( t1 - t2 );
-		side = 1;
-		frac2 = ( t1 + offset + SURFACE_CLIP_EPSILON ) * idist;
-		frac = ( t1 - offset + SURFACE_CLIP_EPSILON ) * idist;
+		*side = 1;
+		*frac2 = ( t1 + offset + SURFACE_CLIP_EPSILON ) * idist;
+		*frac = ( t1 - offset + SURFACE_CLIP_EPSILON ) * idist;
 	}
 	else if ( t1 > t2 )
 	{
 		idist = 1.0f / ( t1 - t2 );
-		side = 0;
-		frac2 = ( t1 - offset - SURFACE_CLIP_EPSILON ) * idist;
-		frac = ( t1 + offset + SURFACE_CLIP_EPSILON ) * idist;
+		*side = 0;
+		*frac2 = ( t1 - offset - SURFACE_CLIP_EPSILON ) * idist;
+		*frac = ( t1 + offset + SURFACE_CLIP_EPSILON ) * idist;
 	}
 	else
 	{
-		side = 0;
-		frac = 1;
-		frac2 = 0;
+		*side = 0;
+		*frac = 1;
+		*frac2 = 0;
 	}
 
-	// move up to the node
-	if ( frac < 0 )
+	// move up to the node, go past the node
+	*frac = Math::Clamp( *frac, 0.0f, 1.0f );
+	*frac2 = Math::Clamp( *frac2, 0.0f, 1.0f );
+
+	return 2;
+}
+
+static inline void CM_LerpTraceSegment( float p1f, float p2f, const vec3_t p1, const vec3_t p2, float frac,
+                                        float *midf, vec3_t mid )
+{
+	*midf = p1f + ( p2f - p1f ) * frac;
+
+	mid[ 0 ] = p1[ 0 ] + frac * ( p2[ 0 ] - p1[ 0 ] );
+	mid[ 1 ] = p1[ 1 ] + frac * ( p2[ 1 ] - p1[ 1 ] );
+	mid[ 2 ] = p1[ 2 ] + frac * ( p2[ 2 ] - p1[ 2 ] );
+}
+
+/*
+==================
+CM_TraceThroughTree
+
+Traverse all the contacted leafs from the start to the end position.
+If the trace is a point, they will be exactly in order, but for larger
+trace volumes it is possible to hit something in a later leaf with
+a smaller intercept fraction.
+==================
+*/
+static void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2 )
+{
+	int      side;
+	float    frac, frac2;
+	float    midf;
+	vec3_t   mid;
+
+	if ( tw->trace.fraction < p1f )
 	{
-		frac = 0;
+		return; // already hit something nearer
 	}
 
-	if ( frac > 1 )
+	// if < 0, we are in a leaf node
+	if ( num < 0 )
 	{
-		frac = 1;
+		CM_TraceThroughLeaf( tw, &cm.leafs[ -1 - num ] );
+		return;
 	}
 
-	midf = p1f + ( p2f - p1f ) * frac;
+	const cNode_t *node = cm.nodes + num;
+	int sides = CM_SplitTraceSegment( tw, node->plane, p1, p2, &side, &frac, &frac2 );
 
-	mid[ 0 ] = p1[ 0 ] + frac * ( p2[ 0 ] - p1[ 0 ] );
-	mid[ 1 ] = p1[ 1 ] + frac * ( p2[ 1 ] - p1[ 1 ] );
-	mid[ 2 ] = p1[ 2 ] + frac * ( p2[ 2 ] - p1[ 2 ] );
+	if ( sides != 2 )
+	{
+		CM_TraceThroughTree( tw, node->children[ sides ], p1f, p2f, p1, p2 );
+		return;
+	}
 
+	CM_LerpTraceSegment( p1f, p2f, p1, p2, frac, &midf, mid );
 	CM_TraceThroughTree( tw, node->children[ side ], p1f, midf, p1, mid );
 
-	// go past the node
-	if ( frac2 < 0 )
+	CM_LerpTraceSegment( p1f, p2f, p1, p2, frac2, &midf, mid );
+	CM_TraceThroughTree( tw, node->children[ side ^ 1 ], midf, p2f, mid, p2 );
+}
+
+/*
+==================
+CM_TraceRaysThroughTree
+
+Same as CM_TraceThroughTree for several traces at once, a node is visited
+once for all the traces that reach it. The traces are independent so each
+of them only has to see its leafs in the same order as CM_TraceThroughTree.
+==================
+*/
+static const int MAX_TRACE_PACKET = 16;
+
+struct traceRay_t
+{
+	traceWork_t *tw;
+	float       p1f, p2f;
+	vec3_t      p1, p2;
+};
+
+static void CM_TraceRaysThroughTree( const traceRay_t *rays, int count, int num )
+{
+	if ( count == 1 )
 	{
-		frac2 = 0;
+		CM_TraceThroughTree( rays->tw, num, rays->p1f, rays->p2f, rays->p1, rays->p2 );
+		return;
 	}
 
-	if ( frac2 > 1 )
+	if ( num < 0 )
 	{
-		frac2 = 1;
+		const cLeaf_t *leaf = &cm.leafs[ -1 - num ];
+
+		for ( int i = 0; i < count; i++ )
+		{
+			if ( !( rays[ i ].tw->trace.fraction < rays[ i ].p1f ) )
+			{
+				CM_TraceThroughLeaf( rays[ i ].tw, leaf );
+			}
+		}
+
+		return;
 	}
 
-	midf = p1f + ( p2f - p1f ) * frac2;
+	const cNode_t *node = cm.nodes + num;
+	traceRay_t    children[ 2 ][ MAX_TRACE_PACKET ];
+	int           numChildren[ 2 ] = { 0, 0 };
+	int           sides[ MAX_TRACE_PACKET ], side[ MAX_TRACE_PACKET ];
+	float         frac[ MAX_TRACE_PACKET ], frac2[ MAX_TRACE_PACKET ];
 
-	mid[ 0 ] = p1[ 0 ] + frac2 * ( p2[ 0 ] - p1[ 0 ] );
-	mid[ 1 ] = p1[ 1 ] + frac2 * ( p2[ 1 ] - p1[ 1 ] );
-	mid[ 2 ] = p1[ 2 ] + frac2 * ( p2[ 2 ] - p1[ 2 ] );
+	// first the near side of each trace
+	for ( int i = 0; i < count; i++ )
+	{
+		const traceRay_t &ray = rays[ i ];
 
-	CM_TraceThroughTree( tw, node->children[ side ^ 1 ], midf, p2f, mid, p2 );
+		sides[ i ] = -1;
+
+		if ( ray.tw->trace.fraction < ray.p1f )
+		{
+			continue; // already hit something nearer
+		}
+
+		sides[ i ] = CM_SplitTraceSegment( ray.tw, node->plane, ray.p1, ray.p2, &side[ i ], &frac[ i ], &frac2[ i ] );
+
+		if ( sides[ i ] != 2 )
+		{
+			children[ sides[ i ] ][ numChildren[ sides[ i ] ]++ ] = ray;
+			continue;
+		}
+
+		traceRay_t &near = children[ side[ i ] ][ numChildren[ side[ i ] ]++ ];
+		near.tw = ray.tw;
+		near.p1f = ray.p1f;
+		VectorCopy( ray.p1, near.p1 );
+		CM_LerpTraceSegment( ray.p1f, ray.p2f, ray.p1, ray.p2, frac[ i ], &near.p2f, near.p2 );
+	}
+
+	for ( int child = 0; child < 2; child++ )
+	{
+		if ( numChildren[ child ] )
+		{
+			CM_TraceRaysThroughTree( children[ child ], numChildren[ child ], node->children[ child ] );
+		}
+	}
+
+	// then the far side of the traces crossing the plane
+	numChildren[ 0 ] = numChildren[ 1 ] = 0;
+
+	for ( int i = 0; i < count; i++ )
+	{
+		if ( sides[ i ] != 2 )
+		{
+			continue;
+		}
+
+		const traceRay_t &ray = rays[ i ];
+		traceRay_t &far = children[ side[ i ] ^ 1 ][ numChildren[ side[ i ] ^ 1 ]++ ];
+		far.tw = ray.tw;
+		far.p2f = ray.p2f;
+		VectorCopy( ray.p2, far.p2 );
+		CM_LerpTraceSegment( ray.p1f, ray.p2f, ray.p1, ray.p2, frac2[ i ], &far.p1f, far.p1 );
+	}
+
+	for ( int child = 0; child < 2; child++ )
+	{
+		if ( numChildren[ child ] )
+		{
+			CM_TraceRaysThroughTree( children[ child ], numChildren[ child ], node->children[ child ] );
+		}
+	}
 }
 
 //======================================================================
 
 /*
 ==================
-CM_Trace
+CM_SetupTrace
+
+Fills in the trace work for a trace, returns false if there is no map
 ==================
 */
-static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, const vec3_t mins,
-                      const vec3_t maxs, clipHandle_t model, const vec3_t origin, int brushmask,
-                      int skipmask, traceType_t type, const sphere_t *sphere )
+static bool CM_SetupTrace( traceWork_t *tw, const vec3_t start, const vec3_t end, const vec3_t mins,
+                           const vec3_t maxs, const vec3_t origin, int brushmask, int skipmask,
+                           traceType_t type, const sphere_t *sphere )
 {
 	int         i;
 	vec3_t      offset;
-	cmodel_t    *cmod;
-
-	cmod = CM_ClipHandleToModel( model );
-
-	cm.checkcount++; // for multi-check avoidance
 
 	c_traces++; // for statistics, may be zeroed
 
 	// fill in a default trace
-	traceWork_t tw{};
-	tw.trace.fraction = 1; // assume it goes the entire distance until shown otherwise
-	VectorCopy( origin, tw.modelOrigin );
-	tw.type = type;
+	tw->trace.fraction = 1; // assume it goes the entire distance until shown otherwise
+	VectorCopy( origin, tw->modelOrigin );
+	tw->type = type;
 
 	if ( !cm.numNodes )
 	{
-		*results = tw.trace;
-
-		return; // map not loaded, shouldn't happen
+		return false; // map not loaded, shouldn't happen
 	}
 
 	// allow nullptr to be passed in for 0,0,0
@@ -1880,8 +2339,8 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 	}
 
 	// set basic parms
-	tw.contents = brushmask;
-	tw.skipContents = skipmask;
+	tw->contents = brushmask;
+	tw->skipContents = skipmask;
 
 	// adjust so that mins and maxs are always symmetric, which
 	// avoids some complications with plane expanding of rotated
@@ -1891,86 +2350,86 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 		offset[ 1 ] = ( mins[ 1 ] + maxs[ 1 ] ) * 0.5;
 		offset[ 2 ] = ( mins[ 2 ] + maxs[ 2 ] ) * 0.5;
 
-		tw.size[ 0 ][ 0 ] = mins[ 0 ] - offset[ 0 ];
-		tw.size[ 0 ][ 1 ] = mins[ 1 ] - offset[ 1 ];
-		tw.size[ 0 ][ 2 ] = mins[ 2 ] - offset[ 2 ];
+		tw->size[ 0 ][ 0 ] = mins[ 0 ] - offset[ 0 ];
+		tw->size[ 0 ][ 1 ] = mins[ 1 ] - offset[ 1 ];
+		tw->size[ 0 ][ 2 ] = mins[ 2 ] - offset[ 2 ];
 
-		tw.size[ 1 ][ 0 ] = maxs[ 0 ] - offset[ 0 ];
-		tw.size[ 1 ][ 1 ] = maxs[ 1 ] - offset[ 1 ];
-		tw.size[ 1 ][ 2 ] = maxs[ 2 ] - offset[ 2 ];
+		tw->size[ 1 ][ 0 ] = maxs[ 0 ] - offset[ 0 ];
+		tw->size[ 1 ][ 1 ] = maxs[ 1 ] - offset[ 1 ];
+		tw->size[ 1 ][ 2 ] = maxs[ 2 ] - offset[ 2 ];
 
-		tw.start[ 0 ] = start[ 0 ] + offset[ 0 ];
-		tw.start[ 1 ] = start[ 1 ] + offset[ 1 ];
-		tw.start[ 2 ] = start[ 2 ] + offset[ 2 ];
+		tw->start[ 0 ] = start[ 0 ] + offset[ 0 ];
+		tw->start[ 1 ] = start[ 1 ] + offset[ 1 ];
+		tw->start[ 2 ] = start[ 2 ] + offset[ 2 ];
 
-		tw.end[ 0 ] = end[ 0 ] + offset[ 0 ];
-		tw.end[ 1 ] = end[ 1 ] + offset[ 1 ];
-		tw.end[ 2 ] = end[ 2 ] + offset[ 2 ];
+		tw->end[ 0 ] = end[ 0 ] + offset[ 0 ];
+		tw->end[ 1 ] = end[ 1 ] + offset[ 1 ];
+		tw->end[ 2 ] = end[ 2 ] + offset[ 2 ];
 	}
 
 	// if a sphere is already specified
 	if ( sphere )
 	{
-		tw.sphere = *sphere;
+		tw->sphere = *sphere;
 	}
 	else
 	{
-		tw.sphere.radius = ( tw.size[ 1 ][ 0 ] > tw.size[ 1 ][ 2 ] ) ? tw.size[ 1 ][ 2 ] : tw.size[ 1 ][ 0 ];
-		tw.sphere.halfheight = tw.size[ 1 ][ 2 ];
-		VectorSet( tw.sphere.offset, 0, 0, tw.size[ 1 ][ 2 ] - tw.sphere.radius );
+		tw->sphere.radius = ( tw->size[ 1 ][ 0 ] > tw->size[ 1 ][ 2 ] ) ? tw->size[ 1 ][ 2 ] : tw->size[ 1 ][ 0 ];
+		tw->sphere.halfheight = tw->size[ 1 ][ 2 ];
+		VectorSet( tw->sphere.offset, 0, 0, tw->size[ 1 ][ 2 ] - tw->sphere.radius );
 	}
 
-	tw.maxOffset = VectorLength( tw.size[ 1 ] );
+	tw->maxOffset = VectorLength( tw->size[ 1 ] );
 
-	// tw.offsets[signbits] = vector to appropriate corner from origin
-	tw.offsets[ 0 ][ 0 ] = tw.size[ 0 ][ 0 ];
-	tw.offsets[ 0 ][ 1 ] = tw.size[ 0 ][ 1 ];
-	tw.offsets[ 0 ][ 2 ] = tw.size[ 0 ][ 2 ];
+	// tw->offsets[signbits] = vector to appropriate corner from origin
+	tw->offsets[ 0 ][ 0 ] = tw->size[ 0 ][ 0 ];
+	tw->offsets[ 0 ][ 1 ] = tw->size[ 0 ][ 1 ];
+	tw->offsets[ 0 ][ 2 ] = tw->size[ 0 ][ 2 ];
 
-	tw.offsets[ 1 ][ 0 ] = tw.size[ 1 ][ 0 ];
-	tw.offsets[ 1 ][ 1 ] = tw.size[ 0 ][ 1 ];
-	tw.offsets[ 1 ][ 2 ] = tw.size[ 0 ][ 2 ];
+	tw->offsets[ 1 ][ 0 ] = tw->size[ 1 ][ 0 ];
+	tw->offsets[ 1 ][ 1 ] = tw->size[ 0 ][ 1 ];
+	tw->offsets[ 1 ][ 2 ] = tw->size[ 0 ][ 2 ];
 
-	tw.offsets[ 2 ][ 0 ] = tw.size[ 0 ][ 0 ];
-	tw.offsets[ 2 ][ 1 ] = tw.size[ 1 ][ 1 ];
-	tw.offsets[ 2 ][ 2 ] = tw.size[ 0 ][ 2 ];
+	tw->offsets[ 2 ][ 0 ] = tw->size[ 0 ][ 0 ];
+	tw->offsets[ 2 ][ 1 ] = tw->size[ 1 ][ 1 ];
+	tw->offsets[ 2 ][ 2 ] = tw->size[ 0 ][ 2 ];
 
-	tw.offsets[ 3 ][ 0 ] = tw.size[ 1 ][ 0 ];
-	tw.offsets[ 3 ][ 1 ] = tw.size[ 1 ][ 1 ];
-	tw.offsets[ 3 ][ 2 ] = tw.size[ 0 ][ 2 ];
+	tw->offsets[ 3 ][ 0 ] = tw->size[ 1 ][ 0 ];
+	tw->offsets[ 3 ][ 1 ] = tw->size[ 1 ][ 1 ];
+	tw->offsets[ 3 ][ 2 ] = tw->size[ 0 ][ 2 ];
 
-	tw.offsets[ 4 ][ 0 ] = tw.size[ 0 ][ 0 ];
-	tw.offsets[ 4 ][ 1 ] = tw.size[ 0 ][ 1 ];
-	tw.offsets[ 4 ][ 2 ] = tw.size[ 1 ][ 2 ];
+	tw->offsets[ 4 ][ 0 ] = tw->size[ 0 ][ 0 ];
+	tw->offsets[ 4 ][ 1 ] = tw->size[ 0 ][ 1 ];
+	tw->offsets[ 4 ][ 2 ] = tw->size[ 1 ][ 2 ];
 
-	tw.offsets[ 5 ][ 0 ] = tw.size[ 1 ][ 0 ];
-	tw.offsets[ 5 ][ 1 ] = tw.size[ 0 ][ 1 ];
-	tw.offsets[ 5 ][ 2 ] = tw.size[ 1 ][ 2 ];
+	tw->offsets[ 5 ][ 0 ] = tw->size[ 1 ][ 0 ];
+	tw->offsets[ 5 ][ 1 ] = tw->size[ 0 ][ 1 ];
+	tw->offsets[ 5 ][ 2 ] = tw->size[ 1 ][ 2 ];
 
-	tw.offsets[ 6 ][ 0 ] = tw.size[ 0 ][ 0 ];
-	tw.offsets[ 6 ][ 1 ] = tw.size[ 1 ][ 1 ];
-	tw.offsets[ 6 ][ 2 ] = tw.size[ 1 ][ 2 ];
+	tw->offsets[ 6 ][ 0 ] = tw->size[ 0 ][ 0 ];
+	tw->offsets[ 6 ][ 1 ] = tw->size[ 1 ][ 1 ];
+	tw->offsets[ 6 ][ 2 ] = tw->size[ 1 ][ 2 ];
 
-	tw.offsets[ 7 ][ 0 ] = tw.size[ 1 ][ 0 ];
-	tw.offsets[ 7 ][ 1 ] = tw.size[ 1 ][ 1 ];
-	tw.offsets[ 7 ][ 2 ] = tw.size[ 1 ][ 2 ];
+	tw->offsets[ 7 ][ 0 ] = tw->size[ 1 ][ 0 ];
+	tw->offsets[ 7 ][ 1 ] = tw->size[ 1 ][ 1 ];
+	tw->offsets[ 7 ][ 2 ] = tw->size[ 1 ][ 2 ];
 
 	//
 	// calculate bounds
 	//
-	if ( tw.type == traceType_t::TT_CAPSULE )
+	if ( tw->type == traceType_t::TT_CAPSULE )
 	{
 		for ( i = 0; i < 3; i++ )
 		{
-			if ( tw.start[ i ] < tw.end[ i ] )
+			if ( tw->start[ i ] < tw->end[ i ] )
 			{
-				tw.bounds[ 0 ][ i ] = tw.start[ i ] - fabsf( tw.sphere.offset[ i ] ) - tw.sphere.radius;
-				tw.bounds[ 1 ][ i ] = tw.end[ i ] + fabsf( tw.sphere.offset[ i ] ) + tw.sphere.radius;
+				tw->bounds[ 0 ][ i ] = tw->start[ i ] - fabsf( tw->sphere.offset[ i ] ) - tw->sphere.radius;
+				tw->bounds[ 1 ][ i ] = tw->end[ i ] + fabsf( tw->sphere.offset[ i ] ) + tw->sphere.radius;
 			}
 			else
 			{
-				tw.bounds[ 0 ][ i ] = tw.end[ i ] - fabsf( tw.sphere.offset[ i ] ) - tw.sphere.radius;
-				tw.bounds[ 1 ][ i ] = tw.start[ i ] + fabsf( tw.sphere.offset[ i ] ) + tw.sphere.radius;
+				tw->bounds[ 0 ][ i ] = tw->end[ i ] - fabsf( tw->sphere.offset[ i ] ) - tw->sphere.radius;
+				tw->bounds[ 1 ][ i ] = tw->start[ i ] + fabsf( tw->sphere.offset[ i ] ) + tw->sphere.radius;
 			}
 		}
 	}
@@ -1978,19 +2437,90 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 	{
 		for ( i = 0; i < 3; i++ )
 		{
-			if ( tw.start[ i ] < tw.end[ i ] )
+			if ( tw->start[ i ] < tw->end[ i ] )
 			{
-				tw.bounds[ 0 ][ i ] = tw.start[ i ] + tw.size[ 0 ][ i ];
-				tw.bounds[ 1 ][ i ] = tw.end[ i ] + tw.size[ 1 ][ i ];
+				tw->bounds[ 0 ][ i ] = tw->start[ i ] + tw->size[ 0 ][ i ];
+				tw->bounds[ 1 ][ i ] = tw->end[ i ] + tw->size[ 1 ][ i ];
 			}
 			else
 			{
-				tw.bounds[ 0 ][ i ] = tw.end[ i ] + tw.size[ 0 ][ i ];
-				tw.bounds[ 1 ][ i ] = tw.start[ i ] + tw.size[ 1 ][ i ];
+				tw->bounds[ 0 ][ i ] = tw->end[ i ] + tw->size[ 0 ][ i ];
+				tw->bounds[ 1 ][ i ] = tw->start[ i ] + tw->size[ 1 ][ i ];
 			}
 		}
 	}
 
+	return true;
+}
+
+/*
+==================
+CM_SetupTraceSweep
+
+Extents used against the node planes by a trace that is not a position test
+==================
+*/
+static void CM_SetupTraceSweep( traceWork_t *tw )
+{
+	//
+	// check for point special case
+	//
+	if ( tw->size[ 0 ][ 0 ] == 0 && tw->size[ 0 ][ 1 ] == 0 && tw->size[ 0 ][ 2 ] == 0 )
+	{
+		tw->isPoint = true;
+		VectorClear( tw->extents );
+	}
+	else
+	{
+		tw->isPoint = false;
+		tw->extents[ 0 ] = tw->size[ 1 ][ 0 ];
+		tw->extents[ 1 ] = tw->size[ 1 ][ 1 ];
+		tw->extents[ 2 ] = tw->size[ 1 ][ 2 ];
+	}
+}
+
+/*
+==================
+CM_FinishTrace
+==================
+*/
+static void CM_FinishTrace( trace_t *results, traceWork_t *tw, const vec3_t start, const vec3_t end )
+{
+	// generate endpos from the original, unmodified start/end
+	if ( tw->trace.fraction == 1 )
+	{
+		VectorCopy( end, tw->trace.endpos );
+	}
+	else
+	{
+		VectorLerp( start, end, tw->trace.fraction, tw->trace.endpos );
+	}
+
+	*results = tw->trace;
+}
+
+/*
+==================
+CM_Trace
+==================
+*/
+static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, const vec3_t mins,
+                      const vec3_t maxs, clipHandle_t model, const vec3_t origin, int brushmask,
+                      int skipmask, traceType_t type, const sphere_t *sphere )
+{
+	cmodel_t    *cmod;
+
+	cmod = CM_ClipHandleToModel( model );
+
+	traceWork_t tw{};
+	CM_BeginTraceVisits( &tw ); // for multi-check avoidance
+
+	if ( !CM_SetupTrace( &tw, start, end, mins, maxs, origin, brushmask, skipmask, type, sphere ) )
+	{
+		*results = tw.trace;
+		return;
+	}
+
 	//
 	// check for position test special case
 	//
@@ -2036,21 +2566,7 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 	}
 	else
 	{
-		//
-		// check for point special case
-		//
-		if ( tw.size[ 0 ][ 0 ] == 0 && tw.size[ 0 ][ 1 ] == 0 && tw.size[ 0 ][ 2 ] == 0 )
-		{
-			tw.isPoint = true;
-			VectorClear( tw.extents );
-		}
-		else
-		{
-			tw.isPoint = false;
-			tw.extents[ 0 ] = tw.size[ 1 ][ 0 ];
-			tw.extents[ 1 ] = tw.size[ 1 ][ 1 ];
-			tw.extents[ 2 ] = tw.size[ 1 ][ 2 ];
-		}
+		CM_SetupTraceSweep( &tw );
 
 		//
 		// general sweeping through world
@@ -2094,17 +2610,7 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 		}
 	}
 
-	// generate endpos from the original, unmodified start/end
-	if ( tw.trace.fraction == 1 )
-	{
-		VectorCopy( end, tw.trace.endpos );
-	}
-	else
-	{
-		VectorLerp( start, end, tw.trace.fraction, tw.trace.endpos );
-	}
-
-	*results = tw.trace;
+	CM_FinishTrace( results, &tw, start, end );
 }
 
 /*
@@ -2118,6 +2624,91 @@ void CM_BoxTrace( trace_t *results, const vec3_t start, const vec3_t end, const
 	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, skipmask, type, nullptr );
 }
 
+/*
+==================
+CM_BoxTraceBatch
+
+The sweeps through the world are sent down the tree in packets of
+MAX_TRACE_PACKET traces, which share a stamp of the tested brushes and
+surfaces. Position tests and traces against other models don't descend
+the tree and go through CM_Trace.
+==================
+*/
+void CM_BoxTraceBatch( trace_t *results, const boxTraceQuery_t *queries, int count,
+                       clipHandle_t model, int brushmask, int skipmask, traceType_t type )
+{
+	if ( model || !cm.numNodes )
+	{
+		for ( int i = 0; i < count; i++ )
+		{
+			const boxTraceQuery_t &q = queries[ i ];
+			CM_BoxTrace( &results[ i ], q.start, q.end, q.mins, q.maxs, model, brushmask, skipmask, type );
+		}
+
+		return;
+	}
+
+	traceWork_t tws[ MAX_TRACE_PACKET ];
+	traceRay_t  rays[ MAX_TRACE_PACKET ];
+	int         indexes[ MAX_TRACE_PACKET ];
+	int         numRays = 0;
+
+	for ( int i = 0; i <= count; i++ )
+	{
+		if ( numRays == MAX_TRACE_PACKET || ( i == count && numRays ) )
+		{
+			CM_TraceRaysThroughTree( rays, numRays, 0 );
+
+			for ( int j = 0; j < numRays; j++ )
+			{
+				const boxTraceQuery_t &q = queries[ indexes[ j ] ];
+				CM_FinishTrace( &results[ indexes[ j ] ], &tws[ j ], q.start, q.end );
+			}
+
+			numRays = 0;
+		}
+
+		if ( i == count )
+		{
+			break;
+		}
+
+		const boxTraceQuery_t &q = queries[ i ];
+
+		if ( VectorCompare( q.start, q.end ) )
+		{
+			CM_BoxTrace( &results[ i ], q.start, q.end, q.mins, q.maxs, model, brushmask, skipmask, type );
+			continue;
+		}
+
+		traceWork_t &tw = tws[ numRays ];
+		tw = {};
+
+		if ( !numRays )
+		{
+			CM_BeginTraceVisits( &tw );
+		}
+		else
+		{
+			tw.visits = tws[ 0 ].visits;
+		}
+
+		tw.rayMask = 1u << numRays;
+
+		CM_SetupTrace( &tw, q.start, q.end, q.mins, q.maxs, vec3_origin, brushmask, skipmask, type, nullptr );
+		CM_SetupTraceSweep( &tw );
+
+		traceRay_t &ray = rays[ numRays ];
+		ray.tw = &tw;
+		ray.p1f = 0;
+		ray.p2f = 1;
+		VectorCopy( tw.start, ray.p1 );
+		VectorCopy( tw.end, ray.p2 );
+
+		indexes[ numRays++ ] = i;
+	}
+}
+
 /*
 ==================
 CM_TransformedBoxTrace
@@ -2365,7 +2956,7 @@ float CM_DistanceToModel( const vec3_t loc, clipHandle_t model ) {
 	const int *endBrushNum = firstBrushNum + leaf->numLeafBrushes;
 	for ( const int *brushNum = firstBrushNum; brushNum < endBrushNum; brushNum++ )
 	{
-		const cbrush_t *b = &cm.brushes[ *brushNum ];
+		const cbrush_t *b = CM_LeafBrush( *brushNum );
 
 		d1 = CM_DistanceToBrush( loc, b );
 		if( d1 < dist )
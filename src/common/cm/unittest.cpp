@@ -28,11 +28,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 ===========================================================================
 */
 
+#include <random>
+#include <thread>
+
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
-#include "cm_public.h"
+#include "cm_local.h"
 #include "common/FileSystem.h"
+#ifdef BUILD_ENGINE
+#include "engine/framework/CvarSystem.h"
+#endif
 
 namespace {
 
@@ -184,4 +190,316 @@ TEST_F(TraceTest, BoxHitPatch)
     EXPECT_NEAR(tr.plane.dist, 362.105, PATCH_PLANE_DIST_ATOL);
 }
 
+// A batch must give the same results as tracing its queries one by one
+TEST_F(TraceTest, BatchMatchesSingleTraces)
+{
+    std::mt19937 rng(12);
+    std::uniform_real_distribution<float> position(-2500.0f, 2500.0f);
+    std::uniform_real_distribution<float> extent(0.0f, 40.0f);
+    std::vector<boxTraceQuery_t> queries(1000);
+    for (boxTraceQuery_t& q : queries) {
+        for (int i = 0; i < 3; i++) {
+            q.start[i] = position(rng);
+            // rays going from around the same place, like a hitscan spread
+            q.end[i] = rng() % 8 ? q.start[i] + position(rng) / 4 : q.start[i];
+            q.maxs[i] = rng() % 3 ? extent(rng) : 0.0f;
+            q.mins[i] = -q.maxs[i];
+        }
+    }
+
+    for (traceType_t type : {traceType_t::TT_AABB, traceType_t::TT_CAPSULE}) {
+        std::vector<trace_t> results(queries.size());
+        CM_BoxTraceBatch(results.data(), queries.data(), queries.size(), CM_InlineModel(0), contentmask, skipmask, type);
+
+        for (size_t i = 0; i < queries.size(); i++) {
+            const boxTraceQuery_t& q = queries[i];
+            trace_t tr;
+            CM_BoxTrace(&tr, q.start, q.end, q.mins, q.maxs, CM_InlineModel(0), contentmask, skipmask, type);
+            EXPECT_EQ(tr.fraction, results[i].fraction) << "query " << i;
+            EXPECT_EQ(tr.startsolid, results[i].startsolid) << "query " << i;
+            EXPECT_EQ(tr.allsolid, results[i].allsolid) << "query " << i;
+            EXPECT_EQ(tr.contents, results[i].contents) << "query " << i;
+            EXPECT_EQ(tr.surfaceFlags, results[i].surfaceFlags) << "query " << i;
+            EXPECT_THAT(results[i].plane.normal, Pointwise(FloatNear(0), tr.plane.normal)) << "query " << i;
+            EXPECT_THAT(results[i].endpos, Pointwise(FloatNear(0), tr.endpos)) << "query " << i;
+        }
+    }
+}
+
+#ifdef BUILD_ENGINE
+// The SIMD brush tests must give the same results as the reference code
+TEST_F(TraceTest, SIMDBrushesMatchReference)
+{
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<float> position(-2500.0f, 2500.0f);
+    std::uniform_real_distribution<float> extent(0.0f, 40.0f);
+    std::vector<boxTraceQuery_t> queries(4000);
+    for (boxTraceQuery_t& q : queries) {
+        for (int i = 0; i < 3; i++) {
+            q.start[i] = position(rng);
+            // some position tests
+            q.end[i] = rng() % 4 ? q.start[i] + position(rng) / 4 : q.start[i];
+            q.maxs[i] = rng() % 3 ? extent(rng) : 0.0f;
+            q.mins[i] = -extent(rng);
+        }
+    }
+
+    auto run = [&](bool simd, traceType_t type) {
+        Cvar::SetValueForce("cm_simdBrushes", simd ? "1" : "0");
+        std::vector<trace_t> results;
+        for (const boxTraceQuery_t& q : queries) {
+            trace_t tr;
+            CM_BoxTrace(&tr, q.start, q.end, q.mins, q.maxs, CM_InlineModel(0), contentmask, skipmask, type);
+            results.push_back(tr);
+        }
+        return results;
+    };
+
+    for (traceType_t type : {traceType_t::TT_AABB, traceType_t::TT_CAPSULE}) {
+        std::vector<trace_t> reference = run(false, type);
+        std::vector<trace_t> results = run(true, type);
+
+        for (size_t i = 0; i < queries.size(); i++) {
+            EXPECT_EQ(reference[i].fraction, results[i].fraction) << "query " << i;
+            EXPECT_EQ(reference[i].startsolid, results[i].startsolid) << "query " << i;
+            EXPECT_EQ(reference[i].allsolid, results[i].allsolid) << "query " << i;
+            EXPECT_EQ(reference[i].contents, results[i].contents) << "query " << i;
+            EXPECT_EQ(reference[i].surfaceFlags, results[i].surfaceFlags) << "query " << i;
+            EXPECT_THAT(results[i].plane.normal, Pointwise(FloatNear(0), reference[i].plane.normal)) << "query " << i;
+            EXPECT_EQ(reference[i].plane.dist, results[i].plane.dist) << "query " << i;
+        }
+    }
+
+    Cvar::SetValueForce("cm_simdBrushes", "1");
+}
+
+#if defined(DAEMON_USE_ARCH_INTRINSICS_I686_SSE)
+// The SIMD brush planes must not divide by zero where the reference loop
+// doesn't, so common.floatExceptions.divByZero can be used with them
+TEST_F(TraceTest, SIMDBrushesRaiseNoDivisionByZero)
+{
+    std::mt19937 rng(16);
+    std::uniform_real_distribution<float> position(-2500.0f, 2500.0f);
+    std::vector<boxTraceQuery_t> queries(1000);
+    for (boxTraceQuery_t& q : queries) {
+        for (int i = 0; i < 3; i++) {
+            q.start[i] = position(rng);
+            // axial moves put the start and end points at the same distance of many planes
+            q.end[i] = i == 0 ? q.start[i] + position(rng) / 4 : q.start[i];
+            q.maxs[i] = 15.0f;
+            q.mins[i] = -15.0f;
+        }
+    }
+
+    Cvar::SetValueForce("cm_simdBrushes", "1");
+    unsigned int mask = _MM_GET_EXCEPTION_MASK();
+    _MM_SET_EXCEPTION_STATE(0);
+    _MM_SET_EXCEPTION_MASK(mask & ~_MM_MASK_DIV_ZERO);
+    for (const boxTraceQuery_t& q : queries) {
+        trace_t tr;
+        CM_BoxTrace(&tr, q.start, q.end, q.mins, q.maxs, CM_InlineModel(0), contentmask, skipmask, traceType_t::TT_AABB);
+    }
+    _MM_SET_EXCEPTION_MASK(mask);
+}
+#endif
+
+// Testing only the facets near a trace must give the same results as testing them all
+TEST_F(TraceTest, FacetTreeMatchesAllFacets)
+{
+    // around the patches of the other tests
+    const vec3_t centers[] = { { -1990, 1855, 110 }, { 1617, 2020, 115 }, { 1774.7, 1113.7, 150.1 } };
+
+    std::mt19937 rng(14);
+    std::uniform_real_distribution<float> position(-150.0f, 150.0f);
+    std::uniform_real_distribution<float> extent(0.0f, 40.0f);
+    std::vector<boxTraceQuery_t> queries(6000);
+    for (size_t n = 0; n < queries.size(); n++) {
+        boxTraceQuery_t& q = queries[n];
+        bool point = rng() % 3 == 0;
+        bool positionTest = rng() % 5 == 0;
+        for (int i = 0; i < 3; i++) {
+            q.start[i] = centers[n % 3][i] + position(rng);
+            q.end[i] = positionTest ? q.start[i] : centers[n % 3][i] + position(rng);
+            q.maxs[i] = point ? 0.0f : extent(rng);
+            q.mins[i] = point ? 0.0f : -extent(rng);
+        }
+    }
+
+    auto run = [&](bool tree, traceType_t type) {
+        Cvar::SetValueForce("cm_facetTrees", tree ? "1" : "0");
+        std::vector<trace_t> results;
+        for (const boxTraceQuery_t& q : queries) {
+            trace_t tr;
+            CM_BoxTrace(&tr, q.start, q.end, q.mins, q.maxs, CM_InlineModel(0), contentmask, skipmask, type);
+            results.push_back(tr);
+        }
+        return results;
+    };
+
+    for (traceType_t type : {traceType_t::TT_AABB, traceType_t::TT_CAPSULE}) {
+        std::vector<trace_t> reference = run(false, type);
+        std::vector<trace_t> results = run(true, type);
+
+        for (size_t i = 0; i < queries.size(); i++) {
+            EXPECT_EQ(reference[i].fraction, results[i].fraction) << "query " << i;
+            EXPECT_EQ(reference[i].startsolid, results[i].startsolid) << "query " << i;
+            EXPECT_EQ(reference[i].allsolid, results[i].allsolid) << "query " << i;
+            EXPECT_EQ(reference[i].contents, results[i].contents) << "query " << i;
+            EXPECT_THAT(results[i].plane.normal, Pointwise(FloatNear(0), reference[i].plane.normal)) << "query " << i;
+            EXPECT_EQ(reference[i].plane.dist, results[i].plane.dist) << "query " << i;
+        }
+    }
+
+    Cvar::SetValueForce("cm_facetTrees", "1");
+}
+
+// Loading the surface collides from the cache must give the same traces as
+// generating them, and a damaged cache must be ignored
+TEST_F(TraceTest, CollisionCacheMatchesGeneratedCollision)
+{
+    const vec3_t centers[] = { { -1990, 1855, 110 }, { 1617, 2020, 115 }, { 1774.7, 1113.7, 150.1 } };
+
+    std::mt19937 rng(15);
+    std::uniform_real_distribution<float> position(-150.0f, 150.0f);
+    std::uniform_real_distribution<float> extent(0.0f, 40.0f);
+    std::vector<boxTraceQuery_t> queries(3000);
+    for (size_t n = 0; n < queries.size(); n++) {
+        boxTraceQuery_t& q = queries[n];
+        for (int i = 0; i < 3; i++) {
+            q.start[i] = centers[n % 3][i] + position(rng);
+            q.end[i] = centers[n % 3][i] + position(rng);
+            q.maxs[i] = extent(rng);
+            q.mins[i] = -extent(rng);
+        }
+    }
+
+    auto run = [&] {
+        std::vector<trace_t> results;
+        for (const boxTraceQuery_t& q : queries) {
+            trace_t tr;
+            CM_BoxTrace(&tr, q.start, q.end, q.mins, q.maxs, CM_InlineModel(0), contentmask, skipmask, traceType_t::TT_AABB);
+            results.push_back(tr);
+        }
+        return results;
+    };
+
+    auto expectSame = [&](const std::vector<trace_t>& reference, const std::vector<trace_t>& results) {
+        for (size_t i = 0; i < queries.size(); i++) {
+            EXPECT_EQ(reference[i].fraction, results[i].fraction) << "query " << i;
+            EXPECT_EQ(reference[i].startsolid, results[i].startsolid) << "query " << i;
+            EXPECT_EQ(reference[i].contents, results[i].contents) << "query " << i;
+            EXPECT_THAT(results[i].plane.normal, Pointwise(FloatNear(0), reference[i].plane.normal)) << "query " << i;
+        }
+    };
+
+    const char* map = "plat23_1.13.4";
+    const char* cachePath = "cache/maps/plat23_1.13.4.cmc";
+
+    Cvar::SetValue("cm_cache", "0");
+    CM_LoadMap(map);
+    ASSERT_FALSE(cm.loadedFromCache);
+    std::vector<trace_t> reference = run();
+
+    Cvar::SetValue("cm_cache", "1");
+    std::error_code err;
+    FS::HomePath::DeleteFile(cachePath, err);
+    CM_LoadMap(map);
+    EXPECT_FALSE(cm.loadedFromCache);
+    ASSERT_TRUE(FS::HomePath::FileExists(cachePath));
+    expectSame(reference, run());
+
+    CM_LoadMap(map);
+    EXPECT_TRUE(cm.loadedFromCache);
+    expectSame(reference, run());
+
+    {
+        FS::File file = FS::HomePath::OpenEdit(cachePath);
+        file.SeekEnd(-100);
+        char c;
+        file.Read(&c, 1);
+        c ^= 0x10;
+        file.SeekCur(-1);
+        file.Write(&c, 1);
+    }
+
+    CM_LoadMap(map);
+    EXPECT_FALSE(cm.loadedFromCache);
+    expectSame(reference, run());
+
+    // the damaged cache was replaced
+    CM_LoadMap(map);
+    EXPECT_TRUE(cm.loadedFromCache);
+}
+
+// Traces keep their state per thread in the engine, so the same traces run
+// from several threads at once must give the results of a single thread
+TEST_F(TraceTest, ConcurrentTraces)
+{
+    struct Query {
+        vec3_t start, end, mins, maxs, boxMins, boxMaxs;
+        traceType_t type;
+        bool againstBox;
+    };
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> position(-2500.0f, 2500.0f);
+    std::uniform_real_distribution<float> extent(0.0f, 40.0f);
+    std::vector<Query> queries(2000);
+    for (Query& q : queries) {
+        for (int i = 0; i < 3; i++) {
+            q.start[i] = position(rng);
+            q.end[i] = q.start[i] + position(rng) / 4;
+            q.maxs[i] = extent(rng);
+            q.mins[i] = -q.maxs[i];
+            q.boxMaxs[i] = extent(rng);
+            q.boxMins[i] = -q.boxMaxs[i];
+        }
+        q.type = rng() % 2 ? traceType_t::TT_AABB : traceType_t::TT_CAPSULE;
+        q.againstBox = rng() % 4 == 0;
+    }
+
+    auto run = [&](const Query& q) {
+        trace_t tr;
+        if (q.againstBox) {
+            vec3_t origin{ q.start[0], q.start[1], q.start[2] + 30 };
+            clipHandle_t box = CM_TempBoxModel(q.boxMins, q.boxMaxs, false);
+            CM_TransformedBoxTrace(&tr, q.start, q.end, q.mins, q.maxs, box, contentmask, skipmask, origin, vec3_origin, q.type);
+        } else {
+            CM_BoxTrace(&tr, q.start, q.end, q.mins, q.maxs, CM_InlineModel(0), contentmask, skipmask, q.type);
+        }
+        return tr;
+    };
+
+    std::vector<trace_t> expected;
+    for (const Query& q : queries) {
+        expected.push_back(run(q));
+    }
+
+    std::vector<int> mismatches(4, 0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < mismatches.size(); t++) {
+        threads.emplace_back([&, t] {
+            for (int pass = 0; pass < 5; pass++) {
+                for (size_t i = 0; i < queries.size(); i++) {
+                    // different orders on each thread
+                    size_t n = (i * (2 * t + 1) + pass) % queries.size();
+                    trace_t tr = run(queries[n]);
+                    if (tr.fraction != expected[n].fraction || tr.startsolid != expected[n].startsolid ||
+                        tr.allsolid != expected[n].allsolid || !VectorCompare(tr.endpos, expected[n].endpos)) {
+                        mismatches[t]++;
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (int count : mismatches) {
+        EXPECT_EQ(0, count);
+    }
+}
+#endif
+
 } // namespace
@@ -157,6 +157,8 @@ struct refexport_t {
 	int ( *BuildSkeleton )( refSkeleton_t* skel, qhandle_t anim, int startFrame, int endFrame, float frac,
 		bool clearOrigin );
 	int ( *BlendSkeleton )( refSkeleton_t* skel, const refSkeleton_t* blend, float frac );
+	void ( *BuildSkeletons )( const std::vector<SkeletonRequest>& requests, std::vector<refSkeleton_t>& skeletons,
+		std::vector<int>& results );
 	int ( *BoneIndex )( qhandle_t hModel, const char* boneName );
 	int ( *AnimNumFrames )( qhandle_t hAnim );
 	int ( *AnimFrameRate )( qhandle_t hAnim );
@@ -51,7 +51,7 @@ namespace Audio{
  *position tracks the current position while reading the file
  */
 struct OggDataSource {
-	std::string* audioFile;
+	const FS::FileView* audioFile;
 	size_t position;
 };
 
@@ -87,7 +87,7 @@ size_t OggCallbackRead(void* ptr, size_t size, size_t count, void* datasource)
 		return 0;
 	}
 
-	std::string* audioFile = data->audioFile;
+	const FS::FileView* audioFile = data->audioFile;
 	size_t position = data->position;
 	size_t bytesRemaining = audioFile->size() - position;
 	size_t bytesToRead = size * count;
@@ -95,7 +95,7 @@ size_t OggCallbackRead(void* ptr, size_t size, size_t count, void* datasource)
 		bytesToRead = bytesRemaining;
 	}
 
-	std::copy_n(audioFile->cbegin() + position, bytesToRead, static_cast<char*>(ptr));
+	std::copy_n(audioFile->data() + position, bytesToRead, static_cast<char*>(ptr));
 	data->position += bytesToRead;
 
 	size_t elementsRead = bytesToRead / size;
@@ -113,10 +113,10 @@ const ov_callbacks Ogg_Callbacks = {&OggCallbackRead, nullptr, nullptr, nullptr}
 
 AudioData LoadOggCodec(std::string filename)
 {
-	std::string audioFile;
+	FS::FileView audioFile;
 	try
 	{
-		audioFile = FS::PakPath::ReadFile(filename);
+		audioFile = FS::PakPath::ReadFileView(filename);
 	}
 	catch (std::system_error& err)
 	{
@@ -46,7 +46,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 namespace Audio{
 
 struct OpusDataSource {
-	std::string* audioFile;
+	const FS::FileView* audioFile;
 	size_t position;
 };
 
@@ -81,7 +81,7 @@ int OpusCallbackRead(void* dataSource, unsigned char* ptr, int nBytes)
 		return 0;
 	}
 
-	std::string* audioFile = data->audioFile;
+	const FS::FileView* audioFile = data->audioFile;
 	size_t position = data->position;
 	size_t bytesRemaining = audioFile->size() - position;
 	size_t bytesToRead = nBytes;
@@ -101,10 +101,10 @@ const OpusFileCallbacks Opus_Callbacks = {&OpusCallbackRead, nullptr, nullptr, n
 
 AudioData LoadOpusCodec(std::string filename)
 {
-	std::string audioFile;
+	FS::FileView audioFile;
 	try
 	{
-		audioFile = FS::PakPath::ReadFile(filename);
+		audioFile = FS::PakPath::ReadFileView(filename);
 	}
 	catch (std::system_error& err)
 	{
@@ -52,6 +52,12 @@ namespace Audio {
 		return out;
 	}
 
+	void Sample::Prefetch() {
+		if ( GetName() != "sound/null" && GetName() != "sound/null.wav" ) {
+			PrefetchSoundFile(GetName());
+		}
+	}
+
     bool Sample::Load() {
         audioLogs.Debug("Loading Sample '%s'", GetName());
 
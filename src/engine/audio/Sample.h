@@ -101,6 +101,7 @@ namespace Audio {
             explicit Sample(std::string name);
             virtual ~Sample() override final;
 
+            virtual void Prefetch() override final;
             virtual bool Load() override final;
             virtual void Cleanup() override final;
 
@@ -75,9 +75,11 @@ static int FindSoundLoader(std::string filename)
 	return bestLoader;
 }
 
-AudioData LoadSoundCodec(std::string filename)
+// Find the file a sound is loaded from and the index of its loader, or -1 if
+// there is no file with a supported format (filename is left without extension
+// if it had one that wasn't found)
+static int FindSoundFile(std::string& filename)
 {
-
 	std::string ext = FS::Path::Extension(filename);
 
 	// if filename has extension, try to load it
@@ -87,7 +89,7 @@ AudioData LoadSoundCodec(std::string filename)
 			if (ext == soundLoaders[i].ext) {
 				// if file exists, load it
 				if (FS::PakPath::FileExists(filename)) {
-					return soundLoaders[i].SoundLoader(filename);
+					return i;
 				}
 			}
 		}
@@ -109,8 +111,26 @@ AudioData LoadSoundCodec(std::string filename)
 
 	if (bestLoader >= 0)
 	{
-		std::string altName = Str::Format("%s%s", filename, soundLoaders[bestLoader].ext );
-		return soundLoaders[bestLoader].SoundLoader(altName);
+		filename = Str::Format("%s%s", filename, soundLoaders[bestLoader].ext );
+	}
+
+	return bestLoader;
+}
+
+void PrefetchSoundFile(std::string filename)
+{
+	if (FindSoundFile(filename) >= 0) {
+		FS::PakPath::PrefetchFile(filename);
+	}
+}
+
+AudioData LoadSoundCodec(std::string filename)
+{
+	int loader = FindSoundFile(filename);
+
+	if (loader >= 0)
+	{
+		return soundLoaders[loader].SoundLoader(filename);
 	}
 
 	if (FS::PakPath::FileExists(filename)) {
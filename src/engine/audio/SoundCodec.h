@@ -38,6 +38,9 @@ namespace Audio {
 
     AudioData LoadSoundCodec(std::string filename);
 
+    // Start reading the file LoadSoundCodec would load in the background
+    void PrefetchSoundFile(std::string filename);
+
     AudioData LoadWavCodec(std::string filename);
 
     AudioData LoadOggCodec(std::string filename);
@@ -283,6 +283,9 @@ enum cgameImport_t
   CG_LAN_RESETPINGS,
   CG_LAN_SERVERSTATUS,
   CG_LAN_RESETSERVERSTATUS,
+
+  // Renderer, added later to keep the ids of the other messages
+  CG_R_BUILDSKELETONS,
 };
 
 // All Miscs
@@ -403,6 +406,10 @@ namespace Render {
 		IPC::Message<IPC::Id<VM::QVM, CG_R_BUILDSKELETON>, int, int, int, float, bool>,
 		IPC::Reply<refSkeleton_t, int>
 	>;
+	using BuildSkeletonsMsg = IPC::SyncMessage<
+		IPC::Message<IPC::Id<VM::QVM, CG_R_BUILDSKELETONS>, std::vector<SkeletonRequest>>,
+		IPC::Reply<std::vector<refSkeleton_t>, std::vector<int>>
+	>;
 	using BoneIndexMsg = IPC::SyncMessage<
 		IPC::Message<IPC::Id<VM::QVM, CG_R_BONEINDEX>, int, std::string>,
 		IPC::Reply<int>
@@ -1291,6 +1291,12 @@ void CGameVM::QVMSyscall(int syscallNum, Util::Reader& reader, IPC::Channel& cha
 			});
 			break;
 
+		case CG_R_BUILDSKELETONS:
+			IPC::HandleMsg<Render::BuildSkeletonsMsg>(channel, std::move(reader), [this] (const std::vector<SkeletonRequest>& requests, std::vector<refSkeleton_t>& skeletons, std::vector<int>& results) {
+				re.BuildSkeletons(requests, skeletons, results);
+			});
+			break;
+
 		case CG_R_BONEINDEX:
 			IPC::HandleMsg<Render::BoneIndexMsg>(channel, std::move(reader), [this] (int model, const std::string& boneName, int& index) {
 				index = re.BoneIndex(model, boneName.c_str());
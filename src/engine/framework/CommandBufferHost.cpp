@@ -97,6 +97,7 @@ namespace IPC {
             Sys::Drop("Command buffer for %s had an incomplete message write", name);
         }
         std::vector<char>& readerData = reader.GetData();
+        Util::ReserveMessageBuffer(readerData, size);
         readerData.resize(size);
         buffer.Read(readerData.data(), size, sizeof(uint32_t));
 
@@ -42,6 +42,9 @@ namespace Resource {
         return true;
     }
 
+    void Resource::Prefetch() {
+    }
+
     bool Resource::IsStillValid() {
         return true;
     }
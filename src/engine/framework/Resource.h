@@ -107,6 +107,11 @@ namespace Resource {
             // Defaults to []{return true;}
             virtual bool TagDependencies();
 
+            // Starts reading the files of the resource in the background, called
+            // shortly before Load when several resources are loaded at once.
+            // Defaults to doing nothing
+            virtual void Prefetch();
+
             // Loads the resource, doing potentially big IO, should return true on
             // success and false on error (in which case the resource will be deleted)
             // TODO provide a facility to know if resources we depend on have been loaded?
@@ -195,6 +200,9 @@ namespace Resource {
             // Like Register() but returns null instead of the default value
             std::shared_ptr<T> RegisterInternal(Str::StringRef name);
 
+            // How many resources have their files read ahead of the one being loaded
+            static constexpr size_t PREFETCH_AHEAD = 16;
+
             bool inRegistration;
             bool immediate;
             std::shared_ptr<T> defaultValue;
@@ -234,7 +242,22 @@ namespace Resource {
         Prune();
 
         // And then load the new ones, so as to reduce peak memory usage.
+        // The files of the next few resources are read while one is loaded.
+        std::vector<T*> toLoad;
+        for (auto& entry : resources) {
+            if (!entry.second->loaded) {
+                toLoad.push_back(entry.second.get());
+            }
+        }
+
+        size_t numLoaded = 0, numPrefetched = 0;
         for (auto it = resources.begin(); it != resources.end(); ) {
+            if (!it->second->loaded) {
+                numLoaded++;
+                for (; numPrefetched < toLoad.size() && numPrefetched < numLoaded + PREFETCH_AHEAD; numPrefetched++) {
+                    toLoad[numPrefetched]->Prefetch();
+                }
+            }
             if (!it->second->loaded && !it->second->TryLoad()) {
                 it->second->Cleanup();
                 it = resources.erase(it);
@@ -138,6 +138,9 @@ static Cvar::Cvar<int> vm_timeout(
 	"Receive timeout in seconds",
 	Cvar::NONE, 2);
 
+// Size of the region holding both rings of the shared memory IPC transport
+static const size_t SHARED_MEMORY_IPC_SIZE = 2 * 1024 * 1024;
+
 #if defined(DAEMON_NACL_RUNTIME_ENABLED)
 static Cvar::Cvar<bool> vm_nacl_available(
 	"vm.nacl.available",
@@ -668,6 +671,17 @@ void VMBase::Create()
 		Log::Notice("^6Using %s VM with unreleased ABI changes", this->name);
 	}
 
+	// VMs that don't know about the shared memory transport stop here
+	bool vmSharedMemoryIPC = reader.HasUnreadData() && reader.Read<bool>();
+	if (params.sharedMemoryIPC.Get()) {
+		if (vmSharedMemoryIPC) {
+			rootChannel.CreateSharedMemoryTransport(SHARED_MEMORY_IPC_SIZE);
+			Log::Verbose("Using shared memory IPC for the %s VM", this->name);
+		} else {
+			Log::Warn("The %s VM doesn't support shared memory IPC, using the socket", this->name);
+		}
+	}
+
 	Log::Notice("Loaded %s VM module in %d msec", this->name, Sys::Milliseconds() - loadStartTime);
 }
 
@@ -695,8 +709,61 @@ void VMBase::FreeInProcessVM() {
 	inProcess.running = false;
 }
 
-void VMBase::LogMessage(bool vmToEngine, bool start, int id)
+void SyscallStats::Add(uint64_t ns, uint64_t messageBytes)
 {
+	count++;
+	totalNs += ns;
+	maxNs = std::max(maxNs, ns);
+	bytes += messageBytes;
+
+	int bucket = 0;
+	for (uint64_t us = ns / 1000; us != 0 && bucket < NUM_BUCKETS - 1; us >>= 1) {
+		bucket++;
+	}
+	histogram[bucket]++;
+}
+
+uint64_t SyscallStats::PercentileUs(double fraction) const
+{
+	uint64_t seen = 0;
+	for (int bucket = 0; bucket < NUM_BUCKETS - 1; bucket++) {
+		seen += histogram[bucket];
+		if (seen >= fraction * count) {
+			return uint64_t(1) << bucket;
+		}
+	}
+	return maxNs / 1000;
+}
+
+static std::vector<VMBase*>& AllVMs()
+{
+	static std::vector<VMBase*> vms;
+	return vms;
+}
+
+const std::vector<VMBase*>& VMBase::GetAll()
+{
+	return AllVMs();
+}
+
+VMBase::VMBase(std::string name_, int vmTypeCvarFlags)
+	: processHandle(Sys::INVALID_HANDLE), name(name_), type(TYPE_NACL), params(name_, vmTypeCvarFlags)
+{
+	AllVMs().push_back(this);
+}
+
+void VMBase::LogMessage(bool vmToEngine, bool start, int id, size_t receivedBytes)
+{
+	if (start) {
+		profileStack.push_back({Sys::SteadyClock::now(), rootChannel.GetTransferredBytes() - receivedBytes});
+	} else if (!profileStack.empty()) {
+		const ProfileFrame& frame = profileStack.back();
+		uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Sys::SteadyClock::now() - frame.start).count();
+		uint64_t key = uint32_t(id) | (vmToEngine ? uint64_t(1) << 32 : 0);
+		syscallProfile[key].Add(ns, rootChannel.GetTransferredBytes() - frame.transferredBytes);
+		profileStack.pop_back();
+	}
+
 	if (syscallLogFile) {
 		int minor = id & 0xffff;
 		int major = id >> 16;
@@ -719,6 +786,9 @@ void VMBase::Free()
 		syscallLogFile.Close(err);
 	}
 
+	// Frames left by messages interrupted by an error
+	profileStack.clear();
+
 	if (!IsActive())
 		return;
 
@@ -761,6 +831,129 @@ void VMBase::Free()
 VMBase::~VMBase()
 {
 	Free();
+
+	std::vector<VMBase*>& vms = AllVMs();
+	vms.erase(std::remove(vms.begin(), vms.end(), this), vms.end());
 }
 
+class IPCBufferStatsCmd : public Cmd::StaticCmd {
+public:
+	IPCBufferStatsCmd() : StaticCmd("ipcBufferStats", Cmd::BASE, "prints how many IPC message buffers the engine used and grew") {}
+
+	void Run(const Cmd::Args&) const override {
+		const Util::MessageBufferStats& stats = Util::GetMessageBufferStats();
+		Print("%llu message buffers used, %llu grown, %llu heap allocations",
+			static_cast<unsigned long long>(stats.acquired), static_cast<unsigned long long>(stats.grown),
+			static_cast<unsigned long long>(stats.allocated));
+	}
+};
+static IPCBufferStatsCmd ipcBufferStatsCmdRegistration;
+
+class VMProfileCmd : public Cmd::StaticCmd {
+public:
+	VMProfileCmd() : StaticCmd("vmProfile", Cmd::BASE, "prints the messages exchanged with a VM that took the most time") {}
+
+	void Run(const Cmd::Args& args) const override {
+		if (args.Argc() < 2 || args.Argc() > 4) {
+			Usage(args);
+			return;
+		}
+
+		VMBase* vm = nullptr;
+		for (VMBase* candidate : VMBase::GetAll()) {
+			if (candidate->GetName() == args.Argv(1)) {
+				vm = candidate;
+			}
+		}
+		if (!vm) {
+			Print("No VM named %s", args.Argv(1));
+			return;
+		}
+
+		if (args.Argc() == 3 && args.Argv(2) == "reset") {
+			vm->ResetSyscallProfile();
+			return;
+		}
+
+		// Sorted by total time, as the time of a message includes the
+		// messages it causes the slowest ones come first
+		using Entry = std::pair<uint64_t, SyscallStats>;
+		std::vector<Entry> entries(vm->GetSyscallProfile().begin(), vm->GetSyscallProfile().end());
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+			return a.second.totalNs > b.second.totalNs;
+		});
+
+		if (args.Argc() == 4 && args.Argv(2) == "csv") {
+			WriteCSV(args.Argv(3), entries);
+			return;
+		}
+
+		size_t count = 20;
+		if (args.Argc() == 3) {
+			int n;
+			if (!Str::ParseInt(n, args.Argv(2)) || n <= 0) {
+				Usage(args);
+				return;
+			}
+			count = n;
+		}
+
+		Print("%-4s %-11s %9s %10s %8s %8s %8s %8s %12s", "dir", "id", "count", "total ms", "avg us", "p50 us", "p99 us", "max us", "bytes");
+		for (size_t i = 0; i < std::min(count, entries.size()); i++) {
+			const SyscallStats& stats = entries[i].second;
+			Print("%-4s %-11s %9u %10.2f %8.1f %8u %8u %8u %12u",
+				Direction(entries[i].first), Id(entries[i].first), stats.count, stats.totalNs / 1e6,
+				stats.totalNs / 1e3 / stats.count, stats.PercentileUs(0.5), stats.PercentileUs(0.99),
+				stats.maxNs / 1000, stats.bytes);
+		}
+	}
+
+private:
+	void Usage(const Cmd::Args& args) const {
+		PrintUsage(args, "<vm> [<count> | reset | csv <file>]", "prints the messages with a VM that took the most time");
+	}
+
+	static const char* Direction(uint64_t key) {
+		return key >> 32 ? "V->E" : "E->V";
+	}
+
+	static std::string Id(uint64_t key) {
+		return Str::Format("%d:%d", (key >> 16) & 0xffff, key & 0xffff);
+	}
+
+	void WriteCSV(Str::StringRef filename, const std::vector<std::pair<uint64_t, SyscallStats>>& entries) const {
+		std::error_code err;
+		FS::File file = FS::HomePath::OpenWrite(filename, err);
+		if (err) {
+			Print("Couldn't open %s: %s", filename, err.message());
+			return;
+		}
+
+		try {
+			std::string header = "direction,major,minor,count,total_ns,max_ns,bytes";
+			for (int bucket = 0; bucket < SyscallStats::NUM_BUCKETS - 1; bucket++) {
+				header += Str::Format(",under_%dus", 1 << bucket);
+			}
+			header += Str::Format(",over_%dus", 1 << (SyscallStats::NUM_BUCKETS - 2));
+			file.Printf("%s\n", header);
+
+			for (const auto& entry : entries) {
+				const SyscallStats& stats = entry.second;
+				std::string line = Str::Format("%s,%d,%d,%u,%u,%u,%u", Direction(entry.first),
+					(entry.first >> 16) & 0xffff, entry.first & 0xffff, stats.count, stats.totalNs, stats.maxNs, stats.bytes);
+				for (uint64_t n : stats.histogram) {
+					line += Str::Format(",%u", n);
+				}
+				file.Printf("%s\n", line);
+			}
+			file.Close();
+		} catch (std::system_error& error) {
+			Print("Error while writing %s: %s", filename, error.what());
+			return;
+		}
+		Print("Wrote %d messages to %s", entries.size(), filename);
+	}
+};
+static VMProfileCmd vmProfileCmdRegistration;
+
 } // namespace VM
@@ -98,20 +98,42 @@ struct VMParams {
 		  vmType("vm." + name + ".type", "how the vm should be loaded for " + name, vmTypeFlags,
 		         Util::ordinal(vmType_t::TYPE_NACL), 0, Util::ordinal(vmType_t::TYPE_END) - 1),
 		  debug("vm." + name + ".debug", "run a gdbserver on localhost:4014 to debug the VM", Cvar::NONE, false),
-		  debugLoader("vm." + name + ".debugLoader", "make nacl_loader dump information to " + name + "-nacl_loader.log", Cvar::NONE, 1, 0, 5) {
+		  debugLoader("vm." + name + ".debugLoader", "make nacl_loader dump information to " + name + "-nacl_loader.log", Cvar::NONE, 1, 0, 5),
+		  sharedMemoryIPC("vm." + name + ".sharedMemoryIPC", "send the " + name + " syscalls through shared memory instead of the socket", Cvar::NONE, false) {
 	}
 
 	Cvar::Cvar<bool> logSyscalls;
 	Cvar::Range<Cvar::Cvar<int>> vmType;
 	Cvar::Cvar<bool> debug;
 	Cvar::Range<Cvar::Cvar<int>> debugLoader;
+	Cvar::Cvar<bool> sharedMemoryIPC;
+};
+
+// Counts and timings of one kind of message exchanged with a VM, used to find
+// which syscalls are worth batching or moving to the command buffer. Times and
+// sizes include the nested messages sent while the message was handled.
+struct SyscallStats {
+	// Bucket i counts the messages that took less than 2^i microseconds (and
+	// more than the previous bucket), the last one also counts the slower ones.
+	static const int NUM_BUCKETS = 16;
+
+	uint64_t count = 0;
+	uint64_t totalNs = 0;
+	uint64_t maxNs = 0;
+	uint64_t bytes = 0;
+	uint64_t histogram[NUM_BUCKETS] = {};
+
+	void Add(uint64_t ns, uint64_t messageBytes);
+
+	// Upper bound in microseconds of the bucket where the given fraction of
+	// the messages is reached
+	uint64_t PercentileUs(double fraction) const;
 };
 
 // Base class for a virtual machine instance
 class VMBase {
 public:
-	VMBase(std::string name_, int vmTypeCvarFlags)
-		: processHandle(Sys::INVALID_HANDLE), name(name_), type(TYPE_NACL), params(name_, vmTypeCvarFlags) {}
+	VMBase(std::string name_, int vmTypeCvarFlags);
 
 	// Create the VM for the named module. This will automatically free any existing VM.
 	void Create();
@@ -128,13 +150,31 @@ public:
 	// Make sure the VM is closed on exit
 	virtual ~VMBase();
 
+	const std::string& GetName() const
+	{
+		return name;
+	}
+
+	// The key is the message ID, with bit 32 set for the messages sent by the VM
+	const std::unordered_map<uint64_t, SyscallStats>& GetSyscallProfile() const
+	{
+		return syscallProfile;
+	}
+	void ResetSyscallProfile()
+	{
+		syscallProfile.clear();
+	}
+
+	// All the VMs, for the profiling command
+	static const std::vector<VMBase*>& GetAll();
+
 	// Send a message to the VM
 	template<typename Msg, typename... Args> void SendMsg(Args&&... args)
 	{
 		// Marking lambda as mutable to work around a bug in gcc 4.6
 		LogMessage(false, true, Msg::id);
 		IPC::SendMsg<Msg>(rootChannel, [this](uint32_t id, Util::Reader reader) mutable {
-			LogMessage(true, true, id);
+			LogMessage(true, true, id, reader.GetData().size());
 			Syscall(id, std::move(reader), rootChannel);
 			LogMessage(true, false, id);
 		}, std::forward<Args>(args)...);
@@ -177,7 +217,17 @@ private:
 	// Logging the syscalls
 	FS::File syscallLogFile;
 
-	void LogMessage(bool vmToEngine, bool start, int id);
+	// Profiling the syscalls, with one frame for each nested message
+	struct ProfileFrame {
+		Sys::SteadyClock::time_point start;
+		uint64_t transferredBytes;
+	};
+	std::vector<ProfileFrame> profileStack;
+	std::unordered_map<uint64_t, SyscallStats> syscallProfile;
+
+	// receivedBytes is the size of the message from the VM that was already
+	// read when it starts being handled
+	void LogMessage(bool vmToEngine, bool start, int id, size_t receivedBytes = 0);
 };
 
 } // namespace VM
@@ -132,6 +132,17 @@ int RE_BlendSkeleton( refSkeleton_t*, const refSkeleton_t*, float )
 {
 	return 1;
 }
+void RE_BuildSkeletons( const std::vector<SkeletonRequest>& requests, std::vector<refSkeleton_t>& skeletons,
+	std::vector<int>& results )
+{
+	skeletons.resize( requests.size() );
+	results.assign( requests.size(), 1 );
+
+	for ( refSkeleton_t& skel : skeletons )
+	{
+		skel.numBones = 0;
+	}
+}
 int RE_BoneIndex( qhandle_t, const char* )
 {
 	return 0;
@@ -244,6 +255,7 @@ refexport_t    *GetRefAPI( int, refimport_t* )
     re.CheckSkeleton = RE_CheckSkeleton;
     re.BuildSkeleton = RE_BuildSkeleton;
     re.BlendSkeleton = RE_BlendSkeleton;
+    re.BuildSkeletons = RE_BuildSkeletons;
     re.BoneIndex = RE_BoneIndex;
     re.AnimNumFrames = RE_AnimNumFrames;
     re.AnimFrameRate = RE_AnimFrameRate;
@@ -627,6 +627,11 @@ bool FS_LoadServerPaks(const char* paks, bool isDemo)
 {
 	Cmd::Args args(paks);
 	fs_missingPaks.clear();
+
+	// Resolve all the paks first so that they can be loaded together
+	// Each pak is listed with its request, or -1 if it wasn't found
+	std::vector<FS::PakPath::PakLoadRequest> requests;
+	std::vector<std::pair<missingPak_t, int>> listed;
 	for (auto& x: args) {
 		std::string name, version;
 		Util::optional<uint32_t> checksum;
@@ -639,11 +644,8 @@ bool FS_LoadServerPaks(const char* paks, bool isDemo)
 				if (!pak) {
 					Sys::Drop("Pak %s version %s not found", name, version);
 				}
-				try {
-					FS::PakPath::LoadPakExplicitWithoutChecksum(*pak); // FIXME bogus checksum argument
-				} catch (const std::system_error& e) {
-					Sys::Drop("Failed to load pak %s version %s: %s", name, version, e.what());
-				}
+				listed.push_back({{std::move(name), std::move(version), 0}, static_cast<int>(requests.size())});
+				requests.push_back({pak, Util::nullopt, {}}); // FIXME bogus checksum argument
 				continue;
 			}
 			// non-legacy paks (with non empty version) must have a checksum
@@ -653,14 +655,26 @@ bool FS_LoadServerPaks(const char* paks, bool isDemo)
 		// Keep track of all missing paks
 		const FS::PakInfo* pak = FS::FindPak(name, version, *checksum);
 		if (!pak)
-			fs_missingPaks.push_back({std::move(name), std::move(version), *checksum});
+			listed.push_back({{std::move(name), std::move(version), *checksum}, -1});
 		else {
-			try {
-				FS::PakPath::LoadPakExplicit(*pak, *checksum);
-			} catch (std::system_error&) {
-				fs_missingPaks.push_back({std::move(name), std::move(version), *checksum});
-			}
+			listed.push_back({{std::move(name), std::move(version), *checksum}, static_cast<int>(requests.size())});
+			requests.push_back({pak, *checksum, {}});
+		}
+	}
+
+	FS::PakPath::LoadPaksExplicit(requests);
+	for (auto& x: listed) {
+		if (x.second == -1) {
+			fs_missingPaks.push_back(std::move(x.first));
+			continue;
+		}
+		const FS::PakPath::PakLoadRequest& request = requests[x.second];
+		if (!request.err)
+			continue;
+		if (!request.expectedChecksum) {
+			Sys::Drop("Failed to load pak %s version %s: %s", x.first.name, x.first.version, request.err.message());
 		}
+		fs_missingPaks.push_back(std::move(x.first));
 	}
 
 	// Load extra paks as well for demos
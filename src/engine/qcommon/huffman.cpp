@@ -39,7 +39,8 @@ Maryland 20850 USA.
 #include "qcommon/q_shared.h"
 #include "qcommon.h"
 
-static int bloc = 0;
+// messages can be encoded by several threads at once, see sv_parallelSnapshots
+static thread_local int bloc = 0;
 
 //bani - optimized version
 //clears data along the way so we don't have to memset() it ahead of time
@@ -473,6 +474,175 @@ void Huff_offsetTransmit( huff_t *huff, int ch, byte *fout, int *offset )
 	*offset = bloc;
 }
 
+/*
+=============================================================================
+
+Table driven coding for trees that don't change anymore, such as the one
+used by MSG_WriteBits and MSG_ReadBits. The adaptive coding done by
+Huff_Compress and Huff_Decompress updates the tree after every symbol so
+it keeps walking the tree.
+
+=============================================================================
+*/
+
+/* Write up to HUFF_WORD_BITS bits at once, first bit in the lowest bit */
+void Huff_putBits( uint64_t bits, int count, byte *fout, int *offset )
+{
+	if ( !count )
+	{
+		return;
+	}
+
+	byte *out = fout + ( *offset >> 3 );
+	int  shift = *offset & 7;
+
+	bits <<= shift;
+
+	// clear the following bytes like Huff_putBit does
+	if ( shift )
+	{
+		out[ 0 ] |= bits;
+	}
+	else
+	{
+		out[ 0 ] = bits;
+	}
+
+	for ( int i = 1; i * 8 < shift + count; i++ )
+	{
+		out[ i ] = bits >> ( i * 8 );
+	}
+
+	*offset += count;
+}
+
+/* Read the HUFF_WORD_BITS bits starting at offset, bytes from size on are read as zeroes */
+uint64_t Huff_peekBits( const byte *fin, int offset, int size )
+{
+	const byte *in = fin + ( offset >> 3 );
+	int        count = size - ( offset >> 3 );
+	uint64_t   bits = 0;
+
+	if ( count >= 8 )
+	{
+		bits = uint64_t( in[ 0 ] ) | uint64_t( in[ 1 ] ) << 8 | uint64_t( in[ 2 ] ) << 16 | uint64_t( in[ 3 ] ) << 24 |
+		       uint64_t( in[ 4 ] ) << 32 | uint64_t( in[ 5 ] ) << 40 | uint64_t( in[ 6 ] ) << 48 | uint64_t( in[ 7 ] ) << 56;
+	}
+	else
+	{
+		for ( int i = 0; i < count; i++ )
+		{
+			bits |= uint64_t( in[ i ] ) << ( i * 8 );
+		}
+	}
+
+	return bits >> ( offset & 7 );
+}
+
+static void Huff_AddCodes( huffTable_t *table, const node_t *node, uint64_t code, int length )
+{
+	if ( !node )
+	{
+		return;
+	}
+
+	if ( node->symbol != INTERNAL_NODE )
+	{
+		table->codes[ node->symbol ] = code;
+		table->lengths[ node->symbol ] = std::min( length, 255 );
+
+		if ( length <= HUFF_TABLE_BITS )
+		{
+			// every index starting with the code decodes to the symbol
+			for ( int i = code; i < ( 1 << HUFF_TABLE_BITS ); i += 1 << length )
+			{
+				table->decode[ i ].symbol = node->symbol;
+				table->decode[ i ].length = length;
+			}
+		}
+
+		return;
+	}
+
+	if ( length < 64 )
+	{
+		Huff_AddCodes( table, node->left, code, length + 1 );
+		Huff_AddCodes( table, node->right, code | ( uint64_t( 1 ) << length ), length + 1 );
+	}
+}
+
+void Huff_BuildTable( huffTable_t *table, huff_t *huff )
+{
+	*table = {};
+	table->huff = huff;
+	Huff_AddCodes( table, huff->tree, 0, 0 );
+}
+
+/* Send a symbol */
+void Huff_tableTransmit( const huffTable_t *table, int ch, byte *fout, int *offset )
+{
+	int length = table->lengths[ ch ];
+
+	if ( length > HUFF_WORD_BITS )
+	{
+		Huff_offsetTransmit( table->huff, ch, fout, offset );
+		return;
+	}
+
+	Huff_putBits( table->codes[ ch ], length, fout, offset );
+}
+
+/* Get a symbol, bytes from size on are read as zeroes */
+void Huff_tableReceive( const huffTable_t *table, int *ch, const byte *fin, int *offset, int size )
+{
+	int      pos = *offset;
+	int      index = pos >> 3;
+	unsigned peek;
+
+	if ( index + 2 < size )
+	{
+		peek = fin[ index ] | ( fin[ index + 1 ] << 8 ) | ( fin[ index + 2 ] << 16 );
+	}
+	else
+	{
+		peek = 0;
+
+		for ( int i = 0; i < 3 && index + i < size; i++ )
+		{
+			peek |= fin[ index + i ] << ( i * 8 );
+		}
+	}
+
+	const huffDecode_t &entry = table->decode[ ( peek >> ( pos & 7 ) ) & ( ( 1 << HUFF_TABLE_BITS ) - 1 ) ];
+
+	if ( entry.length )
+	{
+		*ch = entry.symbol;
+		*offset = pos + entry.length;
+		return;
+	}
+
+	// long code, not in the table
+	const node_t *node = table->huff->tree;
+
+	while ( node && node->symbol == INTERNAL_NODE )
+	{
+		int bit = ( pos >> 3 ) < size ? fin[ pos >> 3 ] >> ( pos & 7 ) & 0x1 : 0;
+
+		node = bit ? node->right : node->left;
+		pos++;
+	}
+
+	if ( !node )
+	{
+		*ch = 0;
+		return;
+	}
+
+	*ch = node->symbol;
+	*offset = pos;
+}
+
 void Huff_Decompress( msg_t *mbuf, int offset )
 {
 	int    ch, cch, i, j, size;
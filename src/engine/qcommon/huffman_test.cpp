@@ -0,0 +1,423 @@
+/*
+===========================================================================
+Daemon BSD Source Code
+Copyright (c) 2024, Daemon Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Daemon developers nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL DAEMON DEVELOPERS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+===========================================================================
+*/
+
+#include <chrono>
+#include <iostream>
+#include <numeric>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "common/Common.h"
+#include "qcommon/qcommon.h"
+
+namespace {
+
+// Skewed like the message byte frequencies, so that some codes are longer
+// than HUFF_TABLE_BITS
+int SymbolWeight( int symbol )
+{
+    return std::max( 1, 20000 >> ( symbol / 16 ) );
+}
+
+class HuffmanTest : public testing::Test {
+protected:
+    void SetUp() override
+    {
+        huff = new huffman_t;
+        table = new huffTable_t;
+        Huff_Init( huff );
+
+        for ( int i = 0; i < 256; i++ )
+        {
+            for ( int j = 0; j < SymbolWeight( i ); j++ )
+            {
+                Huff_addRef( &huff->compressor, i );
+                Huff_addRef( &huff->decompressor, i );
+            }
+        }
+
+        Huff_BuildTable( table, &huff->compressor );
+    }
+
+    void TearDown() override
+    {
+        delete table;
+        delete huff;
+    }
+
+    // Bytes distributed like the symbol weights, like a snapshot payload
+    std::vector<byte> Payload( size_t size, unsigned seed )
+    {
+        std::vector<double> weights;
+        for ( int i = 0; i < 256; i++ )
+        {
+            weights.push_back( SymbolWeight( i ) );
+        }
+
+        std::mt19937 rng( seed );
+        std::discrete_distribution<int> dist( weights.begin(), weights.end() );
+        std::vector<byte> payload( size );
+        for ( byte& b : payload )
+        {
+            b = dist( rng );
+        }
+        return payload;
+    }
+
+    huffman_t *huff;
+    huffTable_t *table;
+};
+
+TEST_F(HuffmanTest, CodeLengths)
+{
+    int maxLength = 0;
+    for ( int i = 0; i < 256; i++ )
+    {
+        maxLength = std::max<int>( maxLength, table->lengths[ i ] );
+    }
+
+    // make sure the slow path gets tested too
+    EXPECT_GT( maxLength, HUFF_TABLE_BITS );
+}
+
+TEST_F(HuffmanTest, TransmitMatchesTree)
+{
+    std::vector<byte> payload = Payload( 4096, 1 );
+    std::vector<byte> expected( 16384, 0xAA ), actual( 16384, 0xAA );
+
+    // start at an odd bit, the bytes after the cursor must be handled the same
+    int expectedBit = 5, actualBit = 5;
+    for ( byte b : payload )
+    {
+        Huff_offsetTransmit( &huff->compressor, b, expected.data(), &expectedBit );
+        Huff_tableTransmit( table, b, actual.data(), &actualBit );
+        ASSERT_EQ( expectedBit, actualBit );
+    }
+
+    EXPECT_EQ( expected, actual );
+}
+
+TEST_F(HuffmanTest, ReceiveMatchesTree)
+{
+    std::vector<byte> payload = Payload( 4096, 2 );
+    std::vector<byte> data( 16384 );
+
+    int bit = 3;
+    for ( byte b : payload )
+    {
+        Huff_offsetTransmit( &huff->compressor, b, data.data(), &bit );
+    }
+
+    int size = ( bit >> 3 ) + 1;
+    int expectedBit = 3, actualBit = 3;
+    for ( byte b : payload )
+    {
+        int expected, actual;
+        Huff_offsetReceive( huff->decompressor.tree, &expected, data.data(), &expectedBit );
+        Huff_tableReceive( table, &actual, data.data(), &actualBit, size );
+        ASSERT_EQ( b, expected );
+        ASSERT_EQ( expected, actual );
+        ASSERT_EQ( expectedBit, actualBit );
+    }
+}
+
+// A scripted game recorded as entity states, sent through the snapshot delta
+// coding which uses the message Huffman table. Only run on request with
+// --gtest_also_run_disabled_tests --gtest_filter=HuffmanBenchmark.*
+const int NUM_PLAYERS = 24;
+const int NUM_ENTITIES = 96;
+const int NUM_SNAPSHOTS = 200;
+const int FRAME_MSEC = 50;
+
+class HuffmanBenchmark : public testing::Test {
+protected:
+    void SetUp() override
+    {
+        std::mt19937 rng( 4 );
+        std::uniform_int_distribution<int> coord( -3000, 3000 );
+        std::vector<entityState_t> states( NUM_ENTITIES );
+
+        for ( int i = 0; i < NUM_ENTITIES; i++ )
+        {
+            entityState_t &state = states[ i ];
+            memset( &state, 0, sizeof( state ) );
+            state.number = i;
+            state.eType = i < NUM_PLAYERS ? 1 : 2 + i % 5;
+            state.clientNum = i < NUM_PLAYERS ? i : 0;
+            state.modelindex = 1 + i % 40;
+            state.groundEntityNum = ENTITYNUM_WORLD;
+            state.pos.trType = trType_t::TR_STATIONARY;
+            VectorSet( state.pos.trBase, coord( rng ), coord( rng ), coord( rng ) / 10 );
+            VectorCopy( state.pos.trBase, state.origin );
+        }
+
+        for ( int n = 0; n < NUM_SNAPSHOTS; n++ )
+        {
+            int time = n * FRAME_MSEC;
+
+            for ( int i = 0; i < NUM_PLAYERS; i++ )
+            {
+                // players run around, turn and change animations
+                entityState_t &state = states[ i ];
+                float yaw = ( time + i * 1000 ) * 0.0005f;
+                state.pos.trType = trType_t::TR_LINEAR;
+                state.pos.trTime = time;
+                VectorSet( state.pos.trDelta, roundf( cosf( yaw ) * 320 ), roundf( sinf( yaw ) * 320 ), 0 );
+                VectorMA( state.pos.trBase, FRAME_MSEC * 0.001f, state.pos.trDelta, state.pos.trBase );
+                SnapVector( state.pos.trBase );
+                VectorCopy( state.pos.trBase, state.origin );
+                state.apos.trBase[ YAW ] = AngleNormalize360( RAD2DEG( yaw ) );
+                state.apos.trBase[ PITCH ] = float( int( rng() % 60 ) - 30 ) * 0.5f;
+                VectorCopy( state.apos.trBase, state.angles );
+
+                if ( rng() % 10 == 0 )
+                {
+                    // the toggle bit restarts the animation
+                    const int toggleBit = 1 << ( ANIM_BITS - 1 );
+                    state.legsAnim = ( ( state.legsAnim ^ toggleBit ) & toggleBit ) | rng() % 20;
+                    state.torsoAnim = rng() % 20;
+                }
+
+                if ( rng() % 8 == 0 )
+                {
+                    state.events[ state.eventSequence & ( MAX_EVENTS - 1 ) ] = 1 + rng() % 60;
+                    state.eventSequence = ( state.eventSequence + 1 ) & 255;
+                }
+            }
+
+            for ( int i = NUM_PLAYERS; i < NUM_ENTITIES; i++ )
+            {
+                // the other entities rarely change
+                entityState_t &state = states[ i ];
+
+                if ( rng() % 30 == 0 )
+                {
+                    state.time = time;
+                    state.frame = ( state.frame + 1 ) & 0xff;
+                    state.eFlags ^= 1 << ( rng() % 8 );
+                }
+            }
+
+            snapshots.push_back( states );
+        }
+    }
+
+    // The bytes the delta coding sends through the Huffman code are mostly
+    // those of the changed fields. They are taken here as the changed words
+    // of each entity, without their high zero bytes, after its number.
+    std::vector<byte> Payload( int snapshot )
+    {
+        std::vector<byte> payload;
+
+        for ( int e = 0; e < NUM_ENTITIES; e++ )
+        {
+            const int *from = reinterpret_cast<const int *>( &snapshots[ snapshot - 1 ][ e ] );
+            const int *to = reinterpret_cast<const int *>( &snapshots[ snapshot ][ e ] );
+            bool changed = false;
+
+            for ( size_t i = 0; i < sizeof( entityState_t ) / sizeof( int ); i++ )
+            {
+                if ( from[ i ] == to[ i ] )
+                {
+                    continue;
+                }
+
+                if ( !changed )
+                {
+                    payload.push_back( e >> ( GENTITYNUM_BITS & 7 ) );
+                    changed = true;
+                }
+
+                unsigned value = to[ i ];
+                do
+                {
+                    payload.push_back( value & 0xff );
+                    value >>= 8;
+                } while ( value );
+            }
+        }
+
+        return payload;
+    }
+
+    std::vector<std::vector<entityState_t>> snapshots;
+};
+
+TEST_F(HuffmanBenchmark, DISABLED_Snapshots)
+{
+    using Clock = std::chrono::steady_clock;
+    const int iterations = 20;
+
+    auto ns = []( Clock::duration d ) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>( d ).count();
+    };
+
+    // the tree walk and the table of the message Huffman code, on the same
+    // snapshot payloads
+    const huffTable_t *table = MSG_HuffmanTable();
+    std::vector<std::vector<byte>> payloads;
+    size_t payloadBytes = 0;
+    for ( int i = 1; i < NUM_SNAPSHOTS; i++ )
+    {
+        payloads.push_back( Payload( i ) );
+        payloadBytes += payloads.back().size();
+    }
+
+    std::vector<byte> treeData( MAX_MSGLEN ), tableData( MAX_MSGLEN );
+    Clock::duration treeSend{}, tableSend{}, treeReceive{}, tableReceive{};
+
+    for ( int n = 0; n < iterations; n++ )
+    {
+        for ( const std::vector<byte> &payload : payloads )
+        {
+            auto start = Clock::now();
+            int treeBit = 0;
+            for ( byte b : payload )
+            {
+                Huff_offsetTransmit( table->huff, b, treeData.data(), &treeBit );
+            }
+            treeSend += Clock::now() - start;
+
+            start = Clock::now();
+            int tableBit = 0;
+            for ( byte b : payload )
+            {
+                Huff_tableTransmit( table, b, tableData.data(), &tableBit );
+            }
+            tableSend += Clock::now() - start;
+
+            int size = ( tableBit >> 3 ) + 1;
+            ASSERT_EQ( treeBit, tableBit );
+            ASSERT_EQ( 0, memcmp( treeData.data(), tableData.data(), size ) );
+
+            int treeSum = 0, tableSum = 0;
+            start = Clock::now();
+            treeBit = 0;
+            for ( size_t i = 0; i < payload.size(); i++ )
+            {
+                int ch;
+                Huff_offsetReceive( table->huff->tree, &ch, treeData.data(), &treeBit );
+                treeSum += ch;
+            }
+            treeReceive += Clock::now() - start;
+
+            start = Clock::now();
+            tableBit = 0;
+            for ( size_t i = 0; i < payload.size(); i++ )
+            {
+                int ch;
+                Huff_tableReceive( table, &ch, tableData.data(), &tableBit, size );
+                tableSum += ch;
+            }
+            tableReceive += Clock::now() - start;
+
+            ASSERT_EQ( treeBit, tableBit );
+            ASSERT_EQ( treeSum, tableSum );
+            ASSERT_EQ( std::accumulate( payload.begin(), payload.end(), 0 ), tableSum );
+        }
+    }
+
+    double codedBytes = double( payloadBytes ) * iterations;
+    std::cout << Str::Format( "Huffman code, %.1f payload bytes per snapshot\n",
+                              double( payloadBytes ) / ( NUM_SNAPSHOTS - 1 ) );
+    std::cout << Str::Format( "send: tree %.2f ns/byte, table %.2f ns/byte\n",
+                              ns( treeSend ) / codedBytes, ns( tableSend ) / codedBytes );
+    std::cout << Str::Format( "receive: tree %.2f ns/byte, table %.2f ns/byte\n",
+                              ns( treeReceive ) / codedBytes, ns( tableReceive ) / codedBytes );
+
+    // the whole delta coding, which uses the table
+    std::vector<std::vector<byte>> messages( NUM_SNAPSHOTS, std::vector<byte>( MAX_MSGLEN ) );
+    std::vector<int> bits( NUM_SNAPSHOTS );
+    std::vector<entityState_t> read( NUM_ENTITIES );
+    Clock::duration writeTime{}, readTime{};
+    size_t bytes = 0;
+
+    for ( int n = 0; n < iterations; n++ )
+    {
+        // each snapshot is a delta from the previous one
+        auto start = Clock::now();
+        for ( int i = 1; i < NUM_SNAPSHOTS; i++ )
+        {
+            msg_t msg;
+            MSG_Init( &msg, messages[ i ].data(), messages[ i ].size() );
+            for ( int e = 0; e < NUM_ENTITIES; e++ )
+            {
+                MSG_WriteDeltaEntity( &msg, &snapshots[ i - 1 ][ e ], &snapshots[ i ][ e ], false );
+            }
+            MSG_WriteBits( &msg, MAX_GENTITIES - 1, GENTITYNUM_BITS );
+            ASSERT_FALSE( msg.overflowed );
+            bits[ i ] = msg.bit;
+        }
+        writeTime += Clock::now() - start;
+
+        start = Clock::now();
+        for ( int i = 1; i < NUM_SNAPSHOTS; i++ )
+        {
+            msg_t msg;
+            MSG_Init( &msg, messages[ i ].data(), messages[ i ].size() );
+            msg.cursize = ( bits[ i ] >> 3 ) + 1;
+            MSG_BeginReading( &msg );
+            while ( true )
+            {
+                int number = MSG_ReadBits( &msg, GENTITYNUM_BITS );
+                if ( number == MAX_GENTITIES - 1 || msg.readcount > msg.cursize )
+                {
+                    break;
+                }
+                MSG_ReadDeltaEntity( &msg, &snapshots[ i - 1 ][ number ], &read[ number ], number );
+            }
+            ASSERT_EQ( bits[ i ], msg.bit );
+        }
+        readTime += Clock::now() - start;
+    }
+
+    for ( int i = 1; i < NUM_SNAPSHOTS; i++ )
+    {
+        bytes += ( bits[ i ] >> 3 ) + 1;
+    }
+
+    // the last snapshot was read into a fresh state for the unchanged entities
+    for ( int e = 0; e < NUM_ENTITIES; e++ )
+    {
+        if ( memcmp( &snapshots.back()[ e ], &snapshots[ NUM_SNAPSHOTS - 2 ][ e ], sizeof( entityState_t ) ) )
+        {
+            EXPECT_EQ( 0, memcmp( &snapshots.back()[ e ], &read[ e ], sizeof( entityState_t ) ) ) << "entity " << e;
+        }
+    }
+
+    double total = double( bytes ) * iterations;
+    std::cout << Str::Format( "delta coding, %d snapshots of %d entities, %.1f bytes per snapshot\n",
+                              NUM_SNAPSHOTS - 1, NUM_ENTITIES, double( bytes ) / ( NUM_SNAPSHOTS - 1 ) );
+    std::cout << Str::Format( "write: %.2f ns/byte, read: %.2f ns/byte\n",
+                              ns( writeTime ) / total, ns( readTime ) / total );
+}
+
+} // namespace
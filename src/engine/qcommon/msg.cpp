@@ -33,10 +33,14 @@ Maryland 20850 USA.
 */
 
 #include <stddef.h>
+#include <atomic>
+#include <bitset>
+#include <memory>
 #include "qcommon/q_shared.h"
 #include "qcommon.h"
 
 static huffman_t msgHuff;
+static huffTable_t msgHuffTable;
 static bool  msgInit = false;
 
 /*
@@ -159,6 +163,8 @@ void MSG_WriteBits( msg_t *msg, int value, int bits )
 		bits = -bits;
 	}
 
+	msg->lastWrite = msg->oob ? msg->cursize : msg->bit;
+
 	if ( msg->oob )
 	{
 		if ( bits == 8 )
@@ -190,30 +196,119 @@ void MSG_WriteBits( msg_t *msg, int value, int bits )
 	}
 	else
 	{
+		// the low bits are sent as they are and the remaining bytes are
+		// Huffman coded, everything is gathered in a word and written at
+		// once, so a float sent as a small integer is a single write
+		int      nbits = bits & 7;
+		uint64_t word = value & ( ( 1 << nbits ) - 1 );
+		int      wordBits = nbits;
+
+		value >>= nbits;
+
+		for ( i = nbits; i < bits; i += 8 )
 		{
-			int nbits;
+			int ch = value & 0xff;
+			int length = msgHuffTable.lengths[ ch ];
 
-			nbits = bits & 7;
+			value >>= 8;
 
-			for ( i = 0; i < nbits; i++ )
+			if ( wordBits + length > HUFF_WORD_BITS )
 			{
-				Huff_putBit( ( value & 1 ), msg->data, &msg->bit );
-				value = ( value >> 1 );
+				Huff_putBits( word, wordBits, msg->data, &msg->bit );
+				word = 0;
+				wordBits = 0;
+
+				if ( length > HUFF_WORD_BITS )
+				{
+					Huff_tableTransmit( &msgHuffTable, ch, msg->data, &msg->bit );
+					continue;
+				}
 			}
 
-			bits = bits - nbits;
+			word |= msgHuffTable.codes[ ch ] << wordBits;
+			wordBits += length;
 		}
 
-		for ( i = 0; i < bits; i += 8 )
-		{
-			Huff_offsetTransmit( &msgHuff.compressor, ( value & 0xff ), msg->data, &msg->bit );
-			value = ( value >> 8 );
-		}
+		Huff_putBits( word, wordBits, msg->data, &msg->bit );
 
 		msg->cursize = ( msg->bit >> 3 ) + 1;
 	}
 }
 
+/*
+============
+MSG_WriteMsgBits
+
+Appends everything that was written to src, which must have been
+written from its start and in the same mode as msg. The static Huffman
+code doesn't depend on the position, so this produces the same bits as
+doing the writes directly on msg.
+============
+*/
+void MSG_WriteMsgBits( msg_t *msg, const msg_t *src )
+{
+	int numBytes = ( src->bit + 7 ) >> 3;
+
+	msg->uncompsize += src->uncompsize; // NERVE - SMF - net debugging
+
+	if ( !src->bit )
+	{
+		return;
+	}
+
+	// MSG_WriteBits checks the size before each write, as the size only
+	// grows the check of the last write of src is the one that matters
+	int lastWriteSize;
+
+	if ( msg->oob )
+	{
+		lastWriteSize = msg->cursize + src->lastWrite;
+	}
+	else
+	{
+		// the first write of src sees the current size
+		lastWriteSize = src->lastWrite ? ( ( msg->bit + src->lastWrite ) >> 3 ) + 1 : msg->cursize;
+	}
+
+	if ( msg->maxsize - lastWriteSize < 32 )
+	{
+		msg->overflowed = true;
+		return;
+	}
+
+	if ( msg->oob )
+	{
+		msg->lastWrite = msg->cursize + src->lastWrite;
+		memcpy( msg->data + msg->cursize, src->data, src->cursize );
+		msg->cursize += src->cursize;
+		msg->bit += src->bit;
+		return;
+	}
+
+	msg->lastWrite = msg->bit + src->lastWrite;
+
+	// bits above the cursor are always zero since Huff_putBit clears the
+	// bytes as it goes, so the source bytes can be OR'd in a byte at a time
+	byte *out = msg->data + ( msg->bit >> 3 );
+	int shift = msg->bit & 7;
+
+	for ( int i = 0; i < numBytes; i++ )
+	{
+		if ( shift )
+		{
+			out[ i ] |= src->data[ i ] << shift;
+			out[ i + 1 ] = src->data[ i ] >> ( 8 - shift );
+		}
+		else
+		{
+			out[ i ] = src->data[ i ];
+		}
+	}
+
+	msg->bit += src->bit;
+	msg->cursize = ( msg->bit >> 3 ) + 1;
+}
+
 int MSG_ReadBits( msg_t *msg, int bits )
 {
 	int      value;
@@ -264,17 +359,42 @@ int MSG_ReadBits( msg_t *msg, int bits )
 	}
 	else
 	{
-		for ( i = 0; i < ( bits & 7 ); i++ )
-		{
-			value |= ( Huff_getBit( msg->data, &msg->bit ) << i );
-		}
+		// read a word and decode from it, with the same layout as MSG_WriteBits
+		int      nbits = bits & 7;
+		uint64_t word = Huff_peekBits( msg->data, msg->bit, msg->maxsize );
+		int      used = nbits;
+
+		value = word & ( ( 1 << nbits ) - 1 );
 
-		for ( ; i < bits; i += 8 )
+		for ( i = nbits; i < bits; i += 8 )
 		{
-			Huff_offsetReceive( msgHuff.decompressor.tree, &get, msg->data, &msg->bit );
+			if ( used + HUFF_TABLE_BITS > HUFF_WORD_BITS )
+			{
+				msg->bit += used;
+				word = Huff_peekBits( msg->data, msg->bit, msg->maxsize );
+				used = 0;
+			}
+
+			const huffDecode_t &entry = msgHuffTable.decode[ ( word >> used ) & ( ( 1 << HUFF_TABLE_BITS ) - 1 ) ];
+
+			if ( entry.length )
+			{
+				get = entry.symbol;
+				used += entry.length;
+			}
+			else
+			{
+				// long code
+				msg->bit += used;
+				Huff_tableReceive( &msgHuffTable, &get, msg->data, &msg->bit, msg->maxsize );
+				word = Huff_peekBits( msg->data, msg->bit, msg->maxsize );
+				used = 0;
+			}
+
 			value |= get << i;
 		}
 
+		msg->bit += used;
 		msg->readcount = ( msg->bit >> 3 ) + 1;
 	}
 
@@ -693,6 +813,137 @@ void MSG_ReadDeltaUsercmd( msg_t *msg, usercmd_t *from, usercmd_t *to )
 /*
 =============================================================================
 
+Change masks for the delta compressed states, which are made of 32 bit
+words. The words are compared four at a time, then the changed words are
+mapped to the fields they belong to.
+
+=============================================================================
+*/
+
+/*
+=================
+MSG_ChangedWords
+
+Sets a bit in changed for each of the count words that differ
+=================
+*/
+static void MSG_ChangedWords( const int *from, const int *to, int count, uint64_t *changed )
+{
+	for ( int base = 0; base < count; base += 64 )
+	{
+		int      end = std::min( count - base, 64 );
+		uint64_t mask = 0;
+		int      i = 0;
+
+#if defined( DAEMON_USE_ARCH_INTRINSICS_I686_SSE2 )
+		for ( ; i + 4 <= end; i += 4 )
+		{
+			__m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i *>( from + base + i ) );
+			__m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i *>( to + base + i ) );
+			int     equal = _mm_movemask_ps( _mm_castsi128_ps( _mm_cmpeq_epi32( a, b ) ) );
+
+			mask |= uint64_t( equal ^ 0xf ) << i;
+		}
+#endif
+
+		for ( ; i < end; i++ )
+		{
+			if ( from[ base + i ] != to[ base + i ] )
+			{
+				mask |= uint64_t( 1 ) << i;
+			}
+		}
+
+		changed[ base / 64 ] = mask;
+	}
+}
+
+/*
+=================
+MSG_ChangedFields
+
+Turns the changed words into changed fields, wordFields gives the field
+each word belongs to or -1. Counts the changes of each field in
+fieldUses. Returns the number of fields up to the last changed one.
+=================
+*/
+static int MSG_ChangedFields( const uint64_t *changedWords, int numWords, const int *wordFields,
+                              std::atomic<int> *fieldUses, uint64_t *changed, int numFields )
+{
+	int lc = 0;
+
+	std::fill( changed, changed + ( numFields + 63 ) / 64, 0 );
+
+	for ( int base = 0; base < numWords; base += 64 )
+	{
+		for ( uint64_t words = changedWords[ base / 64 ]; words; words &= words - 1 )
+		{
+			int i = wordFields[ base + CountTrailingZeroes( words ) ];
+
+			if ( i < 0 || ( changed[ i / 64 ] & ( uint64_t( 1 ) << ( i % 64 ) ) ) )
+			{
+				continue;
+			}
+
+			changed[ i / 64 ] |= uint64_t( 1 ) << ( i % 64 );
+			// snapshots can be written by several threads at once
+			fieldUses[ i ].fetch_add( 1, std::memory_order_relaxed );
+			lc = std::max( lc, i + 1 );
+		}
+	}
+
+	return lc;
+}
+
+/*
+=================
+MSG_UnchangedFields
+
+Returns the number of unchanged fields from i on, stopping at lc
+=================
+*/
+static int MSG_UnchangedFields( const uint64_t *changed, int i, int lc )
+{
+	int start = i;
+
+	while ( i < lc )
+	{
+		uint64_t rest = changed[ i / 64 ] >> ( i % 64 );
+
+		if ( rest )
+		{
+			return std::min( i + CountTrailingZeroes( rest ), lc ) - start;
+		}
+
+		i = ( i / 64 + 1 ) * 64;
+	}
+
+	return lc - start;
+}
+
+/*
+=================
+MSG_WriteUnchanged
+
+Writes the "no change" bits of count fields. Bits written less than a
+byte at a time aren't Huffman coded, so this is the same as writing them
+one by one.
+=================
+*/
+static void MSG_WriteUnchanged( msg_t *msg, int count )
+{
+	while ( count > 0 )
+	{
+		int bits = std::min( count, 7 );
+
+		MSG_WriteBits( msg, 0, bits );
+		count -= bits;
+	}
+}
+
+/*
+=============================================================================
+
 entityState_t communication
 
 =============================================================================
@@ -765,6 +1016,9 @@ static netField_t entityStateFields[] =
 	{ NETF( weaponAnim ),        ANIM_BITS      , 0 },
 };
 
+// How often each field changed, see MSG_PrioritiseEntitystateFields
+static std::atomic<int> entityStateFieldUses[ ARRAY_LEN( entityStateFields ) ];
+
 static int qsort_entitystatefields( const void *a, const void *b )
 {
 	int aa, bb;
@@ -772,12 +1026,12 @@ static int qsort_entitystatefields( const void *a, const void *b )
 	aa = * ( ( int * ) a );
 	bb = * ( ( int * ) b );
 
-	if ( entityStateFields[ aa ].used > entityStateFields[ bb ].used )
+	if ( entityStateFieldUses[ aa ] > entityStateFieldUses[ bb ] )
 	{
 		return -1;
 	}
 
-	if ( entityStateFields[ bb ].used > entityStateFields[ aa ].used )
+	if ( entityStateFieldUses[ bb ] > entityStateFieldUses[ aa ] )
 	{
 		return 1;
 	}
@@ -831,7 +1085,7 @@ void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entitySt
 	netField_t *field;
 	int        trunc;
 	float      fullFloat;
-	int        *fromF, *toF;
+	int        *toF;
 
 	const int numFields = ARRAY_LEN(entityStateFields);
 
@@ -864,21 +1118,26 @@ void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entitySt
 		Sys::Error( "MSG_WriteDeltaEntity: Bad entity number: %i", to->number );
 	}
 
-	lc = 0;
+	static_assert( numFields + 1 <= 64, "entityState_t change masks are a single word" );
 
-	// build the change vector as bytes so it is endian independent
-	for ( i = 0, field = entityStateFields; i < numFields; i++, field++ )
-	{
-		fromF = ( int * )( ( byte * ) from + field->offset );
-		toF = ( int * )( ( byte * ) to + field->offset );
+	// the field each word of entityState_t belongs to
+	static const auto entityWordFields = [] {
+		std::array<int, numFields + 1> wordFields;
 
-		if ( *fromF != *toF )
-		{
-			lc = i + 1;
+		wordFields.fill( -1 );
 
-			field->used++;
+		for ( int n = 0; n < numFields; n++ )
+		{
+			wordFields[ entityStateFields[ n ].offset / 4 ] = n;
 		}
-	}
+
+		return wordFields;
+	}();
+
+	uint64_t changedWords, changed;
+
+	MSG_ChangedWords( reinterpret_cast<const int *>( from ), reinterpret_cast<const int *>( to ), numFields + 1, &changedWords );
+	lc = MSG_ChangedFields( &changedWords, numFields + 1, entityWordFields.data(), entityStateFieldUses, &changed, numFields );
 
 	if ( lc == 0 )
 	{
@@ -901,17 +1160,20 @@ void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entitySt
 
 	MSG_WriteByte( msg, lc );  // # of changes
 
-	for ( i = 0, field = entityStateFields; i < lc; i++, field++ )
+	for ( i = 0; i < lc; i++ )
 	{
-		fromF = ( int * )( ( byte * ) from + field->offset );
-		toF = ( int * )( ( byte * ) to + field->offset );
+		int unchanged = MSG_UnchangedFields( &changed, i, lc );
 
-		if ( *fromF == *toF )
+		if ( unchanged )
 		{
-			MSG_WriteBits( msg, 0, 1 );  // no change
+			MSG_WriteUnchanged( msg, unchanged );  // no change
+			i += unchanged - 1;
 			continue;
 		}
 
+		field = &entityStateFields[ i ];
+		toF = ( int * )( ( byte * ) to + field->offset );
+
 		MSG_WriteBits( msg, 1, 1 );  // changed
 
 		if ( field->bits == 0 )
@@ -1137,9 +1399,17 @@ player_state_t communication
 ============================================================================
 */
 
+static const int MAX_PLAYERSTATE_WORDS = MAX_PLAYERSTATE_SIZE / PLAYERSTATE_FIELD_SIZE;
+
+static int FieldWords(const netField_t& f) {
+	return f.bits == STATS_GROUP_FIELD ? STATS_GROUP_NUM_STATS : 1;
+}
+
 static bool IsValid(const NetcodeTable& table, int size) {
 	if (size % PLAYERSTATE_FIELD_SIZE != 0 || size < int(offsetof(OpaquePlayerState, END)) || size > MAX_PLAYERSTATE_SIZE)
 		return false;
+	// fields can't overlap, the change masks map each word to a single field
+	std::bitset<MAX_PLAYERSTATE_WORDS> used;
 	for (const netField_t& f : table) {
 		if (f.offset < 0 || f.offset % PLAYERSTATE_FIELD_SIZE != 0)
 			return false;
@@ -1152,12 +1422,22 @@ static bool IsValid(const NetcodeTable& table, int size) {
 			if (f.offset >= size)
 				return false;
 		}
+		for (int i = 0; i < FieldWords(f); i++) {
+			int word = f.offset / PLAYERSTATE_FIELD_SIZE + i;
+			if (used[word])
+				return false;
+			used[word] = true;
+		}
 	}
 	return true;
 }
 
 static NetcodeTable playerStateFields;
+// How often each field changed, see MSG_PrioritisePlayerStateFields
+static std::unique_ptr<std::atomic<int>[]> playerStateFieldUses;
 static size_t playerStateSize;
+// the field each word of the player state belongs to, or -1
+static int playerStateWordFields[MAX_PLAYERSTATE_WORDS];
 // This will be called twice (with what should be the same data both times) in a local
 // game where both the cgame and sgame are running.
 void MSG_InitNetcodeTables(NetcodeTable playerStateTable, int psSize) {
@@ -1165,7 +1445,16 @@ void MSG_InitNetcodeTables(NetcodeTable playerStateTable, int psSize) {
 		Sys::Drop("bad playerstate netcode table");
 
 	playerStateFields = std::move(playerStateTable);
+	playerStateFieldUses.reset(new std::atomic<int>[playerStateFields.size()]());
 	playerStateSize = psSize;
+
+	std::fill(std::begin(playerStateWordFields), std::end(playerStateWordFields), -1);
+	for (size_t i = 0; i < playerStateFields.size(); i++) {
+		const netField_t& f = playerStateFields[i];
+		for (int j = 0; j < FieldWords(f); j++) {
+			playerStateWordFields[f.offset / PLAYERSTATE_FIELD_SIZE + j] = i;
+		}
+	}
 }
 // TODO: add function to clear
 
@@ -1177,12 +1466,12 @@ static int qsort_playerstatefields( const void *a, const void *b )
 	aa = * ( ( int * ) a );
 	bb = * ( ( int * ) b );
 
-	if ( playerStateFields[ aa ].used > playerStateFields[ bb ].used )
+	if ( playerStateFieldUses[ aa ] > playerStateFieldUses[ bb ] )
 	{
 		return -1;
 	}
 
-	if ( playerStateFields[ bb ].used > playerStateFields[ aa ].used )
+	if ( playerStateFieldUses[ bb ] > playerStateFieldUses[ aa ] )
 	{
 		return 1;
 	}
@@ -1288,29 +1577,29 @@ void MSG_WriteDeltaPlayerstate(
 	}
 
 	int numFields = playerStateFields.size();
+	int numWords = playerStateSize / PLAYERSTATE_FIELD_SIZE;
 
-	lc = 0;
+	// fields don't overlap so there are at most as many fields as words
+	uint64_t changedWords[ ( MAX_PLAYERSTATE_WORDS + 63 ) / 64 ];
+	uint64_t changed[ ( MAX_PLAYERSTATE_WORDS + 63 ) / 64 ];
 
-	for ( int i = 0; i < numFields; i++ )
-	{
-		netField_t* field = &playerStateFields[i];
-		auto fromF = reinterpret_cast<const int *>( reinterpret_cast<const byte *>( from ) + field->offset );
-		auto toF = reinterpret_cast<const int *>( reinterpret_cast<const byte *>( to ) + field->offset );
-
-		if (field->bits == STATS_GROUP_FIELD
-			? memcmp(fromF, toF, sizeof(int) * STATS_GROUP_NUM_STATS)
-			: *fromF != *toF )
-		{
-			lc = i + 1;
-
-			field->used++;
-		}
-	}
+	MSG_ChangedWords( reinterpret_cast<const int *>( from ), reinterpret_cast<const int *>( to ), numWords, changedWords );
+	lc = MSG_ChangedFields( changedWords, numWords, playerStateWordFields, playerStateFieldUses.get(), changed, numFields );
 
 	MSG_WriteByte( msg, lc );  // # of changes
 
 	for ( int i = 0; i < lc; i++ )
 	{
+		// an unchanged stats group is a single bit too
+		int unchanged = MSG_UnchangedFields( changed, i, lc );
+
+		if ( unchanged )
+		{
+			MSG_WriteUnchanged( msg, unchanged );  // no change
+			i += unchanged - 1;
+			continue;
+		}
+
 		netField_t* field = &playerStateFields[i];
 		auto fromF = reinterpret_cast<const int *>( reinterpret_cast<const byte *>( from ) + field->offset );
 		auto toF = reinterpret_cast<const int *>( reinterpret_cast<const byte *>( to ) + field->offset );
@@ -1320,11 +1609,6 @@ void MSG_WriteDeltaPlayerstate(
 			WriteStatsGroup(msg, fromF, toF);
 			continue;
 		}
-		if ( *fromF == *toF )
-		{
-			MSG_WriteBits( msg, 0, 1 );  // no change
-			continue;
-		}
 
 		MSG_WriteBits( msg, 1, 1 );  // changed
 
@@ -1794,6 +2078,19 @@ void MSG_initHuffman()
 			Huff_addRef( &msgHuff.decompressor, ( byte ) i );  /* Do update */
 		}
 	}
+
+	// both trees are the same, the table is used for sending and receiving
+	Huff_BuildTable( &msgHuffTable, &msgHuff.compressor );
+}
+
+const huffTable_t *MSG_HuffmanTable()
+{
+	if ( !msgInit )
+	{
+		MSG_initHuffman();
+	}
+
+	return &msgHuffTable;
 }
 
 //===========================================================================
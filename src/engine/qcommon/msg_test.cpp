@@ -0,0 +1,581 @@
+/*
+===========================================================================
+Daemon BSD Source Code
+Copyright (c) 2024, Daemon Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Daemon developers nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL DAEMON DEVELOPERS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+===========================================================================
+*/
+
+#include <algorithm>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "common/Common.h"
+#include "qcommon/qcommon.h"
+
+namespace {
+
+// The bit at a time implementation MSG_WriteBits and MSG_ReadBits had
+// before they worked on words, the wire format must stay the same
+void ReferenceWriteBits( msg_t *msg, int value, int bits )
+{
+    huff_t *huff = MSG_HuffmanTable()->huff;
+
+    if ( bits < 0 )
+    {
+        bits = -bits;
+    }
+
+    int nbits = bits & 7;
+    for ( int i = 0; i < nbits; i++ )
+    {
+        Huff_putBit( value & 1, msg->data, &msg->bit );
+        value >>= 1;
+    }
+
+    for ( int i = nbits; i < bits; i += 8 )
+    {
+        Huff_offsetTransmit( huff, value & 0xff, msg->data, &msg->bit );
+        value >>= 8;
+    }
+
+    msg->cursize = ( msg->bit >> 3 ) + 1;
+}
+
+int ReferenceReadBits( msg_t *msg, int bits )
+{
+    huff_t *huff = MSG_HuffmanTable()->huff;
+    bool sgn = bits < 0;
+    int value = 0;
+    int i;
+
+    if ( sgn )
+    {
+        bits = -bits;
+    }
+
+    for ( i = 0; i < ( bits & 7 ); i++ )
+    {
+        value |= Huff_getBit( msg->data, &msg->bit ) << i;
+    }
+
+    for ( ; i < bits; i += 8 )
+    {
+        int get;
+        Huff_offsetReceive( huff->tree, &get, msg->data, &msg->bit );
+        value |= get << i;
+    }
+
+    msg->readcount = ( msg->bit >> 3 ) + 1;
+
+    if ( sgn && ( value & ( 1 << ( bits - 1 ) ) ) )
+    {
+        value |= -1 ^ ( ( 1 << bits ) - 1 );
+    }
+
+    return value;
+}
+
+// Small integer floats, as sent by msg.cpp
+const int FLOAT_INT_BITS = 13;
+const int FLOAT_INT_BIAS = 1 << ( FLOAT_INT_BITS - 1 );
+
+// MSG_WriteDeltaPlayerstate before it used change masks, which walked the
+// fields of the netcode table one by one
+void ReferenceWriteStatsGroup( msg_t *msg, const int *from, const int *to )
+{
+    int statsbits = 0;
+    for ( int i = 0; i < STATS_GROUP_NUM_STATS; i++ )
+    {
+        if ( from[ i ] != to[ i ] )
+        {
+            statsbits |= 1 << i;
+        }
+    }
+
+    if ( !statsbits )
+    {
+        MSG_WriteBits( msg, 0, 1 );
+        return;
+    }
+
+    MSG_WriteBits( msg, 1, 1 );
+    MSG_WriteUShort( msg, statsbits );
+
+    for ( int i = 0; i < STATS_GROUP_NUM_STATS; i++ )
+    {
+        if ( statsbits & ( 1 << i ) )
+        {
+            MSG_WriteBits( msg, to[ i ], -16 );
+        }
+    }
+}
+
+void ReferenceWriteDeltaPlayerstate( msg_t *msg, const NetcodeTable &table, const OpaquePlayerState *from,
+                                     const OpaquePlayerState *to )
+{
+    int lc = 0;
+
+    for ( size_t i = 0; i < table.size(); i++ )
+    {
+        const netField_t &field = table[ i ];
+        auto fromF = reinterpret_cast<const int *>( from->storage + field.offset );
+        auto toF = reinterpret_cast<const int *>( to->storage + field.offset );
+
+        if ( field.bits == STATS_GROUP_FIELD
+             ? memcmp( fromF, toF, sizeof( int ) * STATS_GROUP_NUM_STATS )
+             : *fromF != *toF )
+        {
+            lc = i + 1;
+        }
+    }
+
+    MSG_WriteByte( msg, lc );
+
+    for ( int i = 0; i < lc; i++ )
+    {
+        const netField_t &field = table[ i ];
+        auto fromF = reinterpret_cast<const int *>( from->storage + field.offset );
+        auto toF = reinterpret_cast<const int *>( to->storage + field.offset );
+
+        if ( field.bits == STATS_GROUP_FIELD )
+        {
+            ReferenceWriteStatsGroup( msg, fromF, toF );
+            continue;
+        }
+
+        if ( *fromF == *toF )
+        {
+            MSG_WriteBits( msg, 0, 1 );
+            continue;
+        }
+
+        MSG_WriteBits( msg, 1, 1 );
+
+        if ( field.bits == 0 )
+        {
+            float fullFloat = *reinterpret_cast<const float *>( toF );
+            int trunc = int( fullFloat );
+
+            if ( trunc == fullFloat && trunc + FLOAT_INT_BIAS >= 0 && trunc + FLOAT_INT_BIAS < ( 1 << FLOAT_INT_BITS ) )
+            {
+                MSG_WriteBits( msg, 0, 1 );
+                MSG_WriteBits( msg, trunc + FLOAT_INT_BIAS, FLOAT_INT_BITS );
+            }
+            else
+            {
+                MSG_WriteBits( msg, 1, 1 );
+                MSG_WriteBits( msg, *toF, 32 );
+            }
+        }
+        else
+        {
+            MSG_WriteBits( msg, *toF, field.bits );
+        }
+    }
+}
+
+// A table like the ones of the gamelogic: the fields the engine knows, then
+// game fields of every kind and a stats group, in a shuffled order
+NetcodeTable TestPlayerStateTable( int *size )
+{
+    NetcodeTable table;
+    auto add = [&]( const char *name, size_t offset, int bits ) {
+        table.push_back( { name, int( offset ), bits, 0 } );
+    };
+
+    for ( int i = 0; i < 3; i++ )
+    {
+        add( "origin", offsetof( OpaquePlayerState, origin ) + i * PLAYERSTATE_FIELD_SIZE, 0 );
+        add( "delta_angles", offsetof( OpaquePlayerState, delta_angles ) + i * PLAYERSTATE_FIELD_SIZE, 16 );
+        add( "viewangles", offsetof( OpaquePlayerState, viewangles ) + i * PLAYERSTATE_FIELD_SIZE, 0 );
+    }
+    add( "persistant", offsetof( OpaquePlayerState, persistant ), STATS_GROUP_FIELD );
+    add( "viewheight", offsetof( OpaquePlayerState, viewheight ), -8 );
+    add( "clientNum", offsetof( OpaquePlayerState, clientNum ), 8 );
+    add( "commandTime", offsetof( OpaquePlayerState, commandTime ), 32 );
+
+    int offset = offsetof( OpaquePlayerState, END );
+    for ( int bits : { 1, 4, 7, 8, 10, 16, -16, 24, 32, 0, 0, -8 } )
+    {
+        add( "game", offset, bits );
+        offset += PLAYERSTATE_FIELD_SIZE;
+    }
+    add( "stats", offset, STATS_GROUP_FIELD );
+    offset += STATS_GROUP_NUM_STATS * PLAYERSTATE_FIELD_SIZE;
+
+    // a word which is not sent
+    offset += PLAYERSTATE_FIELD_SIZE;
+
+    std::shuffle( table.begin(), table.end(), std::mt19937( 6 ) );
+    *size = offset;
+    return table;
+}
+
+struct Field {
+    int value;
+    int bits;
+};
+
+// Fields sized like the ones of entity and player states: flags, small
+// integers, floats sent as FLOAT_INT_BITS integers and full 32 bit values
+std::vector<Field> RandomFields( size_t count, unsigned seed )
+{
+    static const int sizes[] = { 1, 1, 1, 2, 4, 7, 8, 8, 10, 13, 13, 16, 24, 32, -8, -16 };
+    std::mt19937 rng( seed );
+    std::vector<Field> fields;
+
+    for ( size_t i = 0; i < count; i++ )
+    {
+        int bits = sizes[ rng() % ARRAY_LEN( sizes ) ];
+        int size = std::abs( bits );
+        unsigned value = rng();
+
+        // most values are small, like in real snapshots
+        if ( rng() % 2 )
+        {
+            value %= 64;
+        }
+
+        if ( size < 32 )
+        {
+            value &= ( 1u << size ) - 1;
+
+            if ( bits < 0 && ( value & ( 1u << ( size - 1 ) ) ) )
+            {
+                value |= ~( ( 1u << size ) - 1 );
+            }
+        }
+
+        fields.push_back( { int( value ), bits } );
+    }
+
+    return fields;
+}
+
+TEST(MsgTest, WriteBitsMatchesReference)
+{
+    std::vector<Field> fields = RandomFields( 20000, 1 );
+    std::vector<byte> expected( MAX_MSGLEN * 4, 0x55 ), actual( MAX_MSGLEN * 4, 0x55 );
+    msg_t reference, msg;
+
+    MSG_Init( &reference, expected.data(), expected.size() );
+    MSG_Init( &msg, actual.data(), actual.size() );
+
+    for ( const Field& field : fields )
+    {
+        ReferenceWriteBits( &reference, field.value, field.bits );
+        MSG_WriteBits( &msg, field.value, field.bits );
+        ASSERT_EQ( reference.bit, msg.bit );
+    }
+
+    EXPECT_EQ( reference.cursize, msg.cursize );
+    EXPECT_FALSE( msg.overflowed );
+    EXPECT_EQ( expected, actual );
+}
+
+TEST(MsgTest, ReadBitsMatchesReference)
+{
+    std::vector<Field> fields = RandomFields( 20000, 2 );
+    std::vector<byte> data( MAX_MSGLEN * 4 );
+    msg_t msg;
+
+    MSG_Init( &msg, data.data(), data.size() );
+    for ( const Field& field : fields )
+    {
+        ReferenceWriteBits( &msg, field.value, field.bits );
+    }
+
+    msg_t reference = msg;
+    MSG_BeginReading( &reference );
+    MSG_BeginReading( &msg );
+
+    for ( const Field& field : fields )
+    {
+        ASSERT_EQ( field.value, ReferenceReadBits( &reference, field.bits ) );
+        ASSERT_EQ( field.value, MSG_ReadBits( &msg, field.bits ) );
+        ASSERT_EQ( reference.bit, msg.bit );
+        ASSERT_EQ( reference.readcount, msg.readcount );
+    }
+}
+
+// Splicing a message written apart must give the same bits, and overflow at
+// the same size, as writing its fields directly
+TEST(MsgTest, WriteMsgBitsMatchesWriteBits)
+{
+    std::vector<Field> prefix = RandomFields( 200, 4 );
+    std::vector<Field> fields = RandomFields( 100, 5 );
+    std::vector<byte> srcData( MAX_MSGLEN );
+    msg_t src;
+
+    MSG_Init( &src, srcData.data(), srcData.size() );
+    for ( const Field& field : fields )
+    {
+        MSG_WriteBits( &src, field.value, field.bits );
+    }
+
+    // prefixes of every length modulo 8
+    for ( size_t numPrefix = 0; numPrefix < 16; numPrefix++ )
+    {
+        int fullSize = 0;
+        bool fitted = false, overflowed = false;
+
+        for ( int maxsize = 0; !fitted || maxsize <= fullSize + 8; maxsize++ )
+        {
+            std::vector<byte> expected( MAX_MSGLEN, 0x55 ), actual( MAX_MSGLEN, 0x55 );
+            msg_t reference, msg;
+
+            MSG_Init( &reference, expected.data(), maxsize );
+            MSG_Init( &msg, actual.data(), maxsize );
+
+            for ( size_t i = 0; i < numPrefix; i++ )
+            {
+                MSG_WriteBits( &reference, prefix[ i ].value, prefix[ i ].bits );
+                MSG_WriteBits( &msg, prefix[ i ].value, prefix[ i ].bits );
+            }
+
+            for ( const Field& field : fields )
+            {
+                MSG_WriteBits( &reference, field.value, field.bits );
+            }
+
+            MSG_WriteMsgBits( &msg, &src );
+
+            ASSERT_EQ( reference.overflowed, msg.overflowed ) << "prefix " << numPrefix << " size " << maxsize;
+
+            if ( reference.overflowed )
+            {
+                overflowed = true;
+                continue;
+            }
+
+            // the smallest size that fits
+            if ( !fitted )
+            {
+                fitted = true;
+                fullSize = maxsize;
+            }
+
+            // the bytes after the last bit may differ
+            ASSERT_EQ( reference.bit, msg.bit );
+            ASSERT_EQ( reference.cursize, msg.cursize );
+            ASSERT_EQ( 0, memcmp( expected.data(), actual.data(), ( msg.bit + 7 ) >> 3 ) );
+        }
+
+        EXPECT_TRUE( overflowed );
+    }
+}
+
+// The change masks must not change the player state bits, and what is read
+// back must be the state which was written
+TEST(MsgTest, PlayerStateDeltaMatchesReference)
+{
+    int size;
+    NetcodeTable table = TestPlayerStateTable( &size );
+    MSG_InitNetcodeTables( table, size );
+
+    std::mt19937 rng( 7 );
+    std::vector<byte> expected( MAX_MSGLEN ), actual( MAX_MSGLEN );
+
+    // a value which fits in the field, so that it is read back unchanged
+    auto randomValue = [&]( int bits ) {
+        unsigned value = rng() % 2 ? rng() % 64 : rng();
+        int numBits = std::abs( bits );
+
+        if ( bits == 0 )
+        {
+            // small integers are sent apart from other floats
+            if ( rng() % 2 )
+            {
+                float f = float( int( rng() % 8192 ) - 4096 );
+                memcpy( &value, &f, sizeof( f ) );
+            }
+        }
+        else if ( numBits < 32 )
+        {
+            value &= ( 1u << numBits ) - 1;
+
+            if ( bits < 0 && ( value & ( 1u << ( numBits - 1 ) ) ) )
+            {
+                value |= ~( ( 1u << numBits ) - 1 );
+            }
+        }
+
+        return int( value );
+    };
+
+    for ( int n = 0; n < 2000; n++ )
+    {
+        OpaquePlayerState from, to, result;
+        int *fromWords = reinterpret_cast<int *>( from.storage );
+        int *toWords = reinterpret_cast<int *>( to.storage );
+
+        // the first delta is from the baseline
+        memset( &from, 0, sizeof( from ) );
+        for ( int i = 0; n && i < size / PLAYERSTATE_FIELD_SIZE; i++ )
+        {
+            fromWords[ i ] = rng();
+        }
+        to = from;
+
+        // few fields change in most deltas
+        unsigned changeOdds = n % 2 ? 2 : 16;
+
+        for ( const netField_t &field : table )
+        {
+            int *word = toWords + field.offset / PLAYERSTATE_FIELD_SIZE;
+
+            if ( field.bits == STATS_GROUP_FIELD )
+            {
+                for ( int i = 0; i < STATS_GROUP_NUM_STATS; i++ )
+                {
+                    if ( rng() % changeOdds == 0 )
+                    {
+                        word[ i ] = randomValue( -16 );
+                    }
+                }
+            }
+            else if ( rng() % changeOdds == 0 )
+            {
+                *word = randomValue( field.bits );
+            }
+        }
+
+        const OpaquePlayerState *deltaFrom = n ? &from : nullptr;
+
+        msg_t reference, msg;
+        MSG_Init( &reference, expected.data(), expected.size() );
+        MSG_Init( &msg, actual.data(), actual.size() );
+
+        ReferenceWriteDeltaPlayerstate( &reference, table, &from, &to );
+        MSG_WriteDeltaPlayerstate( &msg, deltaFrom, &to );
+
+        ASSERT_EQ( reference.bit, msg.bit );
+        ASSERT_EQ( 0, memcmp( expected.data(), actual.data(), ( msg.bit + 7 ) >> 3 ) );
+
+        int written = msg.bit;
+        MSG_BeginReading( &msg );
+        MSG_ReadDeltaPlayerstate( &msg, deltaFrom, &result );
+
+        ASSERT_EQ( written, msg.bit );
+
+        // including the word which is not sent, which keeps its old value
+        ASSERT_EQ( 0, memcmp( &to, &result, size ) );
+    }
+}
+
+// Each word of the player state must belong to one field at most
+TEST(MsgTest, OverlappingNetcodeTableIsRejected)
+{
+    int size;
+    NetcodeTable table = TestPlayerStateTable( &size );
+    EXPECT_NO_THROW( MSG_InitNetcodeTables( table, size ) );
+
+    int statsOffset = -1;
+    for ( const netField_t &field : table )
+    {
+        if ( field.name == "stats" )
+        {
+            statsOffset = field.offset;
+        }
+    }
+    ASSERT_NE( -1, statsOffset );
+
+    // a field inside the stats group
+    NetcodeTable overlapping = table;
+    overlapping.push_back( { "overlap", statsOffset + 3 * PLAYERSTATE_FIELD_SIZE, 8, 0 } );
+    EXPECT_THROW( MSG_InitNetcodeTables( overlapping, size ), Sys::DropErr );
+
+    // the same word sent twice
+    overlapping = table;
+    overlapping.push_back( table.front() );
+    EXPECT_THROW( MSG_InitNetcodeTables( overlapping, size ), Sys::DropErr );
+
+    // a stats group starting in the middle of another one
+    overlapping = table;
+    overlapping.push_back( { "overlap", int( offsetof( OpaquePlayerState, persistant ) ) + 8 * PLAYERSTATE_FIELD_SIZE,
+                             STATS_GROUP_FIELD, 0 } );
+    EXPECT_THROW( MSG_InitNetcodeTables( overlapping, size ), Sys::DropErr );
+
+    // the unsent word can still be used
+    NetcodeTable extended = table;
+    extended.push_back( { "last", size - PLAYERSTATE_FIELD_SIZE, 32, 0 } );
+    EXPECT_NO_THROW( MSG_InitNetcodeTables( extended, size ) );
+
+    MSG_InitNetcodeTables( table, size );
+}
+
+// Random entity states go through MSG_WriteDeltaEntity and MSG_ReadDeltaEntity
+TEST(MsgTest, EntityStateRoundTrip)
+{
+    std::mt19937 rng( 3 );
+    std::vector<byte> data( MAX_MSGLEN );
+
+    auto randomState = [&]( entityState_t *state ) {
+        int *words = reinterpret_cast<int *>( state );
+        for ( size_t i = 0; i < sizeof( *state ) / sizeof( int ); i++ )
+        {
+            switch ( rng() % 4 )
+            {
+            case 0: words[ i ] = 0; break;
+            case 1: words[ i ] = rng() % 128; break;
+            case 2: { float f = float( int( rng() % 8192 ) - 4096 ); memcpy( &words[ i ], &f, sizeof( f ) ); break; }
+            default: words[ i ] = rng(); break;
+            }
+        }
+        state->number = rng() % MAX_GENTITIES;
+    };
+
+    // returns false if the reader doesn't stop where the writer did
+    auto roundTrip = [&]( const entityState_t& from, const entityState_t& to, entityState_t *result ) {
+        msg_t msg;
+        MSG_Init( &msg, data.data(), data.size() );
+        MSG_WriteDeltaEntity( &msg, &from, &to, true );
+        int written = msg.bit;
+
+        MSG_BeginReading( &msg );
+        int number = MSG_ReadBits( &msg, GENTITYNUM_BITS );
+        MSG_ReadDeltaEntity( &msg, &from, result, number );
+        return !msg.overflowed && number == to.number && msg.bit == written;
+    };
+
+    for ( int n = 0; n < 500; n++ )
+    {
+        entityState_t from, to, result, again;
+        randomState( &from );
+        randomState( &to );
+        to.number = from.number;
+
+        ASSERT_TRUE( roundTrip( from, to, &result ) );
+
+        // integer fields are truncated to their size, after that the state
+        // must survive unchanged
+        ASSERT_TRUE( roundTrip( from, result, &again ) );
+        ASSERT_EQ( 0, memcmp( &result, &again, sizeof( result ) ) );
+    }
+}
+
+} // namespace
@@ -126,6 +126,12 @@ namespace net {
 static bool            usingSocks = false;
 static bool            networkingEnabled = false;
 
+// sendmmsg and recvmmsg save a system call per packet on busy servers
+#if defined( __linux__ )
+#define USE_MMSG
+static Cvar::Cvar<bool> net_batchPackets( "net_batchPackets", "send and receive UDP packets in batches", Cvar::NONE, true );
+#endif
+
 cvar_t                     *net_enabled;
 
 static cvar_t              *net_socksEnabled;
@@ -572,96 +578,230 @@ bool        NET_IsLocalAddress( const netadr_t& adr )
 
 /*
 ==================
-Sys_GetPacket
+NET_ReceivedPacket
 
-Never called by the game logic, just the system event queuing
+Fills net_from and checks a packet received by recvfrom or recvmmsg
 ==================
 */
-bool Sys_GetPacket( netadr_t *net_from, msg_t *net_message )
+static bool NET_ReceivedPacket( SOCKET socket, int ret, struct sockaddr_storage *from, socklen_t fromlen,
+                                netadr_t *net_from, msg_t *net_message )
 {
-	int                     ret;
-	struct sockaddr_storage from;
+	if ( socket == ip_socket )
+	{
+		memset( ( ( struct sockaddr_in * ) from )->sin_zero, 0, 8 );
+	}
+
+	if ( socket == ip_socket && usingSocks && memcmp( from, &socksRelayAddr, fromlen ) == 0 )
+	{
+		if ( ret < 10 || net_message->data[ 0 ] != 0 || net_message->data[ 1 ] != 0 || net_message->data[ 2 ] != 0 || net_message->data[ 3 ] != 1 )
+		{
+			return false;
+		}
+
+		net_from->type = netadrtype_t::NA_IP;
+		net_from->ip[ 0 ] = net_message->data[ 4 ];
+		net_from->ip[ 1 ] = net_message->data[ 5 ];
+		net_from->ip[ 2 ] = net_message->data[ 6 ];
+		net_from->ip[ 3 ] = net_message->data[ 7 ];
+		net_from->port = * ( short * ) &net_message->data[ 8 ];
+		net_message->readcount = 10;
+	}
+	else
+	{
+		SockadrToNetadr( ( struct sockaddr * ) from, net_from );
+		net_message->readcount = 0;
+	}
+
+	if ( ret == net_message->maxsize )
+	{
+		Log::Notice( "Oversize packet from %s", NET_AdrToString( *net_from ) );
+		return false;
+	}
+
+	net_message->cursize = ret;
+	return true;
+}
+
+static void NET_ReceiveError()
+{
+	int err = socketError;
+
+	if ( err != net::errc::resource_unavailable_try_again && err != net::errc::connection_reset )
+	{
+		Log::Notice( "NET_GetPacket: %s", NET_ErrorString() );
+	}
+}
+
+#ifdef USE_MMSG
+/*
+=============================================================================
+
+Batched receiving with recvmmsg, packets are drained from a socket in
+one system call and handed out one at a time by Sys_GetPacket.
 
+=============================================================================
+*/
+
+static const int MAX_RECV_BATCH = 16;
+
+struct receivedPacket_t
+{
+	SOCKET                  socket;
+	int                     length;
+	struct sockaddr_storage from;
 	socklen_t               fromlen;
-	int                     err;
+};
 
-	if ( ip_socket != INVALID_SOCKET )
+static receivedPacket_t  recvQueue[ MAX_RECV_BATCH ];
+static std::vector<byte> recvBuffers;
+static int               recvBufferSize;
+static int               recvQueueHead;
+static int               recvQueueCount;
+
+static int NET_ReceiveBatch( SOCKET socket )
+{
+	struct mmsghdr msgs[ MAX_RECV_BATCH ];
+	struct iovec   iovecs[ MAX_RECV_BATCH ];
+
+	for ( int i = 0; i < MAX_RECV_BATCH; i++ )
 	{
-		fromlen = sizeof( from );
-		ret = recvfrom( ip_socket, ( char * ) net_message->data, net_message->maxsize, 0, ( struct sockaddr * ) &from, &fromlen );
+		iovecs[ i ].iov_base = &recvBuffers[ i * recvBufferSize ];
+		iovecs[ i ].iov_len = recvBufferSize;
 
-		if ( ret == SOCKET_ERROR )
-		{
-			err = socketError;
+		memset( &msgs[ i ], 0, sizeof( msgs[ i ] ) );
+		msgs[ i ].msg_hdr.msg_name = &recvQueue[ i ].from;
+		msgs[ i ].msg_hdr.msg_namelen = sizeof( recvQueue[ i ].from );
+		msgs[ i ].msg_hdr.msg_iov = &iovecs[ i ];
+		msgs[ i ].msg_hdr.msg_iovlen = 1;
+	}
 
-			if ( err != net::errc::resource_unavailable_try_again && err != net::errc::connection_reset )
-			{
-				Log::Notice( "NET_GetPacket: %s", NET_ErrorString() );
-			}
+	int ret = recvmmsg( socket, msgs, MAX_RECV_BATCH, MSG_DONTWAIT, nullptr );
+
+	if ( ret == SOCKET_ERROR )
+	{
+		if ( errno == ENOSYS )
+		{
+			Log::Notice( "recvmmsg is unavailable, not batching received packets" );
+			net_batchPackets.Set( false );
 		}
 		else
 		{
-			memset( ( ( struct sockaddr_in * ) &from )->sin_zero, 0, 8 );
+			NET_ReceiveError();
+		}
+
+		return 0;
+	}
+
+	for ( int i = 0; i < ret; i++ )
+	{
+		recvQueue[ i ].socket = socket;
+		recvQueue[ i ].length = msgs[ i ].msg_len;
+		recvQueue[ i ].fromlen = msgs[ i ].msg_hdr.msg_namelen;
+	}
 
-			if ( usingSocks && memcmp( &from, &socksRelayAddr, fromlen ) == 0 )
+	return ret;
+}
+
+static bool NET_GetBatchedPacket( netadr_t *net_from, msg_t *net_message )
+{
+	while ( true )
+	{
+		if ( recvQueueHead == recvQueueCount )
+		{
+			// a larger net_message can't be filled from smaller buffers
+			if ( recvBufferSize < net_message->maxsize )
 			{
-				if ( ret < 10 || net_message->data[ 0 ] != 0 || net_message->data[ 1 ] != 0 || net_message->data[ 2 ] != 0 || net_message->data[ 3 ] != 1 )
-				{
-					return false;
-				}
+				recvBufferSize = net_message->maxsize;
+				recvBuffers.resize( MAX_RECV_BATCH * recvBufferSize );
+			}
 
-				net_from->type = netadrtype_t::NA_IP;
-				net_from->ip[ 0 ] = net_message->data[ 4 ];
-				net_from->ip[ 1 ] = net_message->data[ 5 ];
-				net_from->ip[ 2 ] = net_message->data[ 6 ];
-				net_from->ip[ 3 ] = net_message->data[ 7 ];
-				net_from->port = * ( short * ) &net_message->data[ 8 ];
-				net_message->readcount = 10;
+			recvQueueHead = 0;
+			recvQueueCount = 0;
+
+			if ( ip_socket != INVALID_SOCKET )
+			{
+				recvQueueCount = NET_ReceiveBatch( ip_socket );
 			}
-			else
+
+			if ( !recvQueueCount && ip6_socket != INVALID_SOCKET )
 			{
-				SockadrToNetadr( ( struct sockaddr * ) &from, net_from );
-				net_message->readcount = 0;
+				recvQueueCount = NET_ReceiveBatch( ip6_socket );
 			}
 
-			if ( ret == net_message->maxsize )
+			if ( !recvQueueCount )
 			{
-				Log::Notice( "Oversize packet from %s", NET_AdrToString( *net_from ) );
 				return false;
 			}
+		}
+
+		receivedPacket_t &packet = recvQueue[ recvQueueHead ];
+		int length = std::min( packet.length, net_message->maxsize );
 
-			net_message->cursize = ret;
+		memcpy( net_message->data, &recvBuffers[ recvQueueHead * recvBufferSize ], length );
+		recvQueueHead++;
+
+		if ( NET_ReceivedPacket( packet.socket, length, &packet.from, packet.fromlen, net_from, net_message ) )
+		{
 			return true;
 		}
 	}
+}
+#endif
 
-	if ( ip6_socket != INVALID_SOCKET )
-	{
-		fromlen = sizeof( from );
-		ret = recvfrom( ip6_socket, ( char * ) net_message->data, net_message->maxsize, 0, ( struct sockaddr * ) &from, &fromlen );
+/*
+==================
+Sys_GetPacket
 
-		if ( ret == SOCKET_ERROR )
+Never called by the game logic, just the system event queuing
+==================
+*/
+bool Sys_GetPacket( netadr_t *net_from, msg_t *net_message )
+{
+	int                     ret;
+	struct sockaddr_storage from;
+
+	socklen_t               fromlen;
+
+#ifdef USE_MMSG
+	// packets already read from a socket come first
+	if ( net_batchPackets.Get() || recvQueueHead < recvQueueCount )
+	{
+		if ( NET_GetBatchedPacket( net_from, net_message ) )
 		{
-			err = socketError;
+			return true;
+		}
+	}
+	else
+#endif
+	{
+		if ( ip_socket != INVALID_SOCKET )
+		{
+			fromlen = sizeof( from );
+			ret = recvfrom( ip_socket, ( char * ) net_message->data, net_message->maxsize, 0, ( struct sockaddr * ) &from, &fromlen );
 
-			if ( err != net::errc::resource_unavailable_try_again && err != net::errc::connection_reset )
+			if ( ret == SOCKET_ERROR )
+			{
+				NET_ReceiveError();
+			}
+			else
 			{
-				Log::Notice( "NET_GetPacket: %s", NET_ErrorString() );
+				return NET_ReceivedPacket( ip_socket, ret, &from, fromlen, net_from, net_message );
 			}
 		}
-		else
+
+		if ( ip6_socket != INVALID_SOCKET )
 		{
-			SockadrToNetadr( ( struct sockaddr * ) &from, net_from );
-			net_message->readcount = 0;
+			fromlen = sizeof( from );
+			ret = recvfrom( ip6_socket, ( char * ) net_message->data, net_message->maxsize, 0, ( struct sockaddr * ) &from, &fromlen );
 
-			if ( ret == net_message->maxsize )
+			if ( ret == SOCKET_ERROR )
 			{
-				Log::Notice( "Oversize packet from %s", NET_AdrToString( *net_from ) );
-				return false;
+				NET_ReceiveError();
+			}
+			else
+			{
+				return NET_ReceivedPacket( ip6_socket, ret, &from, fromlen, net_from, net_message );
 			}
-
-			net_message->cursize = ret;
-			return true;
 		}
 	}
 
@@ -672,35 +812,174 @@ bool Sys_GetPacket( netadr_t *net_from, msg_t *net_message )
 
 		if ( ret == SOCKET_ERROR )
 		{
-			err = socketError;
-
-			if ( err != net::errc::resource_unavailable_try_again && err != net::errc::connection_reset )
-			{
-				Log::Notice( "NET_GetPacket: %s", NET_ErrorString() );
-			}
+			NET_ReceiveError();
 		}
 		else
 		{
-			SockadrToNetadr( ( struct sockaddr * ) &from, net_from );
-			net_message->readcount = 0;
+			return NET_ReceivedPacket( multicast6_socket, ret, &from, fromlen, net_from, net_message );
+		}
+	}
 
-			if ( ret == net_message->maxsize )
+	return false;
+}
+
+//=============================================================================
+
+static char socksBuf[ 4096 ];
+
+static void NET_SendError( int err, netadrtype_t type, sa_family_t family )
+{
+	// wouldblock is silent
+	if ( err == net::errc::resource_unavailable_try_again )
+	{
+		return;
+	}
+
+	// some PPP links do not allow broadcasts and return an error
+	if ( ( err == net::errc::address_not_available ) && ( ( type == netadrtype_t::NA_BROADCAST ) ) )
+	{
+		return;
+	}
+
+	if ( family == AF_INET )
+	{
+		Log::Notice( "Sys_SendPacket (ipv4): %s", NET_ErrorString() );
+	}
+	else if ( family == AF_INET6 )
+	{
+		Log::Notice( "Sys_SendPacket (ipv6): %s", NET_ErrorString() );
+	}
+	else
+	{
+		Log::Notice( "Sys_SendPacket (%i): %s", family, NET_ErrorString() );
+	}
+}
+
+#ifdef USE_MMSG
+/*
+=============================================================================
+
+Batched sending with sendmmsg, packets sent between NET_BeginPacketBatch
+and NET_FlushPacketBatch are queued and sent with one system call per
+run of packets going through the same socket.
+
+=============================================================================
+*/
+
+static const int MAX_SEND_BATCH = 64;
+
+struct queuedPacket_t
+{
+	SOCKET                  socket;
+	netadrtype_t            type;
+	size_t                  offset;
+	int                     length;
+	struct sockaddr_storage addr;
+	socklen_t               addrlen;
+};
+
+static bool                        sendBatching;
+static std::vector<queuedPacket_t> sendQueue;
+static std::vector<byte>           sendBuffer;
+
+static void NET_SendBatch( const queuedPacket_t *packets, int count )
+{
+	struct mmsghdr msgs[ MAX_SEND_BATCH ];
+	struct iovec   iovecs[ MAX_SEND_BATCH ];
+
+	for ( int i = 0; i < count; i++ )
+	{
+		iovecs[ i ].iov_base = &sendBuffer[ packets[ i ].offset ];
+		iovecs[ i ].iov_len = packets[ i ].length;
+
+		memset( &msgs[ i ], 0, sizeof( msgs[ i ] ) );
+		msgs[ i ].msg_hdr.msg_name = const_cast<struct sockaddr_storage *>( &packets[ i ].addr );
+		msgs[ i ].msg_hdr.msg_namelen = packets[ i ].addrlen;
+		msgs[ i ].msg_hdr.msg_iov = &iovecs[ i ];
+		msgs[ i ].msg_hdr.msg_iovlen = 1;
+	}
+
+	int sent = 0;
+
+	while ( sent < count )
+	{
+		int ret = sendmmsg( packets[ 0 ].socket, msgs + sent, count - sent, 0 );
+
+		if ( ret == SOCKET_ERROR )
+		{
+			if ( errno == ENOSYS )
 			{
-				Log::Notice( "Oversize packet from %s", NET_AdrToString( *net_from ) );
-				return false;
+				Log::Notice( "sendmmsg is unavailable, not batching sent packets" );
+				net_batchPackets.Set( false );
+
+				for ( ; sent < count; sent++ )
+				{
+					const queuedPacket_t &packet = packets[ sent ];
+
+					if ( sendto( packet.socket, &sendBuffer[ packet.offset ], packet.length, 0,
+					             ( struct sockaddr * ) &packet.addr, packet.addrlen ) == SOCKET_ERROR )
+					{
+						NET_SendError( socketError, packet.type, packet.addr.ss_family );
+					}
+				}
+
+				return;
 			}
 
-			net_message->cursize = ret;
-			return true;
+			// the error is about the first packet not sent, skip it
+			NET_SendError( socketError, packets[ sent ].type, packets[ sent ].addr.ss_family );
+			ret = 1;
 		}
+
+		sent += ret;
 	}
+}
 
-	return false;
+/*
+==================
+NET_BeginPacketBatch
+==================
+*/
+void NET_BeginPacketBatch()
+{
+	sendBatching = net_batchPackets.Get();
 }
 
-//=============================================================================
+/*
+==================
+NET_FlushPacketBatch
 
-static char socksBuf[ 4096 ];
+Sends the queued packets and stops batching
+==================
+*/
+void NET_FlushPacketBatch()
+{
+	sendBatching = false;
+
+	size_t first = 0;
+
+	for ( size_t i = 1; i <= sendQueue.size(); i++ )
+	{
+		// packets are sent in order, split where the socket changes
+		if ( i == sendQueue.size() || i - first == MAX_SEND_BATCH || sendQueue[ i ].socket != sendQueue[ first ].socket )
+		{
+			NET_SendBatch( &sendQueue[ first ], i - first );
+			first = i;
+		}
+	}
+
+	sendQueue.clear();
+	sendBuffer.clear();
+}
+#else
+void NET_BeginPacketBatch()
+{
+}
+
+void NET_FlushPacketBatch()
+{
+}
+#endif
 
 /*
 ==================
@@ -744,6 +1023,23 @@ void Sys_SendPacket( int length, const void *data, const netadr_t& to )
 		memcpy( &socksBuf[ 10 ], data, length );
 		ret = sendto( ip_socket, ( const char* )socksBuf, length + 10, 0, &socksRelayAddr, sizeof( socksRelayAddr ) );
 	}
+#ifdef USE_MMSG
+	else if ( sendBatching && ( addr.ss_family == AF_INET || addr.ss_family == AF_INET6 ) )
+	{
+		queuedPacket_t packet;
+
+		packet.socket = addr.ss_family == AF_INET ? ip_socket : ip6_socket;
+		packet.type = to.type;
+		packet.offset = sendBuffer.size();
+		packet.length = length;
+		packet.addr = addr;
+		packet.addrlen = addr.ss_family == AF_INET ? sizeof( struct sockaddr_in ) : sizeof( struct sockaddr_in6 );
+
+		sendBuffer.insert( sendBuffer.end(), ( const byte * ) data, ( const byte * ) data + length );
+		sendQueue.push_back( packet );
+		return;
+	}
+#endif
 	else
 	{
 		if ( addr.ss_family == AF_INET )
@@ -758,32 +1054,7 @@ void Sys_SendPacket( int length, const void *data, const netadr_t& to )
 
 	if ( ret == SOCKET_ERROR )
 	{
-		int err = socketError;
-
-		// wouldblock is silent
-		if ( err == net::errc::resource_unavailable_try_again )
-		{
-			return;
-		}
-
-		// some PPP links do not allow broadcasts and return an error
-		if ( ( err == net::errc::address_not_available ) && ( ( to.type == netadrtype_t::NA_BROADCAST ) ) )
-		{
-			return;
-		}
-
-		if ( addr.ss_family == AF_INET )
-		{
-			Log::Notice( "Sys_SendPacket (ipv4): %s", NET_ErrorString() );
-		}
-		else if ( addr.ss_family == AF_INET6 )
-		{
-			Log::Notice( "Sys_SendPacket (ipv6): %s", NET_ErrorString() );
-		}
-		else
-		{
-			Log::Notice( "Sys_SendPacket (%i): %s", addr.ss_family , NET_ErrorString() );
-		}
+		NET_SendError( socketError, to.type, addr.ss_family );
 	}
 }
 
@@ -1751,6 +2022,13 @@ void NET_DisableNetworking()
 
 	networkingEnabled = false;
 
+	NET_FlushPacketBatch();
+
+#ifdef USE_MMSG
+	// drop packets read from the sockets being closed
+	recvQueueHead = recvQueueCount = 0;
+#endif
+
 	if ( ip_socket != INVALID_SOCKET )
 	{
 		closesocket( ip_socket );
@@ -1839,6 +2117,9 @@ void NET_Sleep( int msec )
 	fd_set         fdset;
 	SOCKET         highestfd = INVALID_SOCKET;
 
+	// in case a batch wasn't flushed because of an error
+	NET_FlushPacketBatch();
+
 	if ( ip_socket == INVALID_SOCKET && ip6_socket == INVALID_SOCKET )
 	{
 		return;
@@ -1849,6 +2130,14 @@ void NET_Sleep( int msec )
 		return;
 	}
 
+#ifdef USE_MMSG
+	// don't wait for packets that were already read
+	if ( recvQueueHead < recvQueueCount )
+	{
+		return;
+	}
+#endif
+
 	FD_ZERO( &fdset );
 
 	if ( ip_socket != INVALID_SOCKET )
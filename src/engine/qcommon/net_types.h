@@ -78,6 +78,7 @@ struct msg_t
     int      uncompsize; // NERVE - SMF - net debugging
     int      readcount;
     int      bit; // for bitwise reads and writes
+    int      lastWrite; // bit, or out of band byte, where the last write started
 };
 
 #endif // ENGINE_QCOMMON_NET_TYPES_H_
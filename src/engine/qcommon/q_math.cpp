@@ -3346,5 +3346,84 @@ void TransEndLerp( transform_t *t )
 {
 	QuatNormalize( t->rot );
 }
+
+void SkinPoint( const transformMatrix_t *bones, const uint32_t *boneIndexes,
+		const float *boneWeights, int numWeights, const vec3_t in, vec3_t out )
+{
+	SkinPointScalar( bones, boneIndexes, boneWeights, numWeights, in, out );
+}
+
+void SkinVertex( const transformMatrix_t *bones, const uint32_t *boneIndexes,
+		 const float *boneWeights, int numWeights, const vec3_t position, const vec3_t normal,
+		 const vec3_t tangent, const vec3_t binormal, vec3_t outPosition,
+		 vec3_t outNormal, vec3_t outTangent, vec3_t outBinormal )
+{
+	SkinVertexScalar( bones, boneIndexes, boneWeights, numWeights, position, normal, tangent, binormal,
+		outPosition, outNormal, outTangent, outBinormal );
+}
 #endif
 
+// blend the bone matrices, then transform a point with the result
+void SkinPointScalar( const transformMatrix_t *bones, const uint32_t *boneIndexes,
+		      const float *boneWeights, int numWeights, const vec3_t in, vec3_t out )
+{
+	VectorClear( out );
+
+	for ( int i = 0; i < numWeights; i++ )
+	{
+		const transformMatrix_t *b = &bones[ boneIndexes[ i ] ];
+		float scale = b->trans[ 3 ];
+
+		for ( int j = 0; j < 3; j++ )
+		{
+			out[ j ] += boneWeights[ i ] * ( scale * ( b->axis[ 0 ][ j ] * in[ 0 ] + b->axis[ 1 ][ j ] * in[ 1 ]
+			                                           + b->axis[ 2 ][ j ] * in[ 2 ] ) + b->trans[ j ] );
+		}
+	}
+}
+
+static void SkinNormalVector( const transformMatrix_t *b, float weight, const vec3_t in, vec3_t out )
+{
+	for ( int j = 0; j < 3; j++ )
+	{
+		out[ j ] += weight * ( b->axis[ 0 ][ j ] * in[ 0 ] + b->axis[ 1 ][ j ] * in[ 1 ] + b->axis[ 2 ][ j ] * in[ 2 ] );
+	}
+}
+
+// same as SkinPointScalar, plus the normal vectors transformed without scale
+void SkinVertexScalar( const transformMatrix_t *bones, const uint32_t *boneIndexes,
+		       const float *boneWeights, int numWeights, const vec3_t position, const vec3_t normal,
+		       const vec3_t tangent, const vec3_t binormal, vec3_t outPosition,
+		       vec3_t outNormal, vec3_t outTangent, vec3_t outBinormal )
+{
+	SkinPointScalar( bones, boneIndexes, boneWeights, numWeights, position, outPosition );
+
+	VectorClear( outNormal );
+	VectorClear( outTangent );
+	VectorClear( outBinormal );
+
+	for ( int i = 0; i < numWeights; i++ )
+	{
+		const transformMatrix_t *b = &bones[ boneIndexes[ i ] ];
+
+		SkinNormalVector( b, boneWeights[ i ], normal, outNormal );
+		SkinNormalVector( b, boneWeights[ i ], tangent, outTangent );
+		SkinNormalVector( b, boneWeights[ i ], binormal, outBinormal );
+	}
+}
+
+// expand a transform to a 3x4 matrix
+void TransToMatrix( const transform_t *t, transformMatrix_t *m )
+{
+	const float *q = t->rot;
+	float x2 = q[ 0 ] + q[ 0 ], y2 = q[ 1 ] + q[ 1 ], z2 = q[ 2 ] + q[ 2 ];
+	float xx2 = q[ 0 ] * x2, yy2 = q[ 1 ] * y2, zz2 = q[ 2 ] * z2;
+	float xy2 = q[ 0 ] * y2, xz2 = q[ 0 ] * z2, yz2 = q[ 1 ] * z2;
+	float wx2 = q[ 3 ] * x2, wy2 = q[ 3 ] * y2, wz2 = q[ 3 ] * z2;
+
+	Vector4Set( m->axis[ 0 ], 1.0f - yy2 - zz2, xy2 + wz2, xz2 - wy2, 0.0f );
+	Vector4Set( m->axis[ 1 ], xy2 - wz2, 1.0f - xx2 - zz2, yz2 + wx2, 0.0f );
+	Vector4Set( m->axis[ 2 ], xz2 + wy2, yz2 - wx2, 1.0f - xx2 - yy2, 0.0f );
+	Vector4Set( m->trans, t->trans[ 0 ], t->trans[ 1 ], t->trans[ 2 ], t->scale );
+}
+
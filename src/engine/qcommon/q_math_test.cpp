@@ -205,6 +205,92 @@ TEST(QMathTransformTest, TransInverse)
         {-0.4833702, 0.42157, 0.7551386, -0.1356377}, {1.244436,1.155842,-0.5278334}, 0.4);
 }
 
+TEST(QMathTransformTest, TransToMatrix)
+{
+    const transform_t t = MakeTransform(
+        {0.3155654, 0.121273, 0.7211766, 0.6046616}, {-11, -26, 55}, 1.2);
+    transformMatrix_t m;
+    TransToMatrix(&t, &m);
+
+    const uint32_t boneIndex = 0;
+    const float boneWeight = 1;
+    const vec3_t point = {12, 19, -30};
+    vec3_t pointOut;
+    SkinPoint(&m, &boneIndex, &boneWeight, 1, point, pointOut);
+    const vec3_t expectedPoint = {-51.8073, -10.3551, 44.3603};
+    EXPECT_THAT(pointOut, Pointwise(FloatNear(0.001), expectedPoint));
+
+    // the tag axes are the columns of the rotation, the scale is apart
+    vec3_t axis[3];
+    QuatToAxis(t.rot, axis);
+    for (int i = 0; i < 3; i++) {
+        vec3_t column;
+        VectorCopy(m.axis[i], column);
+        EXPECT_THAT(column, Pointwise(FloatNear(1e-5), axis[i]));
+    }
+    EXPECT_FLOAT_EQ(1.2f, m.trans[3]);
+}
+
+// The SSE and scalar skinning against the transforms of each weight, as
+// skinning was done before the bone matrices
+TEST(QMathTransformTest, SkinVertex)
+{
+    const transform_t bones[] = {
+        MakeTransform({0.3155654, 0.121273, 0.7211766, 0.6046616}, {-11, -26, 55}, 1.2),
+        MakeTransform({0.1641059, -0.6753088, 0.2253332, -0.6828266}, {235, 52, 42}, 8),
+        MakeTransform({0.4833702, -0.42157, -0.7551386, -0.1356377}, {2.5, 3.4, 1.4}, 2.5),
+        // a bone scaled to nothing, to hide a part of a model
+        MakeTransform({0.1641059, -0.6753088, 0.2253332, -0.6828266}, {-7, 12, 3}, 0),
+    };
+    transformMatrix_t matrices[4];
+    for (int i = 0; i < 4; i++) {
+        TransToMatrix(&bones[i], &matrices[i]);
+    }
+
+    const vec3_t position = {12, 19, -30};
+    const vec3_t vectors[3] = {{0.48, 0.64, 0.6}, {0, 0.6, -0.8}, {1, 0, 0}};
+
+    auto check = [&](std::vector<uint32_t> boneIndexes, std::vector<float> boneWeights) {
+        int numWeights = boneIndexes.size();
+        vec3_t expectedPosition = {}, expectedVectors[3] = {};
+        for (int i = 0; i < numWeights; i++) {
+            vec3_t tmp;
+            TransformPoint(&bones[boneIndexes[i]], position, tmp);
+            VectorMA(expectedPosition, boneWeights[i], tmp, expectedPosition);
+            for (int j = 0; j < 3; j++) {
+                TransformNormalVector(&bones[boneIndexes[i]], vectors[j], tmp);
+                VectorMA(expectedVectors[j], boneWeights[i], tmp, expectedVectors[j]);
+            }
+        }
+
+        vec3_t outPosition, outVectors[3];
+        SkinVertex(matrices, boneIndexes.data(), boneWeights.data(), numWeights, position,
+            vectors[0], vectors[1], vectors[2], outPosition, outVectors[0], outVectors[1], outVectors[2]);
+        EXPECT_THAT(outPosition, Pointwise(FloatNear(0.001), expectedPosition));
+        for (int j = 0; j < 3; j++) {
+            EXPECT_THAT(outVectors[j], Pointwise(FloatNear(1e-5), expectedVectors[j]));
+        }
+
+        SkinVertexScalar(matrices, boneIndexes.data(), boneWeights.data(), numWeights, position,
+            vectors[0], vectors[1], vectors[2], outPosition, outVectors[0], outVectors[1], outVectors[2]);
+        EXPECT_THAT(outPosition, Pointwise(FloatNear(0.001), expectedPosition));
+        for (int j = 0; j < 3; j++) {
+            EXPECT_THAT(outVectors[j], Pointwise(FloatNear(1e-5), expectedVectors[j]));
+        }
+
+        SkinPoint(matrices, boneIndexes.data(), boneWeights.data(), numWeights, position, outPosition);
+        EXPECT_THAT(outPosition, Pointwise(FloatNear(0.001), expectedPosition));
+        SkinPointScalar(matrices, boneIndexes.data(), boneWeights.data(), numWeights, position, outPosition);
+        EXPECT_THAT(outPosition, Pointwise(FloatNear(0.001), expectedPosition));
+    };
+
+    check({2, 0, 1}, {0.5, 0.3, 0.2});
+
+    // the normals of a zero scale bone are rotated, not lost
+    check({3}, {1});
+    check({3, 1}, {0.75, 0.25});
+}
+
 TEST(QSharedMathTest, InverseSquareRoot)
 {
     constexpr float relativeTolerance = 5.0e-6;
@@ -275,6 +275,16 @@ void  Com_Free_Aligned( void *ptr );
 	};
 #endif
 
+	// A transform_t expanded to a 3x4 matrix, which is cheaper when the
+	// same transform is applied to many vectors, as in CPU vertex skinning.
+	// axis holds the rotated x, y and z axes without the scale, trans the
+	// translation and in its w component the scale, so that normal vectors
+	// are transformed without the scale, even when it is zero.
+	struct alignas(16) transformMatrix_t {
+		vec4_t axis[ 3 ];
+		vec4_t trans;
+	};
+
 	using fixed4_t = int;
 	using fixed8_t = int;
 	using fixed16_t = int;
@@ -1457,6 +1467,55 @@ inline vec_t VectorNormalize2( const vec3_t v, vec3_t out )
 	inline void TransEndLerp( transform_t *t ) {
 		t->sseRot = sseQuatNormalize( t->sseRot );
 	}
+	inline __m128 sseMatrixTransform( __m128 x, __m128 y, __m128 z, const vec3_t in ) {
+		__m128 v = _mm_mul_ps( x, _mm_set1_ps( in[ 0 ] ) );
+		v = _mm_add_ps( v, _mm_mul_ps( y, _mm_set1_ps( in[ 1 ] ) ) );
+		return _mm_add_ps( v, _mm_mul_ps( z, _mm_set1_ps( in[ 2 ] ) ) );
+	}
+	inline void SkinPoint( const transformMatrix_t *bones,
+			       const uint32_t *boneIndexes, const float *boneWeights,
+			       int numWeights, const vec3_t in, vec3_t out ) {
+		__m128 x = mask_0000(), y = x, z = x, t = x;
+		for ( int i = 0; i < numWeights; i++ ) {
+			const transformMatrix_t *b = &bones[ boneIndexes[ i ] ];
+			__m128 w = _mm_set1_ps( boneWeights[ i ] );
+			__m128 bt = _mm_load_ps( b->trans );
+			__m128 ws = _mm_mul_ps( w, sseSwizzle( bt, WWWW ) );
+			x = _mm_add_ps( x, _mm_mul_ps( ws, _mm_load_ps( b->axis[ 0 ] ) ) );
+			y = _mm_add_ps( y, _mm_mul_ps( ws, _mm_load_ps( b->axis[ 1 ] ) ) );
+			z = _mm_add_ps( z, _mm_mul_ps( ws, _mm_load_ps( b->axis[ 2 ] ) ) );
+			t = _mm_add_ps( t, _mm_mul_ps( w, bt ) );
+		}
+		sseStoreVec3( _mm_add_ps( sseMatrixTransform( x, y, z, in ), t ), out );
+	}
+	inline void SkinVertex( const transformMatrix_t *bones,
+				const uint32_t *boneIndexes, const float *boneWeights,
+				int numWeights, const vec3_t position, const vec3_t normal,
+				const vec3_t tangent, const vec3_t binormal, vec3_t outPosition,
+				vec3_t outNormal, vec3_t outTangent, vec3_t outBinormal ) {
+		__m128 x = mask_0000(), y = x, z = x, t = x;
+		__m128 nx = x, ny = x, nz = x;
+		for ( int i = 0; i < numWeights; i++ ) {
+			const transformMatrix_t *b = &bones[ boneIndexes[ i ] ];
+			__m128 w = _mm_set1_ps( boneWeights[ i ] );
+			__m128 bx = _mm_load_ps( b->axis[ 0 ] );
+			__m128 by = _mm_load_ps( b->axis[ 1 ] );
+			__m128 bz = _mm_load_ps( b->axis[ 2 ] );
+			__m128 bt = _mm_load_ps( b->trans );
+			__m128 ws = _mm_mul_ps( w, sseSwizzle( bt, WWWW ) );
+			x = _mm_add_ps( x, _mm_mul_ps( ws, bx ) );
+			y = _mm_add_ps( y, _mm_mul_ps( ws, by ) );
+			z = _mm_add_ps( z, _mm_mul_ps( ws, bz ) );
+			t = _mm_add_ps( t, _mm_mul_ps( w, bt ) );
+			nx = _mm_add_ps( nx, _mm_mul_ps( w, bx ) );
+			ny = _mm_add_ps( ny, _mm_mul_ps( w, by ) );
+			nz = _mm_add_ps( nz, _mm_mul_ps( w, bz ) );
+		}
+		sseStoreVec3( _mm_add_ps( sseMatrixTransform( x, y, z, position ), t ), outPosition );
+		sseStoreVec3( sseMatrixTransform( nx, ny, nz, normal ), outNormal );
+		sseStoreVec3( sseMatrixTransform( nx, ny, nz, tangent ), outTangent );
+		sseStoreVec3( sseMatrixTransform( nx, ny, nz, binormal ), outBinormal );
+	}
 #else
 	// The non-SSE variants are in q_math.cpp file.
 	void TransInit( transform_t *t );
@@ -1485,8 +1544,34 @@ inline vec_t VectorNormalize2( const vec3_t v, vec3_t out )
 	void TransStartLerp( transform_t *t );
 	void TransAddWeight( float weight, const transform_t *a, transform_t *t );
 	void TransEndLerp( transform_t *t );
+
+	void SkinPoint( const transformMatrix_t *bones,
+			const uint32_t *boneIndexes, const float *boneWeights,
+			int numWeights, const vec3_t in, vec3_t out );
+	void SkinVertex( const transformMatrix_t *bones,
+			 const uint32_t *boneIndexes, const float *boneWeights,
+			 int numWeights, const vec3_t position, const vec3_t normal,
+			 const vec3_t tangent, const vec3_t binormal, vec3_t outPosition,
+			 vec3_t outNormal, vec3_t outTangent, vec3_t outBinormal );
 #endif
 
+	// Linear blend skinning: SkinPoint transforms a point by the weighted
+	// sum of the bone matrices made by TransToMatrix, SkinVertex also
+	// transforms the normal, tangent and binormal without the bone scales.
+	// The resulting vectors are not normalized.
+	void TransToMatrix( const transform_t *t, transformMatrix_t *m );
+
+	// The scalar code of SkinPoint and SkinVertex, which they use when
+	// the SSE code isn't available.
+	void SkinPointScalar( const transformMatrix_t *bones,
+			      const uint32_t *boneIndexes, const float *boneWeights,
+			      int numWeights, const vec3_t in, vec3_t out );
+	void SkinVertexScalar( const transformMatrix_t *bones,
+			       const uint32_t *boneIndexes, const float *boneWeights,
+			       int numWeights, const vec3_t position, const vec3_t normal,
+			       const vec3_t tangent, const vec3_t binormal, vec3_t outPosition,
+			       vec3_t outNormal, vec3_t outTangent, vec3_t outBinormal );
+
 //=============================================================================
 
 	char       *COM_SkipPath( char *pathname );
@@ -65,6 +65,7 @@ struct usercmd_t;
 struct entityState_t;
 
 void  MSG_WriteBits( msg_t *msg, int value, int bits );
+void  MSG_WriteMsgBits( msg_t *msg, const msg_t *src );
 
 void  MSG_WriteByte( msg_t *sb, int c );
 void  MSG_WriteShort( msg_t *sb, int c );
@@ -165,6 +166,27 @@ void       NET_LeaveMulticast6();
 
 void       NET_Sleep( int msec );
 
+// queue the packets sent in between and send them with as few system calls as possible
+void       NET_BeginPacketBatch();
+void       NET_FlushPacketBatch();
+
+// batches the packets sent during its lifetime, they are flushed even if an
+// error leaves the scope
+class NetPacketBatch
+{
+public:
+	NetPacketBatch()
+	{
+		NET_BeginPacketBatch();
+	}
+	~NetPacketBatch()
+	{
+		NET_FlushPacketBatch();
+	}
+	NetPacketBatch( const NetPacketBatch& ) = delete;
+	NetPacketBatch& operator=( const NetPacketBatch& ) = delete;
+};
+
 //----(SA)  increased for larger submodel entity counts
 #define MAX_MSGLEN           32768 // max length of a message, which may
 //#define   MAX_MSGLEN              16384       // max length of a message, which may
@@ -744,6 +766,27 @@ struct huffman_t
     huff_t decompressor;
 };
 
+/* Codes of a tree that isn't updated anymore, so that a symbol can be sent
+ * or received at once instead of walking the tree a bit at a time. The
+ * bitstream is the same as with Huff_offsetTransmit and Huff_offsetReceive */
+
+#define HUFF_TABLE_BITS 11
+#define HUFF_WORD_BITS  56 /* bits handled by Huff_putBits and Huff_peekBits */
+
+struct huffDecode_t
+{
+    short symbol;
+    byte  length; /* 0 when the code is longer than HUFF_TABLE_BITS */
+};
+
+struct huffTable_t
+{
+    huff_t       *huff;
+    uint64_t     codes[ HMAX + 1 ]; /* first bit sent in the lowest bit */
+    byte         lengths[ HMAX + 1 ];
+    huffDecode_t decode[ 1 << HUFF_TABLE_BITS ];
+};
+
 void             Huff_Compress( msg_t *buf, int offset );
 void             Huff_Decompress( msg_t *buf, int offset );
 void             Huff_Init( huffman_t *huff );
@@ -754,6 +797,14 @@ void             Huff_offsetReceive( node_t *node, int *ch, byte *fin, int *offs
 void             Huff_offsetTransmit( huff_t *huff, int ch, byte *fout, int *offset );
 void             Huff_putBit( int bit, byte *fout, int *offset );
 int              Huff_getBit( byte *fout, int *offset );
+void             Huff_putBits( uint64_t bits, int count, byte *fout, int *offset );
+uint64_t         Huff_peekBits( const byte *fin, int offset, int size );
+void             Huff_BuildTable( huffTable_t *table, huff_t *huff );
+void             Huff_tableTransmit( const huffTable_t *table, int ch, byte *fout, int *offset );
+void             Huff_tableReceive( const huffTable_t *table, int *ch, const byte *fin, int *offset, int size );
+
+// the codes used by MSG_WriteBits and MSG_ReadBits
+const huffTable_t *MSG_HuffmanTable();
 
 void Trans_LoadDefaultLanguage();
 #endif // QCOMMON_H_
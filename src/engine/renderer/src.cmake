@@ -70,4 +70,7 @@ set(RENDERERLIST
 
 set(RENDERERTESTLIST
     ${ENGINE_DIR}/renderer/gl_shader_test.cpp
+    ${ENGINE_DIR}/renderer/tr_animation_test.cpp
+    ${ENGINE_DIR}/renderer/tr_image_test.cpp
+    ${ENGINE_DIR}/renderer/tr_main_test.cpp
 )
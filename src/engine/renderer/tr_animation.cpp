@@ -1220,6 +1220,48 @@ int RE_BlendSkeleton( refSkeleton_t *skel, const refSkeleton_t *blend, float fra
 	return true;
 }
 
+// below this the threads cost more than they save
+static const int MIN_PARALLEL_SKELETONS = 4;
+
+/*
+==============
+RE_BuildSkeletons
+
+Builds a batch of skeletons, each one as RE_BuildSkeleton followed by
+RE_BlendSkeleton if it has a blend animation. The skeletons only read the
+animations, so they are built in parallel.
+==============
+*/
+void RE_BuildSkeletons( const std::vector<SkeletonRequest> &requests, std::vector<refSkeleton_t> &skeletons,
+                        std::vector<int> &results )
+{
+	int numRequests = requests.size();
+
+	skeletons.resize( numRequests );
+	results.resize( numRequests );
+
+	#pragma omp parallel for schedule( dynamic ) if ( numRequests >= MIN_PARALLEL_SKELETONS )
+	for ( int i = 0; i < numRequests; i++ )
+	{
+		const SkeletonRequest &request = requests[ i ];
+		refSkeleton_t *skel = &skeletons[ i ];
+
+		int result = RE_BuildSkeleton( skel, request.anim, request.startFrame, request.endFrame, request.frac,
+		                               request.clearOrigin );
+
+		if ( result && request.blendAnim )
+		{
+			refSkeleton_t blend;
+
+			result = RE_BuildSkeleton( &blend, request.blendAnim, request.blendStartFrame, request.blendEndFrame,
+			                           request.blendFrac, request.blendClearOrigin )
+			         && RE_BlendSkeleton( skel, &blend, request.blendLerp );
+		}
+
+		results[ i ] = result;
+	}
+}
+
 /*
 ==============
 RE_AnimNumFrames
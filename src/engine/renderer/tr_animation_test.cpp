@@ -0,0 +1,222 @@
+/*
+===========================================================================
+Daemon BSD Source Code
+Copyright (c) 2026, Daemon Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Daemon developers nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL DAEMON DEVELOPERS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+===========================================================================
+*/
+#include <memory>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "common/Common.h"
+
+#include "engine/renderer/tr_local.h"
+
+namespace {
+
+const int NUM_CHANNELS = 4;
+const int NUM_FRAMES = 5;
+const int NUM_COMPONENTS = 6;
+
+// An md5 animation with random frames, every channel animating all components
+class TestAnimation
+{
+public:
+    explicit TestAnimation( unsigned seed )
+    {
+        std::mt19937 rng( seed );
+        std::uniform_real_distribution<float> dist( -0.5f, 0.5f );
+
+        components.resize( NUM_FRAMES * NUM_CHANNELS * NUM_COMPONENTS );
+        for ( float &component : components )
+        {
+            component = dist( rng );
+        }
+
+        for ( int i = 0; i < NUM_FRAMES; i++ )
+        {
+            md5Frame_t &frame = frames[ i ];
+            VectorSet( frame.bounds[ 0 ], -1.0f - i, -1.0f, -1.0f );
+            VectorSet( frame.bounds[ 1 ], 1.0f, 1.0f + i, 1.0f );
+            frame.components = &components[ i * NUM_CHANNELS * NUM_COMPONENTS ];
+        }
+
+        for ( int i = 0; i < NUM_CHANNELS; i++ )
+        {
+            md5Channel_t &channel = channels[ i ];
+            Com_sprintf( channel.name, sizeof( channel.name ), "bone%d", i );
+            channel.parentIndex = i - 1;
+            channel.componentsBits = COMPONENT_BIT_TX | COMPONENT_BIT_TY | COMPONENT_BIT_TZ |
+                                     COMPONENT_BIT_QX | COMPONENT_BIT_QY | COMPONENT_BIT_QZ;
+            channel.componentsOffset = i * NUM_COMPONENTS;
+            VectorClear( channel.baseOrigin );
+            QuatClear( channel.baseQuat );
+        }
+
+        md5.numFrames = NUM_FRAMES;
+        md5.frames = frames;
+        md5.numChannels = NUM_CHANNELS;
+        md5.channels = channels;
+        md5.frameRate = 24;
+        md5.numAnimatedComponents = NUM_CHANNELS * NUM_COMPONENTS;
+
+        Com_sprintf( anim.name, sizeof( anim.name ), "test%u.md5anim", seed );
+        anim.type = animType_t::AT_MD5;
+        anim.md5 = &md5;
+    }
+
+    skelAnimation_t anim;
+
+private:
+    std::vector<float> components;
+    md5Frame_t frames[ NUM_FRAMES ];
+    md5Channel_t channels[ NUM_CHANNELS ];
+    md5Animation_t md5;
+};
+
+class SkeletonBatchTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        savedNumAnimations = tr.numAnimations;
+        std::copy_n( tr.animations, NUM_ANIMATIONS, savedAnimations );
+
+        for ( int i = 0; i < NUM_ANIMATIONS; i++ )
+        {
+            animations[ i ].reset( new TestAnimation( i ) );
+            animations[ i ]->anim.index = i;
+            tr.animations[ i ] = &animations[ i ]->anim;
+        }
+
+        tr.numAnimations = NUM_ANIMATIONS;
+    }
+
+    void TearDown() override
+    {
+        tr.numAnimations = savedNumAnimations;
+        std::copy_n( savedAnimations, NUM_ANIMATIONS, tr.animations );
+    }
+
+    static const int NUM_ANIMATIONS = 3;
+
+private:
+    int savedNumAnimations;
+    skelAnimation_t *savedAnimations[ NUM_ANIMATIONS ];
+    std::unique_ptr<TestAnimation> animations[ NUM_ANIMATIONS ];
+};
+
+void ExpectSameSkeleton( const refSkeleton_t &expected, const refSkeleton_t &skel )
+{
+    EXPECT_EQ( expected.type, skel.type );
+    ASSERT_EQ( expected.numBones, skel.numBones );
+    EXPECT_EQ( expected.scale, skel.scale );
+
+    for ( int i = 0; i < 2; i++ )
+    {
+        for ( int j = 0; j < 3; j++ )
+        {
+            EXPECT_EQ( expected.bounds[ i ][ j ], skel.bounds[ i ][ j ] );
+        }
+    }
+
+    for ( int i = 0; i < skel.numBones; i++ )
+    {
+        const refBone_t &a = expected.bones[ i ];
+        const refBone_t &b = skel.bones[ i ];
+
+        EXPECT_EQ( a.parentIndex, b.parentIndex ) << "bone " << i;
+        EXPECT_EQ( a.t.scale, b.t.scale ) << "bone " << i;
+
+        for ( int j = 0; j < 3; j++ )
+        {
+            EXPECT_EQ( a.t.trans[ j ], b.t.trans[ j ] ) << "bone " << i;
+        }
+
+        for ( int j = 0; j < 4; j++ )
+        {
+            EXPECT_EQ( a.t.rot[ j ], b.t.rot[ j ] ) << "bone " << i;
+        }
+    }
+}
+
+TEST_F(SkeletonBatchTest, MatchesSingleSkeletons)
+{
+    std::mt19937 rng( 42 );
+    std::uniform_int_distribution<int> frame( 0, NUM_FRAMES - 1 );
+    std::uniform_real_distribution<float> frac( 0.0f, 1.0f );
+
+    // enough requests to build them in parallel, with every combination of the origin flags
+    std::vector<SkeletonRequest> requests;
+    for ( int i = 0; i < 32; i++ )
+    {
+        SkeletonRequest request;
+        request.anim = 1 + i % 2;
+        request.startFrame = frame( rng );
+        request.endFrame = frame( rng );
+        request.frac = frac( rng );
+        request.clearOrigin = i & 1;
+        request.blendAnim = i % 8 < 2 ? 0 : 1 + ( i / 2 ) % 2;
+        request.blendStartFrame = frame( rng );
+        request.blendEndFrame = frame( rng );
+        request.blendFrac = frac( rng );
+        request.blendClearOrigin = ( i >> 1 ) & 1;
+        request.blendLerp = frac( rng );
+        requests.push_back( request );
+    }
+
+    std::vector<refSkeleton_t> skeletons;
+    std::vector<int> results;
+    RE_BuildSkeletons( requests, skeletons, results );
+
+    ASSERT_EQ( requests.size(), skeletons.size() );
+    ASSERT_EQ( requests.size(), results.size() );
+
+    for ( size_t i = 0; i < requests.size(); i++ )
+    {
+        const SkeletonRequest &request = requests[ i ];
+        SCOPED_TRACE( i );
+
+        std::unique_ptr<refSkeleton_t> expected( new refSkeleton_t() );
+        int result = RE_BuildSkeleton( expected.get(), request.anim, request.startFrame, request.endFrame,
+                                       request.frac, request.clearOrigin );
+
+        if ( request.blendAnim )
+        {
+            std::unique_ptr<refSkeleton_t> blend( new refSkeleton_t() );
+            result = RE_BuildSkeleton( blend.get(), request.blendAnim, request.blendStartFrame, request.blendEndFrame,
+                                       request.blendFrac, request.blendClearOrigin )
+                     && RE_BlendSkeleton( expected.get(), blend.get(), request.blendLerp );
+        }
+
+        EXPECT_TRUE( result );
+        EXPECT_EQ( result, results[ i ] );
+        ExpectSameSkeleton( *expected, skeletons[ i ] );
+    }
+}
+
+} // namespace
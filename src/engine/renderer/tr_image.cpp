@@ -22,8 +22,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 // tr_image.c
 #include <common/FileSystem.h>
+#include <common/ThreadPool.h>
 #include "InternalImage.h"
 #include "tr_local.h"
+#include <condition_variable>
 #include <iomanip>
 #include "Material.h"
 
@@ -1658,6 +1660,70 @@ static const imageExtLoader_t imageLoaders[] =
 	{ "ktx",  "KTX",  LoadKTX,  true  },
 };
 
+// Time spent loading the images of each loader, see imageLoadStats
+struct imageLoadStats_t
+{
+	std::atomic<int> decoded;
+	std::atomic<int> decodedInBackground;
+	std::atomic<Sys::SteadyClock::rep> decodeTime;
+	std::atomic<Sys::SteadyClock::rep> uploadTime;
+};
+
+static imageLoadStats_t imageLoadStats[ ARRAY_LEN( imageLoaders ) ];
+
+static imageLoadStats_t &R_ImageLoadStats( const imageExtLoader_t *loader )
+{
+	return imageLoadStats[ loader - imageLoaders ];
+}
+
+class ImageLoadStatsCmd : public Cmd::StaticCmd
+{
+public:
+	ImageLoadStatsCmd() : StaticCmd( "imageLoadStats", Cmd::RENDERER, "print the time spent loading images of each format" ) {}
+
+	void Run( const Cmd::Args &args ) const override
+	{
+		if ( args.Argc() > 2 || ( args.Argc() == 2 && args.Argv( 1 ) != "reset" ) )
+		{
+			PrintUsage( args, "[reset]" );
+			return;
+		}
+
+		if ( args.Argc() == 2 )
+		{
+			for ( imageLoadStats_t &stats : imageLoadStats )
+			{
+				stats.decoded = 0;
+				stats.decodedInBackground = 0;
+				stats.decodeTime = 0;
+				stats.uploadTime = 0;
+			}
+
+			return;
+		}
+
+		auto toMs = []( Sys::SteadyClock::rep time ) {
+			return std::chrono::duration<double, std::milli>( Sys::SteadyClock::duration( time ) ).count();
+		};
+
+		Print( "format ext  images background  decode ms  upload ms" );
+
+		for ( const imageExtLoader_t &loader : imageLoaders )
+		{
+			const imageLoadStats_t &stats = R_ImageLoadStats( &loader );
+
+			if ( !stats.decoded )
+			{
+				continue;
+			}
+
+			Print( "%-6s %-4s %6d %10d %10.1f %10.1f", loader.name, loader.ext, stats.decoded.load(),
+			       stats.decodedInBackground.load(), toMs( stats.decodeTime ), toMs( stats.uploadTime ) );
+		}
+	}
+};
+static ImageLoadStatsCmd imageLoadStatsCmdRegistration;
+
 /*
 =================
 R_FindImageLoader
@@ -1717,8 +1783,14 @@ bool R_HasImageLoader( const char *baseName ) {
 static void R_LoadImageWithLoader( const char* fileName, const char* altName, const imageExtLoader_t *loader, byte **pic, int *width, int *height, int *numLayers, int *numMips, int *bits, byte alphaByte )
 {
 	Log::Debug( "Found %s image candidate '%s': %s", loader->name, fileName, altName );
+
+	Sys::SteadyClock::time_point start = Sys::SteadyClock::now();
 	loader->imageLoader( altName, pic, width, height, numLayers, numMips, bits, alphaByte );
 
+	imageLoadStats_t &stats = R_ImageLoadStats( loader );
+	stats.decoded++;
+	stats.decodeTime += ( Sys::SteadyClock::now() - start ).count();
+
 	if ( *pic )
 	{
 		Log::Debug("Found %d×%d %s image '%s': %s", *width, *height, loader->name, fileName, altName );
@@ -1730,12 +1802,14 @@ static void R_LoadImageWithLoader( const char* fileName, const char* altName, co
 R_LoadImage
 
 Loads any of the supported image types into a canonical
-32 bit format.
+32 bit format. Returns the loader of the image, or nullptr
+if it could not be loaded. The file named like the image
+is skipped if it was already tried.
 =================
 */
-static void R_LoadImage( const char *name, byte **pic, int *width, int *height,
+static const imageExtLoader_t *R_LoadImage( const char *name, byte **pic, int *width, int *height,
 			 int *numLayers, int *numMips,
-			 int *bits )
+			 int *bits, bool namedFileTried = false )
 {
 	*pic = nullptr;
 	*width = *height = 0;
@@ -1743,7 +1817,7 @@ static void R_LoadImage( const char *name, byte **pic, int *width, int *height,
 	if ( !name )
 	{
 		Log::Warn("NULL parameter for R_LoadImage" );
-		return;
+		return nullptr;
 	}
 
 	// missing alpha means fully opaque
@@ -1754,7 +1828,7 @@ static void R_LoadImage( const char *name, byte **pic, int *width, int *height,
 	/* The Daemon's default strategy is to use the hardcoded path if it exists.
 	If we are given the name “some.thing.tga” we will look for “some.thing.tga” first
 	and if we are given the name “something.tga” we will look for “something.tga” first. */
-	if ( *ext )
+	if ( *ext && !namedFileTried )
 	{
 		// Look for the correct loader and load the image is the file is found.
 		for ( const auto &loader : imageLoaders )
@@ -1769,7 +1843,7 @@ static void R_LoadImage( const char *name, byte **pic, int *width, int *height,
 
 					if ( *pic )
 					{
-						return;
+						return &loader;
 					}
 				}
 
@@ -1790,7 +1864,7 @@ static void R_LoadImage( const char *name, byte **pic, int *width, int *height,
 	{
 		std::string altName = Str::Format( "%s%s.%s", prefix, name, loader->ext );
 		R_LoadImageWithLoader( name, altName.c_str(), loader, pic, width, height, numLayers, numMips, bits, alphaByte );
-		return;
+		return *pic ? loader : nullptr;
 	}
 
 	/* Then for the name “something.tga“ we look for “something.webp”, “something.png”, etc.
@@ -1806,8 +1880,331 @@ static void R_LoadImage( const char *name, byte **pic, int *width, int *height,
 		{
 			std::string altName = Str::Format( "%s%s.%s", prefix, baseName, loader->ext );
 			R_LoadImageWithLoader( name, altName.c_str(), loader, pic, width, height, numLayers, numMips, bits, alphaByte );
+			return *pic ? loader : nullptr;
 		}
 	}
+
+	return nullptr;
+}
+
+/*
+=================
+R_FindImageFileLoader
+
+Finds the file R_LoadImage would try first for the given image name,
+returns its loader or nullptr if there is none.
+=================
+*/
+static const imageExtLoader_t *R_FindImageFileLoader( const char *name, std::string &fileName )
+{
+	const char *ext = COM_GetExtension( name );
+
+	if ( *ext )
+	{
+		for ( const auto &loader : imageLoaders )
+		{
+			if ( !Q_stricmp( ext, loader.ext ) )
+			{
+				if ( FS::PakPath::FileExists( name ) )
+				{
+					fileName = name;
+					return &loader;
+				}
+
+				break;
+			}
+		}
+	}
+
+	const char *prefix;
+	const imageExtLoader_t* loader = R_FindImageLoader( name, &prefix );
+
+	if ( loader )
+	{
+		fileName = Str::Format( "%s%s.%s", prefix, name, loader->ext );
+		return loader;
+	}
+
+	if ( *ext )
+	{
+		char baseName[ 1024 ];
+		COM_StripExtension3( name, baseName, sizeof(baseName) );
+
+		loader = R_FindImageLoader( baseName, &prefix );
+
+		if ( loader )
+		{
+			fileName = Str::Format( "%s%s.%s", prefix, baseName, loader->ext );
+			return loader;
+		}
+	}
+
+	return nullptr;
+}
+
+static bool R_IsImageLoaded( const std::string &imageName )
+{
+	unsigned hash = GenerateImageHashValue( imageName.c_str() );
+
+	for ( image_t *image = r_imageHashTable[ hash ]; image; image = image->next )
+	{
+		if ( Str::IsIEqual( imageName, image->name ) )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+===============
+R_PrefetchImage
+
+Starts reading the file of an image in the background,
+unless the image is already loaded.
+===============
+*/
+static void R_PrefetchImage( const std::string &imageName )
+{
+	if ( R_IsImageLoaded( imageName ) )
+	{
+		return;
+	}
+
+	std::string fileName;
+
+	if ( R_FindImageFileLoader( imageName.c_str(), fileName ) )
+	{
+		FS::PakPath::PrefetchFile( fileName );
+	}
+}
+
+/*
+=================================================================
+
+BACKGROUND IMAGE DECODING
+
+The images of a shader are queued with R_QueueImageDecode before
+the shader loads them. They are decoded by a pool of threads while
+the main thread uploads them one by one in R_FindImageFile.
+
+=================================================================
+*/
+
+static Cvar::Cvar<bool> r_backgroundImageDecode(
+	"r_backgroundImageDecode", "decode the images of shaders on background threads",
+	Cvar::NONE, true );
+static Cvar::Range<Cvar::Cvar<int>> r_imageDecodeThreads(
+	"r_imageDecodeThreads", "threads used to decode images in the background (0 means one per core, up to 4)",
+	Cvar::NONE, 0, 0, 16 );
+
+// Threads decoding the queued images
+static Sys::ThreadPool imageDecodePool( "image decoding", r_imageDecodeThreads );
+
+// Shared by the main thread and the task decoding the image. A dropped decode
+// is not waited for: the task frees the image itself when it finishes.
+struct pendingImageDecode_t
+{
+	std::mutex mutex;
+	std::condition_variable finishedCond;
+	bool finished = false;
+	bool dropped = false;
+	decodedImage_t decoded;
+	std::exception_ptr error;
+};
+
+// Only used by the main thread
+static std::unordered_map<std::string, std::shared_ptr<pendingImageDecode_t>, Str::IHash, Str::IEqual> pendingImageDecodes;
+
+static void R_DecodeImage( const char *imageName, int bits, decodedImage_t &decoded, bool namedFileTried = false )
+{
+	decoded.pic.assign( MAX_TEXTURE_MIPS * MAX_TEXTURE_LAYERS, nullptr );
+	decoded.bits = bits;
+	decoded.loader = R_LoadImage( imageName, decoded.pic.data(), &decoded.width, &decoded.height,
+		&decoded.numLayers, &decoded.numMips, &decoded.bits, namedFileTried );
+}
+
+static void R_RunImageDecode( pendingImageDecode_t &pending, const std::string &imageName,
+	const std::string &fileName, const imageExtLoader_t *loader, bool tryOtherFiles )
+{
+	{
+		std::lock_guard<std::mutex> lock( pending.mutex );
+
+		if ( pending.dropped )
+		{
+			return;
+		}
+	}
+
+	decodedImage_t decoded;
+	decoded.pic.assign( MAX_TEXTURE_MIPS * MAX_TEXTURE_LAYERS, nullptr );
+	decoded.loader = loader;
+	decoded.tryOtherFiles = tryOtherFiles;
+	decoded.background = true;
+
+	std::exception_ptr error;
+
+	try
+	{
+		// The file was prefetched by the main thread, but the loader reads it
+		// from the file map if the prefetch was dropped or if it is mapped
+		auto paksLock = FS::PakPath::LockLoadedPaks();
+
+		// missing alpha means fully opaque
+		R_LoadImageWithLoader( imageName.c_str(), fileName.c_str(), loader, decoded.pic.data(), &decoded.width,
+			&decoded.height, &decoded.numLayers, &decoded.numMips, &decoded.bits, 0xFF );
+
+		R_ImageLoadStats( loader ).decodedInBackground++;
+	}
+	catch ( ... )
+	{
+		error = std::current_exception();
+	}
+
+	std::lock_guard<std::mutex> lock( pending.mutex );
+
+	if ( pending.dropped )
+	{
+		if ( decoded.pic[ 0 ] )
+		{
+			Z_Free( decoded.pic[ 0 ] );
+		}
+
+		return;
+	}
+
+	pending.decoded = std::move( decoded );
+	pending.error = error;
+	pending.finished = true;
+	pending.finishedCond.notify_one();
+}
+
+/*
+===============
+R_QueueImageDecode
+
+Starts decoding an image in the background, unless it is already loaded.
+Images loaded with IF_HOMEPATH are not taken from the background decodes.
+===============
+*/
+void R_QueueImageDecode( const char *imageName0 )
+{
+	std::string imageName = FS::Path::NormalizeSlashes( imageName0 );
+
+	if ( !r_backgroundImageDecode.Get() )
+	{
+		R_PrefetchImage( imageName );
+		return;
+	}
+
+	if ( pendingImageDecodes.count( imageName ) || R_IsImageLoaded( imageName ) )
+	{
+		return;
+	}
+
+	std::string fileName;
+	const imageExtLoader_t *loader = R_FindImageFileLoader( imageName.c_str(), fileName );
+
+	if ( !loader )
+	{
+		return;
+	}
+
+	// the decoding threads then take the file from the file reading threads
+	FS::PakPath::PrefetchFile( fileName );
+
+	bool tryOtherFiles = Str::IsIEqual( imageName, fileName );
+
+	auto pending = std::make_shared<pendingImageDecode_t>();
+	pendingImageDecodes.emplace( imageName, pending );
+
+	imageDecodePool.Enqueue( [ pending, imageName, fileName, loader, tryOtherFiles ] {
+		R_RunImageDecode( *pending, imageName, fileName, loader, tryOtherFiles );
+	} );
+}
+
+static void R_DropDecodedImage( pendingImageDecode_t &pending )
+{
+	std::lock_guard<std::mutex> lock( pending.mutex );
+
+	pending.dropped = true;
+
+	// otherwise the task frees it, if it has started
+	if ( pending.finished && pending.decoded.pic[ 0 ] )
+	{
+		Z_Free( pending.decoded.pic[ 0 ] );
+	}
+}
+
+/*
+===============
+R_GetDecodedImage
+
+Waits for the background decode of an image if there is one and it can be
+used, else decodes the image on the main thread.
+===============
+*/
+decodedImage_t R_GetDecodedImage( const std::string &imageName, int bits )
+{
+	decodedImage_t decoded;
+	auto it = pendingImageDecodes.find( imageName );
+
+	if ( it == pendingImageDecodes.end() )
+	{
+		R_DecodeImage( imageName.c_str(), bits, decoded );
+		return decoded;
+	}
+
+	std::shared_ptr<pendingImageDecode_t> pending = std::move( it->second );
+	pendingImageDecodes.erase( it );
+
+	// the KTX loader reads the file from the homepath with this flag
+	if ( bits & IF_HOMEPATH )
+	{
+		R_DropDecodedImage( *pending );
+		R_DecodeImage( imageName.c_str(), bits, decoded );
+		return decoded;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock( pending->mutex );
+		pending->finishedCond.wait( lock, [ &pending ] { return pending->finished; } );
+	}
+
+	if ( pending->error )
+	{
+		std::rethrow_exception( pending->error );
+	}
+
+	decoded = std::move( pending->decoded );
+	decoded.bits |= bits;
+
+	if ( !decoded.pic[ 0 ] && decoded.tryOtherFiles )
+	{
+		// the other files are tried on the main thread, not the failed one again
+		R_DecodeImage( imageName.c_str(), bits, decoded, true );
+	}
+
+	return decoded;
+}
+
+/*
+===============
+R_FinishImageDecodes
+
+Drops the background decodes of the images which were not loaded,
+without waiting for them.
+===============
+*/
+void R_FinishImageDecodes()
+{
+	for ( auto &pending : pendingImageDecodes )
+	{
+		R_DropDecodedImage( *pending.second );
+	}
+
+	pendingImageDecodes.clear();
 }
 
 /*
@@ -1887,15 +2284,16 @@ image_t *R_FindImageFile( const char *imageName0, imageParams_t &imageParams )
 	const imageParams_t initialParams = imageParams;
 
 	// Load and create the image.
-	int width = 0, height = 0, numLayers = 0, numMips = 0;
-	byte *pic[ MAX_TEXTURE_MIPS * MAX_TEXTURE_LAYERS ];
-	pic[ 0 ] = nullptr;
+	decodedImage_t decoded = R_GetDecodedImage( imageName, imageParams.bits );
 
-	R_LoadImage( imageName.c_str(), pic, &width, &height, &numLayers, &numMips, &imageParams.bits);
+	imageParams.bits = decoded.bits;
+
+	byte **pic = decoded.pic.data();
+	int width = decoded.width, height = decoded.height, numMips = decoded.numMips;
 
 	if ( *pic )
 	{
-		if ( numLayers > 0 )
+		if ( decoded.numLayers > 0 )
 		{
 			Z_Free( *pic );
 			return nullptr;
@@ -1911,9 +2309,13 @@ image_t *R_FindImageFile( const char *imageName0, imageParams_t &imageParams )
 		R_ProcessLightmap( *pic, width, height, imageParams.bits );
 	}
 
+	Sys::SteadyClock::time_point start = Sys::SteadyClock::now();
+
 	image_t *image = R_CreateImage( imageName.c_str(), (const byte**)pic, width, height, numMips, imageParams);
 	image->initialParams = initialParams;
 
+	R_ImageLoadStats( decoded.loader ).uploadTime += ( Sys::SteadyClock::now() - start ).count();
+
 	Z_Free( *pic );
 
 	return image;
@@ -2812,6 +3214,11 @@ void R_ShutdownImages()
 {
 	Log::Debug("------- R_ShutdownImages -------" );
 
+	R_FinishImageDecodes();
+
+	// the dropped decodes still use the loaders
+	imageDecodePool.Wait();
+
 	for ( image_t *image : tr.images )
 	{
 		if ( image->texture->IsResident() ) {
@@ -162,7 +162,7 @@ void LoadCRN(const char* name, byte **data, int *width, int *height,
              int *numLayers, int *numMips, int *bits, byte)
 {
     std::error_code err;
-    std::string buff = FS::PakPath::ReadFile( name, err );
+    FS::FileView buff = FS::PakPath::ReadFileView( name, err );
     *numLayers = 0;
     if ( err ) {
         return;
@@ -175,16 +175,19 @@ bool IsValidKTXFileStreamPosition( const byte *position, size_t ktxSize, const b
 	return position >= ktxData && position < ktxData + ktxSize;
 }
 
-bool LoadInMemoryKTX( const char *name, void *ktxData, size_t ktxSize,
+bool LoadInMemoryKTX( const char *name, const void *ktxData, size_t ktxSize,
     			     byte **data, int *width, int *height, int *numLayers,
     			     int *numMips, int *bits ) {
-	auto *hdr{ static_cast<KTX_header_t *>(ktxData) };
-
-	if( !IsValidKTXHeader( hdr, ktxSize ) ) {
+	if( !IsValidKTXHeader( static_cast<const KTX_header_t *>(ktxData), ktxSize ) ) {
 		Log::Warn("KTX image '%s' has an invalid format", name);
 		return false;
 	}
 
+	// The file data may be mapped read-only, so the header is fixed up in a copy
+	KTX_header_t header;
+	memcpy( &header, ktxData, sizeof( header ) );
+	KTX_header_t *hdr{ &header };
+
 	bool needReverseBytes{false};
 	if( !TryApplyKTXHeaderEndianness( hdr, needReverseBytes ) ) {
 		Log::Warn("KTX image '%s' has unknown endianness value '%d'", name,
@@ -207,12 +210,12 @@ bool LoadInMemoryKTX( const char *name, void *ktxData, size_t ktxSize,
 	*numMips = hdr->numberOfMipmapLevels;
 	*numLayers = hdr->numberOfFaces == 6 ? 6 : 0;
 
-	byte *firstImageDataPtr{ (byte *)(hdr + 1) + hdr->bytesOfKeyValueData };
+	const byte *firstImageDataPtr{ static_cast<const byte *>(ktxData) + sizeof(KTX_header_t) + hdr->bytesOfKeyValueData };
 	if ( !IsValidKTXFileStreamPosition( firstImageDataPtr, ktxSize, static_cast<const byte *>(ktxData) ) ) {
 		Log::Warn("KTX image '%s' has bad bytesOfKeyValueData or texture data", name);
 		return false;
 	}
-	byte *ptr{ firstImageDataPtr };
+	const byte *ptr{ firstImageDataPtr };
 	size_t totalImageSize{ 0 };
 
 	// For most textures imageSize is the number of bytes of pixel data in the
@@ -754,18 +757,18 @@ void LoadKTX( const char *name, byte **pic, int *width, int *height,
 	*numLayers = 0;
 
 	std::error_code err;
-	std::string ktxData;
+	FS::FileView ktxData;
 	if ( ( *bits ) & IF_HOMEPATH ) {
-		ktxData = FS::HomePath::OpenRead( name, err ).ReadAll();
+		ktxData = FS::FileView( FS::HomePath::OpenRead( name, err ).ReadAll() );
 	} else {
-		ktxData = FS::PakPath::ReadFile( name, err );
+		ktxData = FS::PakPath::ReadFileView( name, err );
 	}
 	
 	if ( err ) {
 		return;
 	}
 
-	if ( !LoadInMemoryKTX( name, &ktxData[0], ktxData.size(), pic, width, height, numLayers, numMips, bits ) ) {
+	if ( !LoadInMemoryKTX( name, ktxData.data(), ktxData.size(), pic, width, height, numLayers, numMips, bits ) ) {
 		if (*pic) {
 			Z_Free(*pic);
 		}
@@ -0,0 +1,114 @@
+/*
+===========================================================================
+Daemon BSD Source Code
+Copyright (c) 2026, Daemon Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Daemon developers nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL DAEMON DEVELOPERS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+===========================================================================
+*/
+#include <gtest/gtest.h>
+
+#include "common/Common.h"
+
+#include "engine/renderer/tr_local.h"
+
+namespace {
+
+// A 2x2 image with a red, a green, a blue and a half transparent white texel
+const char IMAGE_NAME[] = "textures/imagedecode";
+
+class ImageDecodeTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        const FS::PakInfo* pak = FS::FindPak( "testdata", "src" );
+        if ( !pak ) {
+            FAIL() << "Test data not available - some tests will be skipped. Please add daemon/pkg/ to the pak path";
+        }
+        FS::PakPath::LoadPak( *pak );
+    }
+
+    void TearDown() override
+    {
+        R_FinishImageDecodes();
+    }
+
+    static void ExpectImage( const decodedImage_t &decoded )
+    {
+        ASSERT_TRUE( decoded.pic[ 0 ] );
+        EXPECT_EQ( decoded.width, 2 );
+        EXPECT_EQ( decoded.height, 2 );
+        EXPECT_EQ( decoded.numLayers, 0 );
+
+        // the top left texel, red, then the half transparent bottom right one
+        const byte *pic = decoded.pic[ 0 ];
+        EXPECT_EQ( pic[ 0 ], 255 );
+        EXPECT_EQ( pic[ 1 ], 0 );
+        EXPECT_EQ( pic[ 2 ], 0 );
+        EXPECT_EQ( pic[ 3 ], 255 );
+        EXPECT_EQ( pic[ 15 ], 128 );
+
+        Z_Free( decoded.pic[ 0 ] );
+    }
+};
+
+TEST_F( ImageDecodeTest, QueuedImageIsTaken )
+{
+    R_QueueImageDecode( IMAGE_NAME );
+    decodedImage_t decoded = R_GetDecodedImage( IMAGE_NAME, IF_NOPICMIP );
+
+    EXPECT_TRUE( decoded.background );
+    EXPECT_TRUE( decoded.bits & IF_NOPICMIP );
+    ExpectImage( decoded );
+}
+
+TEST_F( ImageDecodeTest, UnusedImageIsDropped )
+{
+    R_QueueImageDecode( IMAGE_NAME );
+    R_FinishImageDecodes();
+
+    // decoded again, as the background decode is gone
+    decodedImage_t decoded = R_GetDecodedImage( IMAGE_NAME, 0 );
+
+    EXPECT_FALSE( decoded.background );
+    ExpectImage( decoded );
+}
+
+TEST_F( ImageDecodeTest, HomePathImageIsLoadedOnMainThread )
+{
+    R_QueueImageDecode( IMAGE_NAME );
+    decodedImage_t decoded = R_GetDecodedImage( IMAGE_NAME, IF_HOMEPATH );
+
+    EXPECT_FALSE( decoded.background );
+    EXPECT_TRUE( decoded.bits & IF_HOMEPATH );
+    ExpectImage( decoded );
+
+    // the dropped decode is not taken by a later load either
+    decoded = R_GetDecodedImage( IMAGE_NAME, 0 );
+    EXPECT_FALSE( decoded.background );
+    ExpectImage( decoded );
+}
+
+} // namespace
@@ -1341,6 +1341,10 @@ ScreenshotCmd screenshotPNGRegistration("screenshotPNG", ssFormat_t::SSF_PNG, "p
 
 		// clear all our internal state
 		ResetStruct( tr );
+		tr.currentEntity = nullptr;
+		tr.currentModel = nullptr;
+		ResetStruct( tr.orientation );
+		ResetStruct( tr.pc );
 		ResetStruct( backEnd );
 		ResetStruct( tess );
 
@@ -1716,6 +1720,7 @@ ScreenshotCmd screenshotPNGRegistration("screenshotPNG", ssFormat_t::SSF_PNG, "p
 		re.CheckSkeleton = RE_CheckSkeleton;
 		re.BuildSkeleton = RE_BuildSkeleton;
 		re.BlendSkeleton = RE_BlendSkeleton;
+		re.BuildSkeletons = RE_BuildSkeletons;
 		re.BoneIndex = RE_BoneIndex;
 		re.AnimNumFrames = RE_AnimNumFrames;
 		re.AnimFrameRate = RE_AnimFrameRate;
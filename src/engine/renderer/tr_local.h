@@ -2505,9 +2505,11 @@ enum
 		image_t   *lightGrid2Image;
 
 		// render entities
-		trRefEntity_t *currentEntity;
+		// the current entity, model, orientation and counters are per thread
+		// so that R_CollectDrawSurfsParallel workers can add surfaces concurrently
+		static thread_local trRefEntity_t *currentEntity;
 		trRefEntity_t worldEntity; // point currentEntity at this when rendering world
-		model_t       *currentModel;
+		static thread_local model_t       *currentModel;
 
 		// -----------------------------------------
 
@@ -2524,7 +2526,7 @@ enum
 		// 1/pow(2, overbrightBits) if r_overbrightQ3 is on
 		float identityLight;
 
-		orientationr_t orientation; // for current entity
+		static thread_local orientationr_t orientation; // for current entity
 
 		trRefdef_t     refdef;
 
@@ -2539,7 +2541,7 @@ enum
 		vec3_t         sunLight; // from the sky shader for this level
 		vec3_t         sunDirection;
 
-		frontEndCounters_t pc;
+		static thread_local frontEndCounters_t pc;
 		int                frontEndMsec; // not in pc due to clearing issue
 
 		bool skipSubgroupProfiler = false;
@@ -2831,6 +2833,9 @@ inline bool checkGLErrors()
 	void           R_AddPolygonSurfaces();
 
 	void R_AddDrawSurf( surfaceType_t *surface, shader_t *shader, int lightmapNum, bool bspSurface = false, int portalNum = -1 );
+	void R_RadixSortDrawSurfs( drawSurf_t *drawSurfs, int numDrawSurfs );
+	bool R_UseParallelFrontend( int numItems );
+	void R_CollectDrawSurfsParallel( int numItems, void ( *collect )( int first, int last ) );
 
 	void           R_LocalNormalToWorld( const vec3_t local, vec3_t world );
 	void           R_LocalPointToWorld( const vec3_t local, vec3_t world );
@@ -3003,6 +3008,29 @@ void GL_CompressedTexSubImage3D( GLenum target, GLint level, GLint xOffset, GLin
 
 	bool R_HasImageLoader( const char *baseName );
 	image_t *R_FindImageFile( const char *name, imageParams_t &imageParams );
+	struct imageExtLoader_t;
+
+	// An image decoded by R_GetDecodedImage, which isn't uploaded yet
+	struct decodedImage_t
+	{
+		std::vector<byte *> pic;
+		int width = 0;
+		int height = 0;
+		int numLayers = 0;
+		int numMips = 0;
+		int bits = 0;
+		const imageExtLoader_t *loader = nullptr;
+
+		// R_LoadImage would try other files if this one can't be decoded
+		bool tryOtherFiles = false;
+
+		// taken from a decode queued by R_QueueImageDecode
+		bool background = false;
+	};
+
+	void    R_QueueImageDecode( const char *name );
+	decodedImage_t R_GetDecodedImage( const std::string &name, int bits );
+	void    R_FinishImageDecodes();
 	image_t *R_FindCubeImage( const char *name, imageParams_t &imageParams );
 
 	image_t *R_CreateImage( const char *name, const byte **pic, int width, int height, int numMips, const imageParams_t &imageParams,
@@ -3380,6 +3408,8 @@ void GLimp_LogComment_( std::string comment );
 	                                  bool clearOrigin );
 	void R_TransformSkeleton( refSkeleton_t* skel, const float scale );
 	int             RE_BlendSkeleton( refSkeleton_t *skel, const refSkeleton_t *blend, float frac );
+	void            RE_BuildSkeletons( const std::vector<SkeletonRequest> &requests, std::vector<refSkeleton_t> &skeletons,
+	                                   std::vector<int> &results );
 	int             RE_AnimNumFrames( qhandle_t hAnim );
 	int             RE_AnimFrameRate( qhandle_t hAnim );
 
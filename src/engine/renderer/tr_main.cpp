@@ -24,8 +24,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "tr_local.h"
 #include "Material.h"
 #include "EntityCache.h"
+#include "framework/OmpSystem.h"
 
 trGlobals_t tr;
+thread_local trRefEntity_t *trGlobals_t::currentEntity;
+thread_local model_t *trGlobals_t::currentModel;
+thread_local orientationr_t trGlobals_t::orientation;
+thread_local frontEndCounters_t trGlobals_t::pc;
 
 // convert from our coordinate system (looking down X)
 // to OpenGL's coordinate system (looking down -Z)
@@ -1606,12 +1611,34 @@ bool R_MirrorViewBySurface(drawSurf_t *drawSurf)
 	return true;
 }
 
+static Cvar::Cvar<bool> r_parallelFrontend(
+	"r_parallelFrontend", "collect world and entity surfaces on multiple threads", Cvar::NONE, false );
+
+// a draw surface added by a R_CollectDrawSurfsParallel worker
+struct pendingDrawSurf_t
+{
+	trRefEntity_t *entity;
+	surfaceType_t *surface;
+	shader_t      *shader;
+	int           lightmapNum;
+	bool          bspSurface;
+	int           portalNum;
+};
+
+// set while a worker collects a chunk, R_AddDrawSurf appends to it
+static thread_local std::vector<pendingDrawSurf_t> *pendingDrawSurfs = nullptr;
+
+static std::vector<std::vector<pendingDrawSurf_t>> pendingDrawSurfChunks;
+
+// chunks per thread, more chunks balance uneven items better
+static const int PARALLEL_FRONTEND_CHUNKS = 4;
+
 /*
 =================
-R_AddDrawSurf
+R_AddEntityDrawSurf
 =================
 */
-void R_AddDrawSurf( surfaceType_t *surface, shader_t *shader, int lightmapNum, bool bspSurface, int portalNum )
+static void R_AddEntityDrawSurf( trRefEntity_t *entity, surfaceType_t *surface, shader_t *shader, int lightmapNum, bool bspSurface, int portalNum )
 {
 	// instead of checking for overflow, we just mask the index
 	// so it wraps around
@@ -1620,7 +1647,7 @@ void R_AddDrawSurf( surfaceType_t *surface, shader_t *shader, int lightmapNum, b
 
 	drawSurf_t* drawSurf = &tr.refdef.drawSurfs[ index ];
 
-	drawSurf->entity = tr.currentEntity;
+	drawSurf->entity = entity;
 	drawSurf->surface = surface;
 	drawSurf->shader = shader;
 	drawSurf->bspSurface = bspSurface;
@@ -1628,13 +1655,13 @@ void R_AddDrawSurf( surfaceType_t *surface, shader_t *shader, int lightmapNum, b
 
 	int entityNum;
 
-	if ( tr.currentEntity == &tr.worldEntity )
+	if ( entity == &tr.worldEntity )
 	{
 		entityNum = -1;
 	}
 	else
 	{
-		entityNum = tr.currentEntity - tr.refdef.entities;
+		entityNum = entity - tr.refdef.entities;
 	}
 
 	if (shader->sort > Util::ordinal(shaderSort_t::SS_OPAQUE))
@@ -1647,10 +1674,484 @@ void R_AddDrawSurf( surfaceType_t *surface, shader_t *shader, int lightmapNum, b
 	tr.refdef.numDrawSurfs++;
 
 	if ( shader->depthShader != nullptr ) {
-		R_AddDrawSurf( surface, shader->depthShader, 0, bspSurface );
+		R_AddEntityDrawSurf( entity, surface, shader->depthShader, 0, bspSurface, -1 );
+	}
+}
+
+/*
+=================
+R_AddDrawSurf
+=================
+*/
+void R_AddDrawSurf( surfaceType_t *surface, shader_t *shader, int lightmapNum, bool bspSurface, int portalNum )
+{
+	if ( pendingDrawSurfs )
+	{
+		pendingDrawSurfs->push_back( { tr.currentEntity, surface, shader, lightmapNum, bspSurface, portalNum } );
+		return;
+	}
+
+	R_AddEntityDrawSurf( tr.currentEntity, surface, shader, lightmapNum, bspSurface, portalNum );
+}
+
+static void R_AddFrontEndCounters( frontEndCounters_t &total, const frontEndCounters_t &pc )
+{
+	total.c_box_cull_in += pc.c_box_cull_in;
+	total.c_box_cull_clip += pc.c_box_cull_clip;
+	total.c_box_cull_out += pc.c_box_cull_out;
+	total.c_plane_cull_in += pc.c_plane_cull_in;
+	total.c_plane_cull_out += pc.c_plane_cull_out;
+	total.c_sphere_cull_mdv_in += pc.c_sphere_cull_mdv_in;
+	total.c_sphere_cull_mdv_clip += pc.c_sphere_cull_mdv_clip;
+	total.c_sphere_cull_mdv_out += pc.c_sphere_cull_mdv_out;
+	total.c_box_cull_mdv_in += pc.c_box_cull_mdv_in;
+	total.c_box_cull_mdv_clip += pc.c_box_cull_mdv_clip;
+	total.c_box_cull_mdv_out += pc.c_box_cull_mdv_out;
+	total.c_box_cull_md5_in += pc.c_box_cull_md5_in;
+	total.c_box_cull_md5_clip += pc.c_box_cull_md5_clip;
+	total.c_box_cull_md5_out += pc.c_box_cull_md5_out;
+	total.c_nodes += pc.c_nodes;
+	total.c_leafs += pc.c_leafs;
+}
+
+/*
+=================
+R_UseParallelFrontend
+
+Whether it is worth splitting numItems over the OpenMP threads
+=================
+*/
+bool R_UseParallelFrontend( int numItems )
+{
+	return r_parallelFrontend.Get() && Omp::GetThreads() > 1 && numItems > 1;
+}
+
+/*
+=================
+R_CollectDrawSurfsParallel
+
+Same as calling collect( 0, numItems ) on the main thread, but the items
+are split in chunks over the OpenMP threads. The draw surfaces added by
+each chunk are buffered and added in chunk order once all are done, so the
+sort keys are the same as with a sequential walk.
+
+The workers start from the current entity, model and orientation of the
+main thread, collect must not change any other shared state.
+=================
+*/
+void R_CollectDrawSurfsParallel( int numItems, void ( *collect )( int first, int last ) )
+{
+	int numChunks = std::min( numItems, Omp::GetThreads() * PARALLEL_FRONTEND_CHUNKS );
+
+	if ( numChunks < 1 )
+	{
+		return;
+	}
+
+	if ( int( pendingDrawSurfChunks.size() ) < numChunks )
+	{
+		pendingDrawSurfChunks.resize( numChunks );
+	}
+
+	trRefEntity_t *currentEntity = tr.currentEntity;
+	model_t *currentModel = tr.currentModel;
+	orientationr_t orientation = tr.orientation;
+	frontEndCounters_t counters{};
+	std::exception_ptr error;
+
+	#pragma omp parallel
+	{
+		frontEndCounters_t threadCounters = tr.pc;
+
+		tr.currentEntity = currentEntity;
+		tr.currentModel = currentModel;
+		tr.orientation = orientation;
+		tr.pc = {};
+
+		// exceptions must not escape an OpenMP parallel region,
+		// keep the first one and rethrow it from the main thread
+		#pragma omp for schedule( dynamic )
+		for ( int chunk = 0; chunk < numChunks; chunk++ )
+		{
+			std::vector<pendingDrawSurf_t> &buffer = pendingDrawSurfChunks[ chunk ];
+
+			buffer.clear();
+			pendingDrawSurfs = &buffer;
+
+			try
+			{
+				collect( numItems * chunk / numChunks, numItems * ( chunk + 1 ) / numChunks );
+			}
+			catch ( ... )
+			{
+				#pragma omp critical
+				if ( !error )
+				{
+					error = std::current_exception();
+				}
+			}
+
+			pendingDrawSurfs = nullptr;
+		}
+
+		#pragma omp critical
+		R_AddFrontEndCounters( counters, tr.pc );
+
+		tr.pc = threadCounters;
+		tr.currentEntity = currentEntity;
+		tr.currentModel = currentModel;
+		tr.orientation = orientation;
+	}
+
+	if ( error )
+	{
+		std::rethrow_exception( error );
+	}
+
+	R_AddFrontEndCounters( tr.pc, counters );
+
+	for ( int chunk = 0; chunk < numChunks; chunk++ )
+	{
+		for ( const pendingDrawSurf_t &p : pendingDrawSurfChunks[ chunk ] )
+		{
+			R_AddEntityDrawSurf( p.entity, p.surface, p.shader, p.lightmapNum, p.bspSurface, p.portalNum );
+		}
+	}
+}
+
+static Cvar::Cvar<bool> r_radixSortDrawSurfs(
+	"r_radixSortDrawSurfs", "sort draw surfaces with a radix sort instead of std::sort", Cvar::NONE, true );
+
+// the radix sort works on compact (key, index) pairs and gathers the
+// draw surfaces once at the end, instead of moving them on every pass
+struct drawSurfSortKey_t
+{
+	uint64_t sort;
+	uint32_t index;
+};
+
+static const int RADIX_DIGIT_BITS = 11;
+static const int RADIX_BUCKETS = 1 << RADIX_DIGIT_BITS;
+static const uint64_t RADIX_DIGIT_MASK = RADIX_BUCKETS - 1;
+
+// below this the histograms cost more than an insertion sort
+static const int RADIX_MIN_SURFACES = 64;
+
+static std::vector<drawSurfSortKey_t> drawSurfSortKeys;
+static std::vector<drawSurfSortKey_t> drawSurfSortScratch;
+static std::vector<uint32_t> drawSurfSortCounts;
+static std::vector<drawSurf_t> drawSurfSortGather;
+
+/*
+=================
+R_RadixSortKeys
+
+LSD radix sort of drawSurfSortKeys, returns the sorted keys which are in
+either drawSurfSortKeys or drawSurfSortScratch
+=================
+*/
+static const drawSurfSortKey_t *R_RadixSortKeys( int numKeys, uint64_t usedBits )
+{
+	// only sort the digits that some key actually uses
+	int numDigits = 0;
+	while ( numDigits * RADIX_DIGIT_BITS < 64 && ( usedBits >> ( numDigits * RADIX_DIGIT_BITS ) ) != 0 )
+	{
+		numDigits++;
+	}
+
+	// build the histograms of all digits in a single pass
+	drawSurfSortCounts.assign( numDigits * RADIX_BUCKETS, 0 );
+	for ( int i = 0; i < numKeys; i++ )
+	{
+		uint64_t sort = drawSurfSortKeys[ i ].sort;
+
+		for ( int digit = 0; digit < numDigits; digit++ )
+		{
+			drawSurfSortCounts[ digit * RADIX_BUCKETS + ( sort & RADIX_DIGIT_MASK ) ]++;
+			sort >>= RADIX_DIGIT_BITS;
+		}
+	}
+
+	drawSurfSortKey_t *src = drawSurfSortKeys.data();
+	drawSurfSortKey_t *dst = drawSurfSortScratch.data();
+
+	for ( int digit = 0; digit < numDigits; digit++ )
+	{
+		int shift = digit * RADIX_DIGIT_BITS;
+		uint32_t *counts = &drawSurfSortCounts[ digit * RADIX_BUCKETS ];
+
+		// all keys have the same value for this digit, the pass would not move anything
+		if ( counts[ ( src[ 0 ].sort >> shift ) & RADIX_DIGIT_MASK ] == uint32_t( numKeys ) )
+		{
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for ( int bucket = 0; bucket < RADIX_BUCKETS; bucket++ )
+		{
+			uint32_t count = counts[ bucket ];
+			counts[ bucket ] = offset;
+			offset += count;
+		}
+
+		for ( int i = 0; i < numKeys; i++ )
+		{
+			dst[ counts[ ( src[ i ].sort >> shift ) & RADIX_DIGIT_MASK ]++ ] = src[ i ];
+		}
+
+		std::swap( src, dst );
+	}
+
+	return src;
+}
+
+/*
+=================
+R_RadixSortDrawSurfs
+
+Stable sort of draw surfaces by their sort key
+=================
+*/
+void R_RadixSortDrawSurfs( drawSurf_t *drawSurfs, int numDrawSurfs )
+{
+	if ( numDrawSurfs < 2 )
+	{
+		return;
+	}
+
+	drawSurfSortKeys.resize( numDrawSurfs );
+	drawSurfSortScratch.resize( numDrawSurfs );
+	drawSurfSortGather.resize( numDrawSurfs );
+
+	uint64_t usedBits = 0;
+	for ( int i = 0; i < numDrawSurfs; i++ )
+	{
+		drawSurfSortKeys[ i ].sort = drawSurfs[ i ].sort;
+		drawSurfSortKeys[ i ].index = i;
+		usedBits |= drawSurfs[ i ].sort;
+	}
+
+	const drawSurfSortKey_t *sorted;
+
+	if ( numDrawSurfs < RADIX_MIN_SURFACES )
+	{
+		for ( int i = 1; i < numDrawSurfs; i++ )
+		{
+			drawSurfSortKey_t key = drawSurfSortKeys[ i ];
+			int j = i;
+
+			for ( ; j > 0 && drawSurfSortKeys[ j - 1 ].sort > key.sort; j-- )
+			{
+				drawSurfSortKeys[ j ] = drawSurfSortKeys[ j - 1 ];
+			}
+
+			drawSurfSortKeys[ j ] = key;
+		}
+
+		sorted = drawSurfSortKeys.data();
+	}
+	else
+	{
+		sorted = R_RadixSortKeys( numDrawSurfs, usedBits );
+	}
+
+	for ( int i = 0; i < numDrawSurfs; i++ )
+	{
+		drawSurfSortGather[ i ] = drawSurfs[ sorted[ i ].index ];
+	}
+
+	std::copy( drawSurfSortGather.begin(), drawSurfSortGather.begin() + numDrawSurfs, drawSurfs );
+}
+
+static void R_StdSortDrawSurfs( drawSurf_t *drawSurfs, int numDrawSurfs )
+{
+	std::sort( drawSurfs, drawSurfs + numDrawSurfs,
+	           []( const drawSurf_t &a, const drawSurf_t &b ) {
+	               return a.sort < b.sort;
+	           } );
+}
+
+/*
+==============================================================================
+
+DRAW SURFACE CAPTURES
+
+captureDrawSurfs saves the unsorted sort keys of every view of the next
+frame, benchmarkDrawSurfSort replays such captures through both sorts
+
+==============================================================================
+*/
+
+static const std::string drawSurfCapturePath = "drawsurfs";
+static const std::string drawSurfCaptureHeader = "drawsurfs 1";
+
+static std::string drawSurfCaptureName;
+static int drawSurfCaptureFrame = -1;
+static std::string drawSurfCaptureData;
+
+static void R_CaptureDrawSurfs()
+{
+	if ( drawSurfCaptureName.empty() )
+	{
+		return;
 	}
+
+	if ( drawSurfCaptureFrame < 0 )
+	{
+		drawSurfCaptureFrame = tr.frameCount;
+		drawSurfCaptureData = drawSurfCaptureHeader + "\n";
+	}
+
+	if ( tr.frameCount == drawSurfCaptureFrame )
+	{
+		drawSurfCaptureData += Str::Format( "%d\n", tr.viewParms.numDrawSurfs );
+
+		for ( int i = 0; i < tr.viewParms.numDrawSurfs; i++ )
+		{
+			drawSurfCaptureData += Str::Format( "%x\n", tr.viewParms.drawSurfs[ i ].sort );
+		}
+
+		return;
+	}
+
+	// the captured frame is complete
+	std::string path = Str::Format( "%s/%s.txt", drawSurfCapturePath, drawSurfCaptureName );
+
+	try
+	{
+		FS::File file = FS::HomePath::OpenWrite( path );
+		file.Write( drawSurfCaptureData.data(), drawSurfCaptureData.size() );
+		file.Close();
+		Log::Notice( "Saved the draw surfaces of frame %d to %s", drawSurfCaptureFrame, path );
+	}
+	catch ( std::system_error &err )
+	{
+		Log::Warn( "Failed to save draw surfaces to %s: %s", path, err.what() );
+	}
+
+	drawSurfCaptureName.clear();
+	drawSurfCaptureData.clear();
+	drawSurfCaptureFrame = -1;
 }
 
+class CaptureDrawSurfsCmd : public Cmd::StaticCmd
+{
+public:
+	CaptureDrawSurfsCmd() : StaticCmd(
+		"captureDrawSurfs", Cmd::RENDERER, "save the draw surface sort keys of the next frame" ) {}
+
+	void Run( const Cmd::Args &args ) const override
+	{
+		if ( args.Argc() != 2 )
+		{
+			PrintUsage( args, "<name>" );
+			return;
+		}
+
+		drawSurfCaptureName = args.Argv( 1 );
+		drawSurfCaptureFrame = -1;
+	}
+};
+static CaptureDrawSurfsCmd captureDrawSurfsCmdRegistration;
+
+class BenchmarkDrawSurfSortCmd : public Cmd::StaticCmd
+{
+public:
+	BenchmarkDrawSurfSortCmd() : StaticCmd(
+		"benchmarkDrawSurfSort", Cmd::RENDERER, "replay a draw surface capture through both draw surface sorts" ) {}
+
+	void Run( const Cmd::Args &args ) const override
+	{
+		if ( args.Argc() < 2 || args.Argc() > 3 )
+		{
+			PrintUsage( args, "<name> [iterations]" );
+			return;
+		}
+
+		int iterations = 100;
+		if ( args.Argc() == 3 && ( !Str::ParseInt( iterations, args.Argv( 2 ) ) || iterations < 1 ) )
+		{
+			PrintUsage( args, "<name> [iterations]" );
+			return;
+		}
+
+		std::string path = Str::Format( "%s/%s.txt", drawSurfCapturePath, args.Argv( 1 ) );
+		std::vector<std::vector<drawSurf_t>> views;
+		int numDrawSurfs = 0;
+
+		try
+		{
+			std::istringstream stream( FS::HomePath::OpenRead( path ).ReadAll() );
+			std::string line;
+
+			if ( !std::getline( stream, line ) || line != drawSurfCaptureHeader )
+			{
+				Print( "%s is not a draw surface capture", path );
+				return;
+			}
+
+			while ( std::getline( stream, line ) && !line.empty() )
+			{
+				views.emplace_back( std::stoi( line ) );
+
+				for ( drawSurf_t &drawSurf : views.back() )
+				{
+					std::getline( stream, line );
+					drawSurf.sort = std::stoull( line, nullptr, 16 );
+				}
+
+				numDrawSurfs += views.back().size();
+			}
+		}
+		catch ( std::exception &err )
+		{
+			Print( "Failed to read %s: %s", path, err.what() );
+			return;
+		}
+
+		std::vector<drawSurf_t> work;
+		Sys::SteadyClock::duration stdSortTime{}, radixSortTime{};
+
+		auto timeSort = [&]( void ( *sortFunc )( drawSurf_t *, int ), Sys::SteadyClock::duration &total ) {
+			for ( int iteration = 0; iteration < iterations; iteration++ )
+			{
+				for ( const std::vector<drawSurf_t> &view : views )
+				{
+					work = view;
+
+					auto start = Sys::SteadyClock::now();
+					sortFunc( work.data(), work.size() );
+					total += Sys::SteadyClock::now() - start;
+				}
+			}
+		};
+
+		timeSort( R_StdSortDrawSurfs, stdSortTime );
+		timeSort( R_RadixSortDrawSurfs, radixSortTime );
+
+		for ( const std::vector<drawSurf_t> &view : views )
+		{
+			work = view;
+			R_RadixSortDrawSurfs( work.data(), work.size() );
+
+			if ( !std::is_sorted( work.begin(), work.end(),
+			                      []( const drawSurf_t &a, const drawSurf_t &b ) { return a.sort < b.sort; } ) )
+			{
+				Print( "^1Radix sort produced an unsorted view" );
+				return;
+			}
+		}
+
+		auto toMs = []( Sys::SteadyClock::duration time ) {
+			return std::chrono::duration<double, std::milli>( time ).count();
+		};
+
+		Print( "Sorted %d views with %d draw surfaces %d times: std::sort %.3f ms, radix sort %.3f ms",
+		       views.size(), numDrawSurfs, iterations, toMs( stdSortTime ), toMs( radixSortTime ) );
+	}
+};
+static BenchmarkDrawSurfSortCmd benchmarkDrawSurfSortCmdRegistration;
+
 static uint32_t currentView = 0;
 
 /*
@@ -1680,10 +2181,16 @@ static void R_SortDrawSurfs()
 		tr.viewParms.numDrawSurfs = MAX_DRAWSURFS;
 	}
 
-	std::sort( tr.viewParms.drawSurfs, tr.viewParms.drawSurfs + tr.viewParms.numDrawSurfs,
-	           []( const drawSurf_t &a, const drawSurf_t &b ) {
-	               return a.sort < b.sort;
-	           } );
+	R_CaptureDrawSurfs();
+
+	if ( r_radixSortDrawSurfs.Get() )
+	{
+		R_RadixSortDrawSurfs( tr.viewParms.drawSurfs, tr.viewParms.numDrawSurfs );
+	}
+	else
+	{
+		R_StdSortDrawSurfs( tr.viewParms.drawSurfs, tr.viewParms.numDrawSurfs );
+	}
 
 	// compute the offsets of the first surface of each SS_* type
 	sort = Util::ordinal( shaderSort_t::SS_BAD ) - 1;
@@ -1746,106 +2253,128 @@ static void R_SortDrawSurfs()
 
 /*
 =============
-R_AddEntitySurfaces
+R_AddEntitySurface
 =============
 */
-void R_AddEntitySurfaces()
+static void R_AddEntitySurface( int i )
 {
-	if ( !r_drawentities->integer )
+	trRefEntity_t* ent = tr.currentEntity = &tr.refdef.entities[ i ];
+
+	//
+	// the weapon model must be handled special --
+	// we don't want the hacked weapon position showing in
+	// mirrors, because the true body position will already be drawn
+	//
+	if ( ( ent->e.renderfx & RF_FIRST_PERSON ) &&
+	     ( tr.viewParms.portalLevel > 0 || tr.viewParms.isMirror ) )
 	{
 		return;
 	}
 
-	// AddRefEntities();
-
-	for ( int i = 0; i < tr.refdef.numEntities; i++ )
+	// simple generated models, like sprites and beams, are not culled
+	switch ( ent->e.reType )
 	{
-		trRefEntity_t* ent = tr.currentEntity = &tr.refdef.entities[ i ];
+		case refEntityType_t::RT_PORTALSURFACE:
+			break; // don't draw anything
 
-		//
-		// the weapon model must be handled special --
-		// we don't want the hacked weapon position showing in
-		// mirrors, because the true body position will already be drawn
-		//
-		if ( ( ent->e.renderfx & RF_FIRST_PERSON ) &&
-		     ( tr.viewParms.portalLevel > 0 || tr.viewParms.isMirror ) )
+		case refEntityType_t::RT_SPRITE:
 		{
-			continue;
+			// self blood sprites, talk balloons, etc should not be drawn in the primary
+			// view.  We can't just do this check for all entities, because md3
+			// entities may still want to cast shadows from them
+			if ( ( ent->e.renderfx & RF_THIRD_PERSON ) &&
+				tr.viewParms.portalLevel == 0 ) {
+				return;
+			}
+
+			shader_t* shader = R_GetShaderByHandle( ent->e.customShader );
+			R_AddDrawSurf( &entitySurface, shader, -1 );
+			break;
 		}
 
-		// simple generated models, like sprites and beams, are not culled
-		switch ( ent->e.reType )
-		{
-			case refEntityType_t::RT_PORTALSURFACE:
-				break; // don't draw anything
+		case refEntityType_t::RT_MODEL:
+			// we must set up parts of tr.or for model culling
+			R_RotateEntityForViewParms( ent, &tr.viewParms, &tr.orientation );
 
-			case refEntityType_t::RT_SPRITE:
-			{
-				// self blood sprites, talk balloons, etc should not be drawn in the primary
-				// view.  We can't just do this check for all entities, because md3
-				// entities may still want to cast shadows from them
-				if ( ( ent->e.renderfx & RF_THIRD_PERSON ) &&
-					tr.viewParms.portalLevel == 0 ) {
-					continue;
-				}
+			tr.currentModel = R_GetModelByHandle( ent->e.hModel );
 
-				shader_t* shader = R_GetShaderByHandle( ent->e.customShader );
-				R_AddDrawSurf( &entitySurface, shader, -1 );
-				break;
+			if ( !tr.currentModel )
+			{
+				R_AddDrawSurf( &entitySurface, tr.defaultShader, -1 );
 			}
+			else
+			{
+				switch ( tr.currentModel->type ) {
+					case modtype_t::MOD_MESH:
+						R_AddMDVSurfaces( ent );
+						break;
+
+					case modtype_t::MOD_MD5:
+						R_AddMD5Surfaces( ent );
+						break;
+
+					case modtype_t::MOD_IQM:
+						R_AddIQMSurfaces( ent );
+						break;
+
+					case modtype_t::MOD_BSP:
+						R_AddBSPModelSurfaces( ent );
+						break;
+
+					case modtype_t::MOD_BAD: // null model axis
+						if ( ( ent->e.renderfx & RF_THIRD_PERSON ) &&
+							tr.viewParms.portalLevel == 0 ) {
+							break;
+						}
 
-			case refEntityType_t::RT_MODEL:
-				// we must set up parts of tr.or for model culling
-				R_RotateEntityForViewParms( ent, &tr.viewParms, &tr.orientation );
-
-				tr.currentModel = R_GetModelByHandle( ent->e.hModel );
+						VectorClear( ent->localBounds[0] );
+						VectorClear( ent->localBounds[1] );
+						VectorClear( ent->worldBounds[0] );
+						VectorClear( ent->worldBounds[1] );
+						R_AddDrawSurf( &entitySurface, tr.defaultShader, -1, 0 );
+						break;
 
-				if ( !tr.currentModel )
-				{
-					R_AddDrawSurf( &entitySurface, tr.defaultShader, -1 );
+					default:
+						Sys::Drop( "R_AddEntitySurfaces: Bad modeltype" );
 				}
-				else
-				{
-					switch ( tr.currentModel->type ) {
-						case modtype_t::MOD_MESH:
-							R_AddMDVSurfaces( ent );
-							break;
+			}
 
-						case modtype_t::MOD_MD5:
-							R_AddMD5Surfaces( ent );
-							break;
+			break;
 
-						case modtype_t::MOD_IQM:
-							R_AddIQMSurfaces( ent );
-							break;
+		default:
+			Sys::Drop( "R_AddEntitySurfaces: Bad reType" );
+	}
+}
 
-						case modtype_t::MOD_BSP:
-							R_AddBSPModelSurfaces( ent );
-							break;
+/*
+=============
+R_AddEntitySurfaces
+=============
+*/
+void R_AddEntitySurfaces()
+{
+	if ( !r_drawentities->integer )
+	{
+		return;
+	}
 
-						case modtype_t::MOD_BAD: // null model axis
-							if ( ( ent->e.renderfx & RF_THIRD_PERSON ) &&
-								tr.viewParms.portalLevel == 0 ) {
-								break;
-							}
-
-							VectorClear( ent->localBounds[0] );
-							VectorClear( ent->localBounds[1] );
-							VectorClear( ent->worldBounds[0] );
-							VectorClear( ent->worldBounds[1] );
-							R_AddDrawSurf( &entitySurface, tr.defaultShader, -1, 0 );
-							break;
+	// AddRefEntities();
 
-						default:
-							Sys::Drop( "R_AddEntitySurfaces: Bad modeltype" );
-					}
-				}
+	if ( R_UseParallelFrontend( tr.refdef.numEntities ) )
+	{
+		R_CollectDrawSurfsParallel( tr.refdef.numEntities, []( int first, int last ) {
+			for ( int i = first; i < last; i++ )
+			{
+				R_AddEntitySurface( i );
+			}
+		} );
 
-				break;
+		return;
+	}
 
-			default:
-				Sys::Drop( "R_AddEntitySurfaces: Bad reType" );
-		}
+	for ( int i = 0; i < tr.refdef.numEntities; i++ )
+	{
+		R_AddEntitySurface( i );
 	}
 }
 
@@ -0,0 +1,171 @@
+/*
+===========================================================================
+Daemon BSD Source Code
+Copyright (c) 2026, Daemon Developers
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Daemon developers nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL DAEMON DEVELOPERS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+===========================================================================
+*/
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "common/Common.h"
+
+#include "engine/renderer/tr_local.h"
+
+namespace {
+
+std::vector<drawSurf_t> RandomDrawSurfs( int count, uint64_t keyMask )
+{
+    std::mt19937_64 rng( count );
+    std::vector<drawSurf_t> drawSurfs( count );
+
+    for ( int i = 0; i < count; i++ )
+    {
+        drawSurfs[ i ].sort = rng() & keyMask;
+        drawSurfs[ i ].portalNum = i;
+    }
+
+    return drawSurfs;
+}
+
+void ExpectSameOrder( std::vector<drawSurf_t> drawSurfs )
+{
+    std::vector<drawSurf_t> expected = drawSurfs;
+    std::stable_sort( expected.begin(), expected.end(),
+                      []( const drawSurf_t &a, const drawSurf_t &b ) { return a.sort < b.sort; } );
+
+    R_RadixSortDrawSurfs( drawSurfs.data(), drawSurfs.size() );
+
+    for ( size_t i = 0; i < drawSurfs.size(); i++ )
+    {
+        EXPECT_EQ( expected[ i ].sort, drawSurfs[ i ].sort ) << "at " << i;
+        EXPECT_EQ( expected[ i ].portalNum, drawSurfs[ i ].portalNum ) << "at " << i;
+    }
+}
+
+TEST(DrawSurfSortTest, MatchesStableSort)
+{
+    for ( int count : { 0, 1, 2, 63, 64, 1000, MAX_DRAWSURFS } )
+    {
+        ExpectSameOrder( RandomDrawSurfs( count, ~uint64_t( 0 ) ) );
+    }
+}
+
+TEST(DrawSurfSortTest, KeepsOrderOfEqualKeys)
+{
+    // few distinct keys so that most passes are skipped and ties are common
+    ExpectSameOrder( RandomDrawSurfs( 5000, uint64_t( 3 ) << SORT_SHADER_SHIFT ) );
+}
+
+const int NUM_COLLECT_ITEMS = 3000;
+const int NUM_COLLECT_SHADERS = 6;
+
+std::vector<shader_t> collectShaders;
+std::vector<surfaceType_t> collectSurfaces;
+
+// adds zero to two surfaces per item, some of them with a depth shader
+void CollectTestDrawSurfs( int first, int last )
+{
+    for ( int i = first; i < last; i++ )
+    {
+        int count = i % 7 == 0 ? 0 : i % 5 == 0 ? 2 : 1;
+
+        for ( int j = 0; j < count; j++ )
+        {
+            R_AddDrawSurf( &collectSurfaces[ i ], &collectShaders[ ( i + j ) % NUM_COLLECT_SHADERS ],
+                           i % 3 - 1, i & 1, i % 4 - 1 );
+        }
+    }
+}
+
+std::vector<drawSurf_t> CollectDrawSurfs( bool parallel )
+{
+    std::vector<drawSurf_t> drawSurfs( MAX_DRAWSURFS );
+    drawSurf_t *savedDrawSurfs = tr.refdef.drawSurfs;
+    int savedNumDrawSurfs = tr.refdef.numDrawSurfs;
+
+    tr.refdef.drawSurfs = drawSurfs.data();
+    tr.refdef.numDrawSurfs = 0;
+    tr.currentEntity = &tr.worldEntity;
+
+    if ( parallel )
+    {
+        R_CollectDrawSurfsParallel( NUM_COLLECT_ITEMS, CollectTestDrawSurfs );
+    }
+    else
+    {
+        CollectTestDrawSurfs( 0, NUM_COLLECT_ITEMS );
+    }
+
+    drawSurfs.resize( tr.refdef.numDrawSurfs );
+    tr.refdef.drawSurfs = savedDrawSurfs;
+    tr.refdef.numDrawSurfs = savedNumDrawSurfs;
+
+    return drawSurfs;
+}
+
+void ExpectSameDrawSurfs( const std::vector<drawSurf_t> &expected, const std::vector<drawSurf_t> &drawSurfs )
+{
+    ASSERT_EQ( expected.size(), drawSurfs.size() );
+
+    for ( size_t i = 0; i < drawSurfs.size(); i++ )
+    {
+        EXPECT_EQ( expected[ i ].entity, drawSurfs[ i ].entity ) << "at " << i;
+        EXPECT_EQ( expected[ i ].surface, drawSurfs[ i ].surface ) << "at " << i;
+        EXPECT_EQ( expected[ i ].shader, drawSurfs[ i ].shader ) << "at " << i;
+        EXPECT_EQ( expected[ i ].sort, drawSurfs[ i ].sort ) << "at " << i;
+        EXPECT_EQ( expected[ i ].bspSurface, drawSurfs[ i ].bspSurface ) << "at " << i;
+        EXPECT_EQ( expected[ i ].portalNum, drawSurfs[ i ].portalNum ) << "at " << i;
+    }
+}
+
+TEST(DrawSurfCollectTest, ParallelMatchesSequential)
+{
+    collectSurfaces.assign( NUM_COLLECT_ITEMS, surfaceType_t::SF_BAD );
+    collectShaders.assign( NUM_COLLECT_SHADERS + 1, shader_t() );
+
+    // opaque and blended shaders, two of them with a depth pre-pass
+    shader_t &depthShader = collectShaders[ NUM_COLLECT_SHADERS ];
+    depthShader.sortedIndex = NUM_COLLECT_SHADERS;
+    depthShader.sort = Util::ordinal( shaderSort_t::SS_DEPTH );
+
+    for ( int i = 0; i < NUM_COLLECT_SHADERS; i++ )
+    {
+        collectShaders[ i ].sortedIndex = NUM_COLLECT_SHADERS - i;
+        collectShaders[ i ].sort = Util::ordinal( i % 2 ? shaderSort_t::SS_BLEND0 : shaderSort_t::SS_OPAQUE );
+        collectShaders[ i ].depthShader = i % 3 == 0 ? &depthShader : nullptr;
+    }
+
+    std::vector<drawSurf_t> expected = CollectDrawSurfs( false );
+    std::vector<drawSurf_t> drawSurfs = CollectDrawSurfs( true );
+    ExpectSameDrawSurfs( expected, drawSurfs );
+
+    R_RadixSortDrawSurfs( expected.data(), expected.size() );
+    R_RadixSortDrawSurfs( drawSurfs.data(), drawSurfs.size() );
+    ExpectSameDrawSurfs( expected, drawSurfs );
+}
+
+} // namespace
@@ -447,7 +447,7 @@ int RE_LerpTagET( orientation_t* tag, const trRefEntity_t* ent, const char* tagN
 
 	if ( model->type == modtype_t::MOD_MD5 || model->type == modtype_t::MOD_IQM )
 	{
-		vec3_t tmp;
+		transformMatrix_t matrix;
 
 		int retval = RE_BoneIndex( handle, tagName );
 
@@ -458,11 +458,13 @@ int RE_LerpTagET( orientation_t* tag, const trRefEntity_t* ent, const char* tagN
 
 		VectorScale( ent->skeleton.bones[ retval ].t.trans,
 			ent->skeleton.scale, tag->origin );
-		QuatToAxis( ent->skeleton.bones[ retval ].t.rot, tag->axis );
-		VectorCopy( tag->axis[ 2 ], tmp );
-		VectorCopy( tag->axis[ 1 ], tag->axis[ 2 ] );
-		VectorCopy( tag->axis[ 0 ], tag->axis[ 1 ] );
-		VectorCopy( tmp, tag->axis[ 0 ] );
+
+		// same bone matrix as for CPU skinning, which has no scale
+		// in its axes, with the axes rotated
+		TransToMatrix( &ent->skeleton.bones[ retval ].t, &matrix );
+		VectorCopy( matrix.axis[ 2 ], tag->axis[ 0 ] );
+		VectorCopy( matrix.axis[ 0 ], tag->axis[ 1 ] );
+		VectorCopy( matrix.axis[ 1 ], tag->axis[ 2 ] );
 		VectorNormalize( tag->axis[ 0 ] );
 		VectorNormalize( tag->axis[ 1 ] );
 		VectorNormalize( tag->axis[ 2 ] );
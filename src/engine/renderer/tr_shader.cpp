@@ -1415,6 +1415,18 @@ static bool ParseMap( const char **text, char *buffer, int bufferSize )
 	return true;
 }
 
+// Maps of these stage types are ignored when the feature is disabled
+static bool IsStageTypeDisabled( stageType_t type )
+{
+	// NOTE: Normal map can ship height map in alpha channel.
+	return ( type == stageType_t::ST_NORMALMAP && !glConfig.normalMapping && !glConfig.reliefMapping )
+		|| ( type == stageType_t::ST_HEIGHTMAP && !glConfig.reliefMapping )
+		|| ( type == stageType_t::ST_SPECULARMAP && !glConfig.specularMapping )
+		|| ( type == stageType_t::ST_PHYSICALMAP && !glConfig.physicalMapping )
+		|| ( type == stageType_t::ST_GLOWMAP && !r_glowMapping->integer )
+		|| ( type == stageType_t::ST_REFLECTIONMAP && !glConfig.reflectionMappingAvailable );
+}
+
 static bool LoadMap( shaderStage_t *stage, const char *buffer, stageType_t type, const int bundleIndex = TB_COLORMAP )
 {
 	const char         *buffer_p = &buffer[ 0 ];
@@ -1427,13 +1439,7 @@ static bool LoadMap( shaderStage_t *stage, const char *buffer, stageType_t type,
 
 	const char *token = COM_ParseExt2( &buffer_p, false );
 
-	// NOTE: Normal map can ship height map in alpha channel.
-	if ( ( type == stageType_t::ST_NORMALMAP && !glConfig.normalMapping && !glConfig.reliefMapping )
-		|| ( type == stageType_t::ST_HEIGHTMAP && !glConfig.reliefMapping )
-		|| ( type == stageType_t::ST_SPECULARMAP && !glConfig.specularMapping )
-		|| ( type == stageType_t::ST_PHYSICALMAP && !glConfig.physicalMapping )
-		|| ( type == stageType_t::ST_GLOWMAP && !r_glowMapping->integer )
-		|| ( type == stageType_t::ST_REFLECTIONMAP && !glConfig.reflectionMappingAvailable ) )
+	if ( IsStageTypeDisabled( type ) )
 	{
 		return true;
 	}
@@ -3434,6 +3440,26 @@ static bool ParseStage( shaderStage_t *stage, const char **text )
 	of colormaps like diffusemap… */
 	loadMap = delayedStageTextures[ TB_COLORMAP ].active;
 
+	/* Decode all the stage textures in the background first, so that
+	they are decoded while the first ones are uploaded. Most of them
+	were already queued by QueueShaderImageDecodes. */
+	for ( const auto& delayedStageTexture : delayedStageTextures )
+	{
+		if ( !delayedStageTexture.active || IsStageTypeDisabled( delayedStageTexture.type ) )
+		{
+			continue;
+		}
+
+		const char *buffer_p = delayedStageTexture.path;
+		const char *imageName = COM_ParseExt2( &buffer_p, false );
+
+		// Built-in images like $whiteimage and *black.
+		if ( imageName[ 0 ] != '$' && imageName[ 0 ] != '*' )
+		{
+			R_QueueImageDecode( imageName );
+		}
+	}
+
 	for ( int bundleIndex = 0; bundleIndex < MAX_TEXTURE_BUNDLES; bundleIndex++ )
 	{
 		auto& delayedStageTexture = delayedStageTextures[ bundleIndex ];
@@ -3996,6 +4022,109 @@ shader.  Parse it into the global shader variable.  Later functions
 will optimize it.
 =================
 */
+/*
+=================
+QueueShaderImageDecodes
+
+Starts decoding the images of all the stages of a shader before
+the first stage loads its images. The stages with an ifStatic
+condition are left to ParseStage, which queues their images once
+the condition is evaluated. Dynamic conditions are ignored as the
+images are loaded anyway. The decodes the shader does not use are
+dropped by R_FinishImageDecodes once it is parsed.
+=================
+*/
+static void QueueShaderImageDecodes( const char *text )
+{
+	static const struct {
+		const char *keyword;
+		stageType_t type;
+	} imageKeywords[] = {
+		{ "map", stageType_t::ST_COLORMAP },
+		{ "clampmap", stageType_t::ST_COLORMAP },
+		{ "diffuseMap", stageType_t::ST_DIFFUSEMAP },
+		{ "normalMap", stageType_t::ST_NORMALMAP },
+		{ "normalHeightMap", stageType_t::ST_NORMALMAP },
+		{ "heightMap", stageType_t::ST_HEIGHTMAP },
+		{ "specularMap", stageType_t::ST_SPECULARMAP },
+		{ "physicalMap", stageType_t::ST_PHYSICALMAP },
+		{ "glowMap", stageType_t::ST_GLOWMAP },
+	};
+
+	// the text starts after the opening brace of the shader
+	int depth = 1;
+
+	// images of the stage being read
+	std::vector<std::string> stageImages;
+	bool staticCondition = false;
+
+	while ( true )
+	{
+		const char *token = COM_ParseExt2( &text, true );
+
+		if ( !token[ 0 ] )
+		{
+			return;
+		}
+
+		if ( token[ 0 ] == '{' )
+		{
+			if ( ++depth == 2 )
+			{
+				stageImages.clear();
+				staticCondition = false;
+			}
+
+			continue;
+		}
+
+		if ( token[ 0 ] == '}' )
+		{
+			// end of shader definition
+			if ( --depth == 0 )
+			{
+				return;
+			}
+
+			// end of stage
+			if ( depth == 1 && !staticCondition )
+			{
+				for ( const std::string &imageName : stageImages )
+				{
+					R_QueueImageDecode( imageName.c_str() );
+				}
+			}
+
+			continue;
+		}
+
+		if ( !Q_stricmp( token, "ifStatic" ) )
+		{
+			staticCondition = true;
+			continue;
+		}
+
+		for ( const auto &imageKeyword : imageKeywords )
+		{
+			if ( Q_stricmp( token, imageKeyword.keyword ) )
+			{
+				continue;
+			}
+
+			const char *imageName = COM_ParseExt2( &text, false );
+
+			// Built-in images like $whiteimage and *black.
+			if ( imageName[ 0 ] && imageName[ 0 ] != '$' && imageName[ 0 ] != '*'
+				&& !IsStageTypeDisabled( imageKeyword.type ) )
+			{
+				stageImages.emplace_back( imageName );
+			}
+
+			break;
+		}
+	}
+}
+
 static bool ParseShader( const char *_text )
 {
 	const char **text;
@@ -4013,6 +4142,8 @@ static bool ParseShader( const char *_text )
 		return false;
 	}
 
+	QueueShaderImageDecodes( _text );
+
 	while ( true )
 	{
 		token = COM_ParseExt2( text, true );
@@ -6329,7 +6460,12 @@ shader_t       *R_FindShader( const char *name, int flags )
 			Log::Notice("loading explicit shader '%s'", strippedName );
 		}
 
-		if ( !ParseShader( shaderText ) )
+		bool parsed = ParseShader( shaderText );
+
+		// Drop the decodes of the images the shader did not load.
+		R_FinishImageDecodes();
+
+		if ( !parsed )
 		{
 			// had errors, so use default shader
 			shader.defaultShader = true;
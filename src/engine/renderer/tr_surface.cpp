@@ -41,6 +41,25 @@ use the shader system.
 */
 
 static transform_t bones[ MAX_BONES ];
+static transformMatrix_t boneMatrices[ MAX_BONES ];
+
+// below this the OpenMP overhead costs more than CPU skinning on one thread
+static const int MIN_PARALLEL_SKINNING_VERTEXES = 256;
+
+/*
+==============
+Tess_BoneMatrices
+
+Expand the bones for CPU skinning with SkinPoint and SkinVertex
+==============
+*/
+static void Tess_BoneMatrices( int numBones )
+{
+	for ( int i = 0; i < numBones; i++ )
+	{
+		TransToMatrix( &bones[ i ], &boneMatrices[ i ] );
+	}
+}
 
 /*
 ==============
@@ -1053,77 +1072,42 @@ static void Tess_SurfaceMD5( md5Surface_t *srf )
 	}
 
 	shaderVertex_t *modelTessVertex = tess.verts + tess.numVertexes;
+	int numVerts = srf->numVerts;
+
+	Tess_BoneMatrices( model->numBones );
 
 	// Deform the vertices by the lerped bones.
 	if ( tess.skipTangents )
 	{
-		#pragma omp parallel for
-		for ( int i = 0; i < static_cast<int>( srf->numVerts ); i++ )
+		#pragma omp parallel for if ( numVerts >= MIN_PARALLEL_SKINNING_VERTEXES )
+		for ( int i = 0; i < numVerts; i++ )
 		{
 			shaderVertex_t *tessVertex = modelTessVertex + i;
 			md5Vertex_t *vertex = surfaceVertex + i;
 
-			vec4_t *vertexPosition = &vertex->position;
-
-			float *boneWeight = vertex->boneWeights;
-			float *lastWeight = boneWeight + vertex->numWeights;
-			uint32_t *boneIndex = vertex->boneIndexes;
-
-			vec3_t position = {};
-
-			for ( ; boneWeight < lastWeight; boneWeight++, boneIndex++ )
-			{
-				vec3_t tmp;
-
-				TransformPoint( &bones[ *boneIndex ], *vertexPosition, tmp );
-				VectorMA( position, *boneWeight, tmp, position );
-			}
-
-			VectorCopy( position, tessVertex->xyz );
+			SkinPoint( boneMatrices, vertex->boneIndexes, vertex->boneWeights, vertex->numWeights,
+			           vertex->position, tessVertex->xyz );
 
 			Vector2Copy( vertex->texCoords, tessVertex->texCoords );
 		}
 	}
 	else
 	{
-		#pragma omp parallel for
-		for ( int i = 0; i < static_cast<int>( srf->numVerts ); i++ )
+		#pragma omp parallel for if ( numVerts >= MIN_PARALLEL_SKINNING_VERTEXES )
+		for ( int i = 0; i < numVerts; i++ )
 		{
 			shaderVertex_t *tessVertex = modelTessVertex + i;
 			md5Vertex_t *vertex = surfaceVertex + i;
 
-			vec4_t *vertexPosition = &vertex->position;
-			vec4_t *vertexNormal = &vertex->normal;
-			vec4_t *vertexTangent = &vertex->tangent;
-			vec4_t *vertexBinormal = &vertex->binormal;
+			vec3_t tangent, binormal, normal;
 
-			float *boneWeight = vertex->boneWeights;
-			float *lastWeight = boneWeight + vertex->numWeights;
-			uint32_t *boneIndex = vertex->boneIndexes;
-
-			vec3_t tangent = {}, binormal = {}, normal = {}, position = {};
-
-			for ( ; boneWeight < lastWeight; boneWeight++, boneIndex++ )
-			{
-				vec3_t tmp;
-
-				TransformPoint( &bones[ *boneIndex ], *vertexPosition, tmp );
-				VectorMA( position, *boneWeight, tmp, position );
-
-				TransformNormalVector( &bones[ *boneIndex ], *vertexNormal, tmp );
-				VectorMA( normal, *boneWeight, tmp, normal );
-
-				TransformNormalVector( &bones[ *boneIndex ], *vertexTangent, tmp );
-				VectorMA( tangent, *boneWeight, tmp, tangent );
-
-				TransformNormalVector( &bones[ *boneIndex ], *vertexBinormal, tmp );
-				VectorMA( binormal, *boneWeight, tmp, binormal );
-			}
+			SkinVertex( boneMatrices, vertex->boneIndexes, vertex->boneWeights, vertex->numWeights,
+			            vertex->position, vertex->normal, vertex->tangent, vertex->binormal,
+			            tessVertex->xyz, normal, tangent, binormal );
 
 			VectorNormalizeFast( normal );
 			VectorNormalizeFast( tangent );
 			VectorNormalizeFast( binormal );
-			VectorCopy( position, tessVertex->xyz );
 
 			R_TBNtoQtangentsFast( tangent, binormal, normal, tessVertex->qtangents );
 
@@ -1135,6 +1119,32 @@ static void Tess_SurfaceMD5( md5Surface_t *srf )
 	tess.numVertexes += srf->numVerts;
 }
 
+/*
+=================
+Tess_IQMBoneWeights
+
+Gather the non-zero weights of an IQM vertex for SkinPoint and SkinVertex
+=================
+*/
+static inline int Tess_IQMBoneWeights( const byte *blendIndex, const byte *blendWeight,
+                                       uint32_t *boneIndexes, float *boneWeights )
+{
+	const float weightFactor = 1.0f / 255.0f;
+	int numWeights = 0;
+
+	for ( int i = 0; i < 4; i++ )
+	{
+		if ( blendWeight[ i ] != 0 )
+		{
+			boneIndexes[ numWeights ] = blendIndex[ i ];
+			boneWeights[ numWeights ] = blendWeight[ i ] * weightFactor;
+			numWeights++;
+		}
+	}
+
+	return numWeights;
+}
+
 /*
 =================
 Tess_SurfaceIQM
@@ -1250,53 +1260,36 @@ void Tess_SurfaceIQM( srfIQModel_t *surf ) {
 	// Deform the vertices by the lerped bones.
 	if ( model->num_joints > 0 && model->blendWeights && model->blendIndexes )
 	{
-		const float weightFactor = 1.0f / 255.0f;
+		byte *modelBlendIndex = model->blendIndexes + 4 * firstVertex;
+		byte *modelBlendWeight = model->blendWeights + 4 * firstVertex;
+		int numVertexes = surf->num_vertexes;
+
+		Tess_BoneMatrices( model->num_joints );
 
 		if ( tess.skipTangents )
 		{
-			byte *modelBlendIndex = model->blendIndexes + 4 * firstVertex;
-			byte *modelBlendWeight = model->blendWeights + 4 * firstVertex;
-
-			#pragma omp parallel for
-			for ( int i = 0; i < surf->num_vertexes; i++ )
+			#pragma omp parallel for if ( numVertexes >= MIN_PARALLEL_SKINNING_VERTEXES )
+			for ( int i = 0; i < numVertexes; i++ )
 			{
 				shaderVertex_t *tessVertex = modelTessVertex + i;
 
 				float *vertexPosition = modelPosition + 3 * i;
 				float *vertexTexcoord = modelTexcoord + 2 * i;
 
-				byte *blendIndex = modelBlendIndex + 4 * i;
-				byte *lastBlendIndex = blendIndex + 4;
-				byte *blendWeight = modelBlendWeight + 4 * i;
-
-				vec3_t position = {};
-
-				for ( ; blendIndex < lastBlendIndex; blendIndex++, blendWeight++ )
-				{
-					if ( *blendWeight == 0 )
-					{
-						continue;
-					}
-
-					float weight = *blendWeight * weightFactor;
-					vec3_t tmp;
-
-					TransformPoint( &bones[ *blendIndex ], vertexPosition, tmp );
-					VectorMA( position, weight, tmp, position );
-				}
+				uint32_t boneIndexes[ 4 ];
+				float boneWeights[ 4 ];
+				int numWeights = Tess_IQMBoneWeights( modelBlendIndex + 4 * i, modelBlendWeight + 4 * i,
+				                                      boneIndexes, boneWeights );
 
-				VectorCopy( position, tessVertex->xyz );
+				SkinPoint( boneMatrices, boneIndexes, boneWeights, numWeights, vertexPosition, tessVertex->xyz );
 
 				Vector2Copy( vertexTexcoord, tessVertex->texCoords );
 			}
 		}
 		else
 		{
-			byte *modelBlendIndex = model->blendIndexes + 4 * firstVertex;
-			byte *modelBlendWeight = model->blendWeights + 4 * firstVertex;
-
-			#pragma omp parallel for
-			for ( int i = 0; i < surf->num_vertexes; i++ )
+			#pragma omp parallel for if ( numVertexes >= MIN_PARALLEL_SKINNING_VERTEXES )
+			for ( int i = 0; i < numVertexes; i++ )
 			{
 				shaderVertex_t *tessVertex = modelTessVertex + i;
 
@@ -1306,39 +1299,20 @@ void Tess_SurfaceIQM( srfIQModel_t *surf ) {
 				float *vertexBitangent = modelBitangent + 3 * i;
 				float *vertexTexcoord = modelTexcoord + 2 * i;
 
-				byte *blendIndex = modelBlendIndex + 4 * i;
-				byte *lastBlendIndex = blendIndex + 4;
-				byte *blendWeight = modelBlendWeight + 4 * i;
-
-				vec3_t position = {}, tangent = {}, binormal = {}, normal = {};
-
-				for ( ; blendIndex < lastBlendIndex; blendIndex++, blendWeight++ )
-				{
-					if ( *blendWeight == 0 )
-					{
-						continue;
-					}
-
-					float weight = *blendWeight * weightFactor;
-					vec3_t tmp;
-
-					TransformPoint( &bones[ *blendIndex ], vertexPosition, tmp );
-					VectorMA( position, weight, tmp, position );
-
-					TransformNormalVector( &bones[ *blendIndex ], vertexNormal, tmp );
-					VectorMA( normal, weight, tmp, normal );
+				uint32_t boneIndexes[ 4 ];
+				float boneWeights[ 4 ];
+				int numWeights = Tess_IQMBoneWeights( modelBlendIndex + 4 * i, modelBlendWeight + 4 * i,
+				                                      boneIndexes, boneWeights );
 
-					TransformNormalVector( &bones[ *blendIndex ], vertexTangent, tmp );
-					VectorMA( tangent, weight, tmp, tangent );
+				vec3_t tangent, binormal, normal;
 
-					TransformNormalVector( &bones[ *blendIndex ], vertexBitangent, tmp );
-					VectorMA( binormal, weight, tmp, binormal );
-				}
+				SkinVertex( boneMatrices, boneIndexes, boneWeights, numWeights,
+				            vertexPosition, vertexNormal, vertexTangent, vertexBitangent,
+				            tessVertex->xyz, normal, tangent, binormal );
 
 				VectorNormalizeFast( normal );
 				VectorNormalizeFast( tangent );
 				VectorNormalizeFast( binormal );
-				VectorCopy( position, tessVertex->xyz );
 
 				R_TBNtoQtangentsFast( tangent, binormal, normal, tessVertex->qtangents );
 
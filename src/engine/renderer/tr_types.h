@@ -289,6 +289,23 @@ struct LerpTagSync {
 	orientation_t orientation;
 };
 
+// One skeleton of a batch, optionally blended with a second pose
+struct SkeletonRequest {
+	qhandle_t anim;
+	int       startFrame;
+	int       endFrame;
+	float     frac;
+	bool8_t   clearOrigin;
+
+	// no blending if 0
+	qhandle_t blendAnim;
+	int       blendStartFrame;
+	int       blendEndFrame;
+	float     blendFrac;
+	bool8_t   blendClearOrigin;
+	float     blendLerp;
+};
+
 // ================================================================================================
 
 struct refdef_t
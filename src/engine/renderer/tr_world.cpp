@@ -125,6 +125,34 @@ static bool R_CullSurface( surfaceType_t *surface, shader_t *shader, int planeBi
 	return false;
 }
 
+// with r_parallelFrontend the walk only lists the surfaces of the visible
+// leaves, they are culled and added by R_CollectDrawSurfsParallel afterwards
+struct worldSurfaceCandidate_t
+{
+	bspSurface_t *surf;
+	int          portalNum;
+	int          planeBits;
+};
+
+static bool collectWorldSurfaceCandidates = false;
+static std::vector<worldSurfaceCandidate_t> worldSurfaceCandidates;
+
+/*
+======================
+R_CullAndAddWorldSurface
+======================
+*/
+static void R_CullAndAddWorldSurface( bspSurface_t *surf, int portalNum, int planeBits )
+{
+	// try to cull before lighting or adding
+	if ( R_CullSurface( surf->data, surf->shader, planeBits ) )
+	{
+		return;
+	}
+
+	R_AddDrawSurf( surf->data, surf->shader, surf->lightmapNum, true, portalNum );
+}
+
 /*
 ======================
 R_AddWorldSurface
@@ -139,13 +167,13 @@ static bool R_AddWorldSurface( bspSurface_t *surf, int portalNum, int planeBits
 
 	surf->viewCount = tr.viewCountNoReset;
 
-	// try to cull before lighting or adding
-	if ( R_CullSurface( surf->data, surf->shader, planeBits ) )
+	if ( collectWorldSurfaceCandidates )
 	{
+		worldSurfaceCandidates.push_back( { surf, portalNum, planeBits } );
 		return true;
 	}
 
-	R_AddDrawSurf( surf->data, surf->shader, surf->lightmapNum, true, portalNum );
+	R_CullAndAddWorldSurface( surf, portalNum, planeBits );
 	return true;
 }
 
@@ -600,6 +628,22 @@ void R_AddWorldSurfaces()
 	// clear traversal list
 	backEndData[ tr.smpFrame ]->traversalLength = 0;
 
+	collectWorldSurfaceCandidates = R_UseParallelFrontend( tr.world->numSurfaces );
+	worldSurfaceCandidates.clear();
+
 	// update visbounds and add surfaces that weren't cached with VBOs
 	R_RecursiveWorldNode( tr.world->nodes, FRUSTUM_CLIPALL );
+
+	if ( collectWorldSurfaceCandidates )
+	{
+		collectWorldSurfaceCandidates = false;
+
+		R_CollectDrawSurfsParallel( worldSurfaceCandidates.size(), []( int first, int last ) {
+			for ( int i = first; i < last; i++ )
+			{
+				const worldSurfaceCandidate_t &candidate = worldSurfaceCandidates[ i ];
+				R_CullAndAddWorldSurface( candidate.surf, candidate.portalNum, candidate.planeBits );
+			}
+		} );
+	}
 }
@@ -51,7 +51,6 @@ Maryland 20850 USA.
 struct svEntity_t
 {
 	entityState_t        baseline; // for delta compression of initial sighting
-	int                  snapshotCounter; // used to prevent double adding from portal views
 };
 
 enum class serverState_t
@@ -67,7 +66,6 @@ struct server_t
 	bool      restarting; // if true, send configstring changes during SS_LOADING
 	int           serverId; // changes each server start
 	int           restartedServerId; // serverId before a map_restart
-	int             snapshotCounter; // incremented for each snapshot built
 	int             timeResidual; // <= 1000 / sv_frame->value
 	int             nextFrameTime; // when time > nextFrameTime, process world
 
@@ -99,6 +97,10 @@ struct server_t
 	float ucompAve;
 	int   ucompNum;
 	// -NERVE - SMF
+
+	// wall time won by sv_parallelSnapshots, in microseconds
+	int   snapshotTimeSaved;
+	int   snapshotTimeSavedWindow;
 };
 
 struct clientSnapshot_t
@@ -374,6 +376,7 @@ void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg );
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages();
 void SV_SendClientSnapshot( client_t *client );
+void SV_UpdateEntityClusterIndex();
 
 //bani
 void SV_SendClientIdle( client_t *client );
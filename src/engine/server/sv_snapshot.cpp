@@ -32,8 +32,14 @@ Maryland 20850 USA.
 ===========================================================================
 */
 
+#include <atomic>
+#include <bitset>
+#include <exception>
+#include <mutex>
+
 #include "server.h"
 #include "qcommon/sys.h"
+#include "framework/OmpSystem.h"
 
 /*
 =============================================================================
@@ -58,9 +64,132 @@ A server packet will look something like:
 */
 
 static Cvar::Cvar<bool> sv_novis("sv_novis", "skip PVS check when transmitting entities", 0, false);
+static Cvar::Cvar<bool> sv_deltaCache("sv_deltaCache", "share entity delta encodings between clients", Cvar::NONE, true);
+static Cvar::Cvar<bool> sv_parallelSnapshots("sv_parallelSnapshots", "build and encode client snapshots on multiple threads", Cvar::NONE, false);
 
 static Log::Logger bandwidthLog("server.bandwidth");
 
+/*
+=============================================================================
+
+Entity delta cache
+
+Clients which acknowledged the same snapshot need the same delta for
+each entity, so encoded deltas are kept for the frame and copied into
+the messages of the other clients.
+
+=============================================================================
+*/
+
+static const int MAX_DELTA_CACHE_ENTRIES = 8; // distinct deltas kept per entity
+static const int MAX_ENTITY_DELTA_BYTES = 1024;
+
+struct deltaCacheEntry_t
+{
+	entityState_t from;
+	entityState_t to;
+	bool          force;
+	msg_t         msg;
+	byte          msgBuf[ MAX_ENTITY_DELTA_BYTES ];
+};
+
+struct deltaCacheSlot_t
+{
+	std::mutex lock; // deltas may be written by sv_parallelSnapshots threads
+	int        frame;
+	int        numEntries;
+	std::unique_ptr<deltaCacheEntry_t[]> entries;
+};
+
+static deltaCacheSlot_t deltaCache[ MAX_GENTITIES ];
+static int deltaCacheFrame;
+
+static deltaCacheEntry_t *SV_FindCachedDelta( deltaCacheSlot_t &slot, const entityState_t *from,
+                                              const entityState_t *to, bool force )
+{
+	if ( slot.frame != deltaCacheFrame )
+	{
+		slot.frame = deltaCacheFrame;
+		slot.numEntries = 0;
+	}
+
+	for ( int i = 0; i < slot.numEntries; i++ )
+	{
+		deltaCacheEntry_t &entry = slot.entries[ i ];
+
+		if ( entry.force == force && !memcmp( &entry.to, to, sizeof( *to ) )
+		     && !memcmp( &entry.from, from, sizeof( *from ) ) )
+		{
+			return &entry;
+		}
+	}
+
+	return nullptr;
+}
+
+/*
+=============
+SV_WriteDeltaEntityCached
+
+Same as MSG_WriteDeltaEntity with a non-null to
+=============
+*/
+static void SV_WriteDeltaEntityCached( msg_t *msg, const entityState_t *from, const entityState_t *to, bool force )
+{
+	if ( !sv_deltaCache.Get() || msg->oob )
+	{
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	deltaCacheSlot_t &slot = deltaCache[ to->number ];
+
+	{
+		std::lock_guard<std::mutex> guard( slot.lock );
+		deltaCacheEntry_t *entry = SV_FindCachedDelta( slot, from, to, force );
+
+		if ( entry )
+		{
+			MSG_WriteMsgBits( msg, &entry->msg );
+			return;
+		}
+	}
+
+	byte  deltaBuf[ MAX_ENTITY_DELTA_BYTES ];
+	msg_t delta;
+
+	MSG_Init( &delta, deltaBuf, sizeof( deltaBuf ) );
+	MSG_WriteDeltaEntity( &delta, from, to, force );
+
+	if ( delta.overflowed )
+	{
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	MSG_WriteMsgBits( msg, &delta );
+
+	std::lock_guard<std::mutex> guard( slot.lock );
+
+	// another thread may have added it meanwhile
+	if ( slot.numEntries == MAX_DELTA_CACHE_ENTRIES || SV_FindCachedDelta( slot, from, to, force ) )
+	{
+		return;
+	}
+
+	if ( !slot.entries )
+	{
+		slot.entries.reset( new deltaCacheEntry_t[ MAX_DELTA_CACHE_ENTRIES ] );
+	}
+
+	deltaCacheEntry_t &entry = slot.entries[ slot.numEntries++ ];
+
+	entry.from = *from;
+	entry.to = *to;
+	entry.force = force;
+	MSG_Copy( &entry.msg, entry.msgBuf, sizeof( entry.msgBuf ), &delta );
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -122,7 +251,7 @@ static void SV_EmitPacketEntities( const clientSnapshot_t *from, clientSnapshot_
 			// delta update from old position
 			// because the force parm is false, this will not result
 			// in any bytes being emitted if the entity has not changed at all
-			MSG_WriteDeltaEntity( msg, oldent, newent, false );
+			SV_WriteDeltaEntityCached( msg, oldent, newent, false );
 			oldindex++;
 			newindex++;
 			continue;
@@ -131,7 +260,7 @@ static void SV_EmitPacketEntities( const clientSnapshot_t *from, clientSnapshot_
 		if ( newnum < oldnum )
 		{
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity( msg, &sv.svEntities[ newnum ].baseline, newent, true );
+			SV_WriteDeltaEntityCached( msg, &sv.svEntities[ newnum ].baseline, newent, true );
 			newindex++;
 			continue;
 		}
@@ -285,6 +414,10 @@ struct snapshotEntityNumbers_t
 {
 	int numSnapshotEntities;
 	int snapshotEntities[ MAX_SNAPSHOT_ENTITIES ];
+
+	// used to prevent double adding from portal views, this is kept
+	// per snapshot so several snapshots can be built at the same time
+	std::bitset<MAX_GENTITIES> added;
 };
 
 /*
@@ -317,16 +450,15 @@ static int SV_QsortEntityNumbers( const void *a, const void *b )
 SV_AddEntToSnapshot
 ===============
 */
-static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt,
-                                 snapshotEntityNumbers_t *eNums )
+static void SV_AddEntToSnapshot( sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums )
 {
 	// if we have already added this entity to this snapshot, don't add again
-	if ( svEnt->snapshotCounter == sv.snapshotCounter )
+	if ( eNums->added[ gEnt->s.number ] )
 	{
 		return;
 	}
 
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added.set( gEnt->s.number );
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES )
@@ -338,6 +470,194 @@ static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt,
 	eNums->numSnapshotEntities++;
 }
 
+/*
+=============================================================================
+
+Entity cluster index
+
+Entities are bucketed by the PVS clusters they touch once per frame, so
+building a snapshot only has to look at entities in the clusters it can
+see instead of testing every entity against every client's PVS.
+
+=============================================================================
+*/
+
+struct entityClusterIndex_t
+{
+	// entities touching cluster c are entities[ clusterStart[ c ] .. clusterStart[ c + 1 ] - 1 ]
+	std::vector<int> clusterStart;
+	std::vector<int> entities;
+
+	// entities which must be tested regardless of the PVS
+	std::bitset<MAX_GENTITIES> unclustered;
+};
+
+static entityClusterIndex_t entityClusterIndex;
+
+/*
+===============
+SV_EntityClusters
+
+Returns the clusters an entity is sent through, or false if the entity
+must always be tested because its visibility doesn't depend on the PVS
+or it touches more clusters than it can store.
+===============
+*/
+static bool SV_EntityClusters( const sharedEntity_t *ent, int numClusters, const int **clusters, int *count )
+{
+	if ( ent->r.svFlags & ( SVF_BROADCAST | SVF_BROADCAST_ONCE | SVF_CLIENTS_IN_RANGE ) )
+	{
+		return false;
+	}
+
+	if ( ent->r.svFlags & SVF_IGNOREBMODELEXTENTS )
+	{
+		*clusters = &ent->r.originCluster;
+		*count = 1;
+	}
+	else
+	{
+		if ( ent->r.numClusters < 0 || ent->r.numClusters > MAX_ENT_CLUSTERS || ent->r.lastCluster )
+		{
+			return false;
+		}
+
+		*clusters = ent->r.clusternums;
+		*count = ent->r.numClusters;
+	}
+
+	for ( int i = 0; i < *count; i++ )
+	{
+		if ( ( *clusters )[ i ] < 0 || ( *clusters )[ i ] >= numClusters )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+===============
+SV_UpdateEntityClusterIndex
+
+Must be called after the game ran and before building snapshots.
+Also fixes the entity numbers, so that building snapshots doesn't
+write to the entities and can be done by several threads.
+===============
+*/
+void SV_UpdateEntityClusterIndex()
+{
+	entityClusterIndex_t &index = entityClusterIndex;
+	int numClusters = CM_NumClusters();
+	const int *clusters = nullptr;
+	int count = 0;
+
+	index.clusterStart.assign( numClusters + 1, 0 );
+	index.entities.clear();
+	index.unclustered.reset();
+
+	if ( sv.state == serverState_t::SS_DEAD || !sv.gentities )
+	{
+		return;
+	}
+
+	// count the entities of each cluster
+	for ( int e = 0; e < sv.num_entities; e++ )
+	{
+		sharedEntity_t *ent = SV_GentityNum( e );
+
+		if ( !ent->r.linked )
+		{
+			continue;
+		}
+
+		if ( ent->s.number != e )
+		{
+			Log::Debug( "FIXING ENT->S.NUMBER!!!" );
+			ent->s.number = e;
+		}
+
+		if ( ent->r.svFlags & SVF_NOCLIENT )
+		{
+			continue;
+		}
+
+		if ( !SV_EntityClusters( ent, numClusters, &clusters, &count ) )
+		{
+			index.unclustered.set( e );
+			continue;
+		}
+
+		for ( int i = 0; i < count; i++ )
+		{
+			index.clusterStart[ clusters[ i ] + 1 ]++;
+		}
+	}
+
+	for ( int c = 0; c < numClusters; c++ )
+	{
+		index.clusterStart[ c + 1 ] += index.clusterStart[ c ];
+	}
+
+	// then fill them
+	std::vector<int> fill = index.clusterStart;
+	index.entities.resize( index.clusterStart[ numClusters ] );
+
+	for ( int e = 0; e < sv.num_entities; e++ )
+	{
+		sharedEntity_t *ent = SV_GentityNum( e );
+
+		if ( !ent->r.linked || ( ent->r.svFlags & SVF_NOCLIENT ) || index.unclustered[ e ] )
+		{
+			continue;
+		}
+
+		SV_EntityClusters( ent, numClusters, &clusters, &count );
+
+		for ( int i = 0; i < count; i++ )
+		{
+			index.entities[ fill[ clusters[ i ] ]++ ] = e;
+		}
+	}
+}
+
+/*
+===============
+SV_PotentiallyVisibleEntities
+
+Marks the entities that touch a cluster of the PVS, or which
+can't be culled by the PVS alone.
+===============
+*/
+static void SV_PotentiallyVisibleEntities( const byte *pvs, std::bitset<MAX_GENTITIES> &candidates )
+{
+	const entityClusterIndex_t &index = entityClusterIndex;
+	int numClusters = static_cast<int>( index.clusterStart.size() ) - 1;
+
+	candidates = index.unclustered;
+
+	for ( int c = 0; c < numClusters; c++ )
+	{
+		// skip 8 invisible clusters at once
+		if ( !pvs[ c >> 3 ] )
+		{
+			c |= 7;
+			continue;
+		}
+
+		if ( !( pvs[ c >> 3 ] & ( 1 << ( c & 7 ) ) ) )
+		{
+			continue;
+		}
+
+		for ( int i = index.clusterStart[ c ]; i < index.clusterStart[ c + 1 ]; i++ )
+		{
+			candidates.set( index.entities[ i ] );
+		}
+	}
+}
+
 /*
 ===============
 SV_AddEntitiesVisibleFromPoint
@@ -350,7 +670,6 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 {
 	int            e, i;
 	sharedEntity_t *ent, *playerEnt;
-	svEntity_t     *svEnt;
 	int            l;
 	int            clientarea, clientcluster;
 	int            leafnum;
@@ -375,6 +694,17 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 
 	clientpvs = CM_ClusterPVS( clientcluster );
 
+	std::bitset<MAX_GENTITIES> candidates;
+
+	if ( sv_novis.Get() )
+	{
+		candidates.set();
+	}
+	else
+	{
+		SV_PotentiallyVisibleEntities( clientpvs, candidates );
+	}
+
 //	c_fullsend = 0;
 
 	playerEnt = SV_GentityNum( frame->ps.clientNum );
@@ -386,6 +716,12 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 
 	for ( e = 0; e < sv.num_entities; e++ )
 	{
+		// skip entities in clusters that can't be seen
+		if ( !candidates[ e ] )
+		{
+			continue;
+		}
+
 		ent = SV_GentityNum( e );
 
 		// never send entities that aren't linked in
@@ -394,12 +730,6 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 			continue;
 		}
 
-		if ( ent->s.number != e )
-		{
-			Log::Debug( "FIXING ENT->S.NUMBER!!!" );
-			ent->s.number = e;
-		}
-
 		// entities can be flagged to explicitly not be sent to the client
 		if ( ent->r.svFlags & SVF_NOCLIENT )
 		{
@@ -443,29 +773,30 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 			}
 		}
 
-		svEnt = SV_SvEntityForGentity( ent );
+		// validates the entity number
+		SV_SvEntityForGentity( ent );
 
 		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter )
+		if ( eNums->added[ e ] )
 		{
 			continue;
 		}
 
 		if ( sv_novis.Get() )
 		{
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+			SV_AddEntToSnapshot( ent, eNums );
 			continue;
 		}
 
 		// broadcast entities are always sent
 		if ( ent->r.svFlags & SVF_BROADCAST )
 		{
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+			SV_AddEntToSnapshot( ent, eNums );
 			continue;
 		}
 
 		if ( ( ent->r.svFlags & SVF_BROADCAST_ONCE ) && !client->reliableAcknowledge ) {
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+			SV_AddEntToSnapshot( ent, eNums );
 			continue;
 		}
 
@@ -473,7 +804,7 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 		if ( (ent->r.svFlags & SVF_CLIENTS_IN_RANGE) &&
 		     Distance( ent->s.origin, playerEnt->s.origin ) <= ent->r.clientRadius )
 		{
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+			SV_AddEntToSnapshot( ent, eNums );
 			continue;
 		}
 
@@ -484,7 +815,7 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 		{
 			if ( bitvector[ ent->r.originCluster >> 3 ] & ( 1 << ( ent->r.originCluster & 7 ) ) )
 			{
-				SV_AddEntToSnapshot( svEnt, ent, eNums );
+				SV_AddEntToSnapshot( ent, eNums );
 			}
 
 			continue;
@@ -555,16 +886,14 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 
 			if ( ment )
 			{
-				svEntity_t *master = nullptr;
+				SV_SvEntityForGentity( ment );
 
-				master = SV_SvEntityForGentity( ment );
-
-				if ( master->snapshotCounter == sv.snapshotCounter || !ment->r.linked )
+				if ( eNums->added[ ment->s.number ] || !ment->r.linked )
 				{
 					continue;
 				}
 
-				SV_AddEntToSnapshot( master, ment, eNums );
+				SV_AddEntToSnapshot( ment, eNums );
 			}
 
 			continue; // master needs to be added, but not this dummy ent
@@ -575,7 +904,6 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 			{
 				int            h;
 				sharedEntity_t *ment = nullptr;
-				svEntity_t     *master = nullptr;
 
 				for ( h = 0; h < sv.num_entities; h++ )
 				{
@@ -588,7 +916,7 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 
 					if ( ment )
 					{
-						master = SV_SvEntityForGentity( ment );
+						SV_SvEntityForGentity( ment );
 					}
 					else
 					{
@@ -600,25 +928,19 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 						continue;
 					}
 
-					if ( ment->s.number != h )
-					{
-						Log::Debug( "FIXING vis dummy multiple ment->S.NUMBER!!!" );
-						ment->s.number = h;
-					}
-
 					if ( ment->r.svFlags & SVF_NOCLIENT )
 					{
 						continue;
 					}
 
-					if ( master->snapshotCounter == sv.snapshotCounter )
+					if ( eNums->added[ ment->s.number ] )
 					{
 						continue;
 					}
 
 					if ( ment->s.otherEntityNum == ent->s.number )
 					{
-						SV_AddEntToSnapshot( master, ment, eNums );
+						SV_AddEntToSnapshot( ment, eNums );
 					}
 				}
 
@@ -627,7 +949,7 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 		}
 
 		// add it
-		SV_AddEntToSnapshot( svEnt, ent, eNums );
+		SV_AddEntToSnapshot( ent, eNums );
 
 		// if it's a portal entity, add everything visible from its camera position
 		if ( ent->r.svFlags & SVF_PORTAL )
@@ -653,7 +975,7 @@ static void SV_AddEntitiesVisibleFromPoint( client_t* client, vec3_t origin, cli
 
 /*
 =============
-SV_BuildClientSnapshot
+SV_GatherClientSnapshot
 
 Decides which entities are going to be visible to the client, and
 copies off the playerstate and areabits.
@@ -662,28 +984,25 @@ This properly handles multiple recursive portals, but the render
 currently doesn't.
 
 For viewing through other player's eyes, clent can be something other than client->gentity
+
+This only touches the client's own frame, so it can run for several
+clients at the same time. Returns false if there is nothing to store.
 =============
 */
-static void SV_BuildClientSnapshot( client_t *client )
+static bool SV_GatherClientSnapshot( client_t *client, snapshotEntityNumbers_t *entityNumbers )
 {
 	vec3_t                  org;
 	clientSnapshot_t        *frame;
-	snapshotEntityNumbers_t entityNumbers;
 	int                     i;
-	sharedEntity_t          *ent;
-	entityState_t           *state;
-	svEntity_t              *svEnt;
 	sharedEntity_t          *clent;
 	int                     clientNum;
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
-
 	// this is the frame we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	entityNumbers->numSnapshotEntities = 0;
+	entityNumbers->added.reset();
 	memset( frame->areabits, 0, sizeof( frame->areabits ) );
 
 	// show_bug.cgi?id=62
@@ -693,7 +1012,7 @@ static void SV_BuildClientSnapshot( client_t *client )
 
 	if ( !clent || client->state == clientState_t::CS_ZOMBIE )
 	{
-		return;
+		return false;
 	}
 
 	// grab the current playerState_t
@@ -709,9 +1028,7 @@ static void SV_BuildClientSnapshot( client_t *client )
 		Sys::Drop( "SV_SvEntityForGentity: bad gEnt" );
 	}
 
-	svEnt = &sv.svEntities[ clientNum ];
-
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	entityNumbers->added.set( clientNum );
 
 	if ( clent->r.svFlags & SVF_SELF_PORTAL_EXCLUSIVE )
 	{
@@ -727,14 +1044,14 @@ static void SV_BuildClientSnapshot( client_t *client )
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint( client, org, frame, &entityNumbers /*, false, client->netchan.remoteAddress.type == NA_LOOPBACK */ );
+	SV_AddEntitiesVisibleFromPoint( client, org, frame, entityNumbers /*, false, client->netchan.remoteAddress.type == NA_LOOPBACK */ );
 
 	// if there were portals visible, there may be out of order entities
 	// in the list which will need to be resorted for the delta compression
 	// to work correctly.  This also catches the error condition
 	// of an entity being included twice.
-	qsort( entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities,
-	       sizeof( entityNumbers.snapshotEntities[ 0 ] ), SV_QsortEntityNumbers );
+	qsort( entityNumbers->snapshotEntities, entityNumbers->numSnapshotEntities,
+	       sizeof( entityNumbers->snapshotEntities[ 0 ] ), SV_QsortEntityNumbers );
 
 	// now that all viewpoint's areabits have been OR'd together, invert
 	// all of them to make it a mask vector, which is what the renderer wants
@@ -743,13 +1060,33 @@ static void SV_BuildClientSnapshot( client_t *client )
 		( ( int * ) frame->areabits ) [ i ] = ( ( int * ) frame->areabits ) [ i ] ^ -1;
 	}
 
+	return true;
+}
+
+/*
+=============
+SV_StoreClientSnapshot
+
+Copies the entity states of a gathered snapshot into the
+circular svs.snapshotEntities buffer. Must not be run in parallel.
+=============
+*/
+static void SV_StoreClientSnapshot( client_t *client, const snapshotEntityNumbers_t *entityNumbers )
+{
+	clientSnapshot_t *frame;
+	int              i;
+	sharedEntity_t   *ent;
+	entityState_t    *state;
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
 	// copy the entity states out
 	frame->num_entities = 0;
 	frame->first_entity = svs.nextSnapshotEntities;
 
-	for ( i = 0; i < entityNumbers.numSnapshotEntities; i++ )
+	for ( i = 0; i < entityNumbers->numSnapshotEntities; i++ )
 	{
-		ent = SV_GentityNum( entityNumbers.snapshotEntities[ i ] );
+		ent = SV_GentityNum( entityNumbers->snapshotEntities[ i ] );
 		state = &svs.snapshotEntities[ svs.nextSnapshotEntities % svs.numSnapshotEntities ];
 		*state = ent->s;
 		svs.nextSnapshotEntities++;
@@ -764,6 +1101,21 @@ static void SV_BuildClientSnapshot( client_t *client )
 	}
 }
 
+/*
+=============
+SV_BuildClientSnapshot
+=============
+*/
+static void SV_BuildClientSnapshot( client_t *client )
+{
+	snapshotEntityNumbers_t entityNumbers;
+
+	if ( SV_GatherClientSnapshot( client, &entityNumbers ) )
+	{
+		SV_StoreClientSnapshot( client, &entityNumbers );
+	}
+}
+
 /*
 ====================
 SV_RateMsec
@@ -925,12 +1277,41 @@ void SV_SendClientIdle( client_t *client )
 	sv.ubpsTotalBytes += msg.uncompsize / 8; // NERVE - SMF - net debugging
 }
 
+/*
+=======================
+SV_FinishClientSnapshot
+
+Appends the download data to a client message and sends it
+=======================
+*/
+static void SV_FinishClientSnapshot( client_t *client, msg_t *msg )
+{
+	// Add any download data if the client is downloading
+	SV_WriteDownloadToClient( client, msg );
+
+	// check for overflow
+	if ( msg->overflowed )
+	{
+		Log::Warn("msg overflowed for %s", client->name );
+		MSG_Clear( msg );
+
+		SV_DropClient( client, "Msg overflowed" );
+		return;
+	}
+
+	SV_SendMessageToClient( msg, client );
+
+	sv.bpsTotalBytes += msg->cursize; // NERVE - SMF - net debugging
+	sv.ubpsTotalBytes += msg->uncompsize / 8; // NERVE - SMF - net debugging
+}
+
 /*
 =======================
 SV_SendClientSnapshot
 
 Also called by SV_FinalCommand
 
+The entity cluster index must be up to date, see SV_UpdateEntityClusterIndex
 =======================
 */
 void SV_SendClientSnapshot( client_t *client )
@@ -973,23 +1354,141 @@ void SV_SendClientSnapshot( client_t *client )
 	// and the playerState_t
 	SV_WriteSnapshotToClient( client, &msg );
 
-	// Add any download data if the client is downloading
-	SV_WriteDownloadToClient( client, &msg );
+	SV_FinishClientSnapshot( client, &msg );
+}
 
-	// check for overflow
-	if ( msg.overflowed )
+/*
+=======================
+SV_SendClientSnapshotsParallel
+
+Same as calling SV_SendClientSnapshot on every client of the list, but
+the visibility and delta encoding work of the active and zombie clients
+is spread over the OpenMP threads. Storing the entity states and sending
+the messages is serialized, and the messages are sent in list order.
+
+=======================
+*/
+struct pendingSnapshot_t
+{
+	client_t                *client;
+	bool                    parallel;
+	snapshotEntityNumbers_t entityNumbers;
+	bool                    gathered;
+	msg_t                   msg;
+	byte                    msgBuf[ MAX_MSGLEN ];
+};
+
+static void SV_SendClientSnapshotsParallel( const std::vector<client_t *> &clients )
+{
+	static std::vector<pendingSnapshot_t> pending;
+	std::exception_ptr error;
+	int numPending = clients.size();
+
+	if ( pending.size() < clients.size() )
 	{
-		Log::Warn("msg overflowed for %s", client->name );
-		MSG_Clear( &msg );
+		pending.resize( clients.size() );
+	}
 
-		SV_DropClient( client, "Msg overflowed" );
-		return;
+	Sys::SteadyClock::time_point wallStart = Sys::SteadyClock::now();
+	std::atomic<Sys::SteadyClock::rep> workTime( 0 );
+
+	// exceptions must not escape an OpenMP parallel region,
+	// keep the first one and rethrow it from the main thread
+	auto runParallel = [&]( void ( *func )( pendingSnapshot_t & ) ) {
+		#pragma omp parallel for schedule( dynamic )
+		for ( int i = 0; i < numPending; i++ )
+		{
+			Sys::SteadyClock::time_point start = Sys::SteadyClock::now();
+
+			try
+			{
+				func( pending[ i ] );
+			}
+			catch ( ... )
+			{
+				#pragma omp critical
+				if ( !error )
+				{
+					error = std::current_exception();
+				}
+			}
+
+			workTime += ( Sys::SteadyClock::now() - start ).count();
+		}
+
+		if ( error )
+		{
+			std::rethrow_exception( error );
+		}
+	};
+
+	for ( int i = 0; i < numPending; i++ )
+	{
+		client_t *client = clients[ i ];
+
+		// zombie clients need full snaps, see SV_SendClientSnapshot
+		pending[ i ].client = client;
+		pending[ i ].parallel = client->state >= clientState_t::CS_ACTIVE || client->state == clientState_t::CS_ZOMBIE;
 	}
 
-	SV_SendMessageToClient( &msg, client );
+	// build the snapshots
+	runParallel( []( pendingSnapshot_t &p ) {
+		if ( p.parallel )
+		{
+			p.gathered = SV_GatherClientSnapshot( p.client, &p.entityNumbers );
+		}
+	} );
 
-	sv.bpsTotalBytes += msg.cursize; // NERVE - SMF - net debugging
-	sv.ubpsTotalBytes += msg.uncompsize / 8; // NERVE - SMF - net debugging
+	// entity states are appended to a shared circular buffer,
+	// do it in client order like SV_SendClientSnapshot would
+	for ( int i = 0; i < numPending; i++ )
+	{
+		pendingSnapshot_t &p = pending[ i ];
+
+		if ( p.parallel && p.gathered )
+		{
+			SV_StoreClientSnapshot( p.client, &p.entityNumbers );
+		}
+
+		MSG_Init( &p.msg, p.msgBuf, sizeof( p.msgBuf ) );
+	}
+
+	// delta encode them
+	runParallel( []( pendingSnapshot_t &p ) {
+		if ( !p.parallel )
+		{
+			return;
+		}
+
+		// NOTE, MRE: all server->client messages now acknowledge
+		// let the client know which reliable clientCommands we have received
+		MSG_WriteLong( &p.msg, p.client->lastClientCommand );
+
+		// (re)send any reliable server commands
+		SV_UpdateServerCommandsToClient( p.client, &p.msg );
+
+		// send over all the relevant entityState_t
+		// and the playerState_t
+		SV_WriteSnapshotToClient( p.client, &p.msg );
+	} );
+
+	Sys::SteadyClock::duration wallTime = Sys::SteadyClock::now() - wallStart;
+
+	// the time it would have taken on a single thread minus the time it took
+	sv.snapshotTimeSaved = std::chrono::duration_cast<std::chrono::microseconds>(
+		Sys::SteadyClock::duration( workTime.load() ) - wallTime ).count();
+
+	for ( int i = 0; i < numPending; i++ )
+	{
+		if ( pending[ i ].parallel )
+		{
+			SV_FinishClientSnapshot( pending[ i ].client, &pending[ i ].msg );
+		}
+		else
+		{
+			SV_SendClientSnapshot( pending[ i ].client );
+		}
+	}
 }
 
 /*
@@ -1002,13 +1501,26 @@ void SV_SendClientMessages()
 {
 	client_t *c;
 	int      numclients = 0; // NERVE - SMF - net debugging
+	static std::vector<client_t *> snapshotClients;
+	bool     parallel = sv_parallelSnapshots.Get() && Omp::GetThreads() > 1;
+
+	snapshotClients.clear();
 
 	sv.bpsTotalBytes = 0; // NERVE - SMF - net debugging
 	sv.ubpsTotalBytes = 0; // NERVE - SMF - net debugging
+	sv.snapshotTimeSaved = 0;
+
+	// deltas of the previous frame are unlikely to be reused
+	deltaCacheFrame++;
 
 	// Gordon: update any changed configstrings from this frame
 	SV_UpdateConfigStrings();
 
+	SV_UpdateEntityClusterIndex();
+
+	// the packets are sent when the function returns or an error unwinds it
+	NetPacketBatch packetBatch;
+
 	// send a message to each connected client
 	for ( int i = 0; i < sv_maxClients.Get(); i++ )
 	{
@@ -1044,10 +1556,22 @@ void SV_SendClientMessages()
 			continue;
 		}
 
+		// keep the clients in order, see SV_SendClientSnapshotsParallel
+		if ( parallel )
+		{
+			snapshotClients.push_back( c );
+			continue;
+		}
+
 		// generate and send a new message
 		SV_SendClientSnapshot( c );
 	}
 
+	if ( !snapshotClients.empty() )
+	{
+		SV_SendClientSnapshotsParallel( snapshotClients );
+	}
+
 	// NERVE - SMF - net debugging
 	bandwidthLog.DoDebugCode( [numclients] {
 		if ( numclients <= 0 )
@@ -1082,6 +1606,8 @@ void SV_SendClientMessages()
 			sv.ubpsMaxBytes = sv.ubpsTotalBytes;
 		}
 
+		sv.snapshotTimeSavedWindow += sv.snapshotTimeSaved;
+
 		sv.bpsWindowSteps++;
 
 		if ( sv.bpsWindowSteps >= MAX_BPS_WINDOW )
@@ -1100,6 +1626,13 @@ void SV_SendClientMessages()
 			bandwidthLog.Debug( "bpspc(%2.0f) bps(%2.0f) pk(%i) ubps(%2.0f) upk(%i) cr(%2.2f) acr(%2.2f)",
 			             ave / ( float ) numclients, ave, sv.bpsMaxBytes, uave, sv.ubpsMaxBytes, comp_ratio,
 			             sv.ucompAve / sv.ucompNum );
+
+			if ( sv.snapshotTimeSavedWindow )
+			{
+				bandwidthLog.Debug( "parallel snapshots saved %.0fus per frame",
+				             sv.snapshotTimeSavedWindow / ( float ) MAX_BPS_WINDOW );
+				sv.snapshotTimeSavedWindow = 0;
+			}
 		}
 	});
 
@@ -70,6 +70,8 @@ static void CommonInit(Sys::OSHandle rootSocket)
 	writer.Write<uint32_t>(IPC::ABI_VERSION_DETECTION_ABI_VERSION);
 	writer.Write<std::string>(IPC::SYSCALL_ABI_VERSION);
 	writer.Write<bool>(IPC::DAEMON_HAS_COMPATIBILITY_BREAKING_SYSCALL_CHANGES);
+	// This VM can use the shared memory transport, older engines ignore it
+	writer.Write<bool>(true);
 	VM::rootChannel.SendMsg(writer);
 
 	// Start the main loop
@@ -79,6 +81,10 @@ static void CommonInit(Sys::OSHandle rootSocket)
 		if (id == IPC::ID_EXIT) {
 			return;
 		}
+		if (id == IPC::ID_SHARED_MEMORY_TRANSPORT) {
+			VM::rootChannel.AcceptSharedMemoryTransport(reader.Read<IPC::SharedMemory>());
+			continue;
+		}
 		VM::VMHandleSyscall(id, std::move(reader));
 	}
 }
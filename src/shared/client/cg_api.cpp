@@ -485,6 +485,22 @@ int trap_R_BlendSkeleton( refSkeleton_t *skel, const refSkeleton_t *blend, float
     return true;
 }
 
+// Builds the skeletons of a whole frame in a single round trip, the returned
+// results are those of trap_R_BuildSkeleton for each request
+std::vector<int> trap_R_BuildSkeletons( const std::vector<SkeletonRequest>& requests, std::vector<refSkeleton_t>& skeletons )
+{
+	std::vector<int> results;
+	skeletons.clear();
+
+	if ( requests.empty() )
+	{
+		return results;
+	}
+
+	VM::SendMsg<Render::BuildSkeletonsMsg>(requests, skeletons, results);
+	return results;
+}
+
 int trap_R_BoneIndex( qhandle_t hModel, const char *boneName )
 {
 	int index;
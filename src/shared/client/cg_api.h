@@ -110,6 +110,7 @@ std::vector<bool> trap_R_BatchInPVS(
 qhandle_t       trap_R_RegisterAnimation( const char *name );
 int             trap_R_BuildSkeleton( refSkeleton_t *skel, qhandle_t anim, int startFrame, int endFrame, float frac, bool clearOrigin );
 int             trap_R_BlendSkeleton( refSkeleton_t *skel, const refSkeleton_t *blend, float frac );
+std::vector<int> trap_R_BuildSkeletons( const std::vector<SkeletonRequest>& requests, std::vector<refSkeleton_t>& skeletons );
 int             trap_R_BoneIndex( qhandle_t hModel, const char *boneName );
 int             trap_R_AnimNumFrames( qhandle_t hAnim );
 int             trap_R_AnimFrameRate( qhandle_t hAnim );